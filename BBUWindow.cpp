@@ -3,36 +3,6 @@
 #include <Button.h>
 #include <Roster.h>
 #include <TextControl.h>
-#include <iostream.h>
-#include <stdlib.h>
-
-
-char *itoa(uint32 i) 
-{ 
-        char *buf = new char[12];
-        char *pos = buf + sizeof(buf) - 1; 
-        unsigned int u; 
-        int negative = 0; 
-        if (i < 0) { 
-                negative = 1; 
-                u = ((unsigned int)(-(1+i))) + 1; 
-        } else { 
-                u = i; 
-        } 
-
-        *pos = 0; 
-
-        do { 
-                *--pos = '0' + (u % 10); 
-                u /= 10; 
-        } while (u); 
-
-        if (negative) { 
-                *--pos = '-'; 
-        } 
-
-        return pos; 
-} 
 
 
 BBUWindow::BBUWindow( BMessenger *msngr )
@@ -47,14 +17,18 @@ BBUWindow::BBUWindow( BMessenger *msngr )
   main_view->SetViewColor(216,216,216); 
   AddChild( main_view );
 
-  BString ProxyServ, ProxyAuth; uint32 ProxyPort, PollRate;
-  LoadSettings(&ProxyServ,&ProxyAuth,&ProxyPort,&PollRate);
-  
+  Settings settings;
+  LoadSettings(&settings);
+  BString PollRate, ProxyServ, ProxyAuth, ProxyPort;
+  settings.Get(SETTING_POLL_INTERVAL, &PollRate );
+  settings.Get(SETTING_PROXY_SERVER , &ProxyServ);
+  settings.Get(SETTING_PROXY_AUTH   , &ProxyAuth);
+  settings.Get(SETTING_PROXY_PORT   , &ProxyPort);
 
-  poll_rate->SetDivider(130); poll_rate->SetText( itoa(PollRate)      ); main_view->AddChild( poll_rate );
+  poll_rate->SetDivider(130); poll_rate->SetText( PollRate.String()  ); main_view->AddChild( poll_rate );
   proxy_serv->SetDivider(65); proxy_serv->SetText( ProxyServ.String() ); main_view->AddChild(proxy_serv );
   proxy_auth->SetDivider(65); proxy_auth->SetText( ProxyAuth.String() ); main_view->AddChild(proxy_auth );
-  proxy_port->SetDivider(20); proxy_port->SetText( itoa(ProxyPort)    ); main_view->AddChild(proxy_port );
+  proxy_port->SetDivider(20); proxy_port->SetText( ProxyPort.String() ); main_view->AddChild(proxy_port );
   
   main_view->AddChild( new BButton( BRect (10,10,180,20), "Button1", "Configure Sound", new BMessage(SOUND_BUTTON) ) );
   main_view->AddChild( new BButton( BRect (10,70,450,20), "Button2", "Save Settings"  , new BMessage(SAVE_SETTINGS) ) );
@@ -68,14 +42,20 @@ void BBUWindow::MessageReceived(BMessage *msg)
   { be_roster->Launch("application/x-vnd.Be.SoundsPrefs"); }
   if( msg->what == SAVE_SETTINGS )
   {
-    SaveSettings( proxy_serv->Text(), proxy_auth->Text(), atoi(proxy_port->Text()), atoi(poll_rate->Text()) );
+    // Whatever doesn't parse keeps its current value
+    Settings settings;
+    LoadSettings(&settings);
+    settings.Set(SETTING_POLL_INTERVAL, poll_rate->Text() );
+    settings.Set(SETTING_PROXY_SERVER , proxy_serv->Text());
+    settings.Set(SETTING_PROXY_AUTH   , proxy_auth->Text());
+    settings.Set(SETTING_PROXY_PORT   , proxy_port->Text());
+    SaveSettings(settings);
     PostMessage(B_QUIT_REQUESTED);
   }
 }
 
 bool BBUWindow::QuitRequested()
 {
-  cout << "Quit Requested" << endl;
   Hide();
   msngr->SendMessage( RELOAD_SETTINGS );
   Lock();
@@ -2,8 +2,12 @@
 #include "DeskbarView.h"
 #include "BBUWindow.h"
 #include "Settings.h"
+#include "Feed/FeedCheck.h"
+#include "Feed/FeedMetrics.h"
+#include "Feed/FeedProxy.h"
+#include "Feed/FeedSocket.h"
+#include "Feed/FeedTrace.h"
 
-#include <E-mail.h>
 #include <Beep.h>
 #include <String.h>
 #include <Entry.h>
@@ -13,64 +17,68 @@
 #include <PopUpMenu.h>
 #include <MenuItem.h>
 #include <Deskbar.h>
-#include <iostream.h>
-#include <NetEndpoint.h>
 #include <Messenger.h>
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int32 RetrieveFromBeBits(void *msngr)
+// Shared by all checks, so what's learned about the proxies carries over;
+// it only parses the list and encodes the credentials when they change
+static FeedProxyPool sProxies;
+// The items the view has been sent, so that checks only send what's new and
+// can stop reading the feed where it gets to the old ones. It locks itself,
+// and only while it's looked at, so checks don't wait for each other.
+static FeedChecker sSeen;
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// What a check thread gets to work with; it owns it
+struct FetchJob
 {
-  BString ProxyServ, ProxyAuth; uint32 ProxyPort, PollRate;
-  LoadSettings(&ProxyServ,&ProxyAuth,&ProxyPort,&PollRate);
+  FetchJob(BHandler *target, FeedCancel *cancel) : messenger(target), cancel(cancel) { cancel->Acquire(); }
+  ~FetchJob() { cancel->Release(); }
 
-  BString reply,Software;
-  BMessage *msg = NULL;
-  BNetEndpoint endpoint;
+  BMessenger  messenger;
+  FeedCancel *cancel;
+};
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int32 RetrieveFromBeBits(void *data)
+{
+  FetchJob *job = (FetchJob*)data;
+  FeedSpan loading(FEED_STAGE_SETTINGS);
+  Settings settings;
+  LoadSettings(&settings);
+  loading.End();
 
-  if( 0 != ProxyServ.Compare(NULL) )
-  {
+  sProxies.Configure(settings.proxy_serv.String(), settings.proxy_port, settings.proxy_auth.String());
 
-    BString Request;
-    Request << "GET http://www.bebits.com/backend/recent HTTP/1.1\n";
-    if( 0 != ProxyAuth.Compare(NULL) )
-    {
-      char auth[100];
-      encode_base64( (char*)&auth, (char*)ProxyAuth.String(),ProxyAuth.CountChars() );
-      Request << "Proxy-Authorization: Basic " << auth << "\n";
-    }
-    Request << "Host: www.bebits.com\n\n";
-    cout << Request.String() << endl;
-    if( B_OK != endpoint.Connect(ProxyServ.String(),ProxyPort) )
-      return B_ERROR;   
-    endpoint.Send(Request.String(), Request.CountChars() );
-  } else {
-    if( B_OK != endpoint.Connect("www.bebits.com",80) )
-      return B_ERROR;   
-    endpoint.Send("GET /backend/recent HTTP/1.1\nHost: www.bebits.com\n\n", 51 );
-  }
+  FeedSource source;
+  source.SetUrl(FEED_URL);
+  source.zDeadlines.zConnect = settings.connect_timeout;
+  source.zDeadlines.zSend    = settings.send_timeout;
+  source.zDeadlines.zReceive = settings.receive_timeout;
+  source.zDeadlines.zTotal   = settings.fetch_timeout;
 
-  reply.UnlockBuffer( endpoint.Receive( reply.LockBuffer(BUFFER_SIZE), BUFFER_SIZE ) );
-  int32 offset1 = reply.FindLast("%%"); reply.RemoveLast("%%");
-  int32 offset2 = reply.FindLast("%%");
-  while( offset1 > 0 && offset2 > 0 )
+  // What's new goes to the view, oldest first
+  FeedSocketTransport transport(30, NULL, job->cancel);
+  std::vector<FeedItem> items;
+  FeedTiming timing;
+  sSeen.SetStopAfterKnown(settings.stop_after_known);
+  bool ok = sSeen.Check(transport, source, &items, &timing, &sProxies, false);
+
+  // Items only count as seen once the view has them: what a cancel or a
+  // failed send leaves out comes again with the next check. Claiming each
+  // one right before sending keeps two checks from both sending it.
+  FeedSpan delivering(FEED_STAGE_DELIVERY);
+  for( size_t i = 0; i < items.size() && !job->cancel->IsCancelled(); i++ )
   {
-    reply.MoveInto(Software, offset2 + 2, offset1 - offset2 - 2  );
-    msg = new BMessage(BEBITS_UPDATE);
-    BString name,url;
-    Software.RemoveFirst("\n");
-    Software.ReplaceFirst("\n"," - ");
-    Software.MoveInto(name, 0, Software.FindFirst("\n") ); 
-    Software.RemoveFirst("\n");
-    Software.MoveInto(url    , 0, Software.FindFirst("\n") ); 
-    msg->AddString("name"   ,name   );
-    msg->AddString("be:url" ,url    );
-    (*(BMessenger*)msngr).SendMessage(msg,msg);
-    delete msg;
-    offset1 = reply.FindLast("%%"); reply.RemoveLast("%%");
-    offset2 = reply.FindLast("%%");
+    if( !sSeen.IsNew(items[i]) )
+      continue;
+    BMessage msg(BEBITS_UPDATE);
+    msg.AddString("name"   ,items[i].zName.c_str() );
+    msg.AddString("be:url" ,items[i].zUrl.c_str()  );
+    if( job->messenger.SendMessage(&msg) != B_OK )
+      sSeen.Forget(items[i]);
   }
-  delete (BMessenger*)msngr;
-  endpoint.Close();
-  return B_OK;
+  delivering.End();
+  FeedTraceFlush();
+  delete job;
+  return ok ? B_OK : B_ERROR;
 }
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 BBitmap *get_resource_bitmap()
@@ -97,12 +105,19 @@ DeskbarView::DeskbarView(BMessage *archive)
 	  menu( new BPopUpMenu("Menu",false,false) ),
 	  count( 0 ),
 	  mod_value( 600 ),
-	  new_item (false)
+	  new_item (false),
+	  cancel( NULL )
 {}
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void DeskbarView::AttachedToWindow(void) 
 {
-    LoadSettings(NULL,NULL,NULL,&mod_value);
+    Settings settings;
+    PollSettings(&settings);  // Starts watching the file
+    cancel = new FeedCancel();
+    sSeen.Forget();  // The menu starts out empty
+    LoadSettings(&settings);
+    mod_value = settings.poll_rate;
+    gFeedPollInterval.Set(mod_value);
 
 
 	SetViewColor(Parent()->ViewColor());
@@ -134,6 +149,10 @@ void DeskbarView::AttachedToWindow(void)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void DeskbarView::DetachedFromWindow(void) 
 {
+  // Checks still running give up; they hold on to cancel until they're done
+  cancel->Cancel();
+  cancel->Release();
+  cancel = NULL;
   delete Bitmap;
   delete menu;
 }
@@ -141,6 +160,15 @@ void DeskbarView::DetachedFromWindow(void)
 void DeskbarView::Pulse()
 {
   if( new_item ) { SetDrawingMode(B_OP_INVERT); DrawBitmap( Bitmap ); }
+
+  // Pick up settings edited behind our back
+  Settings settings;
+  if( PollSettings(&settings) & (1 << SETTING_POLL_INTERVAL) )
+  { mod_value = settings.poll_rate; gFeedPollInterval.Set(mod_value); }
+
+  if( count % METRICS_FLUSH_PULSES == 0 )
+    FeedMetricsWrite(METRICS_FILE);
+
   if( count++ % mod_value == 0  )
   { CheckForUpdates(); }
 }
@@ -201,8 +229,12 @@ void DeskbarView::MessageReceived(BMessage *msg)
       BString name, url;
       msg->FindString("name"   , &name   );
       msg->FindString("be:url" , &url    );
-      if( NULL == menu->FindItem(name.String() ) )
+      // Checks only send new items; this keeps the menu from ever listing
+      // one twice all the same
+      bool seen = NULL != menu->FindItem(name.String() );
+      if( !seen )
       {
+        FeedSpan updating(FEED_STAGE_MENU);
         system_beep("BeBits Updated");
         new_item = true;
         BMessage *menu_msg = new BMessage();
@@ -225,8 +257,21 @@ void DeskbarView::MessageReceived(BMessage *msg)
     case CHECK_NOW:
       CheckForUpdates();
     break;
+    case DUMP_METRICS:
+    {
+      FeedMetricsWrite(METRICS_FILE);
+      BMessage reply(B_REPLY);
+      reply.AddString("text", FeedMetricsText().c_str() );
+      msg->SendReply(&reply);
+    }
+    break;
     case RELOAD_SETTINGS:
-      LoadSettings(NULL,NULL,NULL,&mod_value); 
+    {
+      Settings settings;
+      LoadSettings(&settings);
+      mod_value = settings.poll_rate;
+      gFeedPollInterval.Set(mod_value);
+    }
     break;
     case CONFIGURE:
       new BBUWindow(new BMessenger(this));
@@ -237,5 +282,10 @@ void DeskbarView::MessageReceived(BMessage *msg)
 }
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void DeskbarView::CheckForUpdates()
-{ resume_thread( spawn_thread(RetrieveFromBeBits, "Checking BeBits for updates..", B_NORMAL_PRIORITY, new BMessenger(this) ) ); }
+{
+  FetchJob *job = new FetchJob(this, cancel);
+  thread_id thread = spawn_thread(RetrieveFromBeBits, "Checking BeBits for updates..", B_NORMAL_PRIORITY, job );
+  if( thread < B_OK ) delete job;
+  else resume_thread( thread );
+}
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -5,6 +5,7 @@
 
 class BBitmap;
 class BPopUpMenu;
+class FeedCancel;
 
 extern "C" _EXPORT BView *instantiate_deskbar_item();
 
@@ -36,6 +37,7 @@ private:
  uint32         count;
  uint32         mod_value;
  bool           new_item;
+ FeedCancel    *cancel;     // Calls off the checks still running when detached
 };
 
 
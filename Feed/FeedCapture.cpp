@@ -0,0 +1,128 @@
+//----------------------------------------------------------------------
+//	FeedCapture.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "FeedCapture.h"
+
+#include <string.h>
+
+static const char kCaptureHeader[] = "FEEDCAPTURE 1\n";
+
+size_t FeedExchange::ReplyBytes() const
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < zChunks.size(); i++)
+	{
+		if (!zChunks[i].zSent)
+			bytes += zChunks[i].zData.size();
+	}
+	return bytes;
+}
+
+//-----------------------------------------------------------------------------
+// FeedRecorder
+//-----------------------------------------------------------------------------
+
+FeedRecorder::FeedRecorder(FeedTransport &Inner, FILE *Capture)
+	: zInner(Inner), zCapture(Capture), zStart(0), zOpen(false)
+{
+	fseek(zCapture, 0, SEEK_END);
+	if (ftell(zCapture) == 0)
+		fputs(kCaptureHeader, zCapture);
+}
+
+void FeedRecorder::WriteChunk(const char *Kind, const void *Data, size_t Length)
+{
+	fprintf(zCapture, "%s %.0f %lu\n", Kind, (FeedTime() - zStart) * 1e6, (unsigned long)Length);
+	fwrite(Data, 1, Length, zCapture);
+	fputc('\n', zCapture);
+}
+
+bool FeedRecorder::Connect(const char *Host, unsigned short Port)
+{
+	zStart = FeedTime();
+	bool connected = zInner.Connect(Host, Port);
+	if (connected)
+	{
+		fprintf(zCapture, "connect %s %u\n", Host, Port);
+		zOpen = true;
+	}
+	return connected;
+}
+
+ssize_t FeedRecorder::Send(const void *Data, size_t Length)
+{
+	ssize_t sent = zInner.Send(Data, Length);
+	if (zOpen && sent > 0)
+		WriteChunk("send", Data, sent);
+	return sent;
+}
+
+ssize_t FeedRecorder::Receive(void *Buffer, size_t Length)
+{
+	ssize_t received = zInner.Receive(Buffer, Length);
+	if (zOpen && received > 0)
+		WriteChunk("recv", Buffer, received);
+	return received;
+}
+
+void FeedRecorder::Close()
+{
+	zInner.Close();
+	if (zOpen)
+	{
+		fprintf(zCapture, "close %.0f\n", (FeedTime() - zStart) * 1e6);
+		fflush(zCapture);
+		zOpen = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Loading
+//-----------------------------------------------------------------------------
+
+bool FeedLoadCapture(const char *Filename, std::vector<FeedExchange> *Exchanges)
+{
+	FILE *file = fopen(Filename, "rb");
+	if (file == NULL)
+		return false;
+
+	char line[512];
+	bool ok = fgets(line, sizeof line, file) != NULL && strcmp(line, kCaptureHeader) == 0;
+	FeedExchange *exchange = NULL;
+	while (ok && fgets(line, sizeof line, file) != NULL)
+	{
+		char kind[16], host[256];
+		unsigned int port;
+		double time;
+		unsigned long length;
+		if (sscanf(line, "connect %255s %u", host, &port) == 2)
+		{
+			Exchanges->push_back(FeedExchange());
+			exchange = &Exchanges->back();
+			exchange->zHost = host;
+			exchange->zPort = port;
+		}
+		else if (exchange != NULL && sscanf(line, "close %lf", &time) == 1)
+		{
+			exchange->zCloseTime = time / 1e6;
+			exchange = NULL;
+		}
+		else if (exchange != NULL && sscanf(line, "%15s %lf %lu", kind, &time, &length) == 3
+			&& (strcmp(kind, "send") == 0 || strcmp(kind, "recv") == 0))
+		{
+			FeedChunk chunk;
+			chunk.zSent = kind[0] == 's';
+			chunk.zTime = time / 1e6;
+			chunk.zData.resize(length);
+			ok = fread(&chunk.zData[0], 1, length, file) == length && fgetc(file) == '\n';
+			exchange->zChunks.push_back(chunk);
+		}
+		else
+			ok = false;
+	}
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,71 @@
+//----------------------------------------------------------------------
+//	FeedCapture.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _FEED_CAPTURE_H_
+#define _FEED_CAPTURE_H_
+
+#include "FeedCheck.h"
+
+#include <stdio.h>
+
+// Captures of what went over the wire during fetches, so they can be
+// replayed later (see feedreplay.cpp). A capture file holds one exchange
+// per connection:
+//
+//	FEEDCAPTURE 1
+//	connect <host> <port>
+//	send <microseconds> <length>
+//	<length bytes>
+//	recv <microseconds> <length>
+//	<length bytes>
+//	close <microseconds>
+//
+// Times count from the start of the connect.
+
+struct FeedChunk {
+	bool zSent;				// Sent by us, rather than received
+	double zTime;			// Seconds since the connect started
+	std::string zData;
+};
+
+struct FeedExchange {
+	std::string zHost;
+	unsigned short zPort;
+	std::vector<FeedChunk> zChunks;
+	double zCloseTime;
+
+	FeedExchange() : zPort(0), zCloseTime(0) {}
+	size_t ReplyBytes() const;
+};
+
+// Passes everything on to another transport and writes it to a capture
+// file as it goes
+class FeedRecorder : public FeedTransport {
+public:
+	FeedRecorder(FeedTransport &Inner, FILE *Capture);
+		// Capture must be open for binary writing; the header is written
+		// when it is still empty
+	virtual bool Connect(const char *Host, unsigned short Port);
+	virtual ssize_t Send(const void *Data, size_t Length);
+	virtual ssize_t Receive(void *Buffer, size_t Length);
+	virtual void Close();
+	virtual double ResolveTime() const { return zInner.ResolveTime(); }
+	virtual void SetDeadline(double Deadline) { zInner.SetDeadline(Deadline); }
+	virtual bool Cancelled() const { return zInner.Cancelled(); }
+private:
+	void WriteChunk(const char *Kind, const void *Data, size_t Length);
+
+	FeedTransport &zInner;
+	FILE *zCapture;
+	double zStart;
+	bool zOpen;
+};
+
+bool FeedLoadCapture(const char *Filename, std::vector<FeedExchange> *Exchanges);
+	// Appends the exchanges in Filename; returns false if it can't be read
+	// or isn't a capture
+
+#endif
@@ -0,0 +1,538 @@
+//----------------------------------------------------------------------
+//	FeedCheck.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "FeedCheck.h"
+#include "FeedMetrics.h"
+#include "FeedProxy.h"
+#include "FeedTrace.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <time.h>
+
+#if defined(__HAIKU__) || defined(__BEOS__)
+#include <OS.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// FeedSource
+//-----------------------------------------------------------------------------
+
+bool FeedSource::SetUrl(const char *Url)
+{
+	if (strncmp(Url, "http://", 7) != 0)
+		return false;
+	const char *host = Url + 7;
+	const char *path = strchr(host, '/');
+	if (path == NULL)
+		path = host + strlen(host);
+	const char *colon = (const char *)memchr(host, ':', path - host);
+
+	unsigned long port = 80;
+	if (colon != NULL)
+	{
+		char *end;
+		port = strtoul(colon + 1, &end, 10);
+		if (end != path || port == 0 || port > 0xFFFF)
+			return false;
+	}
+	else
+		colon = path;
+	if (colon == host)
+		return false;
+
+	zHost.assign(host, colon - host);
+	zPort = port;
+	zPath = *path != 0 ? path : "/";
+	return true;
+}
+
+std::string FeedSource::Url() const
+{
+	char port[16] = "";
+	if (zPort != 80)
+		sprintf(port, ":%u", zPort);
+	return "http://" + zHost + port + zPath;
+}
+
+void FeedTiming::Reset()
+{
+	zResolveTime = zConnectTime = zFirstByteTime = zTotalTime = 0;
+	zBytes = 0;
+	zCutShort = false;
+	zBytesSkipped = 0;
+	zStatus = 0;
+	zItems = zNewItems = 0;
+	zError = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Fetching
+//-----------------------------------------------------------------------------
+
+// Deadlines must not move when the time of day is set, so this is the
+// monotonic clock wherever there is one. Not every system we run on has
+// clock_gettime(), but BeOS and Haiku have system_time().
+double FeedTime()
+{
+#if defined(__HAIKU__) || defined(__BEOS__)
+	return system_time() / 1e6;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#else
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec / 1e6;
+#endif
+}
+
+std::string FeedEncodeBase64(const char *Data, size_t Length)
+{
+	static const char kChars[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string result;
+	result.reserve((Length + 2) / 3 * 4);
+	const unsigned char *data = (const unsigned char *)Data;
+	for (size_t i = 0; i < Length; i += 3)
+	{
+		unsigned long block = (unsigned long)data[i] << 16;
+		if (i + 1 < Length)
+			block |= data[i + 1] << 8;
+		if (i + 2 < Length)
+			block |= data[i + 2];
+		result += kChars[(block >> 18) & 63];
+		result += kChars[(block >> 12) & 63];
+		result += i + 1 < Length ? kChars[(block >> 6) & 63] : '=';
+		result += i + 2 < Length ? kChars[block & 63] : '=';
+	}
+	return result;
+}
+
+std::string FeedBasicAuth(const char *UserPassword)
+{
+	if (*UserPassword == 0)
+		return std::string();
+	return "Basic " + FeedEncodeBase64(UserPassword, strlen(UserPassword));
+}
+
+// HTTP/1.0, so that the reply is neither chunked nor kept alive: it simply
+// ends when the server closes the connection
+std::string FeedRequest(const FeedSource &Source)
+{
+	std::string request = "GET ";
+	if (!Source.zProxyHost.empty())
+		request += Source.Url();
+	else
+		request += Source.zPath;
+	request += " HTTP/1.0\r\nHost: " + Source.zHost + "\r\n";
+	if (!Source.zProxyHost.empty() && !Source.zProxyAuthorization.empty())
+		request += "Proxy-Authorization: " + Source.zProxyAuthorization + "\r\n";
+	request += "Connection: close\r\n\r\n";
+	return request;
+}
+
+// Returns the status code of an HTTP reply, 0 if it doesn't look like one
+static int ReplyStatus(const std::string &Reply)
+{
+	int major, minor, status;
+	if (sscanf(Reply.c_str(), "HTTP/%d.%d %d", &major, &minor, &status) != 3)
+		return 0;
+	return status;
+}
+
+// Returns the size of a whole HTTP reply as its headers tell it, 0 if
+// they don't (or aren't all there yet)
+static size_t ReplyLength(const std::string &Reply)
+{
+	size_t body = Reply.find("\r\n\r\n");
+	if (body == std::string::npos)
+		return 0;
+	body += 4;
+	for (size_t line = Reply.find('\n'); line < body; line = Reply.find('\n', line))
+	{
+		line++;
+		if (strncasecmp(Reply.c_str() + line, "Content-Length:", 15) == 0)
+			return body + strtoul(Reply.c_str() + line + 15, NULL, 10);
+	}
+	return 0;
+}
+
+// Where a phase that starts now has to be done by
+static double PhaseDeadline(double Limit, double End)
+{
+	double deadline = Limit > 0 ? FeedTime() + Limit : 0;
+	if (End > 0 && (deadline == 0 || End < deadline))
+		deadline = End;
+	return deadline;
+}
+
+// Tells why a phase of a fetch failed
+static const char *FailedIn(FeedTransport &Transport, const char *Phase, double Deadline)
+{
+	if (Transport.Cancelled())
+		return "cancelled";
+	if (Deadline > 0 && FeedTime() >= Deadline)
+		return "timeout";
+	return Phase;
+}
+
+bool FeedFetch(FeedTransport &Transport, const FeedSource &Source,
+	std::string *Reply, FeedTiming *Timing, FeedReplyReader *Reader)
+{
+	const FeedDeadlines &limits = Source.zDeadlines;
+	double start = FeedTime();
+	double end = limits.zTotal > 0 ? start + limits.zTotal : 0;
+	Timing->Reset();
+	Reply->erase();
+	if (Reader != NULL)
+		Reader->Start();
+
+	double deadline = PhaseDeadline(limits.zConnect, end);
+	Transport.SetDeadline(deadline);
+	bool proxied = !Source.zProxyHost.empty();
+	bool connected = proxied
+		? Transport.Connect(Source.zProxyHost.c_str(), Source.zProxyPort)
+		: Transport.Connect(Source.zHost.c_str(), Source.zPort);
+	Timing->zConnectTime = FeedTime() - start;
+	Timing->zResolveTime = Transport.ResolveTime();
+	FeedTraceSpan(FEED_STAGE_CONNECT, start, start + Timing->zConnectTime);
+	if (!connected)
+	{
+		Timing->zTotalTime = Timing->zConnectTime;
+		Timing->zError = FailedIn(Transport, "connect", deadline);
+		Transport.SetDeadline(0);
+		gFeedFetches.Add();
+		gFeedFetchFailures.Add();
+		return false;
+	}
+
+	FeedSpan sending(FEED_STAGE_SEND);
+	deadline = PhaseDeadline(limits.zSend, end);
+	Transport.SetDeadline(deadline);
+	std::string request = FeedRequest(Source);
+	bool ok = Transport.Send(request.data(), request.size()) == (ssize_t)request.size();
+	if (!ok)
+		Timing->zError = FailedIn(Transport, "send", deadline);
+	sending.End();
+	double sent = FeedTime() - start;
+
+	// The reader only gets to see the reply once the status says it's 2xx
+	deadline = PhaseDeadline(limits.zReceive, end);
+	Transport.SetDeadline(deadline);
+	bool reading = Reader != NULL;
+	while (ok && Reply->size() < kFeedMaxReply)
+	{
+		char buffer[4096];
+		size_t length = kFeedMaxReply - Reply->size();
+		ssize_t received = Transport.Receive(buffer,
+			length < sizeof buffer ? length : sizeof buffer);
+		if (received < 0)
+		{
+			ok = false;
+			Timing->zError = FailedIn(Transport, "receive", deadline);
+		}
+		if (received <= 0)
+			break;
+		if (Reply->empty())
+			Timing->zFirstByteTime = FeedTime() - start;
+		Reply->append(buffer, received);
+
+		if (reading && Reply->find('\n') != std::string::npos)
+		{
+			int status = ReplyStatus(*Reply);
+			reading = status >= 200 && status < 300;
+		}
+		if (reading && !Reader->Read(*Reply))
+		{
+			size_t length = ReplyLength(*Reply);
+			Timing->zCutShort = true;
+			Timing->zBytesSkipped = length > Reply->size() ? length - Reply->size() : 0;
+			break;
+		}
+	}
+	Transport.Close();
+	Transport.SetDeadline(0);
+
+	Timing->zTotalTime = FeedTime() - start;
+	if (Timing->zFirstByteTime > 0)
+	{
+		FeedTraceSpan(FEED_STAGE_FIRST_BYTE, start + sent, start + Timing->zFirstByteTime);
+		FeedTraceSpan(FEED_STAGE_LAST_BYTE, start + Timing->zFirstByteTime, start + Timing->zTotalTime);
+	}
+	Timing->zBytes = Reply->size();
+	Timing->zStatus = ReplyStatus(*Reply);
+	if (ok && (Timing->zStatus < 200 || Timing->zStatus >= 300))
+	{
+		ok = false;
+		Timing->zError = "status";
+	}
+
+	gFeedFetches.Add();
+	gFeedBytes.Add(Timing->zBytes);
+	if (Timing->zCutShort)
+	{
+		gFeedCutShort.Add();
+		gFeedBytesSkipped.Add(Timing->zBytesSkipped);
+	}
+	if (ok)
+	{
+		gFeedLastSuccess.Set(time(NULL));
+		gFeedFetchSeconds.Observe(Timing->zTotalTime);
+	}
+	else
+		gFeedFetchFailures.Add();
+	return ok;
+}
+
+//-----------------------------------------------------------------------------
+// Parsing
+//-----------------------------------------------------------------------------
+
+// Returns the line starting at *Pos (without its line break) and moves
+// *Pos to the next one
+static std::string NextLine(const char *Text, size_t Length, size_t *Pos)
+{
+	size_t start = *Pos, end = start;
+	while (end < Length && Text[end] != '\n')
+		end++;
+	*Pos = end < Length ? end + 1 : end;
+	if (end > start && Text[end - 1] == '\r')
+		end--;
+	return std::string(Text + start, end - start);
+}
+
+static const char *FindMarker(const char *Text, const char *End)
+{
+	for (; Text + 1 < End; Text++)
+	{
+		if (Text[0] == '%' && Text[1] == '%')
+			return Text;
+	}
+	return NULL;
+}
+
+int FeedParser::Parse(const char *Reply, size_t Length, std::vector<FeedItem> *Items)
+{
+	const char *end = Reply + Length;
+	const char *marker = FindMarker(Reply + zOffset, end);
+	if (marker == NULL)
+	{
+		// Half of a marker may be at the end
+		zOffset = Length > 0 ? Length - 1 : 0;
+		return 0;
+	}
+
+	int count = 0;
+	for (;;)
+	{
+		zOffset = marker - Reply;
+		const char *next = FindMarker(marker + 2, end);
+		if (next == NULL)
+			break;
+
+		// The rest of the "%%" line, then name, version and URL
+		const char *text = marker + 2;
+		size_t length = next - text, pos = 0;
+		NextLine(text, length, &pos);
+		std::string name = NextLine(text, length, &pos);
+		std::string version = NextLine(text, length, &pos);
+		std::string url = NextLine(text, length, &pos);
+		if (!url.empty())
+		{
+			FeedItem item;
+			item.zName = name + " - " + version;
+			item.zUrl = url;
+			Items->push_back(item);
+			count++;
+		}
+		marker = next;
+	}
+	return count;
+}
+
+static void CountItems(int Count)
+{
+	gFeedItems.Add(Count);
+	gFeedItemsPerFetch.Observe(Count);
+}
+
+int FeedParse(const char *Reply, size_t Length, std::vector<FeedItem> *Items)
+{
+	int count = FeedParser().Parse(Reply, Length, Items);
+	CountItems(count);
+	return count;
+}
+
+//-----------------------------------------------------------------------------
+// FeedChecker
+//-----------------------------------------------------------------------------
+
+FeedChecker::FeedChecker(size_t Remember)
+	: zRemember(Remember > 0 ? Remember : 1), zStopAfterKnown(0)
+{
+	pthread_mutex_init(&zLock, NULL);
+}
+
+FeedChecker::FeedChecker(const FeedChecker &Other)
+	: zRemember(Other.zRemember), zStopAfterKnown(Other.zStopAfterKnown)
+{
+	pthread_mutex_init(&zLock, NULL);
+	pthread_mutex_lock(&Other.zLock);
+	zSeen = Other.zSeen;
+	zOrder = Other.zOrder;
+	pthread_mutex_unlock(&Other.zLock);
+}
+
+FeedChecker::~FeedChecker()
+{
+	pthread_mutex_destroy(&zLock);
+}
+
+FeedChecker &FeedChecker::operator=(const FeedChecker &Other)
+{
+	if (&Other == this)
+		return *this;
+
+	// A copy first, so that only one lock is ever held at a time
+	pthread_mutex_lock(&Other.zLock);
+	std::set<std::string> seen(Other.zSeen);
+	std::deque<std::string> order(Other.zOrder);
+	pthread_mutex_unlock(&Other.zLock);
+
+	pthread_mutex_lock(&zLock);
+	zRemember = Other.zRemember;
+	zStopAfterKnown = Other.zStopAfterKnown;
+	zSeen.swap(seen);
+	zOrder.swap(order);
+	pthread_mutex_unlock(&zLock);
+	return *this;
+}
+
+void FeedChecker::SetStopAfterKnown(int Run)
+{
+	zStopAfterKnown = Run > 0 ? Run : 0;
+}
+
+bool FeedChecker::IsNew(const FeedItem &Item)
+{
+	pthread_mutex_lock(&zLock);
+	if (!zSeen.insert(Item.zName).second)
+	{
+		pthread_mutex_unlock(&zLock);
+		gFeedDedupeHits.Add();
+		return false;
+	}
+
+	zOrder.push_back(Item.zName);
+	if (zOrder.size() > zRemember)
+	{
+		zSeen.erase(zOrder.front());
+		zOrder.pop_front();
+	}
+	pthread_mutex_unlock(&zLock);
+	gFeedDedupeMisses.Add();
+	return true;
+}
+
+bool FeedChecker::IsKnown(const FeedItem &Item) const
+{
+	pthread_mutex_lock(&zLock);
+	bool known = zSeen.find(Item.zName) != zSeen.end();
+	pthread_mutex_unlock(&zLock);
+	return known;
+}
+
+void FeedChecker::Forget(const FeedItem &Item)
+{
+	pthread_mutex_lock(&zLock);
+	if (zSeen.erase(Item.zName) > 0)
+	{
+		std::deque<std::string>::iterator name = std::find(zOrder.begin(), zOrder.end(), Item.zName);
+		if (name != zOrder.end())
+			zOrder.erase(name);
+	}
+	pthread_mutex_unlock(&zLock);
+}
+
+void FeedChecker::Forget()
+{
+	pthread_mutex_lock(&zLock);
+	zSeen.clear();
+	zOrder.clear();
+	pthread_mutex_unlock(&zLock);
+}
+
+// Parses a reply while it comes in, and calls it a day after a run of
+// known items
+class KnownRunReader : public FeedReplyReader {
+public:
+	KnownRunReader(const FeedChecker &Checker, int StopAfter, std::vector<FeedItem> *Items)
+		: zChecker(Checker), zStopAfter(StopAfter), zItems(Items), zRun(0) {}
+
+	virtual void Start()
+	{
+		zParser.Reset();
+		zItems->clear();
+		zRun = 0;
+	}
+
+	virtual bool Read(const std::string &Reply)
+	{
+		FeedSpan parsing(FEED_STAGE_PARSE);
+		size_t first = zItems->size();
+		zParser.Parse(Reply.data(), Reply.size(), zItems);
+		for (size_t i = first; i < zItems->size(); i++)
+			zRun = zChecker.IsKnown((*zItems)[i]) ? zRun + 1 : 0;
+		return zStopAfter == 0 || zRun < zStopAfter;
+	}
+private:
+	const FeedChecker &zChecker;
+	int zStopAfter;
+	std::vector<FeedItem> *zItems;
+	FeedParser zParser;
+	int zRun;				// Known items in a row, up to the last one
+};
+
+bool FeedChecker::Check(FeedTransport &Transport, const FeedSource &Source,
+	std::vector<FeedItem> *NewItems, FeedTiming *Timing, FeedProxyPool *Proxies,
+	bool Remember)
+{
+	// The reply is parsed as it comes in, so that there's nothing left
+	// to do once it's complete
+	std::string reply;
+	std::vector<FeedItem> items;
+	KnownRunReader reader(*this, zStopAfterKnown, &items);
+	bool ok = Proxies != NULL
+		? Proxies->Fetch(Transport, Source, &reply, Timing, NULL, &reader)
+		: FeedFetch(Transport, Source, &reply, Timing, &reader);
+	if (!ok)
+		return false;
+	Timing->zItems = items.size();
+	CountItems(Timing->zItems);
+
+	// Without remembering, an item that's in the reply twice still only
+	// counts once
+	FeedSpan deduping(FEED_STAGE_DEDUPE);
+	std::set<std::string> unseen;
+	for (size_t i = items.size(); i-- > 0; )
+	{
+		if (Remember ? IsNew(items[i])
+			: !IsKnown(items[i]) && unseen.insert(items[i].zName).second)
+		{
+			NewItems->push_back(items[i]);
+			Timing->zNewItems++;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,202 @@
+//----------------------------------------------------------------------
+//	FeedCheck.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _FEED_CHECK_H_
+#define _FEED_CHECK_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+// Fetching, parsing and deduplicating the BeBits "recent" feed, without
+// anything platform specific: the network is reached through a
+// FeedTransport, normally FeedSocketTransport (FeedSocket.h).
+//
+// The feed is plain text; every item sits between two "%%" lines:
+//
+//	%%
+//	Name
+//	Version
+//	http://url/of/the/item
+//	%%
+
+// How long each part of a fetch may take, in seconds; 0 means no limit
+// other than the transport's own. Resolving counts as connecting, and
+// receiving is the whole reply.
+struct FeedDeadlines {
+	double zConnect;
+	double zSend;
+	double zReceive;
+	double zTotal;
+
+	FeedDeadlines() : zConnect(15), zSend(15), zReceive(30), zTotal(60) {}
+};
+
+// Where a feed comes from
+struct FeedSource {
+	std::string zHost;
+	unsigned short zPort;
+	std::string zPath;
+
+	// Optional HTTP proxy. zProxyAuthorization is the value of the
+	// Proxy-Authorization header, if one is needed (see FeedBasicAuth()).
+	std::string zProxyHost;
+	unsigned short zProxyPort;
+	std::string zProxyAuthorization;
+
+	FeedDeadlines zDeadlines;
+
+	FeedSource() : zPort(80), zProxyPort(0) {}
+	bool SetUrl(const char *Url);
+		// Takes "http://host[:port][/path]"; returns false for anything else
+	std::string Url() const;
+};
+
+struct FeedItem {
+	std::string zName;		// "Name - Version"
+	std::string zUrl;
+};
+
+// How a fetch went. Times are in seconds since the fetch started.
+struct FeedTiming {
+	double zResolveTime;	// Time the connect spent resolving the host, if known
+	double zConnectTime;	// Connected (to the proxy, if there is one)
+	double zFirstByteTime;	// First byte of the reply came in
+	double zTotalTime;		// Reply complete, or failed
+	size_t zBytes;			// Size of the reply, headers included
+	bool zCutShort;			// The reply was left unread from some point on
+	size_t zBytesSkipped;	// What was left unread then, if the server told
+							// the size of the reply (Content-Length)
+	int zStatus;			// HTTP status, 0 if there was no valid reply
+	int zItems;				// Items in the reply, as far as it was read
+	int zNewItems;			// Of those, not seen before (see FeedChecker)
+	const char *zError;		// NULL, or where the fetch failed: "connect", "send",
+							// "receive", "status", "timeout" or "cancelled"
+
+	FeedTiming() { Reset(); }
+	void Reset();
+};
+
+// The network, as far as fetching a feed is concerned. All calls block,
+// until the deadline at the latest.
+class FeedTransport {
+public:
+	virtual ~FeedTransport() {}
+
+	virtual bool Connect(const char *Host, unsigned short Port) = 0;
+	virtual ssize_t Send(const void *Data, size_t Length) = 0;
+	virtual ssize_t Receive(void *Buffer, size_t Length) = 0;
+		// Returns 0 once the other side is done, a negative value on errors
+	virtual void Close() = 0;
+	virtual double ResolveTime() const { return 0; }
+		// How long the last Connect() spent resolving, if that's known
+	virtual void SetDeadline(double /*Deadline*/) {}
+		// Calls still running at Deadline (a FeedTime()) give up; 0 lifts it
+	virtual bool Cancelled() const { return false; }
+		// Whether calls fail because the fetch was called off
+};
+
+class FeedProxyPool;
+
+// Gets to look at a reply while it comes in, and may cut it short
+class FeedReplyReader {
+public:
+	virtual ~FeedReplyReader() {}
+
+	virtual void Start() {}
+		// A fetch begins; whatever came in before is gone
+	virtual bool Read(const std::string &Reply) = 0;
+		// Called with all of a 2xx reply so far, whenever more came in.
+		// Returning false closes the connection, and the reply counts as
+		// complete.
+};
+
+// Replies bigger than this are cut off
+static const size_t kFeedMaxReply = 1024 * 1024;
+
+double FeedTime();
+	// Seconds on a clock that only moves forward (the origin is arbitrary):
+	// system_time() on BeOS and Haiku, CLOCK_MONOTONIC elsewhere, or the
+	// time of day on systems that have neither
+std::string FeedEncodeBase64(const char *Data, size_t Length);
+std::string FeedBasicAuth(const char *UserPassword);
+	// The Basic authorization for "user:password", empty for an empty one
+
+std::string FeedRequest(const FeedSource &Source);
+	// The HTTP request for Source, through its proxy if it has one
+bool FeedFetch(FeedTransport &Transport, const FeedSource &Source,
+	std::string *Reply, FeedTiming *Timing, FeedReplyReader *Reader = NULL);
+	// Sends the request and reads the whole reply, within the deadlines of
+	// Source, or as much of it as Reader wants. Returns false, with Timing
+	// telling how far it got, if that didn't work out or the server didn't
+	// answer with 2xx.
+int FeedParse(const char *Reply, size_t Length, std::vector<FeedItem> *Items);
+	// Appends the items in Reply to Items, in the order they appear
+	// (newest first), and returns how many there were. Headers and
+	// anything else outside of "%%" lines are skipped.
+
+// FeedParse() for a reply that is still coming in
+class FeedParser {
+public:
+	FeedParser() : zOffset(0) {}
+
+	int Parse(const char *Reply, size_t Length, std::vector<FeedItem> *Items);
+		// Appends the items completed since the last call; Reply has to
+		// start with what was given then
+	void Reset() { zOffset = 0; }
+private:
+	size_t zOffset;		// Where parsing picks up again
+};
+
+// Remembers the items it has seen, so that a feed polled over and over
+// only yields what's new. Only the last Remember names are kept.
+//
+// As the feed is newest first, everything after a few items seen before
+// has most likely been seen too: with SetStopAfterKnown(), checks stop
+// reading the reply there.
+//
+// Several threads may check at once: the items seen are only locked while
+// they are looked at or added to, never during a fetch.
+class FeedChecker {
+public:
+	FeedChecker(size_t Remember = 10000);
+	FeedChecker(const FeedChecker &Other);
+	~FeedChecker();
+	FeedChecker &operator=(const FeedChecker &Other);
+
+	void SetStopAfterKnown(int Run);
+		// Makes checks stop reading once Run items in a row were seen
+		// before; 0, the default, reads every reply to the end
+
+	bool Check(FeedTransport &Transport, const FeedSource &Source,
+		std::vector<FeedItem> *NewItems, FeedTiming *Timing, FeedProxyPool *Proxies = NULL,
+		bool Remember = true);
+		// Fetches and parses Source and appends the items not seen before
+		// to NewItems, oldest first. Returns false if the fetch failed.
+		// With Proxies, the fetch goes through them (see FeedProxy.h).
+		// Without Remember, the items aren't marked as seen; that's left
+		// to the caller, e.g. once they have been delivered.
+	bool IsNew(const FeedItem &Item);
+		// Returns true the first time it's given an item (by name)
+	bool IsKnown(const FeedItem &Item) const;
+		// Whether IsNew() would say no, without remembering the item
+	void Forget(const FeedItem &Item);
+		// Makes IsNew() say yes to Item again, e.g. if it couldn't be
+		// delivered after all
+	void Forget();
+private:
+	size_t zRemember;
+	volatile int zStopAfterKnown;
+	mutable pthread_mutex_t zLock;	// Guards zSeen and zOrder
+	std::set<std::string> zSeen;
+	std::deque<std::string> zOrder;	// zSeen in the order they were added
+};
+
+#endif
@@ -0,0 +1,146 @@
+//----------------------------------------------------------------------
+//	FeedMetrics.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "FeedMetrics.h"
+
+#include <stdio.h>
+
+// Metrics in the order they were constructed; built before main() runs,
+// and only read after that
+static FeedMetric *sFirst = NULL;
+static FeedMetric **sLast = &sFirst;
+
+FeedMetric::FeedMetric(const char *Name, const char *Help, const char *Type)
+	: zName(Name), zHelp(Help), zType(Type), zNext(NULL)
+{
+	*sLast = this;
+	sLast = &zNext;
+}
+
+static void AppendSample(std::string *Out, const char *Name, const char *Suffix,
+	const char *Labels, double Value)
+{
+	char line[256];
+	sprintf(line, "%s%s%s %.17g\n", Name, Suffix, Labels, Value);
+	*Out += line;
+}
+
+FeedCounter::FeedCounter(const char *Name, const char *Help)
+	: FeedMetric(Name, Help, "counter"), zValue(0)
+{
+}
+
+void FeedCounter::Write(std::string *Out)
+{
+	AppendSample(Out, Name(), "", "", Value());
+}
+
+FeedGauge::FeedGauge(const char *Name, const char *Help)
+	: FeedMetric(Name, Help, "gauge"), zValue(0)
+{
+}
+
+void FeedGauge::Write(std::string *Out)
+{
+	AppendSample(Out, Name(), "", "", Value());
+}
+
+FeedHistogramMetric::FeedHistogramMetric(const char *Name, const char *Help, const double *Bounds)
+	: FeedMetric(Name, Help, "histogram"), zBounds(Bounds), zBuckets(0), zSum(0)
+{
+	while (zBuckets < kMaxBuckets && Bounds[zBuckets] >= 0)
+		zBuckets++;
+	for (int i = 0; i <= kMaxBuckets; i++)
+		zCounts[i] = 0;
+}
+
+void FeedHistogramMetric::Observe(double Value)
+{
+	int bucket = 0;
+	while (bucket < zBuckets && Value > zBounds[bucket])
+		bucket++;
+	FeedAtomicAdd(&zCounts[bucket], 1);
+	FeedAtomicAdd(&zSum, (long long)(Value * 1e6 + 0.5));
+}
+
+void FeedHistogramMetric::Write(std::string *Out)
+{
+	long long count = 0;
+	for (int i = 0; i <= zBuckets; i++)
+	{
+		count += FeedAtomicGet(&zCounts[i]);
+		char label[64];
+		if (i < zBuckets)
+			sprintf(label, "{le=\"%g\"}", zBounds[i]);
+		else
+			sprintf(label, "{le=\"+Inf\"}");
+		AppendSample(Out, Name(), "_bucket", label, count);
+	}
+	AppendSample(Out, Name(), "_sum", "", FeedAtomicGet(&zSum) / 1e6);
+	AppendSample(Out, Name(), "_count", "", count);
+}
+
+std::string FeedMetricsText()
+{
+	std::string text;
+	for (FeedMetric *metric = sFirst; metric != NULL; metric = metric->zNext)
+	{
+		text += "# HELP ";
+		text += metric->zName;
+		text += " ";
+		text += metric->zHelp;
+		text += "\n# TYPE ";
+		text += metric->zName;
+		text += " ";
+		text += metric->zType;
+		text += "\n";
+		metric->Write(&text);
+	}
+	return text;
+}
+
+bool FeedMetricsWrite(const char *Filename)
+{
+	std::string temporary = std::string(Filename) + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "w");
+	if (file == NULL)
+		return false;
+	std::string text = FeedMetricsText();
+	bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+	ok = fclose(file) == 0 && ok;
+	if (!ok || rename(temporary.c_str(), Filename) != 0)
+	{
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// The feed metrics
+//-----------------------------------------------------------------------------
+
+static const double kFetchSeconds[] = { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, -1 };
+static const double kItemsPerFetch[] = { 0, 1, 2, 5, 10, 20, 50, 100, 500, -1 };
+
+FeedCounter gFeedFetches("feed_fetches_total", "Feed fetches attempted.");
+FeedCounter gFeedFetchFailures("feed_fetch_failures_total",
+	"Feed fetches that failed to connect, send, receive or got a non-2xx status.");
+FeedCounter gFeedBytes("feed_bytes_total", "Bytes received from feeds, headers included.");
+FeedCounter gFeedCutShort("feed_replies_cut_short_total",
+	"Replies that stopped being read once the items in them were known.");
+FeedCounter gFeedBytesSkipped("feed_bytes_skipped_total",
+	"Bytes of replies cut short that were never read, where their size was given.");
+FeedCounter gFeedItems("feed_items_total", "Items parsed from feeds.");
+FeedCounter gFeedDedupeHits("feed_dedupe_hits_total", "Items that had been seen before.");
+FeedCounter gFeedDedupeMisses("feed_dedupe_misses_total", "Items that were new.");
+FeedGauge gFeedLastSuccess("feed_last_success_timestamp_seconds",
+	"Unix time of the last successful fetch.");
+FeedGauge gFeedPollInterval("feed_poll_interval_seconds", "Time between polls.");
+FeedHistogramMetric gFeedFetchSeconds("feed_fetch_duration_seconds",
+	"Time from connecting to the end of the reply.", kFetchSeconds);
+FeedHistogramMetric gFeedItemsPerFetch("feed_items_per_fetch",
+	"Items in each successful fetch.", kItemsPerFetch);
@@ -0,0 +1,107 @@
+//----------------------------------------------------------------------
+//	FeedMetrics.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _FEED_METRICS_H_
+#define _FEED_METRICS_H_
+
+#include <string>
+
+// Counters, gauges and histograms describing how the feed checks go,
+// readable in the Prometheus text format. Updates are single atomic
+// adds or stores, so they can be made from any thread without locking;
+// a reader may see one metric a little ahead of another.
+//
+// Metrics are meant to be globals: they register themselves when
+// constructed, which happens before main() runs.
+
+// FeedAtomicAdd() returns the value from before the add
+#if defined(__HAIKU__)
+#include <SupportDefs.h>
+typedef int64 FeedAtomic;
+inline int64 FeedAtomicAdd(FeedAtomic *Value, int64 Add) { return atomic_add64(Value, Add); }
+inline void FeedAtomicSet(FeedAtomic *Value, int64 New) { atomic_set64(Value, New); }
+inline int64 FeedAtomicGet(FeedAtomic *Value) { return atomic_get64(Value); }
+#else
+typedef long long FeedAtomic;
+inline long long FeedAtomicAdd(FeedAtomic *Value, long long Add) { return __sync_fetch_and_add(Value, Add); }
+inline void FeedAtomicSet(FeedAtomic *Value, long long New) { __sync_lock_test_and_set(Value, New); }
+inline long long FeedAtomicGet(FeedAtomic *Value) { return __sync_fetch_and_add(Value, 0); }
+#endif
+
+class FeedMetric {
+public:
+	FeedMetric(const char *Name, const char *Help, const char *Type);
+	virtual ~FeedMetric() {}
+
+	const char *Name() const { return zName; }
+	virtual void Write(std::string *Out) = 0;
+		// Appends the samples, without the HELP and TYPE lines
+private:
+	friend std::string FeedMetricsText();
+	const char *zName;
+	const char *zHelp;
+	const char *zType;
+	FeedMetric *zNext;
+};
+
+class FeedCounter : public FeedMetric {
+public:
+	FeedCounter(const char *Name, const char *Help);
+	void Add(long long Count = 1) { FeedAtomicAdd(&zValue, Count); }
+	long long Value() { return FeedAtomicGet(&zValue); }
+	virtual void Write(std::string *Out);
+private:
+	FeedAtomic zValue;
+};
+
+class FeedGauge : public FeedMetric {
+public:
+	FeedGauge(const char *Name, const char *Help);
+	void Set(long long Value) { FeedAtomicSet(&zValue, Value); }
+	void Add(long long Value) { FeedAtomicAdd(&zValue, Value); }
+	long long Value() { return FeedAtomicGet(&zValue); }
+	virtual void Write(std::string *Out);
+private:
+	FeedAtomic zValue;
+};
+
+// Counts observations into fixed buckets; Bounds are the upper bounds,
+// in increasing order, ending with a negative value (+Inf is implied)
+class FeedHistogramMetric : public FeedMetric {
+public:
+	enum { kMaxBuckets = 16 };
+
+	FeedHistogramMetric(const char *Name, const char *Help, const double *Bounds);
+	void Observe(double Value);
+	virtual void Write(std::string *Out);
+private:
+	const double *zBounds;
+	int zBuckets;
+	FeedAtomic zCounts[kMaxBuckets + 1];	// Not cumulative; the last one is +Inf
+	FeedAtomic zSum;						// In millionths
+};
+
+std::string FeedMetricsText();
+	// Every metric, in the Prometheus text exposition format
+bool FeedMetricsWrite(const char *Filename);
+	// Replaces Filename with FeedMetricsText() in one go, so a collector
+	// never reads half a file
+
+// The metrics of the feed checks
+extern FeedCounter gFeedFetches;
+extern FeedCounter gFeedFetchFailures;
+extern FeedCounter gFeedBytes;
+extern FeedCounter gFeedCutShort;		// Replies left unread from some point on
+extern FeedCounter gFeedBytesSkipped;	// What was left of them, where known
+extern FeedCounter gFeedItems;
+extern FeedCounter gFeedDedupeHits;		// Items seen before
+extern FeedCounter gFeedDedupeMisses;	// New items
+extern FeedGauge gFeedLastSuccess;		// Unix time of the last good fetch
+extern FeedGauge gFeedPollInterval;		// Seconds, where there is one
+extern FeedHistogramMetric gFeedFetchSeconds;
+extern FeedHistogramMetric gFeedItemsPerFetch;
+
+#endif
@@ -0,0 +1,303 @@
+//----------------------------------------------------------------------
+//	FeedProxy.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "FeedProxy.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+double FeedProxy::Cost() const
+{
+	// Each try takes zLatency and works 1 - zErrorRate of the time
+	double success = 1 - zErrorRate;
+	return zLatency / (success > 0.05 ? success : 0.05);
+}
+
+// Sorts proxies by cost
+struct ByCost {
+	const std::vector<FeedProxy> &zProxies;
+	ByCost(const std::vector<FeedProxy> &Proxies) : zProxies(Proxies) {}
+	bool operator()(int A, int B) const { return zProxies[A].Cost() < zProxies[B].Cost(); }
+};
+
+// Sorts proxies by when they may be tried again
+struct ByRetry {
+	const std::vector<FeedProxy> &zProxies;
+	ByRetry(const std::vector<FeedProxy> &Proxies) : zProxies(Proxies) {}
+	bool operator()(int A, int B) const { return zProxies[A].zRetryAt < zProxies[B].zRetryAt; }
+};
+
+FeedProxyPool::FeedProxyPool(double Alpha, double RetryAfter, double MaxRetryAfter)
+	: zAlpha(Alpha), zRetryAfter(RetryAfter), zMaxRetryAfter(MaxRetryAfter)
+{
+	pthread_mutex_init(&zLock, NULL);
+}
+
+FeedProxyPool::~FeedProxyPool()
+{
+	pthread_mutex_destroy(&zLock);
+}
+
+//-----------------------------------------------------------------------------
+// Configuration
+//-----------------------------------------------------------------------------
+
+static std::string Trim(const std::string &Text)
+{
+	size_t start = Text.find_first_not_of(" \t");
+	if (start == std::string::npos)
+		return std::string();
+	return Text.substr(start, Text.find_last_not_of(" \t") - start + 1);
+}
+
+static FeedProxy NewProxy(const char *Host, unsigned short Port, const char *UserPassword)
+{
+	FeedProxy proxy;
+	proxy.zHost = Host;
+	proxy.zPort = Port;
+	proxy.zAuthorization = FeedBasicAuth(UserPassword);
+	proxy.zLatency = 0;
+	proxy.zErrorRate = 0;
+	proxy.zSamples = 0;
+	proxy.zFailures = 0;
+	proxy.zRetryAt = 0;
+	return proxy;
+}
+
+bool FeedProxyPool::Configure(const char *List, unsigned short DefaultPort, const char *DefaultAuth)
+{
+	char defaults[64];
+	sprintf(defaults, "|%u|", DefaultPort);
+	std::string configuration = std::string(List) + defaults + DefaultAuth;
+
+	pthread_mutex_lock(&zLock);
+	if (configuration == zConfiguration)
+	{
+		pthread_mutex_unlock(&zLock);
+		return false;
+	}
+
+	std::vector<FeedProxy> proxies;
+	std::string list = List;
+	for (size_t start = 0; start <= list.size(); )
+	{
+		size_t comma = list.find(',', start);
+		if (comma == std::string::npos)
+			comma = list.size();
+		std::string entry = Trim(list.substr(start, comma - start));
+		start = comma + 1;
+		if (entry.empty())
+			continue;
+
+		std::string auth = DefaultAuth;
+		size_t at = entry.rfind('@');
+		if (at != std::string::npos)
+		{
+			auth = entry.substr(0, at);
+			entry = entry.substr(at + 1);
+		}
+		unsigned long port = DefaultPort;
+		size_t colon = entry.rfind(':');
+		if (colon != std::string::npos)
+		{
+			port = strtoul(entry.c_str() + colon + 1, NULL, 10);
+			entry.erase(colon);
+		}
+		if (entry.empty() || port == 0 || port > 0xFFFF)
+			continue;
+
+		FeedProxy proxy = NewProxy(entry.c_str(), port, auth.c_str());
+		// What's known about a proxy that stays is kept
+		for (size_t i = 0; i < zProxies.size(); i++)
+		{
+			if (zProxies[i].zHost == proxy.zHost && zProxies[i].zPort == proxy.zPort)
+			{
+				std::string authorization = proxy.zAuthorization;
+				proxy = zProxies[i];
+				proxy.zAuthorization = authorization;
+				break;
+			}
+		}
+		proxies.push_back(proxy);
+	}
+	zProxies = proxies;
+	zConfiguration = configuration;
+	pthread_mutex_unlock(&zLock);
+	return true;
+}
+
+void FeedProxyPool::Add(const char *Host, unsigned short Port, const char *UserPassword)
+{
+	pthread_mutex_lock(&zLock);
+	zProxies.push_back(NewProxy(Host, Port, UserPassword));
+	zConfiguration.erase();
+	pthread_mutex_unlock(&zLock);
+}
+
+int FeedProxyPool::Count()
+{
+	pthread_mutex_lock(&zLock);
+	int count = zProxies.size();
+	pthread_mutex_unlock(&zLock);
+	return count;
+}
+
+bool FeedProxyPool::Proxy(int Index, FeedProxy *Proxy)
+{
+	pthread_mutex_lock(&zLock);
+	bool found = Index >= 0 && Index < (int)zProxies.size();
+	if (found)
+		*Proxy = zProxies[Index];
+	pthread_mutex_unlock(&zLock);
+	return found;
+}
+
+//-----------------------------------------------------------------------------
+// Health
+//-----------------------------------------------------------------------------
+
+void FeedProxyPool::Report(int Index, bool Ok, double Latency)
+{
+	pthread_mutex_lock(&zLock);
+	if (Index >= 0 && Index < (int)zProxies.size())
+	{
+		FeedProxy &proxy = zProxies[Index];
+		if (Ok)
+		{
+			proxy.zLatency = proxy.zSamples > 0 && proxy.zLatency > 0
+				? zAlpha * Latency + (1 - zAlpha) * proxy.zLatency : Latency;
+			proxy.zErrorRate *= 1 - zAlpha;
+			proxy.zFailures = 0;
+		}
+		else
+			NoteFailure(&proxy);
+		proxy.zSamples++;
+	}
+	pthread_mutex_unlock(&zLock);
+}
+
+void FeedProxyPool::NoteFailure(FeedProxy *Proxy)
+{
+	Proxy->zErrorRate = zAlpha + (1 - zAlpha) * Proxy->zErrorRate;
+	Proxy->zFailures++;
+	double wait = ldexp(zRetryAfter, Proxy->zFailures - 1);
+	Proxy->zRetryAt = FeedTime() + (wait < zMaxRetryAfter ? wait : zMaxRetryAfter);
+}
+
+void FeedProxyPool::Probe(FeedTransport &Transport, double Timeout)
+{
+	// Pushing zRetryAt back keeps other threads from probing the same ones
+	std::vector<int> due;
+	std::vector<FeedProxy> targets;
+	pthread_mutex_lock(&zLock);
+	double now = FeedTime();
+	for (size_t i = 0; i < zProxies.size(); i++)
+	{
+		if (zProxies[i].zFailures > 0 && now >= zProxies[i].zRetryAt)
+		{
+			zProxies[i].zRetryAt = now + Timeout;
+			due.push_back(i);
+			targets.push_back(zProxies[i]);
+		}
+	}
+	pthread_mutex_unlock(&zLock);
+
+	for (size_t i = 0; i < due.size() && !Transport.Cancelled(); i++)
+	{
+		Transport.SetDeadline(FeedTime() + Timeout);
+		bool connected = Transport.Connect(targets[i].zHost.c_str(), targets[i].zPort);
+		Transport.Close();
+		Transport.SetDeadline(0);
+		if (Transport.Cancelled())
+			break;
+
+		pthread_mutex_lock(&zLock);
+		// The list may have been configured anew in the meantime
+		if (due[i] < (int)zProxies.size() && zProxies[due[i]].zHost == targets[i].zHost
+			&& zProxies[due[i]].zPort == targets[i].zPort)
+		{
+			// A proxy that answers again gets some of its good name back, or
+			// one that's healthier by now would never let it prove itself
+			if (connected)
+			{
+				zProxies[due[i]].zFailures = 0;
+				zProxies[due[i]].zErrorRate *= 1 - zAlpha;
+			}
+			else
+				NoteFailure(&zProxies[due[i]]);
+		}
+		pthread_mutex_unlock(&zLock);
+	}
+}
+
+// Healthy proxies by cost (untried ones first, as their cost is 0), then
+// the ones that failed, soonest to be retried first
+void FeedProxyPool::Order(std::vector<int> *Order)
+{
+	std::vector<int> failed;
+	Order->clear();
+	pthread_mutex_lock(&zLock);
+	for (size_t i = 0; i < zProxies.size(); i++)
+		(zProxies[i].zFailures == 0 ? *Order : failed).push_back(i);
+	std::stable_sort(Order->begin(), Order->end(), ByCost(zProxies));
+	std::stable_sort(failed.begin(), failed.end(), ByRetry(zProxies));
+	pthread_mutex_unlock(&zLock);
+	Order->insert(Order->end(), failed.begin(), failed.end());
+}
+
+//-----------------------------------------------------------------------------
+// Fetching
+//-----------------------------------------------------------------------------
+
+// Whether a fetch failed because of the proxy, rather than the feed
+static bool ProxyFailed(bool Ok, const FeedTiming &Timing)
+{
+	if (Ok)
+		return false;
+	if (Timing.zStatus == 0)
+		return true;
+	return Timing.zStatus == 407 || (Timing.zStatus >= 502 && Timing.zStatus <= 504);
+}
+
+bool FeedProxyPool::Fetch(FeedTransport &Transport, const FeedSource &Source,
+	std::string *Reply, FeedTiming *Timing, int *Used, FeedReplyReader *Reader)
+{
+	if (Used != NULL)
+		*Used = -1;
+	if (Count() == 0)
+		return FeedFetch(Transport, Source, Reply, Timing, Reader);
+
+	double timeout = Source.zDeadlines.zConnect;
+	Probe(Transport, timeout > 0 && timeout < kFeedProbeTimeout ? timeout : kFeedProbeTimeout);
+
+	std::vector<int> order;
+	Order(&order);
+	FeedSource source = Source;
+	bool ok = false;
+	for (size_t i = 0; i < order.size() && i < (size_t)kFeedProxyAttempts; i++)
+	{
+		FeedProxy proxy;
+		if (!Proxy(order[i], &proxy))
+			break;
+		source.zProxyHost = proxy.zHost;
+		source.zProxyPort = proxy.zPort;
+		source.zProxyAuthorization = proxy.zAuthorization;
+		if (Used != NULL)
+			*Used = order[i];
+
+		ok = FeedFetch(Transport, source, Reply, Timing, Reader);
+		if (Transport.Cancelled())
+			break;
+		bool failed = ProxyFailed(ok, *Timing);
+		Report(order[i], !failed, Timing->zTotalTime);
+		if (!failed)
+			break;
+	}
+	return ok;
+}
@@ -0,0 +1,79 @@
+//----------------------------------------------------------------------
+//	FeedProxy.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _FEED_PROXY_H_
+#define _FEED_PROXY_H_
+
+#include "FeedCheck.h"
+
+#include <pthread.h>
+
+// A set of HTTP proxies to fetch feeds through, each with a moving average
+// of its latency and error rate. Fetches go through the healthiest one and
+// fail over to the next; a proxy that failed is left alone for a while
+// (twice as long after every failure in a row) and then probed with a
+// bare connect before it gets real fetches again.
+//
+// All calls may come from several threads at once.
+
+struct FeedProxy {
+	std::string zHost;
+	unsigned short zPort;
+	std::string zAuthorization;	// Proxy-Authorization header value, encoded once
+
+	double zLatency;			// Moving average of good fetches, in seconds
+	double zErrorRate;			// Moving average of failures, 0 to 1
+	int zSamples;				// Fetches that went through it
+	int zFailures;				// Failures in a row
+	double zRetryAt;			// When it may be probed again, if zFailures
+
+	double Cost() const;
+		// Expected time to a good fetch; lower is better
+};
+
+class FeedProxyPool {
+public:
+	FeedProxyPool(double Alpha = 0.3, double RetryAfter = 30, double MaxRetryAfter = 1800);
+		// Alpha weighs new samples in the averages; RetryAfter is how long
+		// a proxy that failed once is left alone, in seconds
+	~FeedProxyPool();
+
+	bool Configure(const char *List, unsigned short DefaultPort, const char *DefaultAuth);
+		// Sets the proxies from a list like "host[:port], user:pass@host..."
+		// (ports default to DefaultPort, credentials to DefaultAuth).
+		// Nothing happens, and the health is kept, if the list is the same
+		// as last time; returns whether it changed.
+	void Add(const char *Host, unsigned short Port, const char *UserPassword);
+	int Count();
+	bool Proxy(int Index, FeedProxy *Proxy);
+		// Copies the state of a proxy; false if there's no such one
+
+	bool Fetch(FeedTransport &Transport, const FeedSource &Source,
+		std::string *Reply, FeedTiming *Timing, int *Used = NULL,
+		FeedReplyReader *Reader = NULL);
+		// FeedFetch() through the proxies, trying at most kFeedProxyAttempts
+		// of them. Without proxies, it fetches directly. *Used is set to
+		// the proxy of the last attempt, -1 if none.
+	void Report(int Index, bool Ok, double Latency);
+	void Probe(FeedTransport &Transport, double Timeout);
+		// Tries to connect to the proxies that are due for it
+private:
+	void Order(std::vector<int> *Order);
+	void NoteFailure(FeedProxy *Proxy);
+		// The lock must be held
+
+	pthread_mutex_t zLock;
+	std::vector<FeedProxy> zProxies;
+	std::string zConfiguration;
+	double zAlpha;
+	double zRetryAfter;
+	double zMaxRetryAfter;
+};
+
+static const int kFeedProxyAttempts = 3;
+static const double kFeedProbeTimeout = 2;
+
+#endif
@@ -0,0 +1,317 @@
+//----------------------------------------------------------------------
+//	FeedResolve.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "FeedResolve.h"
+#include "FeedCheck.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+//-----------------------------------------------------------------------------
+// FeedAddress
+//-----------------------------------------------------------------------------
+
+bool FeedAddress::Set(const char *Numeric)
+{
+	memset(&zAddress, 0, sizeof zAddress);
+	struct sockaddr_in *v4 = (struct sockaddr_in *)&zAddress;
+	struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)&zAddress;
+	if (inet_pton(AF_INET, Numeric, &v4->sin_addr) == 1)
+	{
+		v4->sin_family = AF_INET;
+		zLength = sizeof *v4;
+		return true;
+	}
+	if (inet_pton(AF_INET6, Numeric, &v6->sin6_addr) == 1)
+	{
+		v6->sin6_family = AF_INET6;
+		zLength = sizeof *v6;
+		return true;
+	}
+	zLength = 0;
+	return false;
+}
+
+void FeedAddress::SetPort(unsigned short Port)
+{
+	if (Family() == AF_INET)
+		((struct sockaddr_in *)&zAddress)->sin_port = htons(Port);
+	else if (Family() == AF_INET6)
+		((struct sockaddr_in6 *)&zAddress)->sin6_port = htons(Port);
+}
+
+std::string FeedAddress::ToString() const
+{
+	char text[INET6_ADDRSTRLEN] = "?";
+	if (Family() == AF_INET)
+		inet_ntop(AF_INET, &((const struct sockaddr_in *)&zAddress)->sin_addr, text, sizeof text);
+	else if (Family() == AF_INET6)
+		inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)&zAddress)->sin6_addr, text, sizeof text);
+	return text;
+}
+
+bool FeedAddress::operator==(const FeedAddress &Other) const
+{
+	return zLength == Other.zLength && memcmp(&zAddress, &Other.zAddress, zLength) == 0;
+}
+
+//-----------------------------------------------------------------------------
+// Resolvers
+//-----------------------------------------------------------------------------
+
+FeedSystemResolver::FeedSystemResolver(int Ttl)
+	: zTtl(Ttl)
+{
+}
+
+bool FeedSystemResolver::Resolve(const char *Host, std::vector<FeedAddress> *Addresses, int *Ttl)
+{
+	struct addrinfo hints, *results;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(Host, NULL, &hints, &results) != 0)
+		return false;
+
+	Addresses->clear();
+	for (struct addrinfo *result = results; result != NULL; result = result->ai_next)
+	{
+		if (result->ai_addrlen > sizeof(struct sockaddr_storage))
+			continue;
+		FeedAddress address;
+		memset(&address.zAddress, 0, sizeof address.zAddress);
+		memcpy(&address.zAddress, result->ai_addr, result->ai_addrlen);
+		address.zLength = result->ai_addrlen;
+		bool duplicate = false;
+		for (size_t i = 0; i < Addresses->size() && !duplicate; i++)
+			duplicate = (*Addresses)[i] == address;
+		if (!duplicate)
+			Addresses->push_back(address);
+	}
+	freeaddrinfo(results);
+	*Ttl = zTtl;
+	return !Addresses->empty();
+}
+
+FeedFakeResolver::FeedFakeResolver()
+	: zFailing(false), zDelay(0), zLookups(0)
+{
+	pthread_mutex_init(&zLock, NULL);
+}
+
+FeedFakeResolver::~FeedFakeResolver()
+{
+	pthread_mutex_destroy(&zLock);
+}
+
+void FeedFakeResolver::Add(const char *Host, const char *Address, int Ttl)
+{
+	FeedAddress address;
+	if (!address.Set(Address))
+		return;
+	pthread_mutex_lock(&zLock);
+	Answer &answer = zAnswers[Host];
+	answer.zAddresses.push_back(address);
+	answer.zTtl = Ttl;
+	pthread_mutex_unlock(&zLock);
+}
+
+void FeedFakeResolver::Remove(const char *Host)
+{
+	pthread_mutex_lock(&zLock);
+	zAnswers.erase(Host);
+	pthread_mutex_unlock(&zLock);
+}
+
+void FeedFakeResolver::SetFailing(bool Failing)
+{
+	pthread_mutex_lock(&zLock);
+	zFailing = Failing;
+	pthread_mutex_unlock(&zLock);
+}
+
+void FeedFakeResolver::SetDelay(double Seconds)
+{
+	pthread_mutex_lock(&zLock);
+	zDelay = Seconds;
+	pthread_mutex_unlock(&zLock);
+}
+
+int FeedFakeResolver::Lookups()
+{
+	pthread_mutex_lock(&zLock);
+	int lookups = zLookups;
+	pthread_mutex_unlock(&zLock);
+	return lookups;
+}
+
+bool FeedFakeResolver::Resolve(const char *Host, std::vector<FeedAddress> *Addresses, int *Ttl)
+{
+	pthread_mutex_lock(&zLock);
+	zLookups++;
+	double delay = zDelay;
+	pthread_mutex_unlock(&zLock);
+
+	if (delay > 0)
+		usleep((useconds_t)(delay * 1e6));
+
+	pthread_mutex_lock(&zLock);
+	std::map<std::string, Answer>::iterator answer = zAnswers.find(Host);
+	bool found = !zFailing && answer != zAnswers.end();
+	if (found)
+	{
+		*Addresses = answer->second.zAddresses;
+		*Ttl = answer->second.zTtl;
+	}
+	pthread_mutex_unlock(&zLock);
+	return found;
+}
+
+//-----------------------------------------------------------------------------
+// FeedDnsCache
+//-----------------------------------------------------------------------------
+
+FeedDnsCache::FeedDnsCache(FeedResolver &Resolver, double RefreshAhead, double MaxStale)
+	: zResolver(Resolver), zRefreshAhead(RefreshAhead), zMaxStale(MaxStale), zRefreshes(0)
+{
+	pthread_mutex_init(&zLock, NULL);
+	pthread_cond_init(&zIdle, NULL);
+}
+
+FeedDnsCache::~FeedDnsCache()
+{
+	WaitForRefreshes();
+	pthread_cond_destroy(&zIdle);
+	pthread_mutex_destroy(&zLock);
+}
+
+void FeedDnsCache::WaitForRefreshes()
+{
+	pthread_mutex_lock(&zLock);
+	while (zRefreshes > 0)
+		pthread_cond_wait(&zIdle, &zLock);
+	pthread_mutex_unlock(&zLock);
+}
+
+void FeedDnsCache::Clear()
+{
+	pthread_mutex_lock(&zLock);
+	zEntries.clear();
+	pthread_mutex_unlock(&zLock);
+}
+
+bool FeedDnsCache::Resolve(const std::string &Host, std::vector<FeedAddress> *Addresses)
+{
+	int ttl = 0;
+	std::vector<FeedAddress> addresses;
+	bool resolved = zResolver.Resolve(Host.c_str(), &addresses, &ttl) && !addresses.empty();
+
+	pthread_mutex_lock(&zLock);
+	if (resolved)
+	{
+		Entry &entry = zEntries[Host];
+		entry.zAddresses = addresses;
+		entry.zResolved = FeedTime();
+		entry.zExpires = entry.zResolved + (ttl > 0 ? ttl : 0);
+		entry.zRefreshing = false;
+		if (Addresses != NULL)
+			*Addresses = addresses;
+	}
+	else
+	{
+		std::map<std::string, Entry>::iterator entry = zEntries.find(Host);
+		if (entry != zEntries.end())
+			entry->second.zRefreshing = false;
+	}
+	pthread_mutex_unlock(&zLock);
+	return resolved;
+}
+
+void *FeedDnsCache::RefreshThread(void *Data)
+{
+	Refresh *refresh = (Refresh *)Data;
+	FeedDnsCache *cache = refresh->zCache;
+	cache->Resolve(refresh->zHost, NULL);
+	delete refresh;
+
+	pthread_mutex_lock(&cache->zLock);
+	if (--cache->zRefreshes == 0)
+		pthread_cond_broadcast(&cache->zIdle);
+	pthread_mutex_unlock(&cache->zLock);
+	return NULL;
+}
+
+FeedDnsSource FeedDnsCache::Lookup(const char *Host, std::vector<FeedAddress> *Addresses)
+{
+	std::string host = Host;
+
+	// Numbers need no resolving
+	FeedAddress numeric;
+	if (numeric.Set(Host))
+	{
+		Addresses->assign(1, numeric);
+		return FEED_DNS_CACHED;
+	}
+
+	pthread_mutex_lock(&zLock);
+	double now = FeedTime();
+	std::map<std::string, Entry>::iterator found = zEntries.find(host);
+	if (found != zEntries.end() && now < found->second.zExpires)
+	{
+		Entry &entry = found->second;
+		*Addresses = entry.zAddresses;
+		double ttl = entry.zExpires - entry.zResolved;
+		if (!entry.zRefreshing && now >= entry.zExpires - ttl * zRefreshAhead)
+		{
+			Refresh *refresh = new Refresh;
+			refresh->zCache = this;
+			refresh->zHost = host;
+			pthread_t thread;
+			if (pthread_create(&thread, NULL, RefreshThread, refresh) == 0)
+			{
+				pthread_detach(thread);
+				entry.zRefreshing = true;
+				zRefreshes++;
+			}
+			else
+				delete refresh;
+		}
+		pthread_mutex_unlock(&zLock);
+		return FEED_DNS_CACHED;
+	}
+	pthread_mutex_unlock(&zLock);
+
+	if (Resolve(host, Addresses))
+		return FEED_DNS_RESOLVED;
+
+	pthread_mutex_lock(&zLock);
+	FeedDnsSource source = FEED_DNS_FAILED;
+	found = zEntries.find(host);
+	if (found != zEntries.end())
+	{
+		if (now < found->second.zExpires + zMaxStale)
+		{
+			*Addresses = found->second.zAddresses;
+			source = FEED_DNS_STALE;
+		}
+		else
+			zEntries.erase(found);
+	}
+	pthread_mutex_unlock(&zLock);
+	return source;
+}
+
+FeedDnsCache &FeedDefaultDnsCache()
+{
+	// Never destroyed, so that it can't go away under a refresh running
+	// while the process exits
+	static FeedSystemResolver *resolver = new FeedSystemResolver();
+	static FeedDnsCache *cache = new FeedDnsCache(*resolver);
+	return *cache;
+}
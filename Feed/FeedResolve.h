@@ -0,0 +1,129 @@
+//----------------------------------------------------------------------
+//	FeedResolve.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _FEED_RESOLVE_H_
+#define _FEED_RESOLVE_H_
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Host name resolution for the socket transport: a FeedResolver does the
+// actual lookups, and a FeedDnsCache in front of it keeps the answers for
+// as long as they're valid, so that polling doesn't hit the resolver every
+// time.
+
+struct FeedAddress {
+	struct sockaddr_storage zAddress;
+	socklen_t zLength;
+
+	bool Set(const char *Numeric);
+		// Takes an IPv4 or IPv6 address in text form
+	void SetPort(unsigned short Port);
+	int Family() const { return zAddress.ss_family; }
+	std::string ToString() const;
+	bool operator==(const FeedAddress &Other) const;
+};
+
+class FeedResolver {
+public:
+	virtual ~FeedResolver() {}
+	virtual bool Resolve(const char *Host, std::vector<FeedAddress> *Addresses, int *Ttl) = 0;
+		// Replaces Addresses with those of Host, in order of preference, and
+		// sets how many seconds they may be kept; returns false if Host
+		// couldn't be resolved. Must be safe to call from several threads.
+};
+
+// getaddrinfo(). It doesn't tell TTLs, so every answer gets the same one.
+class FeedSystemResolver : public FeedResolver {
+public:
+	FeedSystemResolver(int Ttl = 300);
+	virtual bool Resolve(const char *Host, std::vector<FeedAddress> *Addresses, int *Ttl);
+private:
+	int zTtl;
+};
+
+// Answers from a table, for tests: lookups can be slowed down or made to
+// fail, and are counted
+class FeedFakeResolver : public FeedResolver {
+public:
+	FeedFakeResolver();
+	virtual ~FeedFakeResolver();
+
+	void Add(const char *Host, const char *Address, int Ttl);
+		// Host resolves to Address, after the ones added before it
+	void Remove(const char *Host);
+	void SetFailing(bool Failing);
+	void SetDelay(double Seconds);
+	int Lookups();
+
+	virtual bool Resolve(const char *Host, std::vector<FeedAddress> *Addresses, int *Ttl);
+private:
+	struct Answer {
+		std::vector<FeedAddress> zAddresses;
+		int zTtl;
+	};
+	pthread_mutex_t zLock;
+	std::map<std::string, Answer> zAnswers;
+	bool zFailing;
+	double zDelay;
+	int zLookups;
+};
+
+// Where an answer from the cache came from
+enum FeedDnsSource {
+	FEED_DNS_RESOLVED,		// Not cached, or expired: the resolver was asked
+	FEED_DNS_CACHED,		// Cached and still valid
+	FEED_DNS_STALE,			// Expired, but the resolver failed
+	FEED_DNS_FAILED
+};
+
+// Keeps the resolver's answers until their TTL runs out. An answer that's
+// close to running out (the last RefreshAhead of its TTL) is refreshed on
+// a thread of its own while the cached one is still handed out, and one
+// that has run out is handed out anyway, for up to MaxStale seconds, if
+// the resolver fails.
+class FeedDnsCache {
+public:
+	FeedDnsCache(FeedResolver &Resolver, double RefreshAhead = 0.1, double MaxStale = 86400);
+	~FeedDnsCache();
+		// Waits for refreshes that are still running
+
+	FeedDnsSource Lookup(const char *Host, std::vector<FeedAddress> *Addresses);
+	void Clear();
+	void WaitForRefreshes();
+private:
+	struct Entry {
+		std::vector<FeedAddress> zAddresses;
+		double zResolved;
+		double zExpires;
+		bool zRefreshing;
+	};
+	struct Refresh {
+		FeedDnsCache *zCache;
+		std::string zHost;
+	};
+
+	bool Resolve(const std::string &Host, std::vector<FeedAddress> *Addresses);
+		// Asks the resolver and stores what it says; the lock must not be held
+	static void *RefreshThread(void *Data);
+
+	FeedResolver &zResolver;
+	double zRefreshAhead;
+	double zMaxStale;
+	pthread_mutex_t zLock;
+	pthread_cond_t zIdle;
+	int zRefreshes;
+	std::map<std::string, Entry> zEntries;
+};
+
+FeedDnsCache &FeedDefaultDnsCache();
+	// A cache in front of FeedSystemResolver, for the whole process
+
+#endif
@@ -0,0 +1,315 @@
+//----------------------------------------------------------------------
+//	FeedSocket.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "FeedSocket.h"
+#include "FeedTrace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// Connection attempts that can be in flight at once
+static const int kMaxWait = 8;
+
+// Don't let a peer that went away raise SIGPIPE, where that can be asked for
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+//-----------------------------------------------------------------------------
+// FeedCancel
+//-----------------------------------------------------------------------------
+
+FeedCancel::FeedCancel()
+	: zReferences(1), zCancelled(0)
+{
+	if (pipe(zPipe) != 0)
+		zPipe[0] = zPipe[1] = -1;
+}
+
+FeedCancel::~FeedCancel()
+{
+	if (zPipe[0] >= 0)
+	{
+		close(zPipe[0]);
+		close(zPipe[1]);
+	}
+}
+
+void FeedCancel::Acquire()
+{
+	FeedAtomicAdd(&zReferences, 1);
+}
+
+void FeedCancel::Release()
+{
+	if (FeedAtomicAdd(&zReferences, -1) == 1)
+		delete this;
+}
+
+void FeedCancel::Cancel()
+{
+	if (FeedAtomicAdd(&zCancelled, 1) == 0 && zPipe[1] >= 0)
+		write(zPipe[1], "x", 1);
+}
+
+bool FeedCancel::IsCancelled()
+{
+	return FeedAtomicGet(&zCancelled) != 0;
+}
+
+//-----------------------------------------------------------------------------
+// FeedSocketTransport
+//-----------------------------------------------------------------------------
+
+FeedSocketTransport::FeedSocketTransport(int Timeout, FeedDnsCache *Cache, FeedCancel *Cancel)
+	: zSocket(-1), zTimeout(Timeout), zDeadline(0),
+	  zCache(Cache != NULL ? Cache : &FeedDefaultDnsCache()), zCancel(Cancel),
+	  zResolveTime(0), zDnsSource(FEED_DNS_FAILED)
+{
+	if (zCancel != NULL)
+		zCancel->Acquire();
+}
+
+FeedSocketTransport::~FeedSocketTransport()
+{
+	Close();
+	if (zCancel != NULL)
+		zCancel->Release();
+}
+
+bool FeedSocketTransport::Cancelled() const
+{
+	return zCancel != NULL && zCancel->IsCancelled();
+}
+
+double FeedSocketTransport::CallDeadline() const
+{
+	return zDeadline > 0 ? zDeadline : FeedTime() + zTimeout;
+}
+
+// Polls Fds until one of them is ready, Deadline passes or the transport
+// is cancelled; returns the number of ready ones, 0 on timeouts and -1 on
+// errors or cancelling
+int FeedSocketTransport::Wait(struct pollfd *Fds, int Count, double Deadline)
+{
+	struct pollfd fds[kMaxWait + 1];
+	memcpy(fds, Fds, Count * sizeof *Fds);
+	int all = Count;
+	if (zCancel != NULL && zCancel->WaitFd() >= 0)
+	{
+		fds[all].fd = zCancel->WaitFd();
+		fds[all].events = POLLIN;
+		all++;
+	}
+
+	for (;;)
+	{
+		if (Cancelled())
+			return -1;
+		double now = FeedTime();
+		if (now >= Deadline)
+			return 0;
+		int ready = poll(fds, all, (int)((Deadline - now) * 1000) + 1);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready < 0 || Cancelled())
+			return -1;
+		if (ready > 0)
+		{
+			for (int i = 0; i < Count; i++)
+				Fds[i].revents = fds[i].revents;
+			return ready;
+		}
+	}
+}
+
+// Starts a non-blocking connect; returns the socket, -1 if it failed
+// right away. *Connected tells whether it's done already.
+static int StartConnect(const FeedAddress &Address, bool *Connected)
+{
+	*Connected = false;
+	int fd = socket(Address.Family(), SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	*Connected = connect(fd, (const struct sockaddr *)&Address.zAddress, Address.zLength) == 0;
+	if (!*Connected && errno != EINPROGRESS)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Orders the addresses the way RFC 8305 asks for: alternating families,
+// starting with whichever came first
+static void Interleave(std::vector<FeedAddress> *Addresses)
+{
+	if (Addresses->empty())
+		return;
+	std::vector<FeedAddress> first, other;
+	int family = Addresses->front().Family();
+	for (size_t i = 0; i < Addresses->size(); i++)
+		((*Addresses)[i].Family() == family ? first : other).push_back((*Addresses)[i]);
+	Addresses->clear();
+	for (size_t i = 0; i < first.size() || i < other.size(); i++)
+	{
+		if (i < first.size())
+			Addresses->push_back(first[i]);
+		if (i < other.size())
+			Addresses->push_back(other[i]);
+	}
+}
+
+bool FeedSocketTransport::Connect(const char *Host, unsigned short Port)
+{
+	Close();
+	zPeer.erase();
+	if (Cancelled())
+		return false;
+
+	double start = FeedTime();
+	std::vector<FeedAddress> addresses;
+	zDnsSource = zCache->Lookup(Host, &addresses);
+	zResolveTime = FeedTime() - start;
+	FeedTraceSpan(FEED_STAGE_DNS, start, start + zResolveTime);
+	if (zDnsSource == FEED_DNS_FAILED)
+		return false;
+	Interleave(&addresses);
+
+	// Attempts in flight, and the address each one is for
+	std::vector<struct pollfd> attempts;
+	std::vector<size_t> targets;
+	size_t next = 0;
+	double deadline = CallDeadline(), nextStart = 0;
+	while (zSocket < 0)
+	{
+		double now = FeedTime();
+		if (now >= deadline)
+			break;
+		if (next < addresses.size() && (attempts.empty() || now >= nextStart)
+			&& attempts.size() < (size_t)kMaxWait)
+		{
+			bool connected;
+			addresses[next].SetPort(Port);
+			int fd = StartConnect(addresses[next], &connected);
+			if (connected)
+			{
+				zSocket = fd;
+				zPeer = addresses[next].ToString();
+				break;
+			}
+			if (fd >= 0)
+			{
+				struct pollfd attempt;
+				attempt.fd = fd;
+				attempt.events = POLLOUT;
+				attempt.revents = 0;
+				attempts.push_back(attempt);
+				targets.push_back(next);
+				nextStart = now + kFeedAttemptDelay;
+			}
+			next++;
+			continue;
+		}
+		if (attempts.empty())
+			break;
+
+		double until = next < addresses.size() && nextStart < deadline ? nextStart : deadline;
+		int ready = Wait(&attempts[0], attempts.size(), until);
+		if (ready < 0)
+			break;
+		if (ready == 0)
+			continue;
+
+		for (size_t i = attempts.size(); i-- > 0; )
+		{
+			if (attempts[i].revents == 0)
+				continue;
+			int error = 0;
+			socklen_t length = sizeof error;
+			if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0)
+			{
+				zSocket = attempts[i].fd;
+				zPeer = addresses[targets[i]].ToString();
+				attempts.erase(attempts.begin() + i);
+				break;
+			}
+			// Failed: no point in waiting for the next one
+			close(attempts[i].fd);
+			attempts.erase(attempts.begin() + i);
+			targets.erase(targets.begin() + i);
+			nextStart = 0;
+		}
+	}
+	for (size_t i = 0; i < attempts.size(); i++)
+		close(attempts[i].fd);
+	if (zSocket < 0)
+		return false;
+
+	// Stays non-blocking, for Send() and Receive() to keep to the deadline
+	return true;
+}
+
+ssize_t FeedSocketTransport::Send(const void *Data, size_t Length)
+{
+	double deadline = CallDeadline();
+	size_t sent = 0;
+	while (sent < Length)
+	{
+		ssize_t result = send(zSocket, (const char *)Data + sent, Length - sent, kSendFlags);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			struct pollfd writable;
+			writable.fd = zSocket;
+			writable.events = POLLOUT;
+			if (Wait(&writable, 1, deadline) <= 0)
+				return -1;
+			continue;
+		}
+		if (result <= 0)
+			return -1;
+		sent += result;
+	}
+	return sent;
+}
+
+ssize_t FeedSocketTransport::Receive(void *Buffer, size_t Length)
+{
+	double deadline = CallDeadline();
+	for (;;)
+	{
+		ssize_t result = recv(zSocket, Buffer, Length, 0);
+		if (result >= 0)
+			return result;
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+
+		struct pollfd readable;
+		readable.fd = zSocket;
+		readable.events = POLLIN;
+		if (Wait(&readable, 1, deadline) <= 0)
+			return -1;
+	}
+}
+
+void FeedSocketTransport::Close()
+{
+	if (zSocket >= 0)
+		close(zSocket);
+	zSocket = -1;
+}
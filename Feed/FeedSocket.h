@@ -0,0 +1,76 @@
+//----------------------------------------------------------------------
+//	FeedSocket.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _FEED_SOCKET_H_
+#define _FEED_SOCKET_H_
+
+#include "FeedCheck.h"
+#include "FeedMetrics.h"
+#include "FeedResolve.h"
+
+// Calls fetches off from another thread: the transports it's given to
+// give up at once, wherever they're waiting (except in the resolver).
+// Reference counted, as a fetch may well outlive whoever started it.
+class FeedCancel {
+public:
+	FeedCancel();
+		// Starts with one reference
+	void Acquire();
+	void Release();
+
+	void Cancel();
+	bool IsCancelled();
+	int WaitFd() const { return zPipe[0]; }
+		// Becomes readable once cancelled
+private:
+	~FeedCancel();
+
+	FeedAtomic zReferences;
+	FeedAtomic zCancelled;
+	int zPipe[2];
+};
+
+// A FeedTransport on top of BSD sockets. Host names go through a
+// FeedDnsCache; when a host has several addresses, they are tried
+// "happy eyeballs" style (RFC 8305): the next one is started if the last
+// hasn't connected within kFeedAttemptDelay, alternating between IPv6 and
+// IPv4, and the first to connect wins.
+class FeedSocketTransport : public FeedTransport {
+public:
+	FeedSocketTransport(int Timeout = 30, FeedDnsCache *Cache = NULL, FeedCancel *Cancel = NULL);
+		// Timeout, in seconds, applies to connecting and to every send and
+		// receive while there's no deadline. Without a Cache,
+		// FeedDefaultDnsCache() is used. Cancel, if given, is held on to
+		// for as long as the transport lives.
+	virtual ~FeedSocketTransport();
+
+	virtual bool Connect(const char *Host, unsigned short Port);
+	virtual ssize_t Send(const void *Data, size_t Length);
+	virtual ssize_t Receive(void *Buffer, size_t Length);
+	virtual void Close();
+	virtual double ResolveTime() const { return zResolveTime; }
+	virtual void SetDeadline(double Deadline) { zDeadline = Deadline; }
+	virtual bool Cancelled() const;
+
+	FeedDnsSource LastDnsSource() const { return zDnsSource; }
+	std::string PeerAddress() const { return zPeer; }
+private:
+	double CallDeadline() const;
+	int Wait(struct pollfd *Fds, int Count, double Deadline);
+
+	int zSocket;
+	int zTimeout;
+	double zDeadline;
+	FeedDnsCache *zCache;
+	FeedCancel *zCancel;
+	double zResolveTime;
+	FeedDnsSource zDnsSource;
+	std::string zPeer;
+};
+
+static const double kFeedAttemptDelay = 0.25;
+
+#endif
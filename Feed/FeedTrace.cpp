@@ -0,0 +1,196 @@
+//----------------------------------------------------------------------
+//	FeedTrace.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "FeedTrace.h"
+#include "FeedCheck.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+int gFeedTrace = -1;
+
+static const char *kStageNames[FEED_STAGE_COUNT] = {
+	"settings", "dns", "connect", "send", "first byte", "last byte",
+	"parse", "dedupe", "delivery", "menu"
+};
+
+// Each stage counts runs into the current window; once that holds
+// kWindow runs it becomes the previous one, and the histogram covers both
+static const unsigned long kWindow = 1024;
+
+struct StageWindows {
+	FeedHistogram zCurrent;
+	FeedHistogram zPrevious;
+};
+
+static pthread_once_t sOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *sTrace = NULL;
+static StageWindows sStages[FEED_STAGE_COUNT];
+
+const char *FeedStageName(FeedStage Stage)
+{
+	return kStageNames[Stage];
+}
+
+//-----------------------------------------------------------------------------
+// Starting
+//-----------------------------------------------------------------------------
+
+static void FlushAtExit()
+{
+	FeedTraceFlush();
+}
+
+static void Start()
+{
+	const char *filename = getenv("FEED_TRACE");
+	if (filename != NULL && *filename != 0)
+		sTrace = fopen(filename, "w");
+	if (sTrace != NULL)
+	{
+		// The array format doesn't need its closing bracket, so events can
+		// be written as they happen and the file is usable at any point
+		fputs("[\n", sTrace);
+		atexit(FlushAtExit);
+	}
+	gFeedTrace = sTrace != NULL ? 1 : 0;
+}
+
+bool FeedTraceStart()
+{
+	pthread_once(&sOnce, Start);
+	return gFeedTrace > 0;
+}
+
+//-----------------------------------------------------------------------------
+// Spans
+//-----------------------------------------------------------------------------
+
+void FeedTraceSpan(FeedStage Stage, double Start, double End)
+{
+	if (!FeedTraceEnabled())
+		return;
+
+	double duration = End - Start;
+	if (duration < 0)
+		duration = 0;
+	pthread_mutex_lock(&sLock);
+
+	StageWindows &windows = sStages[Stage];
+	if (windows.zCurrent.zCount == kWindow)
+	{
+		windows.zPrevious = windows.zCurrent;
+		memset(&windows.zCurrent, 0, sizeof windows.zCurrent);
+	}
+	FeedHistogram &histogram = windows.zCurrent;
+	histogram.zCounts[FeedHistogram::BucketOf(duration)]++;
+	histogram.zCount++;
+	if (duration > histogram.zMax)
+		histogram.zMax = duration;
+
+	fprintf(sTrace,
+		"{\"name\":\"%s\",\"cat\":\"feed\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,"
+		"\"pid\":1,\"tid\":%lu},\n",
+		kStageNames[Stage], Start * 1e6, duration * 1e6,
+		(unsigned long)pthread_self());
+
+	pthread_mutex_unlock(&sLock);
+}
+
+FeedSpan::FeedSpan(FeedStage Stage)
+	: zStage(Stage), zStart(FeedTraceEnabled() ? FeedTime() : 0)
+{
+}
+
+void FeedSpan::End()
+{
+	if (zStart != 0)
+	{
+		FeedTraceSpan(zStage, zStart, FeedTime());
+		zStart = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Histograms
+//-----------------------------------------------------------------------------
+
+// Bucket 4n+k holds durations of up to 2^n * (1 + (k+1)/4) µs
+double FeedHistogram::Limit(int Bucket)
+{
+	return ldexp(1 + (Bucket % kSubBuckets + 1) / (double)kSubBuckets, Bucket / kSubBuckets);
+}
+
+int FeedHistogram::BucketOf(double Seconds)
+{
+	double micros = Seconds * 1e6;
+	if (micros <= 1)
+		return 0;
+	int exponent;
+	double fraction = frexp(micros, &exponent);	// micros = fraction * 2^exponent, fraction in [0.5, 1)
+	int bucket = (exponent - 1) * kSubBuckets + (int)ceil((fraction * 2 - 1) * kSubBuckets) - 1;
+	if (bucket < 0)
+		bucket = 0;
+	return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+double FeedHistogram::Percentile(double Fraction) const
+{
+	unsigned long target = (unsigned long)ceil(zCount * Fraction), seen = 0;
+	for (int i = 0; i < kBuckets; i++)
+	{
+		seen += zCounts[i];
+		if (seen >= target && seen > 0)
+		{
+			double limit = Limit(i) / 1e6;
+			return limit < zMax ? limit : zMax;
+		}
+	}
+	return zMax;
+}
+
+void FeedTraceHistogram(FeedStage Stage, FeedHistogram *Histogram)
+{
+	memset(Histogram, 0, sizeof *Histogram);
+	if (!FeedTraceEnabled())
+		return;
+
+	pthread_mutex_lock(&sLock);
+	const StageWindows &windows = sStages[Stage];
+	for (int i = 0; i < FeedHistogram::kBuckets; i++)
+		Histogram->zCounts[i] = windows.zCurrent.zCounts[i] + windows.zPrevious.zCounts[i];
+	Histogram->zCount = windows.zCurrent.zCount + windows.zPrevious.zCount;
+	Histogram->zMax = windows.zCurrent.zMax > windows.zPrevious.zMax
+		? windows.zCurrent.zMax : windows.zPrevious.zMax;
+	pthread_mutex_unlock(&sLock);
+}
+
+void FeedTraceDump(FILE *Out)
+{
+	for (int stage = 0; stage < FEED_STAGE_COUNT; stage++)
+	{
+		FeedHistogram histogram;
+		FeedTraceHistogram((FeedStage)stage, &histogram);
+		if (histogram.zCount == 0)
+			continue;
+		fprintf(Out, "%-10s %6lu runs  p50 %9.3fms  p95 %9.3fms  p99 %9.3fms  max %9.3fms\n",
+			kStageNames[stage], histogram.zCount, histogram.Percentile(0.5) * 1000,
+			histogram.Percentile(0.95) * 1000, histogram.Percentile(0.99) * 1000,
+			histogram.zMax * 1000);
+	}
+}
+
+void FeedTraceFlush()
+{
+	if (gFeedTrace <= 0)
+		return;
+	pthread_mutex_lock(&sLock);
+	fflush(sTrace);
+	pthread_mutex_unlock(&sLock);
+}
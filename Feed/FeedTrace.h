@@ -0,0 +1,78 @@
+//----------------------------------------------------------------------
+//	FeedTrace.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _FEED_TRACE_H_
+#define _FEED_TRACE_H_
+
+#include <stdio.h>
+
+// Tracing of every stage a feed check goes through. It's off unless the
+// FEED_TRACE environment variable names a file; the spans are then
+// written there in Chrome's trace-event format (load it in
+// chrome://tracing or Perfetto), and a histogram of the recent durations
+// of each stage is kept in memory. When it's off, a span costs a test of
+// a global.
+
+enum FeedStage {
+	FEED_STAGE_SETTINGS,	// Loading the settings
+	FEED_STAGE_DNS,			// Resolving the host (where the transport can tell)
+	FEED_STAGE_CONNECT,		// Connecting, resolving included
+	FEED_STAGE_SEND,		// Sending the request
+	FEED_STAGE_FIRST_BYTE,	// Waiting for the reply to start
+	FEED_STAGE_LAST_BYTE,	// Reading the rest of the reply
+	FEED_STAGE_PARSE,
+	FEED_STAGE_DEDUPE,
+	FEED_STAGE_DELIVERY,	// Handing the items over to whoever shows them
+	FEED_STAGE_MENU,		// Putting an item in the Deskbar menu
+	FEED_STAGE_COUNT
+};
+
+const char *FeedStageName(FeedStage Stage);
+
+extern int gFeedTrace;		// 1 on, 0 off, -1 not decided yet
+bool FeedTraceStart();
+	// Looks at FEED_TRACE, once; returns whether tracing is on
+
+inline bool FeedTraceEnabled()
+{
+	return gFeedTrace > 0 || (gFeedTrace < 0 && FeedTraceStart());
+}
+
+void FeedTraceSpan(FeedStage Stage, double Start, double End);
+	// Records a stage that ran from Start to End (FeedTime() values)
+
+// Traces the stage from construction until End() or destruction
+class FeedSpan {
+public:
+	FeedSpan(FeedStage Stage);
+	~FeedSpan() { End(); }
+	void End();
+private:
+	FeedStage zStage;
+	double zStart;		// 0 when not tracing, or ended
+};
+
+// Durations of the last runs of a stage, in buckets about 19% wide
+struct FeedHistogram {
+	enum { kSubBuckets = 4, kBuckets = 32 * kSubBuckets };
+
+	unsigned long zCounts[kBuckets];	// Bucket i holds durations up to Limit(i) µs
+	unsigned long zCount;
+	double zMax;						// Seconds
+
+	static double Limit(int Bucket);
+	static int BucketOf(double Seconds);
+	double Percentile(double Fraction) const;
+		// Upper bound of the bucket holding that fraction of the runs, in seconds
+};
+
+void FeedTraceHistogram(FeedStage Stage, FeedHistogram *Histogram);
+	// Copies the histogram of the last 1024 to 2048 runs of Stage
+void FeedTraceDump(FILE *Out);
+	// Prints count, p50, p95, p99 and max for every stage that ran
+void FeedTraceFlush();
+
+#endif
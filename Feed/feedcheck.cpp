@@ -0,0 +1,234 @@
+//----------------------------------------------------------------------
+//	feedcheck.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Polls one or more feeds from the command line and prints every new item,
+// and how long each fetch took, as one JSON object per line:
+//
+//	{"type":"item","feed":"http://...","name":"Foo - 1.0","url":"http://..."}
+//	{"type":"fetch","feed":"http://...","ok":true,"status":200,"connect_ms":...}
+//	{"type":"summary","feed":"http://...","fetches":3,"failures":0,...}
+//
+// With -w everything that goes over the wire is also written to a capture
+// file, for feedreplay.cpp, and with FEED_TRACE set (see FeedTrace.h) the
+// stage histograms go to stderr at the end. -m keeps a file of metrics
+// in the Prometheus text format up to date after every round, and -k
+// stops reading replies at a run of items seen before. It needs nothing
+// but BSD sockets and pthreads:
+//
+//	g++ -O2 -o feedcheck feedcheck.cpp Feed[A-Z]*.cpp -lpthread
+//----------------------------------------------------------------------
+#include "FeedCapture.h"
+#include "FeedMetrics.h"
+#include "FeedProxy.h"
+#include "FeedSocket.h"
+#include "FeedTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char kDefaultFeed[] = "http://www.bebits.com/backend/recent";
+
+// What a feed has been up to so far
+struct FeedStats {
+	int zFetches;
+	int zFailures;
+	int zNewItems;
+	unsigned long zBytes;
+	unsigned long zBytesSkipped;
+	double zMinTime;
+	double zMaxTime;
+	double zSumTime;
+
+	FeedStats() : zFetches(0), zFailures(0), zNewItems(0), zBytes(0), zBytesSkipped(0), zMinTime(0), zMaxTime(0), zSumTime(0) {}
+	void Add(bool Ok, const FeedTiming &Timing);
+};
+
+void FeedStats::Add(bool Ok, const FeedTiming &Timing)
+{
+	if (!Ok)
+		zFailures++;
+	if (zFetches == 0 || Timing.zTotalTime < zMinTime)
+		zMinTime = Timing.zTotalTime;
+	if (Timing.zTotalTime > zMaxTime)
+		zMaxTime = Timing.zTotalTime;
+	zSumTime += Timing.zTotalTime;
+	zNewItems += Timing.zNewItems;
+	zBytes += Timing.zBytes;
+	zBytesSkipped += Timing.zBytesSkipped;
+	zFetches++;
+}
+
+static void PrintString(const std::string &Text)
+{
+	putchar('"');
+	for (size_t i = 0; i < Text.size(); i++)
+	{
+		unsigned char c = Text[i];
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [url...]\n"
+		"Polls the feeds (%s by default) and prints new items as JSON lines.\n"
+		"  -n count      Number of rounds, 0 to keep going (default 1)\n"
+		"  -i seconds    Time between rounds (default 600)\n"
+		"  -t seconds    Time a fetch may take in all (default 60)\n"
+		"  -d c,s,r      Time connecting, sending and receiving may take\n"
+		"                (default 15,15,30)\n"
+		"  -p proxies    HTTP proxies, \"[user:pass@]host[:port],...\"; the\n"
+		"                healthiest one is used\n"
+		"  -a user:pass  Proxy authorization, where the list has none\n"
+		"  -k count      Stop reading a reply after that many known items\n"
+		"                in a row (default 0, read it all)\n"
+		"  -w file       Append what goes over the wire to a capture file\n"
+		"  -m file       Write metrics there after every round\n",
+		Name, kDefaultFeed);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = 1, interval = 600, stopAfterKnown = 0;
+	FeedDeadlines deadlines;
+	const char *proxies = "", *proxyAuth = "";
+	const char *capture = NULL, *metrics = NULL;
+
+	int option;
+	while ((option = getopt(argc, argv, "n:i:t:d:p:a:k:w:m:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'n': rounds = atoi(optarg); break;
+			case 'i': interval = atoi(optarg); break;
+			case 't': deadlines.zTotal = atof(optarg); break;
+			case 'd':
+				if (sscanf(optarg, "%lf,%lf,%lf", &deadlines.zConnect, &deadlines.zSend,
+						&deadlines.zReceive) != 3)
+					Usage(argv[0]);
+				break;
+			case 'a': proxyAuth = optarg; break;
+			case 'k': stopAfterKnown = atoi(optarg); break;
+			case 'w': capture = optarg; break;
+			case 'm': metrics = optarg; break;
+			case 'p': proxies = optarg; break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+
+	std::vector<FeedSource> sources;
+	for (int i = optind; i < argc || (i == optind && sources.empty()); i++)
+	{
+		FeedSource source;
+		const char *url = i < argc ? argv[i] : kDefaultFeed;
+		if (!source.SetUrl(url))
+		{
+			fprintf(stderr, "%s: not an http:// URL: %s\n", argv[0], url);
+			return 2;
+		}
+		source.zDeadlines = deadlines;
+		sources.push_back(source);
+	}
+
+	FeedProxyPool pool;
+	pool.Configure(proxies, 80, proxyAuth);
+	if (*proxies != 0 && pool.Count() == 0)
+		Usage(argv[0]);
+
+	// One checker per feed, so that an item on two feeds shows up on both
+	std::vector<FeedChecker> checkers(sources.size());
+	for (size_t i = 0; i < checkers.size(); i++)
+		checkers[i].SetStopAfterKnown(stopAfterKnown);
+	std::vector<FeedStats> stats(sources.size());
+	FeedSocketTransport sockets;
+	FeedTransport *transport = &sockets;
+	FILE *captureFile = NULL;
+	if (capture != NULL)
+	{
+		captureFile = fopen(capture, "ab");
+		if (captureFile == NULL)
+		{
+			fprintf(stderr, "%s: can't write %s\n", argv[0], capture);
+			return 2;
+		}
+		transport = new FeedRecorder(sockets, captureFile);
+	}
+
+	gFeedPollInterval.Set(interval);
+	for (int round = 0; rounds == 0 || round < rounds; round++)
+	{
+		if (round > 0)
+			sleep(interval);
+
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			std::string feed = sources[i].Url();
+			std::vector<FeedItem> items;
+			FeedTiming timing;
+			bool ok = checkers[i].Check(*transport, sources[i], &items, &timing, &pool);
+			stats[i].Add(ok, timing);
+
+			FeedSpan delivering(FEED_STAGE_DELIVERY);
+			for (size_t j = 0; j < items.size(); j++)
+			{
+				printf("{\"type\":\"item\",\"feed\":");
+				PrintString(feed);
+				printf(",\"name\":");
+				PrintString(items[j].zName);
+				printf(",\"url\":");
+				PrintString(items[j].zUrl);
+				printf("}\n");
+			}
+			delivering.End();
+			printf("{\"type\":\"fetch\",\"feed\":");
+			PrintString(feed);
+			printf(",\"ok\":%s,\"error\":\"%s\",\"status\":%d,\"dns_ms\":%.3f,\"connect_ms\":%.3f,\"first_byte_ms\":%.3f,"
+				"\"total_ms\":%.3f,\"bytes\":%lu,\"cut_short\":%s,\"bytes_skipped\":%lu,\"items\":%d,\"new_items\":%d}\n",
+				ok ? "true" : "false", timing.zError != NULL ? timing.zError : "", timing.zStatus, timing.zResolveTime * 1000, timing.zConnectTime * 1000,
+				timing.zFirstByteTime * 1000, timing.zTotalTime * 1000,
+				(unsigned long)timing.zBytes, timing.zCutShort ? "true" : "false",
+				(unsigned long)timing.zBytesSkipped, timing.zItems, timing.zNewItems);
+			fflush(stdout);
+		}
+		if (metrics != NULL && !FeedMetricsWrite(metrics))
+			fprintf(stderr, "%s: can't write %s\n", argv[0], metrics);
+	}
+
+	if (captureFile != NULL)
+	{
+		delete transport;
+		fclose(captureFile);
+	}
+
+	if (FeedTraceEnabled())
+		FeedTraceDump(stderr);
+
+	bool failed = false;
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		const FeedStats &s = stats[i];
+		printf("{\"type\":\"summary\",\"feed\":");
+		PrintString(sources[i].Url());
+		printf(",\"fetches\":%d,\"failures\":%d,\"new_items\":%d,\"bytes\":%lu,\"bytes_skipped\":%lu,"
+			"\"min_ms\":%.3f,\"avg_ms\":%.3f,\"max_ms\":%.3f}\n",
+			s.zFetches, s.zFailures, s.zNewItems, s.zBytes, s.zBytesSkipped, s.zMinTime * 1000,
+			s.zFetches > 0 ? s.zSumTime / s.zFetches * 1000 : 0.0, s.zMaxTime * 1000);
+		if (s.zFailures == s.zFetches)
+			failed = true;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,291 @@
+//----------------------------------------------------------------------
+//	feedreplay.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Serves captured fetches (feedcheck -w) back on localhost, so the fetcher
+// can be measured without the network getting in the way. Replies go out
+// at their original pace or as fast as possible, optionally cut into
+// fragments of a given size. Connections are served one after the other,
+// going round the exchanges in the captures.
+//
+// With -b it also runs the fetch pipeline against itself that many times
+// and prints the timings as JSON lines, like feedcheck does.
+//
+//	g++ -O2 -o feedreplay feedreplay.cpp Feed[A-Z]*.cpp -lpthread
+//----------------------------------------------------------------------
+#include "FeedCapture.h"
+#include "FeedSocket.h"
+#include "FeedTrace.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+struct ReplayOptions {
+	bool zFast;
+	size_t zFragment;		// 0 sends chunks the way they were received
+};
+
+struct Replay {
+	std::vector<FeedExchange> zExchanges;
+	ReplayOptions zOptions;
+	int zListener;
+	size_t zNext;			// Exchange for the next connection
+};
+
+static void SleepUntil(double Time)
+{
+	double wait = Time - FeedTime();
+	if (wait > 0)
+		usleep((useconds_t)(wait * 1e6));
+}
+
+static bool SendAll(int Socket, const char *Data, size_t Length)
+{
+	while (Length > 0)
+	{
+		ssize_t sent = send(Socket, Data, Length, 0);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+		Data += sent;
+		Length -= sent;
+	}
+	return true;
+}
+
+// Reads a request up to the blank line that ends its headers
+static bool ReadRequest(int Socket)
+{
+	std::string request;
+	while (request.find("\r\n\r\n") == std::string::npos
+		&& request.find("\n\n") == std::string::npos)
+	{
+		char buffer[1024];
+		ssize_t received = recv(Socket, buffer, sizeof buffer, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return false;
+		request.append(buffer, received);
+	}
+	return true;
+}
+
+static void ServeExchange(int Socket, const FeedExchange &Exchange, const ReplayOptions &Options)
+{
+	if (!ReadRequest(Socket))
+		return;
+
+	// Replies are timed from the end of the request, as they were recorded
+	double start = FeedTime(), requestTime = 0;
+	for (size_t i = 0; i < Exchange.zChunks.size(); i++)
+	{
+		const FeedChunk &chunk = Exchange.zChunks[i];
+		if (chunk.zSent)
+		{
+			requestTime = chunk.zTime;
+			continue;
+		}
+		if (!Options.zFast)
+			SleepUntil(start + chunk.zTime - requestTime);
+
+		const std::string &data = chunk.zData;
+		size_t step = Options.zFragment > 0 ? Options.zFragment : data.size();
+		for (size_t offset = 0; offset < data.size(); offset += step)
+		{
+			if (!SendAll(Socket, data.data() + offset, std::min(step, data.size() - offset)))
+				return;
+		}
+	}
+}
+
+static void *ServeThread(void *Data)
+{
+	Replay *replay = (Replay *)Data;
+	for (;;)
+	{
+		int client = accept(replay->zListener, NULL, NULL);
+		if (client < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		int one = 1;
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+		ServeExchange(client, replay->zExchanges[replay->zNext], replay->zOptions);
+		replay->zNext = (replay->zNext + 1) % replay->zExchanges.size();
+		close(client);
+	}
+	return NULL;
+}
+
+static int Listen(unsigned short *Port)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+		return -1;
+	int one = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof address);
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(*Port);
+	socklen_t length = sizeof address;
+	if (bind(listener, (struct sockaddr *)&address, sizeof address) != 0
+		|| listen(listener, 16) != 0
+		|| getsockname(listener, (struct sockaddr *)&address, &length) != 0)
+	{
+		close(listener);
+		return -1;
+	}
+	*Port = ntohs(address.sin_port);
+	return listener;
+}
+
+// The path the first exchange asked for, so the benchmark asks for the same
+static std::string RecordedPath(const FeedExchange &Exchange)
+{
+	for (size_t i = 0; i < Exchange.zChunks.size(); i++)
+	{
+		if (!Exchange.zChunks[i].zSent)
+			continue;
+		const std::string &request = Exchange.zChunks[i].zData;
+		size_t start = request.find(' '), end = request.find(' ', start + 1);
+		if (start == std::string::npos || end == std::string::npos)
+			break;
+		std::string path = request.substr(start + 1, end - start - 1);
+		if (path.compare(0, 7, "http://") == 0)
+		{
+			size_t slash = path.find('/', 7);
+			path = slash != std::string::npos ? path.substr(slash) : "/";
+		}
+		return path;
+	}
+	return "/";
+}
+
+static void Benchmark(unsigned short Port, const std::string &Path, int Rounds)
+{
+	FeedSource source;
+	source.zHost = "127.0.0.1";
+	source.zPort = Port;
+	source.zPath = Path;
+
+	FeedChecker checker;
+	FeedSocketTransport transport;
+	std::vector<double> times;
+	int failures = 0;
+	size_t bytes = 0;
+	double start = FeedTime();
+	for (int round = 0; round < Rounds; round++)
+	{
+		std::vector<FeedItem> items;
+		FeedTiming timing;
+		bool ok = checker.Check(transport, source, &items, &timing);
+		if (!ok)
+			failures++;
+		times.push_back(timing.zTotalTime);
+		bytes += timing.zBytes;
+		printf("{\"type\":\"fetch\",\"round\":%d,\"ok\":%s,\"status\":%d,\"dns_ms\":%.3f,\"connect_ms\":%.3f,"
+			"\"first_byte_ms\":%.3f,\"total_ms\":%.3f,\"bytes\":%lu,\"items\":%d,\"new_items\":%d}\n",
+			round, ok ? "true" : "false", timing.zStatus, timing.zResolveTime * 1000, timing.zConnectTime * 1000,
+			timing.zFirstByteTime * 1000, timing.zTotalTime * 1000,
+			(unsigned long)timing.zBytes, timing.zItems, timing.zNewItems);
+	}
+	double elapsed = FeedTime() - start;
+	if (FeedTraceEnabled())
+		FeedTraceDump(stderr);
+
+	std::sort(times.begin(), times.end());
+	printf("{\"type\":\"summary\",\"fetches\":%d,\"failures\":%d,\"min_ms\":%.3f,\"p50_ms\":%.3f,"
+		"\"p95_ms\":%.3f,\"max_ms\":%.3f,\"fetches_per_s\":%.1f,\"mb_per_s\":%.2f}\n",
+		Rounds, failures, times.front() * 1000, times[times.size() / 2] * 1000,
+		times[times.size() * 95 / 100] * 1000, times.back() * 1000,
+		Rounds / elapsed, bytes / elapsed / 1e6);
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] capture...\n"
+		"Serves recorded fetches on localhost.\n"
+		"  -p port       Port to listen on, 0 for any (default 8080)\n"
+		"  -f            As fast as possible, rather than at the recorded pace\n"
+		"  -s bytes      Send replies in fragments of at most this size\n"
+		"  -b rounds     Fetch from the replay this many times, print the\n"
+		"                timings and quit\n",
+		Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	Replay replay;
+	replay.zOptions.zFast = false;
+	replay.zOptions.zFragment = 0;
+	replay.zNext = 0;
+	unsigned short port = 8080;
+	int rounds = 0;
+
+	int option;
+	while ((option = getopt(argc, argv, "p:fs:b:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'p': port = atoi(optarg); break;
+			case 'f': replay.zOptions.zFast = true; break;
+			case 's': replay.zOptions.zFragment = strtoul(optarg, NULL, 10); break;
+			case 'b': rounds = atoi(optarg); break;
+			default: Usage(argv[0]);
+		}
+	}
+	if (optind == argc)
+		Usage(argv[0]);
+	for (int i = optind; i < argc; i++)
+	{
+		if (!FeedLoadCapture(argv[i], &replay.zExchanges))
+		{
+			fprintf(stderr, "%s: can't read capture %s\n", argv[0], argv[i]);
+			return 1;
+		}
+	}
+	if (replay.zExchanges.empty())
+	{
+		fprintf(stderr, "%s: nothing to replay\n", argv[0]);
+		return 1;
+	}
+
+	replay.zListener = Listen(&port);
+	if (replay.zListener < 0)
+	{
+		fprintf(stderr, "%s: can't listen on port %u: %s\n", argv[0], port, strerror(errno));
+		return 1;
+	}
+	fprintf(stderr, "Replaying %lu exchanges on 127.0.0.1:%u\n",
+		(unsigned long)replay.zExchanges.size(), port);
+
+	if (rounds <= 0)
+	{
+		ServeThread(&replay);
+		return 1;
+	}
+
+	pthread_t server;
+	pthread_create(&server, NULL, ServeThread, &replay);
+	Benchmark(port, RecordedPath(replay.zExchanges[0]), rounds);
+	return 0;
+}
@@ -6,12 +6,15 @@
 #define GOTO_URL              'mURL'
 #define CHECK_NOW             'mCKN'
 #define CONFIGURE             'mCFG'
+#define DUMP_METRICS          'mMTR'  // Replies with the metrics in "text"
 #define RELOAD_SETTINGS       'mRLS'
 
 
 // Hard Coded Options
-#define BUFFER_SIZE           4096
+#define FEED_URL              "http://www.bebits.com/backend/recent"
 #define LIST_ITEM_COUNT       20
+#define METRICS_FILE          "/boot/home/config/settings/SlimSOFT.prom"
+#define METRICS_FLUSH_PULSES  60
 
 // Hard Coded Options for launching Browser
 #define BROWSER_APP_SIGNATURE "application/x-vnd.Be-NPOS"
@@ -0,0 +1,58 @@
+//----------------------------------------------------------------------
+//	BIniDataIO.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "BIniDataIO.h"
+
+//----------------------------------------------------------------------
+// BIniDataWriter
+//----------------------------------------------------------------------
+
+ssize_t BIniDataWriter::Write(const void *buffer, size_t size)
+{
+	if (zOutOfMemory)
+		return B_NO_MEMORY;
+	try
+	{
+		return zWriter.Write(buffer, size);
+	}
+	catch (IniFile::EInsufficientMemory &)
+	{
+		zOutOfMemory = true;
+		return B_NO_MEMORY;
+	}
+}
+
+bool BIniDataWriter::Finish()
+{
+	if (zOutOfMemory)
+		throw IniFile::EInsufficientMemory();
+	return zWriter.Finish();
+}
+
+//----------------------------------------------------------------------
+// BIniDataReader
+//----------------------------------------------------------------------
+
+ssize_t BIniDataReader::Read(void *buffer, size_t size)
+{
+	if (zOutOfMemory)
+		return B_NO_MEMORY;
+	try
+	{
+		return zReader.Read(buffer, size);
+	}
+	catch (IniFile::EInsufficientMemory &)
+	{
+		zOutOfMemory = true;
+		return B_NO_MEMORY;
+	}
+}
+
+void BIniDataReader::Check() const
+{
+	if (zOutOfMemory)
+		throw IniFile::EInsufficientMemory();
+}
@@ -0,0 +1,71 @@
+//----------------------------------------------------------------------
+//	BIniDataIO.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _B_INI_DATA_IO_H_
+#define _B_INI_DATA_IO_H_
+
+#include "IniFile.h"
+
+#if defined(__HAIKU__) || defined(__BEOS__)
+#include <DataIO.h>
+#else
+// Elsewhere, just enough of BDataIO (and the error codes, with Haiku's
+// values) for the adapters below to be built and tested
+#include <limits.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef int32_t status_t;
+
+#define B_OK			((status_t)0)
+#define B_ERROR			((status_t)-1)
+#define B_NO_MEMORY		((status_t)INT_MIN)
+#define B_NOT_ALLOWED	((status_t)(INT_MIN + 15))
+
+class BDataIO {
+public:
+	virtual ~BDataIO() {};
+
+	virtual ssize_t Read(void *buffer, size_t size) = 0;
+	virtual ssize_t Write(const void *buffer, size_t size) = 0;
+};
+#endif
+
+// BDataIO adapters around IniDataWriter and IniDataReader, so anything
+// that can flatten itself to a BDataIO can be streamed straight into a key
+// (and back out again) without a buffer in between. Running out of memory
+// inside Read() or Write() is reported as B_NO_MEMORY, since the caller
+// may not be prepared for exceptions; Finish() and Check() then throw the
+// IniFile::EInsufficientMemory.
+class BIniDataWriter : public BDataIO {
+public:
+	BIniDataWriter(IniFile &Ini, const char *Section, const char *Key, size_t Size)
+		: zWriter(Ini, Section, Key, Size), zOutOfMemory(false) {};
+
+	virtual ssize_t Read(void *, size_t) { return B_NOT_ALLOWED; };
+	virtual ssize_t Write(const void *buffer, size_t size);
+	
+	bool Finish();
+private:
+	IniDataWriter zWriter;
+	bool zOutOfMemory;
+};
+
+class BIniDataReader : public BDataIO {
+public:
+	BIniDataReader(const IniFile &Ini, const char *Section, const char *Key)
+		: zReader(Ini, Section, Key), zOutOfMemory(false) {};
+	
+	virtual ssize_t Read(void *buffer, size_t size);
+	virtual ssize_t Write(const void *, size_t) { return B_NOT_ALLOWED; };
+	
+	void Check() const;
+private:
+	IniDataReader zReader;
+	bool zOutOfMemory;
+};
+
+#endif
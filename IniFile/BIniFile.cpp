@@ -10,30 +10,15 @@
 
 bool BIniFile::WriteMessage(const char *Section, const char *Key, const BMessage &Message)
 {
-	bool result = false;
-
-	int size = Message.FlattenedSize();
-	void *buffer = malloc(size);
-	if (buffer == NULL)
-		throw IniFile::EInsufficientMemory();
-		
-	try
+	// Flatten straight into the encoder; the flattened message is never
+	// in memory in one piece
+	BIniDataWriter io(*this, Section, Key, Message.FlattenedSize());
+	if (Message.Flatten(&io) != B_OK)
 	{
-		if (Message.Flatten((char *)buffer, size) == B_OK)
-		{
-			WriteData(Section, Key, buffer, size);
-			result = true;
-		}
+		io.Finish();	// Throws if we ran out of memory
+		return false;
 	}
-	catch (...)
-	{
-		free(buffer);
-		buffer = NULL;
-		throw;
-	}
-	
-	free(buffer);
-	return result;
+	return io.Finish();
 }
 
 BMessage& BIniFile::ReadMessage(const char *Section, const char *Key, BMessage &Message) const
@@ -43,62 +28,42 @@ BMessage& BIniFile::ReadMessage(const char *Section, const char *Key, BMessage &
 
 BMessage& BIniFile::ReadMessage(const char *Section, const char *Key, BMessage &Message, const BMessage &Default) const
 {
-	void *buffer = NULL;
-	int size;
-	bool result;
-	
 	BMessage Result;
 
-	size = ReadData(Section, Key, &buffer);
-	try
-	{
-		BMemoryIO memIO((const void *)buffer, size);
-		Message = (Result.Unflatten(&memIO) == B_OK) ? Result : Default;
-	}
-	catch (...)
-	{
-		free(buffer);
-		buffer = NULL;
-		throw;
-	}
-	
-	free(buffer);
+	BIniDataReader io(*this, Section, Key);
+	status_t error = Result.Unflatten(&io);
+	io.Check();
+	Message = (error == B_OK) ? Result : Default;
 	return Message;	
 }
 
 BMessage* BIniFile::ReadMessage(const char *Section, const char *Key, const BMessage *Default) const
 {
-	void *buffer = NULL;
-	int size;
-	BMessage *message = NULL;
-
-	size = ReadData(Section, Key, &buffer);
+	BIniDataReader io(*this, Section, Key);
+	BMessage *message = new BMessage();
+	if (message == NULL)
+		throw IniFile::EInsufficientMemory();
+	
+	status_t error = message->Unflatten(&io);
 	try
-	{		
-		BMemoryIO memIO((const void *)buffer, size);
-		message = new BMessage();
-		if (message == NULL)
-			throw IniFile::EInsufficientMemory();
-		if (message->Unflatten(&memIO) != B_OK)
-		{
-			if (Default == NULL)
-			{
-				delete message;
-				message = NULL;
-			}
-			else
-				*message = *Default;
-		
-		}
+	{
+		io.Check();
 	}
 	catch (...)
 	{
-		free(buffer);
-		buffer = NULL;
+		delete message;
 		throw;
 	}
 	
-	free(buffer);
+	if (error != B_OK)
+	{
+		if (Default == NULL)
+		{
+			delete message;
+			message = NULL;
+		}
+		else
+			*message = *Default;
+	}
 	return message;	
 }
-
@@ -7,7 +7,7 @@
 #ifndef _B_INI_FILE_H_
 #define _B_INI_FILE_H_
 
-#include "IniFile.h"
+#include "BIniDataIO.h"
 
 #include <Message.h>
 
@@ -29,5 +29,4 @@ public:
 	BMessage* ReadMessage(const char *Section, const char *Key, const BMessage *Default = NULL) const;	
 };
 
-
 #endif
@@ -5,26 +5,148 @@
 //	over to: http://www.opensource.org/licenses/mit-license.html
 //----------------------------------------------------------------------
 #include <stdlib.h>
+#include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <algorithm>
+#ifdef INIFILE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "IniFile.h"
 
 
+//-----------------------------------------------------------------------------
+// Memory (see IniFile::SetAllocator())
+//-----------------------------------------------------------------------------
+
+static const IniAllocator *sAllocator = NULL;
+
+#ifdef INIFILE_STATS
+static unsigned long sAllocations = 0, sReallocations = 0, sFrees = 0;
+#	define INI_COUNT(counter) __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED)
+#else
+#	define INI_COUNT(counter) ((void)0)
+#endif
+
+static inline void *IniMalloc(size_t Size)
+{
+	INI_COUNT(sAllocations);
+	return sAllocator != NULL ? sAllocator->zAlloc(Size, sAllocator->zCookie) : malloc(Size);
+}
+
+static inline void *IniRealloc(void *Ptr, size_t Size)
+{
+	if (Ptr == NULL)
+		INI_COUNT(sAllocations);
+	else
+		INI_COUNT(sReallocations);
+	return sAllocator != NULL ? sAllocator->zRealloc(Ptr, Size, sAllocator->zCookie) : realloc(Ptr, Size);
+}
+
+static inline void *IniCalloc(size_t Count, size_t Size)
+{
+	if (sAllocator == NULL)
+	{
+		INI_COUNT(sAllocations);
+		return calloc(Count, Size);
+	}
+	if (Size != 0 && Count > (size_t)-1 / Size)
+		return NULL;
+	void *ptr = IniMalloc(Count * Size);
+	if (ptr != NULL)
+		memset(ptr, 0, Count * Size);
+	return ptr;
+}
+
+static inline void IniFree(void *Ptr)
+{
+	if (Ptr == NULL)
+		return;
+	INI_COUNT(sFrees);
+	if (sAllocator != NULL)
+		sAllocator->zFree(Ptr, sAllocator->zCookie);
+	else
+		free(Ptr);
+}
+
+void IniFile::SetAllocator(const IniAllocator *Allocator)
+{
+	sAllocator = Allocator;
+}
+
+#ifdef INIFILE_ZLIB
+// zlib's streams get their memory from the allocator as well
+static voidpf IniZAlloc(voidpf, uInt Items, uInt Size)
+{
+	return IniCalloc(Items, Size);
+}
+
+static void IniZFree(voidpf, voidpf Ptr)
+{
+	IniFree(Ptr);
+}
+#endif
+
+#ifdef INIFILE_STATS
+#include <time.h>
+
+// Measures how long a load or store takes, and how many allocations it makes
+class IniStatsTimer {
+	public:
+		IniStatsTimer(double *Time, unsigned long *Allocations = NULL)
+			: zTime(Time), zAllocations(Allocations),
+			  zStartAllocations(__atomic_load_n(&sAllocations, __ATOMIC_RELAXED))
+		{
+			clock_gettime(CLOCK_MONOTONIC, &zStart);
+		}
+		~IniStatsTimer()
+		{
+			struct timespec end;
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			*zTime = (end.tv_sec - zStart.tv_sec) + (end.tv_nsec - zStart.tv_nsec) / 1e9;
+			if (zAllocations != NULL)
+				*zAllocations = __atomic_load_n(&sAllocations, __ATOMIC_RELAXED) - zStartAllocations;
+		}
+	private:
+		double *zTime;
+		unsigned long *zAllocations;
+		unsigned long zStartAllocations;
+		struct timespec zStart;
+};
+#	define INI_STATS_TIMER(args) IniStatsTimer statsTimer args
+#else
+#	define INI_STATS_TIMER(args)
+#endif
+
+
 //-----------------------------------------------------------------------------
 // IniNode
 //-----------------------------------------------------------------------------
 
 IniNode::IniNode()
+	: zName(NULL), zStr(NULL), zChildList(NULL), zNext(NULL),
+	  zGeneration(0), zFileOffset(-1), zFileLength(-1), zPending(NULL),
+	  zNameInterned(false)
 {
-	IniNode("", "");
+	zChildList = new NodeList();
+	if (zChildList == NULL)
+		throw IniFile::EInsufficientMemory();
+	SetName("");
+	SetStr("");
 }
 
 IniNode::IniNode(const char *Name, const char *Str)
-	: zName(NULL), zStr(NULL), zChildList(NULL), zNext(NULL)
+	: zName(NULL), zStr(NULL), zChildList(NULL), zNext(NULL),
+	  zGeneration(0), zFileOffset(-1), zFileLength(-1), zPending(NULL),
+	  zNameInterned(false)
 {
 	zChildList = new NodeList();
 	if (zChildList == NULL)
@@ -34,10 +156,15 @@ IniNode::IniNode(const char *Name, const char *Str)
 }
 
 IniNode::IniNode(const IniNode &ref)
-	: zName(NULL), zStr(NULL), zChildList(NULL), zNext(NULL)
+	: zName(NULL), zStr(NULL), zChildList(NULL), zNext(NULL),
+	  zGeneration(ref.zGeneration), zFileOffset(ref.zFileOffset),
+	  zFileLength(ref.zFileLength), zPending(NULL),
+	  zNameInterned(ref.zNameInterned)
 {
 	
-	if (ref.zName != NULL)
+	if (ref.zNameInterned)
+		zName = ref.zName;	// Pooled names can be shared by any number of nodes
+	else if (ref.zName != NULL)
 		CopyStr(&zName, ref.zName);
 	else
 		zName = NULL;
@@ -49,29 +176,53 @@ IniNode::IniNode(const IniNode &ref)
 		
 	zNext = NULL;	// This may not be what you expect!
 		
-	zChildList = new NodeList(*ref.zChildList);
-	if (zChildList == NULL)
-		throw IniFile::EInsufficientMemory();
+	// The child list gets copied only once somebody wants to modify it
+	zChildList = ref.zChildList;
+	zChildList->AcquireReference();
 }
 
+#if __cplusplus >= 201103L
+IniNode::IniNode(IniNode &&ref)
+	: zName(ref.zName), zStr(ref.zStr), zChildList(ref.zChildList), zNext(NULL),
+	  zGeneration(ref.zGeneration), zFileOffset(ref.zFileOffset),
+	  zFileLength(ref.zFileLength), zPending(ref.zPending),
+	  zNameInterned(ref.zNameInterned)
+{
+	ref.zName = NULL;
+	ref.zStr = NULL;
+	ref.zChildList = NULL;
+	ref.zPending = NULL;
+}
+#endif
+
 // Currently private
-IniNode& IniNode::operator=(const IniNode &ref)
+IniNode& IniNode::operator=(const IniNode &)
 {
 	return *this;
 }
 
 IniNode::~IniNode()
 {
-	delete zChildList;
+	if (zChildList != NULL && zChildList->ReleaseReference())
+		delete zChildList;
+
+	// Forget about any unparsed parts of a lazily loaded file
+	while (zPending != NULL)
+	{
+		IniRange *next = zPending->zNext;
+		IniFree(zPending);
+		zPending = next;
+	}
 
 	// Delete our name and string data
-	DeleteStr(zName);
+	if (!zNameInterned)
+		DeleteStr(zName);
 	DeleteStr(zStr);
 }
 
 char* IniNode::AllocStr(const size_t size)
 {
-	char *result = (char *)malloc(size);
+	char *result = (char *)IniMalloc(size);
 	if (result == NULL)
 		throw IniFile::EInsufficientMemory();
 	return result;
@@ -79,10 +230,23 @@ char* IniNode::AllocStr(const size_t size)
 
 void IniNode::DeleteStr(char *str)
 {
-	free(str);
+	IniFree(str);
 	str = NULL;
 }
 
+void *IniNode::operator new(size_t Size)
+{
+	void *node = IniMalloc(Size);
+	if (node == NULL)
+		throw IniFile::EInsufficientMemory();
+	return node;
+}
+
+void IniNode::operator delete(void *Ptr)
+{
+	IniFree(Ptr);
+}
+
 void IniNode::CopyStr(char **str, const char *val)
 {
 	if (val == NULL || str == NULL)
@@ -98,9 +262,22 @@ void IniNode::CopyStr(char **str, const char *val)
 
 void IniNode::SetName(const char *Name)
 {
+	if (zNameInterned && Name != NULL)
+	{
+		zName = NULL;	// Not ours to free
+		zNameInterned = false;
+	}
 	CopyStr(&zName, Name);
 }
 
+void IniNode::SetInternedName(const char *Name)
+{
+	if (!zNameInterned)
+		DeleteStr(zName);
+	zName = (char *)Name;
+	zNameInterned = true;
+}
+
 void IniNode::SetStr(const char *Str)
 {
 	CopyStr(&zStr, Str);
@@ -128,17 +305,70 @@ void IniNode::PrintContents(const char *indentStr) const
 // NodeList
 //-----------------------------------------------------------------------------
 
+void *NodeList::operator new(size_t Size)
+{
+	void *list = IniMalloc(Size);
+	if (list == NULL)
+		throw IniFile::EInsufficientMemory();
+	return list;
+}
+
+void NodeList::operator delete(void *Ptr)
+{
+	IniFree(Ptr);
+}
+
 NodeList::NodeList()
-	: zStart(NULL), zEnd(NULL), zCount(0)
+	: zCount(0), zRefs(1), zStart(NULL), zEnd(NULL)
 {
 }
 
 NodeList::NodeList(const NodeList &ref)
-	: zStart(NULL), zEnd(NULL), zCount(0)
+	: zCount(0), zRefs(1), zStart(NULL), zEnd(NULL)
 {
 	Clone(ref);
 }
 
+#if __cplusplus >= 201103L
+NodeList::NodeList(NodeList &&ref)
+	: zCount(ref.zCount), zRefs(1), zStart(ref.zStart), zEnd(ref.zEnd)
+{
+	ref.zStart = NULL;
+	ref.zEnd = NULL;
+	ref.zCount = 0;
+}
+
+NodeList& NodeList::operator=(NodeList &&ref)
+{
+	if (this != &ref)
+	{
+		Clear();
+		zStart = ref.zStart;
+		zEnd = ref.zEnd;
+		zCount = ref.zCount;
+		ref.zStart = NULL;
+		ref.zEnd = NULL;
+		ref.zCount = 0;
+	}
+	return *this;
+}
+#endif
+
+void NodeList::AcquireReference()
+{
+	__atomic_add_fetch(&zRefs, 1, __ATOMIC_RELAXED);
+}
+
+bool NodeList::ReleaseReference()
+{
+	return __atomic_sub_fetch(&zRefs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+bool NodeList::IsShared() const
+{
+	return __atomic_load_n(&zRefs, __ATOMIC_ACQUIRE) > 1;
+}
+
 void NodeList::Clone(const NodeList &ref)
 {
 	Clear();	
@@ -230,39 +460,491 @@ IniNode *NodeList::FindNode(const char *Name) const
 	IniNode *Item;
 	for (Item = zStart; Item != NULL; Item = Item->zNext)
 	{
-		if (strcmp(Name, Item->zName) == 0)
+		if (Item->zName == Name || strcmp(Name, Item->zName) == 0)
+			return Item;
+	}
+	return NULL;
+}
+
+IniNode *NodeList::FindInternedNode(const char *Name) const
+{
+	IniNode *Item;
+	for (Item = zStart; Item != NULL; Item = Item->zNext)
+	{
+		if (Item->zName == Name)
 			return Item;
 	}
 	return NULL;
 }
 
+//-----------------------------------------------------------------------------
+// IniNamePool
+//-----------------------------------------------------------------------------
+
+// Stores each key name once. The names are packed into big blocks and
+// found through an open addressing hash table. Pools are shared by an
+// IniFile and its copies (whose trees share nodes, and thus names), which
+// may be modified by different threads, so interning is serialized.
+class IniNamePool {
+	public:
+		IniNamePool();
+		~IniNamePool();
+
+		const char *Intern(const char *Name);
+		void GetStats(size_t *Strings, size_t *Overhead);
+			// Adds the bytes taken by names and by everything else
+
+		void AcquireReference();
+		bool ReleaseReference();
+			// Returns true if that was the last reference
+	private:
+		void Grow();
+
+		pthread_mutex_t zLock;
+		int zRefs;
+		const char **zTable;	// zTableSize slots, NULL if unused
+		size_t zTableSize;
+		size_t zCount;
+		char *zBlock;			// Block currently being filled
+		size_t zBlockUsed;
+		size_t zBlockSize;
+		size_t zNameBytes;		// Taken by names, over all blocks
+		size_t zBlockBytes;		// Taken by all blocks
+};
+
+// Names are packed into blocks of this size; each block starts
+// with a pointer to the previous one
+static const size_t kNameBlockSize = 4096;
+
+static uint32_t HashName(const char *Name)
+{
+	uint32_t hash = 2166136261u;	// FNV-1a
+	for (; *Name != 0; Name++)
+		hash = (hash ^ (unsigned char)*Name) * 16777619u;
+	return hash;
+}
+
+IniNamePool::IniNamePool()
+	: zRefs(1), zTable(NULL), zTableSize(0), zCount(0), zBlock(NULL),
+	  zBlockUsed(0), zBlockSize(0), zNameBytes(0), zBlockBytes(0)
+{
+	pthread_mutex_init(&zLock, NULL);
+}
+
+IniNamePool::~IniNamePool()
+{
+	while (zBlock != NULL)
+	{
+		char *previous = *(char **)zBlock;
+		IniFree(zBlock);
+		zBlock = previous;
+	}
+	IniFree(zTable);
+	pthread_mutex_destroy(&zLock);
+}
+
+void IniNamePool::AcquireReference()
+{
+	__atomic_add_fetch(&zRefs, 1, __ATOMIC_RELAXED);
+}
+
+bool IniNamePool::ReleaseReference()
+{
+	return __atomic_sub_fetch(&zRefs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+void IniNamePool::GetStats(size_t *Strings, size_t *Overhead)
+{
+	pthread_mutex_lock(&zLock);
+	*Strings += zNameBytes;
+	*Overhead += sizeof(IniNamePool) + zBlockBytes - zNameBytes
+		+ zTableSize * sizeof(const char *);
+	pthread_mutex_unlock(&zLock);
+}
+
+// Doubles the hash table
+void IniNamePool::Grow()
+{
+	size_t size = zTableSize == 0 ? 64 : zTableSize * 2;
+	const char **table = (const char **)IniCalloc(size, sizeof(const char *));
+	if (table == NULL)
+		throw IniFile::EInsufficientMemory();
+	for (size_t i = 0; i < zTableSize; i++)
+	{
+		if (zTable[i] == NULL)
+			continue;
+		size_t slot = HashName(zTable[i]) & (size - 1);
+		while (table[slot] != NULL)
+			slot = (slot + 1) & (size - 1);
+		table[slot] = zTable[i];
+	}
+	IniFree(zTable);
+	zTable = table;
+	zTableSize = size;
+}
+
+const char *IniNamePool::Intern(const char *Name)
+{
+	pthread_mutex_lock(&zLock);
+	try
+	{
+		if ((zCount + 1) * 4 > zTableSize * 3)
+			Grow();
+
+		size_t slot = HashName(Name) & (zTableSize - 1);
+		while (zTable[slot] != NULL)
+		{
+			if (strcmp(zTable[slot], Name) == 0)
+			{
+				const char *result = zTable[slot];
+				pthread_mutex_unlock(&zLock);
+				return result;
+			}
+			slot = (slot + 1) & (zTableSize - 1);
+		}
+
+		// Not there yet, so add it to the current block (or a new
+		// one, which is made big enough for unusually long names)
+		size_t length = strlen(Name) + 1;
+		if (zBlock == NULL || zBlockUsed + length > zBlockSize)
+		{
+			size_t size = sizeof(char *) + length;
+			if (size < kNameBlockSize)
+				size = kNameBlockSize;
+			char *block = (char *)IniMalloc(size);
+			if (block == NULL)
+				throw IniFile::EInsufficientMemory();
+			*(char **)block = zBlock;
+			zBlock = block;
+			zBlockUsed = sizeof(char *);
+			zBlockSize = size;
+			zBlockBytes += size;
+		}
+		char *result = zBlock + zBlockUsed;
+		memcpy(result, Name, length);
+		zBlockUsed += length;
+		zNameBytes += length;
+
+		zTable[slot] = result;
+		zCount++;
+		pthread_mutex_unlock(&zLock);
+		return result;
+	}
+	catch (...)
+	{
+		pthread_mutex_unlock(&zLock);
+		throw;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// IniFileStamp
+//-----------------------------------------------------------------------------
+
+bool IniFileStamp::Set(const char *Filename)
+{
+	struct stat st;
+	if (stat(Filename, &st) != 0)
+		return false;
+
+	zSize = st.st_size;
+	zInode = st.st_ino;
+#if defined(__linux__) || defined(__HAIKU__)
+	zTime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	zChangeTime = (int64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+#else
+	zTime = (int64_t)st.st_mtime * 1000000000;
+	zChangeTime = (int64_t)st.st_ctime * 1000000000;
+#endif
+	return true;
+}
+
+bool IniFileStamp::operator==(const IniFileStamp &Other) const
+{
+	return zSize == Other.zSize && zInode == Other.zInode
+		&& zTime == Other.zTime && zChangeTime == Other.zChangeTime;
+}
+
 //-----------------------------------------------------------------------------
 // IniFile
 //-----------------------------------------------------------------------------
 
+IniFile::IniFile()
+	: zRootList(AcquireEmptyRoot()), zGeneration(0), zStoredGeneration(0), zLayoutValid(false),
+	  zFilename(NULL), zStoresSkipped(0),
+	  zStoresPerformed(0), zStoresIncremental(0), zLoadTime(0), zStoreTime(0),
+	  zLoadAllocations(0), zLazyBuffer(NULL),
+	  zLazySize(0), zUseImage(false), zImage(NULL), zImageSize(0),
+	  zImageSections(NULL), zDataEncoding(Base64Data),
+	  zCompressData(false), zNames(NULL), zHandleSlots(NULL), zHandleCount(0),
+	  zHandlesFrozen(false), zReadOffset(0)
+{
+}
+
 IniFile::IniFile(const IniFile &ref)
-	: zRootList(ref.zRootList)
+	: zRootList(ref.ParsedRootList()), zGeneration(ref.zGeneration),
+	  zStoredGeneration(ref.zStoredGeneration), zLayoutValid(ref.zLayoutValid),
+	  zFilename(NULL), zFileStamp(ref.zFileStamp),
+	  zStoresSkipped(0), zStoresPerformed(0), zStoresIncremental(0),
+	  zLoadTime(0), zStoreTime(0), zLoadAllocations(0), zLazyBuffer(NULL),
+	  zLazySize(0), zUseImage(ref.zUseImage), zImage(NULL),
+	  zImageSize(0), zImageSections(NULL), zDataEncoding(ref.zDataEncoding),
+	  zCompressData(ref.zCompressData), zNames(ref.zNames), zHandleSlots(NULL),
+	  zHandleCount(0), zHandlesFrozen(false), zReadOffset(0)
 {
+	zRootList->AcquireReference();
+	if (zNames != NULL)
+		zNames->AcquireReference();
+	SetFilename(ref.zFilename);
 }
 
 IniFile::IniFile(const char *Filename)
+	: zRootList(AcquireEmptyRoot()), zGeneration(0), zStoredGeneration(0), zLayoutValid(false),
+	  zFilename(NULL), zStoresSkipped(0),
+	  zStoresPerformed(0), zStoresIncremental(0), zLoadTime(0), zStoreTime(0),
+	  zLoadAllocations(0), zLazyBuffer(NULL),
+	  zLazySize(0), zUseImage(false), zImage(NULL), zImageSize(0),
+	  zImageSections(NULL), zDataEncoding(Base64Data),
+	  zCompressData(false), zNames(NULL), zHandleSlots(NULL), zHandleCount(0),
+	  zHandlesFrozen(false), zReadOffset(0)
 {
 	Load(Filename, true);
 }
 
+IniFile::~IniFile()
+{
+	if (zRootList->ReleaseReference())
+		delete zRootList;
+	FreeLazyBuffer();
+	FreeImage();
+	ResetHandles();
+	if (zNames != NULL && zNames->ReleaseReference())
+		delete zNames;
+	IniFree(zFilename);
+}
+
 void IniFile::Clear()
 {
-	zRootList.Clear();
+	NodeList *empty = AcquireEmptyRoot();
+	if (zRootList->ReleaseReference())
+		delete zRootList;
+	zRootList = empty;
+	FreeLazyBuffer();
+	FreeImage();
+	ResetHandles();
+	
+	// The removed sections can't be found by scanning for dirty
+	// nodes, so the next Store() has to rewrite the whole file
+	zGeneration++;
+	zLayoutValid = false;
 }
 
 IniFile &IniFile::operator=(const IniFile &Ini)
 {
-	zRootList = NodeList(Ini.zRootList);
+	if (this == &Ini)
+		return *this;
+
+	NodeList *root = Ini.ParsedRootList();
+	root->AcquireReference();
+	if (zRootList->ReleaseReference())
+		delete zRootList;
+	zRootList = root;
+
+	// Our tree now uses Ini's key names
+	if (Ini.zNames != NULL)
+		Ini.zNames->AcquireReference();
+	if (zNames != NULL && zNames->ReleaseReference())
+		delete zNames;
+	zNames = Ini.zNames;
+
+	FreeLazyBuffer();
+	FreeImage();
+	ResetHandles();
+	zGeneration = Ini.zGeneration;
+	zStoredGeneration = Ini.zStoredGeneration;
+	zLayoutValid = Ini.zLayoutValid;
+	zFileStamp = Ini.zFileStamp;
+	zUseImage = Ini.zUseImage;
+	zDataEncoding = Ini.zDataEncoding;
+	zCompressData = Ini.zCompressData;
+	SetFilename(Ini.zFilename);
+	return *this;
+}
+
+#if __cplusplus >= 201103L
+IniFile::IniFile(IniFile &&ref)
+	: zRootList(AcquireEmptyRoot()), zGeneration(0), zStoredGeneration(0),
+	  zLayoutValid(false), zFilename(NULL),
+	  zStoresSkipped(0), zStoresPerformed(0), zStoresIncremental(0),
+	  zLoadTime(0), zStoreTime(0), zLoadAllocations(0), zLazyBuffer(NULL),
+	  zLazySize(0), zUseImage(false), zImage(NULL),
+	  zImageSize(0), zImageSections(NULL), zDataEncoding(Base64Data),
+	  zCompressData(false), zNames(NULL), zHandleSlots(NULL),
+	  zHandleCount(0), zHandlesFrozen(false), zReadOffset(0)
+{
+	Swap(ref);
+}
+
+IniFile &IniFile::operator=(IniFile &&Ini)
+{
+	// Ini ends up with our old contents and gets rid of them
+	if (this != &Ini)
+		Swap(Ini);
 	return *this;
 }
+#endif
+
+// Exchanges the complete state of two IniFiles
+void IniFile::Swap(IniFile &Ini)
+{
+	std::swap(zRootList, Ini.zRootList);
+	std::swap(zGeneration, Ini.zGeneration);
+	std::swap(zStoredGeneration, Ini.zStoredGeneration);
+	std::swap(zLayoutValid, Ini.zLayoutValid);
+	std::swap(zFilename, Ini.zFilename);
+	std::swap(zFileStamp, Ini.zFileStamp);
+	std::swap(zStoresSkipped, Ini.zStoresSkipped);
+	std::swap(zStoresPerformed, Ini.zStoresPerformed);
+	std::swap(zStoresIncremental, Ini.zStoresIncremental);
+	std::swap(zLoadTime, Ini.zLoadTime);
+	std::swap(zStoreTime, Ini.zStoreTime);
+	std::swap(zLoadAllocations, Ini.zLoadAllocations);
+	std::swap(zLazyBuffer, Ini.zLazyBuffer);
+	std::swap(zLazySize, Ini.zLazySize);
+	std::swap(zUseImage, Ini.zUseImage);
+	std::swap(zImage, Ini.zImage);
+	std::swap(zImageSize, Ini.zImageSize);
+	std::swap(zImageSections, Ini.zImageSections);
+	std::swap(zDataEncoding, Ini.zDataEncoding);
+	std::swap(zCompressData, Ini.zCompressData);
+	std::swap(zNames, Ini.zNames);
+	std::swap(zHandleSlots, Ini.zHandleSlots);
+	std::swap(zHandleCount, Ini.zHandleCount);
+	std::swap(zHandlesFrozen, Ini.zHandlesFrozen);
+}
+
+// Returns our section list with every section parsed, which is
+// what copies need to be made from
+NodeList *IniFile::ParsedRootList() const
+{
+	if (zLazyBuffer != NULL || zImage != NULL)
+		((IniFile *)this)->ParseAllSections();	// Still logically const
+	return zRootList;
+}
+
+// Returns a new reference to the (shared, never modified) empty section
+// list that empty IniFiles start out with, so they don't allocate anything
+NodeList *IniFile::AcquireEmptyRoot()
+{
+	static NodeList *empty = new NodeList();
+	if (empty == NULL)
+		throw IniFile::EInsufficientMemory();
+	empty->AcquireReference();
+	return empty;
+}
+
+// Makes sure our section list isn't shared with anybody else, so sections
+// may be added and modified. Section nodes found before this may be gone.
+void IniFile::MakeWritable()
+{
+	if (!zRootList->IsShared())
+		return;
+
+	// The section copies still share their keys with the original
+	NodeList *root = new NodeList(*zRootList);
+	if (root == NULL)
+		throw IniFile::EInsufficientMemory();
+	if (zRootList->ReleaseReference())
+		delete zRootList;	// Everybody else let go of it in the meantime
+	zRootList = root;
+	ResetHandles();
+}
+
+// Makes sure the keys of iSection (which must be in our own, writable
+// section list) aren't shared with anybody else
+void IniFile::MakeSectionWritable(IniNode *iSection)
+{
+	if (iSection == NULL || !iSection->zChildList->IsShared())
+		return;
+
+	NodeList *keys = new NodeList(*iSection->zChildList);
+	if (keys == NULL)
+		throw IniFile::EInsufficientMemory();
+	if (iSection->zChildList->ReleaseReference())
+		delete iSection->zChildList;
+	iSection->zChildList = keys;
+	ResetHandles();
+}
+
+// Finds or creates the given section, ready for modifying its keys
+IniNode *IniFile::WritableSection(const char *Section)
+{
+	MakeWritable();
+	IniNode *iSection = FindCreateSection(Section);
+	MakeSectionWritable(iSection);
+	return iSection;
+}
+
+bool IniFile::IsModified() const
+{
+	return zGeneration != zStoredGeneration;
+}
+
+// Records a modification of the given section (and key, if any)
+void IniFile::Touch(IniNode *iSection, IniNode *iKey)
+{
+	zGeneration++;
+	if (iSection != NULL)
+		iSection->zGeneration = zGeneration;
+	if (iKey != NULL)
+		iKey->zGeneration = zGeneration;
+}
+
+void IniFile::SetFilename(const char *Filename)
+{
+	if (Filename == zFilename)
+		return;
+
+	char *copy = NULL;
+	if (Filename != NULL)
+	{
+		copy = (char *)IniMalloc(strlen(Filename) + 1);
+		if (copy == NULL)
+			throw IniFile::EInsufficientMemory();
+		strcpy(copy, Filename);
+	}
+	IniFree(zFilename);
+	zFilename = copy;
+}
+
+// Returns true if Filename is the file we last loaded or stored, and
+// nobody has touched it on disk since
+bool IniFile::FileUnchanged(const char *Filename) const
+{
+	if (zFilename == NULL || strcmp(zFilename, Filename) != 0 || !zFileStamp.IsSet())
+		return false;
+
+	IniFileStamp stamp;
+	return stamp.Set(Filename) && stamp == zFileStamp;
+}
+
+// Remembers Filename as being in sync with our tree
+void IniFile::MarkStored(const char *Filename)
+{
+	SetFilename(Filename);
+	if (!zFileStamp.Set(Filename))
+		zFileStamp = IniFileStamp();
+	zStoredGeneration = zGeneration;
+}
 
 bool IniFile::Load(const char *Filename, const bool ThrowExceptionOnFileError)
 {
+	INI_STATS_TIMER((&zLoadTime, &zLoadAllocations));
+
+	// A valid compiled image saves us from parsing anything
+	if (zUseImage && zRootList->Count() == 0 && LoadImage(Filename))
+		return true;
+
 	FILE *stream;
 
 	// Try to open our file
@@ -275,294 +957,41 @@ bool IniFile::Load(const char *Filename, const bool ThrowExceptionOnFileError)
 			return false;
 	}
 
+	// Anything still pending refers to the old file's contents
+	ParseAllSections();
+	MakeWritable();
+
 	IniNode *iSection = NULL, *iKey = NULL;
 	char *line = NULL;
+
+	// Section byte ranges are only meaningful if the whole tree
+	// comes from this one file
+	bool freshLoad = zRootList->Count() == 0;
+	IniNode *iRangeSection = NULL;	// Section whose byte range is still open
+	off_t lineStart = 0;
+	zReadOffset = 0;
 	
 	try
 	{
-		while ( !feof(stream) && ReadLine(stream, &line) )
+		while ( !feof(stream) && (lineStart = zReadOffset, ReadLine(stream, &line)) )
 		{
 	
-			int start = 0;
-			int pos = 0;
-		
-			enum LineType { SectionLine, DataLine, Nonsense } lineType = Nonsense;
-		
-			enum ParseState {	Start,
-								LeadingWhitespace,
-								Name,
-								WhitespaceEmbeddedInOrTrailingAfterName,
-								PostEqualsWhitespace,
-								Value,
-								WhitespaceEmbeddedInOrTrailingAfterValue,
-								PostSectionStartWhitespace,
-								Section,
-								WhitespaceEmbeddedInOrTrailingAfterSection,
-								
-								DataLineFinished,
-								SectionLineFinished,
-
-								Error
-							} state = Start;
-									
-			
-			// Get rid of comments
-			while (line[pos] != 0 && line[pos] != ';')
-				pos++;
-			if (line[pos] == ';')	// We've found a comment
-				line[pos] = 0;		// Ignore the rest of the string
-			
-			pos = 0;
-	
-			// All these indices are with respect the line we just read into "line"
-			int nameStart = 0;		// Index of beginning of StringName string
-			int nameLen = 0;		// Length of StringName string
-			int sectionStart = 0;	// Index of beginning of SectionName string
-			int sectionLen = 0;		// Length of SectionName string
-			int valueStart = 0;		// Index of beginning of Data string
-			int valueLen = 0;		// Length of Data string
-			int whitespaceLen = 0;	// Used to track the length of strings of potentially
-									// embedded whitespace in the data string
-			
-			// Parse the string. This while loop is based off a
-			// finite state diagram I drew up for parsing Ini files.
-			while (state != Error
-				&& state != DataLineFinished
-				&& state != SectionLineFinished)
+			// Now we see what our parser came up with
+			char *name, *value;
+			switch (ParseLine(line, &name, &value))
 			{
-				char ch = line[pos];	// Handy alias
-				switch (state)
+				case DataLine:
 				{
-					case Start:
-						state = LeadingWhitespace;	// Just an alias; fall thru to LeadingWhitespace
-					
-					// Gets rid of leading whitespace
-					case LeadingWhitespace:
-						if ( IsWhitespace(ch) )
-							pos++;
-						else if ( IsNameStart(ch) )
-						{
-							nameStart = pos;
-							pos++;
-							nameLen++;
-							state = Name;
-						}
-						else if ( IsSectionStart(ch) )
-						{
-							pos++;
-							state = PostSectionStartWhitespace;
-						}
-						else
-							state = Error;						
-						break;
-						
-					// Reads in the name of a data item
-					case Name:
-						if ( IsNameChar(ch) )
-						{
-							pos++;
-							nameLen++;
-						}
-						else if ( IsEquals(ch) )
-						{
-							pos++;
-							state = PostEqualsWhitespace;
-						}
-						else if ( IsWhitespace(ch) )
-						{
-							whitespaceLen = 1;	// Reset embedded whitespace counter
-							pos++;
-							state = WhitespaceEmbeddedInOrTrailingAfterName;
-						}
-						else
-							state = Error;
-						break;
-						
-					// Handles (i.e. ignores) whitespace between the
-					// StringName and the "="
-					case WhitespaceEmbeddedInOrTrailingAfterName:
-						if ( IsNameChar(ch) )
-						{
-							// Whitespace was embedded, so count it as
-							// part of the name string
-							nameLen += whitespaceLen + 1;
-							pos++;
-							state = Name;												
-						}
-						else if ( IsWhitespace(ch) )
-						{
-							whitespaceLen++;
-							pos++;
-						}
-						else if ( IsEquals(ch) )
-						{
-							// Whitespace was trailing, so ignore it
-							pos++;
-							state = PostEqualsWhitespace;
-						}
-						else
-							state = Error;						
-						break;
-						
-					// Handles (i.e. ignores) whitespace between
-					// the "=" and the beggining of the value string
-					case PostEqualsWhitespace:
-						if ( IsWhitespace(ch) )
-							pos++;
-						else if ( IsValueChar(ch) )
-						{
-							valueStart = pos;
-							valueLen = 1;
-							pos++;
-							state = Value;
-						}
-						else
-							state = Error;
-						
-						break;
-					
-					// Handles the data string until the end of the line
-					// is found, or we hit some whitspace (at which point
-					// we aren't sure yet if it's embedded whitespace or
-					// extraneous whitespace)
-					case Value:
-						if ( IsValueChar(ch) )
-						{
-							pos++;
-							valueLen++;
-						}
-						else if ( IsWhitespace(ch) )
-						{
-							whitespaceLen = 1;	// Reset embedded whitespace counter
-							pos++;
-							state = WhitespaceEmbeddedInOrTrailingAfterValue;
-						}
-						else if ( IsEndOfLine(ch) )
-							state = DataLineFinished;
-						else
-							state = Error;
-						break;
-						
-					// Handles whitespace that is either embedded in the
-					// value string (in which case we want it to be part
-					// of the data), or completely after the data string
-					// (in which case it is ignored)
-					case WhitespaceEmbeddedInOrTrailingAfterValue:
-						if ( IsValueChar(ch) )
-						{
-							// Whitespace was embedded, so count it as
-							// part of the data string
-							valueLen += whitespaceLen + 1;
-							pos++;
-							state = Value;
-						}
-						else if ( IsWhitespace(ch) )
-						{
-							pos++;
-							whitespaceLen++;
-						}
-						else if ( IsEndOfLine(ch) )
-						{
-							// Whitespace was trailing, so ignore it
-							state = DataLineFinished;
-						}
-						else
-							state = Error;						
-						break;
-						
-					// Handles (i.e. ignores) whitespace between the "["
-					// starting a section and the first character
-					// of the section name
-					case PostSectionStartWhitespace:
-						if ( IsWhitespace(ch) )
-							pos++;
-						else if ( IsSectionChar(ch) )
-						{
-							sectionStart = pos;
-							sectionLen = 1;
-							pos++;
-							state = Section;
-						}
-						else
-							state = Error;
-						break;
-						
-					// Handles the section identifier
-					case Section:
-						if ( IsSectionChar(ch) )
-						{
-							pos++;
-							sectionLen++;
-						}
-						else if ( IsWhitespace(ch) )
-						{
-							whitespaceLen = 1;		// Reset embedded whitespace counter
-							pos++;
-							state = WhitespaceEmbeddedInOrTrailingAfterSection;
-						}
-						else if ( IsSectionEnd(ch) )
-							state = SectionLineFinished;
-						else
-							state = Error;				
-						break;
-						
-					case WhitespaceEmbeddedInOrTrailingAfterSection:
-						if ( IsSectionChar(ch) )
-						{
-							// Whitespace was embedded, so count it as
-							// part of the section string
-							sectionLen += whitespaceLen + 1;
-							pos++;
-							state = Section;
-						}
-						else if ( IsWhitespace(ch) )
-						{
-							whitespaceLen++;
-							pos++;
-						}
-						else if ( IsSectionEnd(ch) )
-							state = SectionLineFinished;
-						else
-							state = Error;
-						break;
-	
-					default:
-						// Some unexpected error
-						state = Error;
-						break;			
-				}		
-			}
-			
-			
-			// Now we see what our parser came up with
-			switch (state)
-			{
-				case DataLineFinished:
-				{
-					// If iSection is NULL, we haven't come across any sections
-					// yet, so this key doesn't belong to any section. Thus
-					// we'll just ignore it
-					if (iSection == NULL)
-					{
-						if (IniFile::DEBUG)
-							printf("IGNR:   \"%s\"\n", line);
+					// If iSection is NULL, we haven't come across any sections
+					// yet, so this key doesn't belong to any section. Thus
+					// we'll just ignore it
+					if (iSection == NULL)
+					{
+						if (IniFile::DEBUG)
+							printf("IGNR:   \"%s\"\n", line);
 						break;
 					}
 	
-					// Add NULL characters immediately after the characters
-					// that make up the string name and the characters that
-					// make up the data string in the line we just read and
-					// parsed. Since there's always at least an "=" between
-					// a string name and the data string, we don't have to
-					// worry about overwriting anything.  Plus, we don't have
-					// to alloc and copy any new strings, we just pass a pointer
-					// to the first character of the given string
-					char *name = &(line[nameStart]);
-					line[nameStart + nameLen] = 0;
-					char *value = &(line[valueStart]);
-					line[valueStart + valueLen] = 0;
-					
-	
 					// Get a pointer to the key
 					iKey = FindCreateKey(iSection, name);
 		
@@ -575,19 +1004,29 @@ bool IniFile::Load(const char *Filename, const bool ThrowExceptionOnFileError)
 					break;
 				}
 				
-				case SectionLineFinished:
+				case SectionLine:
 				{
-					// Add NULL characters immediately after the characters
-					// that make up the section name in the line we just read and
-					// parsed. That way, we don't have to alloc and copy a new
-					// string, we just pass a pointer to the first character of
-					// the section name string
-					char *name = line + sectionStart;
-					line[sectionStart + sectionLen] = 0;
+					// Close the byte range of the previous section
+					if (iRangeSection != NULL)
+						iRangeSection->zFileLength = lineStart - iRangeSection->zFileOffset;
+					iRangeSection = NULL;
 					
 					// Find (if it exists) or create (if it doesn't already exist)
-					// an IniNode object for the given section name.
-					iSection = FindCreateSection(name);
+					// an IniNode object for the given section name. A section
+					// that shows up twice doesn't occupy a single byte range.
+					iSection = FindSection(name);
+					if (iSection != NULL)
+					{
+						MakeSectionWritable(iSection);
+						iSection->zFileOffset = -1;
+						iSection->zFileLength = -1;
+					}
+					else
+					{
+						iSection = AddSection(name);
+						iSection->zFileOffset = lineStart;
+						iRangeSection = iSection;
+					}
 					
 					if (IniFile::DEBUG)
 						printf("SECT: [%s]\n", name);
@@ -595,7 +1034,7 @@ bool IniFile::Load(const char *Filename, const bool ThrowExceptionOnFileError)
 					break;
 				}
 					
-				case Error:
+				case Nonsense:
 				default:
 					if (IniFile::DEBUG)
 						printf("IGNR:   \"%s\"\n", line);
@@ -604,13 +1043,13 @@ bool IniFile::Load(const char *Filename, const bool ThrowExceptionOnFileError)
 		
 		
 			// Finally, we have to free the string alloc'd by ReadLine()
-			free(line);
+			IniFree(line);
 			line = NULL;
 		}
 	}
 	catch (...)
 	{
-		free(line);
+		IniFree(line);
 		line = NULL;
 		fclose(stream);
 		throw;
@@ -619,15 +1058,361 @@ bool IniFile::Load(const char *Filename, const bool ThrowExceptionOnFileError)
 	// Close our file
 	fclose(stream);
 
+	if (iRangeSection != NULL)
+		iRangeSection->zFileLength = zReadOffset - iRangeSection->zFileOffset;
+
+	if (freshLoad)
+	{
+		MarkStored(Filename);
+		zLayoutValid = true;
+		if (zUseImage)
+			StoreImage(Filename);
+	}
+	else
+	{
+		// We merged the file into what we already had, so the
+		// tree no longer matches anything on disk
+		SetFilename(Filename);
+		zLayoutValid = false;
+		Touch(NULL);
+	}
+
 	return true;
 }
 
-bool IniFile::Store(const char *Filename, const bool ThrowExceptionOnFileError)
+// Parses a single line (which must already have been read into line
+// and is modified in the process). For data lines, *name and *value are
+// set to point to the key name and value string; for section lines,
+// *name points to the section name. Both point into line itself.
+IniFile::LineType IniFile::ParseLine(char *line, char **name, char **value)
+{
+	int pos = 0;
+
+	enum ParseState {	Start,
+						LeadingWhitespace,
+						Name,
+						WhitespaceEmbeddedInOrTrailingAfterName,
+						PostEqualsWhitespace,
+						Value,
+						WhitespaceEmbeddedInOrTrailingAfterValue,
+						PostSectionStartWhitespace,
+						Section,
+						WhitespaceEmbeddedInOrTrailingAfterSection,
+						
+						DataLineFinished,
+						SectionLineFinished,
+
+						Error
+					} state = Start;
+							
+	
+	// Get rid of comments
+	while (line[pos] != 0 && line[pos] != ';')
+		pos++;
+	if (line[pos] == ';')	// We've found a comment
+		line[pos] = 0;		// Ignore the rest of the string
+	
+	pos = 0;
+	
+	// All these indices are with respect the line we just read into "line"
+	int nameStart = 0;		// Index of beginning of StringName string
+	int nameLen = 0;		// Length of StringName string
+	int sectionStart = 0;	// Index of beginning of SectionName string
+	int sectionLen = 0;		// Length of SectionName string
+	int valueStart = 0;		// Index of beginning of Data string
+	int valueLen = 0;		// Length of Data string
+	int whitespaceLen = 0;	// Used to track the length of strings of potentially
+							// embedded whitespace in the data string
+	
+	// Parse the string. This while loop is based off a
+	// finite state diagram I drew up for parsing Ini files.
+	while (state != Error
+		&& state != DataLineFinished
+		&& state != SectionLineFinished)
+	{
+		char ch = line[pos];	// Handy alias
+		switch (state)
+		{
+			case Start:
+				state = LeadingWhitespace;	// Just an alias
+				// Fall through
+			
+			// Gets rid of leading whitespace
+			case LeadingWhitespace:
+				if ( IsWhitespace(ch) )
+					pos++;
+				else if ( IsNameStart(ch) )
+				{
+					nameStart = pos;
+					pos++;
+					nameLen++;
+					state = Name;
+				}
+				else if ( IsSectionStart(ch) )
+				{
+					pos++;
+					state = PostSectionStartWhitespace;
+				}
+				else
+					state = Error;						
+				break;
+				
+			// Reads in the name of a data item
+			case Name:
+				if ( IsNameChar(ch) )
+				{
+					pos++;
+					nameLen++;
+				}
+				else if ( IsEquals(ch) )
+				{
+					pos++;
+					state = PostEqualsWhitespace;
+				}
+				else if ( IsWhitespace(ch) )
+				{
+					whitespaceLen = 1;	// Reset embedded whitespace counter
+					pos++;
+					state = WhitespaceEmbeddedInOrTrailingAfterName;
+				}
+				else
+					state = Error;
+				break;
+				
+			// Handles (i.e. ignores) whitespace between the
+			// StringName and the "="
+			case WhitespaceEmbeddedInOrTrailingAfterName:
+				if ( IsNameChar(ch) )
+				{
+					// Whitespace was embedded, so count it as
+					// part of the name string
+					nameLen += whitespaceLen + 1;
+					pos++;
+					state = Name;												
+				}
+				else if ( IsWhitespace(ch) )
+				{
+					whitespaceLen++;
+					pos++;
+				}
+				else if ( IsEquals(ch) )
+				{
+					// Whitespace was trailing, so ignore it
+					pos++;
+					state = PostEqualsWhitespace;
+				}
+				else
+					state = Error;						
+				break;
+				
+			// Handles (i.e. ignores) whitespace between
+			// the "=" and the beggining of the value string
+			case PostEqualsWhitespace:
+				if ( IsWhitespace(ch) )
+					pos++;
+				else if ( IsValueChar(ch) )
+				{
+					valueStart = pos;
+					valueLen = 1;
+					pos++;
+					state = Value;
+				}
+				else
+					state = Error;
+				
+				break;
+			
+			// Handles the data string until the end of the line
+			// is found, or we hit some whitspace (at which point
+			// we aren't sure yet if it's embedded whitespace or
+			// extraneous whitespace)
+			case Value:
+				if ( IsValueChar(ch) )
+				{
+					pos++;
+					valueLen++;
+				}
+				else if ( IsWhitespace(ch) )
+				{
+					whitespaceLen = 1;	// Reset embedded whitespace counter
+					pos++;
+					state = WhitespaceEmbeddedInOrTrailingAfterValue;
+				}
+				else if ( IsEndOfLine(ch) )
+					state = DataLineFinished;
+				else
+					state = Error;
+				break;
+				
+			// Handles whitespace that is either embedded in the
+			// value string (in which case we want it to be part
+			// of the data), or completely after the data string
+			// (in which case it is ignored)
+			case WhitespaceEmbeddedInOrTrailingAfterValue:
+				if ( IsValueChar(ch) )
+				{
+					// Whitespace was embedded, so count it as
+					// part of the data string
+					valueLen += whitespaceLen + 1;
+					pos++;
+					state = Value;
+				}
+				else if ( IsWhitespace(ch) )
+				{
+					pos++;
+					whitespaceLen++;
+				}
+				else if ( IsEndOfLine(ch) )
+				{
+					// Whitespace was trailing, so ignore it
+					state = DataLineFinished;
+				}
+				else
+					state = Error;						
+				break;
+				
+			// Handles (i.e. ignores) whitespace between the "["
+			// starting a section and the first character
+			// of the section name
+			case PostSectionStartWhitespace:
+				if ( IsWhitespace(ch) )
+					pos++;
+				else if ( IsSectionChar(ch) )
+				{
+					sectionStart = pos;
+					sectionLen = 1;
+					pos++;
+					state = Section;
+				}
+				else
+					state = Error;
+				break;
+				
+			// Handles the section identifier
+			case Section:
+				if ( IsSectionChar(ch) )
+				{
+					pos++;
+					sectionLen++;
+				}
+				else if ( IsWhitespace(ch) )
+				{
+					whitespaceLen = 1;		// Reset embedded whitespace counter
+					pos++;
+					state = WhitespaceEmbeddedInOrTrailingAfterSection;
+				}
+				else if ( IsSectionEnd(ch) )
+					state = SectionLineFinished;
+				else
+					state = Error;				
+				break;
+				
+			case WhitespaceEmbeddedInOrTrailingAfterSection:
+				if ( IsSectionChar(ch) )
+				{
+					// Whitespace was embedded, so count it as
+					// part of the section string
+					sectionLen += whitespaceLen + 1;
+					pos++;
+					state = Section;
+				}
+				else if ( IsWhitespace(ch) )
+				{
+					whitespaceLen++;
+					pos++;
+				}
+				else if ( IsSectionEnd(ch) )
+					state = SectionLineFinished;
+				else
+					state = Error;
+				break;
+	
+			default:
+				// Some unexpected error
+				state = Error;
+				break;			
+		}		
+	}
+
+
+	// Now we see what our parser came up with
+	switch (state)
+	{
+		case DataLineFinished:
+			// Add NULL characters immediately after the characters
+			// that make up the string name and the characters that
+			// make up the data string in the line we just read and
+			// parsed. Since there's always at least an "=" between
+			// a string name and the data string, we don't have to
+			// worry about overwriting anything.  Plus, we don't have
+			// to alloc and copy any new strings, we just pass a pointer
+			// to the first character of the given string
+			*name = &(line[nameStart]);
+			line[nameStart + nameLen] = 0;
+			*value = &(line[valueStart]);
+			line[valueStart + valueLen] = 0;
+			return DataLine;
+			
+		case SectionLineFinished:
+			// Same goes for the section name
+			*name = line + sectionStart;
+			line[sectionStart + sectionLen] = 0;
+			*value = NULL;
+			return SectionLine;
+			
+		case Error:
+		default:
+			return Nonsense;
+	}
+}
+
+// Copies len characters at start into the growable, NULL terminated
+// buffer *line of *size bytes
+static void CopyLine(const char *start, size_t len, char **line, size_t *size)
+{
+	if (len + 1 > *size)
+	{
+		char *str = (char *)IniRealloc(*line, len + 1);
+		if (str == NULL)
+			throw IniFile::EInsufficientMemory();
+		*line = str;
+		*size = len + 1;
+	}
+	memcpy(*line, start, len);
+	(*line)[len] = 0;
+}
+
+// Queues the given range of zLazyBuffer to be parsed into iSection
+static void AddPending(IniNode *iSection, off_t start, off_t end)
 {
+	if (start >= end)
+		return;
+
+	IniRange *range = (IniRange *)IniMalloc(sizeof(IniRange));
+	if (range == NULL)
+		throw IniFile::EInsufficientMemory();
+	range->zStart = start;
+	range->zEnd = end;
+	range->zNext = NULL;
+
+	IniRange **tail = &iSection->zPending;
+	while (*tail != NULL)
+		tail = &(*tail)->zNext;
+	*tail = range;
+}
+
+bool IniFile::LoadLazy(const char *Filename, const bool ThrowExceptionOnFileError)
+{
+	INI_STATS_TIMER((&zLoadTime, &zLoadAllocations));
+
+	// A valid compiled image beats scanning the text
+	if (zUseImage && zRootList->Count() == 0 && LoadImage(Filename))
+		return true;
+
 	FILE *stream;
 
-	// Create athe file
-	stream = fopen(Filename, "wt");
+	// Try to open our file
+	stream = fopen(Filename, "rt");
 	if ( stream == NULL )
 	{
 		if (ThrowExceptionOnFileError)
@@ -636,183 +1421,2149 @@ bool IniFile::Store(const char *Filename, const bool ThrowExceptionOnFileError)
 			return false;
 	}
 
-  IniNode *iSection, *iKey;
+	// Anything still pending refers to the old file's contents
+	try
+	{
+		ParseAllSections();
+		MakeWritable();
+	}
+	catch (...)
+	{
+		fclose(stream);
+		throw;
+	}
 
-  // Write our ini tree to disk
-  for (iSection = zRootList.zStart; iSection != NULL; iSection = iSection->zNext)
-  {
-    // Write our section
-	fwrite("[", 1, 1, stream);
-	fwrite(iSection->zName, strlen(iSection->zName), 1, stream);
-	fwrite("]\n", 2, 1, stream);
+	// Slurp in the whole file; the sections will be parsed out of it later
+	struct stat st;
+	if (fstat(fileno(stream), &st) != 0)
+	{
+		fclose(stream);
+		if (ThrowExceptionOnFileError)
+			throw IniFile::EFileError();
+		else
+			return false;
+	}
+	zLazyBuffer = (char *)IniMalloc(st.st_size + 1);
+	if (zLazyBuffer == NULL)
+	{
+		fclose(stream);
+		throw IniFile::EInsufficientMemory();
+	}
+	zLazySize = fread(zLazyBuffer, 1, st.st_size, stream);
+	fclose(stream);
 
-  	for (iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
-    {
-    	// Write our key and its value
-    	fwrite(iKey->zName, strlen(iKey->zName), 1, stream);
-    	fwrite("=", 1, 1, stream);
-    	fwrite(iKey->zStr, strlen(iKey->zStr), 1, stream);
-    	fwrite("\n", 1, 1, stream);
-    }
+	// Section byte ranges are only meaningful if the whole tree
+	// comes from this one file
+	bool freshLoad = zRootList->Count() == 0;
+	IniNode *iSection = NULL;
+	IniNode *iRangeSection = NULL;	// Section whose byte range is still open
+	off_t keysStart = 0;			// Where the current section's keys begin
+	char *line = NULL;
+	size_t lineSize = 0;
 
-    // Write a blank line for aesthetics
-    fwrite("\n", 1, 1, stream);
-  }
+	try
+	{
+		off_t pos = 0;
+		while (pos < zLazySize)
+		{
+			off_t end = pos;
+			while (end < zLazySize && !IsNewline(zLazyBuffer[end]))
+				end++;
 
-	// Close our file
-	fclose(stream);
+			// Only lines starting with a "[" can be section lines, so
+			// we don't bother running anything else through the parser
+			off_t first = pos;
+			while (first < end && IsWhitespace(zLazyBuffer[first]))
+				first++;
 
-  return true;
-}
+			char *name, *value;
+			if (first < end && IsSectionStart(zLazyBuffer[first]))
+			{
+				CopyLine(zLazyBuffer + pos, end - pos, &line, &lineSize);
+				if (ParseLine(line, &name, &value) == SectionLine)
+				{
+					// Hand the lines since the last section line over
+					// to that section, and close its byte range
+					if (iSection != NULL)
+						AddPending(iSection, keysStart, pos);
+					if (iRangeSection != NULL)
+						iRangeSection->zFileLength = pos - iRangeSection->zFileOffset;
+					iRangeSection = NULL;
 
-char inline IniFile::ReadChar(FILE *stream)
-{
-	// Read in a character, returning a newline if no
-	// character is actually read (i.e., eof)
-	char ch;
-	return fread(&ch, 1, 1, stream) == 1 ? ch : '\n';
-}
+					// Same as in Load(), but without parsing sections that
+					// were already pending
+					iSection = zRootList->FindNode(name);
+					if (iSection != NULL)
+					{
+						MakeSectionWritable(iSection);
+						iSection->zFileOffset = -1;
+						iSection->zFileLength = -1;
+					}
+					else
+					{
+						iSection = AddSection(name);
+						iSection->zFileOffset = pos;
+						iRangeSection = iSection;
+					}
+					keysStart = end + 1;
+				}
+			}
 
-// Reads the next line into the pointer pointed to by str
-bool IniFile::ReadLine(FILE *stream, char **string)
-{
+			pos = end + 1;
+		}
 
-	char *str = NULL;
-	int size = 0;
-	int pos = 0;
-	int nextSize = 64;	// Seem like a reasonable default length to me
-	char ch;
-	
-	for (ch = ReadChar(stream); ch != '\n' && ch != '\r'; ch = ReadChar(stream))
+		if (iSection != NULL)
+			AddPending(iSection, keysStart, zLazySize);
+		if (iRangeSection != NULL)
+			iRangeSection->zFileLength = zLazySize - iRangeSection->zFileOffset;
+	}
+	catch (...)
 	{
-		// If we've reached the end of our string, we need to
-		// double its size before moving on. 
-		if (pos == size)
-		{
-			str = (char *)realloc(str, nextSize);
-			if (str == NULL)
-				throw IniFile::EInsufficientMemory();
-			size = nextSize;
-			nextSize *= 2;
-		}
-		
-		str[pos] = ch;
-		pos++;
+		IniFree(line);
+		throw;
 	}
-	
-	if (size != 0)
+	IniFree(line);
+
+	if (freshLoad)
 	{
-		str[pos] = 0;
+		MarkStored(Filename);
+		zLayoutValid = true;
+		if (zUseImage)
+			StoreImage(Filename);
 	}
 	else
 	{
-		str = (char *)malloc(1);
-		if (str == NULL)
-			throw IniFile::EInsufficientMemory();
-		str[0] = 0;
-	}		
-	*string = str;
+		SetFilename(Filename);
+		zLayoutValid = false;
+		Touch(NULL);
+	}
+
 	return true;
-	
-		
 }
 
-IniNode* IniFile::FindSection(const char *Section) const
+// Parses the keys of a lazily loaded section
+void IniFile::ParseSection(IniNode *iSection)
 {
-	return zRootList.FindNode(Section);
-}
+	if (zImage != NULL)
+	{
+		CopyImageSection(iSection);
+		return;
+	}
 
-IniNode *IniFile::FindCreateSection(const char *Section)
-{
-	IniNode *iSection;
+	char *line = NULL;
+	size_t lineSize = 0;
 
-	// Find the section, creating it if it doesn't exist
-	if ((iSection = FindSection(Section)) == NULL)
-		iSection = AddSection(Section);
+	try
+	{
+		while (iSection->zPending != NULL)
+		{
+			IniRange *range = iSection->zPending;
+			off_t pos = range->zStart;
+			while (pos < range->zEnd)
+			{
+				off_t end = pos;
+				while (end < range->zEnd && !IsNewline(zLazyBuffer[end]))
+					end++;
 
-	return iSection;
-}
+				char *name, *value;
+				CopyLine(zLazyBuffer + pos, end - pos, &line, &lineSize);
+				if (ParseLine(line, &name, &value) == DataLine)
+					FindCreateKey(iSection, name)->SetStr(value);
 
-IniNode* IniFile::FindKey(const char *Section, const char *Key) const
-{
-	return FindKey(FindSection(Section), Key);
-}
+				pos = end + 1;
+			}
 
-IniNode* IniFile::FindKey(const IniNode* iSection, const char *Key) const
-{
-	if (iSection == NULL || iSection->zChildList == NULL)
-		return NULL;
-	else
-		return iSection->zChildList->FindNode(Key);
+			iSection->zPending = range->zNext;
+			IniFree(range);
+		}
+	}
+	catch (...)
+	{
+		IniFree(line);
+		throw;
+	}
+	IniFree(line);
 }
 
-IniNode *IniFile::FindCreateKey(char *Section, const char *Key)
+void IniFile::ParseAllSections()
 {
-	return FindCreateKey(FindSection(Section), Key);
+	if (zLazyBuffer == NULL && zImage == NULL)
+		return;
+
+	for (IniNode *iSection = zRootList->zStart; iSection != NULL; iSection = iSection->zNext)
+		ParseSection(iSection);
+	FreeLazyBuffer();
+	FreeImage();
 }
 
-IniNode *IniFile::FindCreateKey(IniNode *iSection, const char *Key)
+void IniFile::FreeLazyBuffer()
 {
-	// Check iSection
-	if (iSection == NULL)
-		return NULL;
+	IniFree(zLazyBuffer);
+	zLazyBuffer = NULL;
+	zLazySize = 0;
+}
+
+//-----------------------------------------------------------------------------
+// IniFile parallel loading
+//-----------------------------------------------------------------------------
+
+// Can be lowered at build time to push small files through the parallel
+// loader as well, which the fuzzer does
+#ifndef INIFILE_PARALLEL_MIN_SIZE
+#define INIFILE_PARALLEL_MIN_SIZE (1024 * 1024)
+#endif
+
+const off_t IniFile::kParallelMinSize = INIFILE_PARALLEL_MIN_SIZE;
+
+// A piece of a file being loaded by LoadParallel()
+struct IniShard {
+	const char *zData;		// The whole mapped file
+	off_t zStart, zEnd;		// Our part of it, starting with a section line
+	NodeList *zSections;	// What we've parsed out of it
+	bool zFailed;
+};
+
+struct IniShardJob {
+	IniFile *zIni;
+	IniShard *zShards;
+	int zCount;
+	int zNext;				// Next shard to be parsed
+};
+
+// Shards remember the pooled copies of the key names they came across
+// lately, so they don't all have to queue up at the pool for every key
+static const int kShardNameCacheSize = 256;
+
+bool IniFile::LoadParallel(const char *Filename, int Threads, const bool ThrowExceptionOnFileError)
+{
+	INI_STATS_TIMER((&zLoadTime, &zLoadAllocations));
+
+	if (Threads <= 0)
+		Threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	// A valid compiled image saves us from parsing anything
+	if (zUseImage && zRootList->Count() == 0 && LoadImage(Filename))
+		return true;
+
+	int fd = open(Filename, O_RDONLY);
+	if (fd < 0)
+	{
+		if (ThrowExceptionOnFileError)
+			throw IniFile::EFileError();
+		else
+			return false;
+	}
+
+	struct stat st;
+	void *data = MAP_FAILED;
+	if (Threads > 1 && fstat(fd, &st) == 0 && st.st_size >= kParallelMinSize)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return Load(Filename, ThrowExceptionOnFileError);
+	off_t size = st.st_size;
+
+	IniShard *shards = NULL;
+	int count = 0;
+	bool freshLoad = zRootList->Count() == 0;
+	try
+	{
+		// Anything still pending refers to the old file's contents
+		ParseAllSections();
+		MakeWritable();
+		NamePool();		// The shards share it
+
+		// Cut the file into a few more shards than we have threads, so
+		// they get spread evenly even if the sections aren't
+		int maxCount = Threads * 4;
+		shards = (IniShard *)IniCalloc(maxCount, sizeof(IniShard));
+		if (shards == NULL)
+			throw IniFile::EInsufficientMemory();
+		off_t start = 0;
+		while (start < size && count < maxCount)
+		{
+			off_t end = size;
+			if (count < maxCount - 1)
+			{
+				end = size / maxCount * (count + 1);
+				end = end <= start ? start + 1 : end;
+				end = FindShardStart((const char *)data, size, end);
+			}
+
+			shards[count].zData = (const char *)data;
+			shards[count].zStart = start;
+			shards[count].zEnd = end;
+			shards[count].zSections = new NodeList();
+			if (shards[count].zSections == NULL)
+				throw IniFile::EInsufficientMemory();
+			count++;
+			start = end;
+		}
+
+		// Parse the shards, with this thread pitching in as well
+		IniShardJob job = { this, shards, count, 0 };
+		pthread_t *threads = (pthread_t *)IniMalloc(Threads * sizeof(pthread_t));
+		int started = 0;
+		if (threads != NULL)
+		{
+			while (started < Threads - 1 && started < count - 1
+				&& pthread_create(&threads[started], NULL, ShardThread, &job) == 0)
+				started++;
+		}
+		ShardThread(&job);
+		for (int i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+		IniFree(threads);
+
+		for (int i = 0; i < count; i++)
+		{
+			if (shards[i].zFailed)
+				throw IniFile::EInsufficientMemory();
+		}
+
+		// Put it all together, in file order
+		for (int i = 0; i < count; i++)
+			SpliceShard(&shards[i]);
+	}
+	catch (...)
+	{
+		for (int i = 0; i < count; i++)
+			delete shards[i].zSections;
+		IniFree(shards);
+		munmap(data, size);
+		throw;
+	}
+
+	for (int i = 0; i < count; i++)
+		delete shards[i].zSections;
+	IniFree(shards);
+	munmap(data, size);
+
+	if (freshLoad)
+	{
+		MarkStored(Filename);
+		zLayoutValid = true;
+		if (zUseImage)
+			StoreImage(Filename);
+	}
+	else
+	{
+		// Same as in Load()
+		SetFilename(Filename);
+		zLayoutValid = false;
+		Touch(NULL);
+	}
+
+	return true;
+}
+
+// Returns where the first section line starting at or after Pos is (or
+// Size, if there's none). Shards have to start there, or they'd miss which
+// section their first keys belong to.
+off_t IniFile::FindShardStart(const char *Data, off_t Size, off_t Pos)
+{
+	// Start at the beginning of the next line, unless Pos already is
+	// at the beginning of one
+	while (Pos > 0 && Pos < Size && !IsNewline(Data[Pos - 1]))
+		Pos++;
+
+	char *line = NULL;
+	size_t lineSize = 0;
+	try
+	{
+		while (Pos < Size)
+		{
+			off_t end = Pos;
+			while (end < Size && !IsNewline(Data[end]))
+				end++;
+
+			// Only lines starting with a "[" can be section lines
+			off_t first = Pos;
+			while (first < end && IsWhitespace(Data[first]))
+				first++;
+			if (first < end && IsSectionStart(Data[first]))
+			{
+				char *name, *value;
+				CopyLine(Data + Pos, end - Pos, &line, &lineSize);
+				if (ParseLine(line, &name, &value) == SectionLine)
+					break;
+			}
+
+			Pos = end + 1;
+		}
+	}
+	catch (...)
+	{
+		IniFree(line);
+		throw;
+	}
+	IniFree(line);
+
+	return Pos < Size ? Pos : Size;
+}
+
+void *IniFile::ShardThread(void *Data)
+{
+	IniShardJob *job = (IniShardJob *)Data;
+	int i;
+	while ((i = __atomic_fetch_add(&job->zNext, 1, __ATOMIC_RELAXED)) < job->zCount)
+	{
+		try
+		{
+			job->zIni->ParseShard(&job->zShards[i]);
+		}
+		catch (...)
+		{
+			job->zShards[i].zFailed = true;
+		}
+	}
+	return NULL;
+}
+
+// Parses a shard into its own list of sections, the same way Load() would
+// have added them to an empty tree. Runs on several threads at once, so
+// this may not touch anything but the shard and the name pool.
+void IniFile::ParseShard(IniShard *Shard)
+{
+	const char *data = Shard->zData;
+	const char *names[kShardNameCacheSize];
+	memset(names, 0, sizeof names);
+
+	IniNode *iSection = NULL;
+	IniNode *iRangeSection = NULL;	// Section whose byte range is still open
+	char *line = NULL;
+	size_t lineSize = 0;
+
+	try
+	{
+		off_t pos = Shard->zStart;
+		while (pos < Shard->zEnd)
+		{
+			off_t end = pos;
+			while (end < Shard->zEnd && !IsNewline(data[end]))
+				end++;
+
+			char *name, *value;
+			CopyLine(data + pos, end - pos, &line, &lineSize);
+			switch (ParseLine(line, &name, &value))
+			{
+				case DataLine:
+				{
+					// Only the very first shard can have keys outside
+					// of any section, which Load() ignores as well
+					if (iSection == NULL)
+						break;
+
+					const char **cached = &names[HashName(name) % kShardNameCacheSize];
+					if (*cached == NULL || strcmp(*cached, name) != 0)
+						*cached = zNames->Intern(name);
+
+					IniNode *iKey = iSection->zChildList->FindInternedNode(*cached);
+					if (iKey == NULL)
+					{
+						iKey = new IniNode(NULL, value);
+						if (iKey == NULL)
+							throw IniFile::EInsufficientMemory();
+						iKey->SetInternedName(*cached);
+						iSection->zChildList->Add(iKey);
+					}
+					else
+						iKey->SetStr(value);
+					break;
+				}
+
+				case SectionLine:
+				{
+					if (iRangeSection != NULL)
+						iRangeSection->zFileLength = pos - iRangeSection->zFileOffset;
+					iRangeSection = NULL;
+
+					iSection = Shard->zSections->FindNode(name);
+					if (iSection != NULL)
+					{
+						iSection->zFileOffset = -1;
+						iSection->zFileLength = -1;
+					}
+					else
+					{
+						iSection = Shard->zSections->Add(name);
+						iSection->zFileOffset = pos;
+						iRangeSection = iSection;
+					}
+					break;
+				}
+
+				case Nonsense:
+				default:
+					break;
+			}
+
+			pos = end + 1;
+		}
+
+		if (iRangeSection != NULL)
+			iRangeSection->zFileLength = Shard->zEnd - iRangeSection->zFileOffset;
+	}
+	catch (...)
+	{
+		IniFree(line);
+		throw;
+	}
+	IniFree(line);
+}
+
+// Moves the sections of a parsed shard into our tree. Sections we already
+// have get the shard's keys merged into them, just like Load() does when
+// it comes across a section for the second time.
+void IniFile::SpliceShard(IniShard *Shard)
+{
+	IniNode *iShardSection;
+	while ((iShardSection = Shard->zSections->Remove()) != NULL)
+	{
+		iShardSection->zNext = NULL;
+		try
+		{
+			IniNode *iSection = FindSection(iShardSection->zName);
+			if (iSection == NULL)
+			{
+				zRootList->Add(iShardSection);
+				continue;
+			}
+
+			MakeSectionWritable(iSection);
+			iSection->zFileOffset = -1;
+			iSection->zFileLength = -1;
+
+			IniNode *iKey;
+			while ((iKey = iShardSection->zChildList->Remove()) != NULL)
+			{
+				iKey->zNext = NULL;
+				IniNode *iOld = iSection->zChildList->FindInternedNode(iKey->zName);
+				if (iOld == NULL)
+					iSection->zChildList->Add(iKey);
+				else
+				{
+					try
+					{
+						iOld->SetStr(iKey->zStr);
+					}
+					catch (...)
+					{
+						delete iKey;
+						throw;
+					}
+					delete iKey;
+				}
+			}
+		}
+		catch (...)
+		{
+			delete iShardSection;
+			throw;
+		}
+		delete iShardSection;
+	}
+}
+
+// Returns a malloc'd copy of Filename with "~" tacked on, the name a new
+// version of the file is written to before it replaces the old one
+static char *TempName(const char *Filename)
+{
+	char *name = (char *)IniMalloc(strlen(Filename) + 2);
+	if (name == NULL)
+		throw IniFile::EInsufficientMemory();
+	strcpy(name, Filename);
+	strcat(name, "~");
+	return name;
+}
+
+bool IniFile::Store(const char *Filename, const bool ThrowExceptionOnFileError)
+{
+	INI_STATS_TIMER((&zStoreTime));
+
+	// Nothing to do if the file on disk already holds our tree
+	bool sameFile = FileUnchanged(Filename);
+	if (sameFile && !IsModified())
+	{
+		zStoresSkipped++;
+		return true;
+	}
+
+	// Storing records where the sections end up
+	MakeWritable();
+
+	// If only a few sections changed, try patching just those
+	if (sameFile && zLayoutValid && StoreIncremental(Filename))
+	{
+		zStoresPerformed++;
+		zStoresIncremental++;
+		if (zUseImage)
+			StoreImage(Filename);
+		return true;
+	}
+
+	ParseAllSections();
+
+	// The file is written next to the old one and renamed over it, so a
+	// failed write leaves the old file as it was. A link is kept, and the
+	// file it points to replaced instead.
+	struct stat st;
+	bool exists = lstat(Filename, &st) == 0;
+	char *target = NULL;
+	if (exists && S_ISLNK(st.st_mode))
+	{
+		target = realpath(Filename, NULL);
+		exists = target != NULL && stat(target, &st) == 0;
+	}
+	const char *path = target != NULL ? target : Filename;
+	char *tempName;
+	try
+	{
+		tempName = TempName(path);
+	}
+	catch (...)
+	{
+		free(target);
+		throw;
+	}
+
+	// Create the file
+	FILE *stream = fopen(tempName, "wt");
+	bool ok = stream != NULL && (!exists || fchmod(fileno(stream), st.st_mode & 07777) == 0);
+
+	IniNode *iSection;
+	off_t offset = 0;
+
+	// Write our ini tree to disk, remembering where each section ended up
+	for (iSection = zRootList->zStart; ok && iSection != NULL; iSection = iSection->zNext)
+	{
+		size_t size = WriteSection(stream, iSection);
+		iSection->zFileOffset = offset;
+		iSection->zFileLength = size;
+		offset += size;
+	}
+
+	// Write errors stick to the stream until it's closed
+	if (stream != NULL)
+	{
+		ok = fflush(stream) == 0 && ferror(stream) == 0 && ok;
+		ok = fclose(stream) == 0 && ok;
+		ok = ok && rename(tempName, path) == 0;
+		if (!ok)
+			unlink(tempName);
+	}
+	IniFree(tempName);
+	free(target);
+
+	if (!ok)
+	{
+		// The offsets no longer describe whatever is on disk
+		zLayoutValid = false;
+		if (ThrowExceptionOnFileError)
+			throw IniFile::EFileError();
+		return false;
+	}
+
+	MarkStored(Filename);
+	zLayoutValid = true;
+	zStoresPerformed++;
+	if (zUseImage)
+		StoreImage(Filename);
+
+	return true;
+}
+
+// Returns the number of bytes WriteSection() will write for iSection
+size_t IniFile::SectionSize(const IniNode *iSection) const
+{
+	size_t size = strlen(iSection->zName) + 3;	// "[" name "]\n"
+	for (IniNode *iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+		size += strlen(iKey->zName) + strlen(iKey->zStr) + 2;	// name "=" value "\n"
+	return size + 1;	// Trailing blank line
+}
+
+// Writes the given section and its keys to stream, returning the
+// number of bytes written
+size_t IniFile::WriteSection(FILE *stream, const IniNode *iSection) const
+{
+	IniNode *iKey;
+
+    // Write our section
+	fwrite("[", 1, 1, stream);
+	fwrite(iSection->zName, strlen(iSection->zName), 1, stream);
+	fwrite("]\n", 2, 1, stream);
+
+  	for (iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+    {
+    	// Write our key and its value
+    	fwrite(iKey->zName, strlen(iKey->zName), 1, stream);
+    	fwrite("=", 1, 1, stream);
+    	fwrite(iKey->zStr, strlen(iKey->zStr), 1, stream);
+    	fwrite("\n", 1, 1, stream);
+    }
+
+    // Write a blank line for aesthetics
+    fwrite("\n", 1, 1, stream);
+
+	return SectionSize(iSection);
+}
+
+// Copies the bytes from Start up to End of source to stream
+static bool CopyRange(FILE *source, FILE *stream, off_t Start, off_t End)
+{
+	if (Start >= End)
+		return true;
+	if (fseeko(source, Start, SEEK_SET) != 0)
+		return false;
+
+	char buffer[65536];
+	for (off_t left = End - Start; left > 0; )
+	{
+		size_t length = left < (off_t)sizeof buffer ? (size_t)left : sizeof buffer;
+		if (fread(buffer, 1, length, source) != length
+			|| fwrite(buffer, 1, length, stream) != length)
+			return false;
+		left -= length;
+	}
+	return true;
+}
+
+// Writes out only the sections modified since the last Load() or Store();
+// everything else, sections still waiting to be parsed and comments
+// included, is copied over from the file as it is. The new file is written
+// next to the old one and then renamed over it, so the file is never seen
+// half written. Returns false, with the file left alone, if a modified
+// section isn't in the file as a single byte range or anything fails.
+bool IniFile::StoreIncremental(const char *Filename)
+{
+	IniNode *iSection;
+	off_t pos = 0;
+	for (iSection = zRootList->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		if (iSection->zGeneration <= zStoredGeneration)
+			continue;
+		if (iSection->zFileOffset < pos || iSection->zFileLength < 0)
+			return false;
+		pos = iSection->zFileOffset + iSection->zFileLength;
+	}
+
+	// A link would get replaced by the new file rather than point to it
+	struct stat st;
+	if (lstat(Filename, &st) != 0 || !S_ISREG(st.st_mode))
+		return false;
+	FILE *source = fopen(Filename, "rb");
+	if (source == NULL)
+		return false;
+
+	char *tempName = TempName(Filename);
+	FILE *stream = fopen(tempName, "wb");
+	bool ok = stream != NULL && fchmod(fileno(stream), st.st_mode & 07777) == 0;
+
+	pos = 0;
+	for (iSection = zRootList->zStart; ok && iSection != NULL; iSection = iSection->zNext)
+	{
+		if (iSection->zGeneration <= zStoredGeneration)
+			continue;
+		ok = CopyRange(source, stream, pos, iSection->zFileOffset);
+		if (ok)
+			WriteSection(stream, iSection);
+		pos = iSection->zFileOffset + iSection->zFileLength;
+	}
+	ok = ok && CopyRange(source, stream, pos, zFileStamp.zSize);
+	fclose(source);
+
+	// Write errors stick to the stream until it's closed
+	if (stream != NULL)
+	{
+		ok = fflush(stream) == 0 && ferror(stream) == 0 && ok;
+		ok = fclose(stream) == 0 && ok;
+		ok = ok && rename(tempName, Filename) == 0;
+		if (!ok)
+			unlink(tempName);
+	}
+	IniFree(tempName);
+	if (!ok)
+		return false;
+
+	// The sections behind a modified one moved along with its end
+	off_t shift = 0;
+	for (iSection = zRootList->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		if (iSection->zFileOffset < 0)
+			continue;
+		iSection->zFileOffset += shift;
+		if (iSection->zGeneration > zStoredGeneration)
+		{
+			off_t size = SectionSize(iSection);
+			shift += size - iSection->zFileLength;
+			iSection->zFileLength = size;
+		}
+	}
+
+	MarkStored(Filename);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// IniFile compiled images
+//-----------------------------------------------------------------------------
+//	An image is laid out as follows, all integers in host byte order (the
+//	magic number doubles as a byte order mark):
+//
+//		ImageHeader
+//		ImageSection[sectionCount]	Sections in file order
+//		ImageKey[keyCount]			Keys, grouped by section, in file order
+//		uint32_t[sectionCount]		Section indices, sorted by section name
+//		char[poolSize]				NULL terminated names and values
+//
+//	Names and values are given as offsets into the string pool.
+
+const char *IniFile::kImageSuffix = ".image";
+
+static const uint32_t kImageMagic = ('I' << 24) | ('N' << 16) | ('I' << 8) | 'i';
+static const uint32_t kImageVersion = 2;
+
+struct ImageHeader {
+	uint32_t zMagic;
+	uint32_t zVersion;
+	int64_t zSourceSize;	// Size, modification time (in nanoseconds) and
+	int64_t zSourceTime;	// inode of the ini file the image was compiled
+	uint64_t zSourceInode;	// from
+	uint32_t zSectionCount;
+	uint32_t zKeyCount;
+	uint32_t zPoolSize;
+	uint32_t zReserved;
+};
+
+struct ImageSection {
+	int64_t zFileOffset;	// IniNode::zFileOffset and zFileLength
+	int64_t zFileLength;
+	uint32_t zName;
+	uint32_t zFirstKey;
+	uint32_t zKeyCount;
+	uint32_t zReserved;
+};
+
+struct ImageKey {
+	uint32_t zName;
+	uint32_t zValue;
+};
+
+// Returns a malloc'd copy of Filename with kImageSuffix tacked on
+static char *ImageName(const char *Filename)
+{
+	char *name = (char *)IniMalloc(strlen(Filename) + strlen(IniFile::kImageSuffix) + 1);
+	if (name == NULL)
+		throw IniFile::EInsufficientMemory();
+	strcpy(name, Filename);
+	strcat(name, IniFile::kImageSuffix);
+	return name;
+}
+
+// Maps the image of Filename and sets up our (empty) tree to pull its
+// sections out of it. Returns false if there's no usable image.
+bool IniFile::LoadImage(const char *Filename)
+{
+	ParseAllSections();		// Drops whatever an empty tree may still hold on to
+
+	IniFileStamp source;
+	if (!source.Set(Filename))
+		return false;
+
+	char *name = ImageName(Filename);
+	int fd = open(name, O_RDONLY);
+	IniFree(name);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void *image = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ImageHeader))
+		image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+		return false;
+
+	// Make sure the image is current and sane before trusting anything in it
+	const ImageHeader *header = (const ImageHeader *)image;
+	size_t size = st.st_size;
+	bool valid = header->zMagic == kImageMagic
+		&& header->zVersion == kImageVersion
+		&& header->zSourceSize == source.zSize
+		&& header->zSourceTime == source.zTime
+		&& header->zSourceInode == (uint64_t)source.zInode;
+	size_t tablesSize = 0;
+	if (valid)
+	{
+		tablesSize = sizeof(ImageHeader)
+			+ (size_t)header->zSectionCount * (sizeof(ImageSection) + sizeof(uint32_t))
+			+ (size_t)header->zKeyCount * sizeof(ImageKey);
+		valid = header->zPoolSize > 0 && tablesSize + header->zPoolSize == size;
+	}
+	const ImageSection *sections = (const ImageSection *)(header + 1);
+	const ImageKey *keys = (const ImageKey *)(sections + (valid ? header->zSectionCount : 0));
+	const uint32_t *sorted = (const uint32_t *)(keys + (valid ? header->zKeyCount : 0));
+	const char *pool = (const char *)image + tablesSize;
+	if (valid)
+		valid = pool[header->zPoolSize - 1] == 0;
+	for (uint32_t i = 0; valid && i < header->zSectionCount; i++)
+	{
+		valid = sections[i].zName < header->zPoolSize
+			&& sorted[i] < header->zSectionCount
+			&& sections[i].zFirstKey <= header->zKeyCount
+			&& sections[i].zKeyCount <= header->zKeyCount - sections[i].zFirstKey;
+	}
+	for (uint32_t i = 0; valid && i < header->zKeyCount; i++)
+		valid = keys[i].zName < header->zPoolSize && keys[i].zValue < header->zPoolSize;
+	if (!valid)
+	{
+		munmap(image, size);
+		return false;
+	}
+
+	zImage = image;
+	zImageSize = size;
+	try
+	{
+		zImageSections = (IniNode **)IniMalloc((header->zSectionCount + 1) * sizeof(IniNode *));
+		if (zImageSections == NULL)
+			throw IniFile::EInsufficientMemory();
+
+		// Create all the sections up front, leaving their keys in the image
+		for (uint32_t i = 0; i < header->zSectionCount; i++)
+		{
+			IniNode *iSection = AddSection(pool + sections[i].zName);
+			iSection->zFileOffset = sections[i].zFileOffset;
+			iSection->zFileLength = sections[i].zFileLength;
+			AddPending(iSection, sections[i].zFirstKey,
+				sections[i].zFirstKey + sections[i].zKeyCount);
+			zImageSections[i] = iSection;
+		}
+	}
+	catch (...)
+	{
+		Clear();
+		throw;
+	}
+
+	MarkStored(Filename);
+	zLayoutValid = true;
+	return true;
+}
+
+// Copies the keys of iSection out of the image
+void IniFile::CopyImageSection(IniNode *iSection)
+{
+	const ImageHeader *header = (const ImageHeader *)zImage;
+	const ImageKey *keys = (const ImageKey *)((const ImageSection *)(header + 1)
+		+ header->zSectionCount);
+	const char *pool = (const char *)zImage + zImageSize - header->zPoolSize;
+
+	while (iSection->zPending != NULL)
+	{
+		IniRange *range = iSection->zPending;
+		for (off_t i = range->zStart; i < range->zEnd; i++)
+		{
+			// Keys in an image are unique already
+			IniNode *iKey = AddKey(iSection, pool + keys[i].zName);
+			iKey->SetStr(pool + keys[i].zValue);
+		}
+
+		iSection->zPending = range->zNext;
+		IniFree(range);
+	}
+}
+
+// Binary searches the image for the given section
+IniNode *IniFile::FindImageSection(const char *Section) const
+{
+	const ImageHeader *header = (const ImageHeader *)zImage;
+	const ImageSection *sections = (const ImageSection *)(header + 1);
+	const uint32_t *sorted = (const uint32_t *)((const ImageKey *)(sections
+		+ header->zSectionCount) + header->zKeyCount);
+	const char *pool = (const char *)zImage + zImageSize - header->zPoolSize;
+
+	uint32_t low = 0, high = header->zSectionCount;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		int cmp = strcmp(Section, pool + sections[sorted[middle]].zName);
+		if (cmp == 0)
+			return zImageSections[sorted[middle]];
+		else if (cmp < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	return NULL;
+}
+
+void IniFile::FreeImage()
+{
+	if (zImage != NULL)
+		munmap(zImage, zImageSize);
+	zImage = NULL;
+	zImageSize = 0;
+	IniFree(zImageSections);
+	zImageSections = NULL;
+}
+
+struct ImageSortEntry {
+	const char *zName;
+	uint32_t zIndex;
+};
+
+static int CompareImageSortEntries(const void *a, const void *b)
+{
+	return strcmp(((const ImageSortEntry *)a)->zName, ((const ImageSortEntry *)b)->zName);
+}
+
+// Compiles our tree into an image next to Filename, which must be in sync
+// with the tree. This is only a cache, so failing to write it isn't an error.
+void IniFile::StoreImage(const char *Filename)
+{
+	ParseAllSections();
+
+	IniFileStamp source;
+	if (!source.Set(Filename))
+		return;
+
+	// Size everything up
+	ImageHeader header;
+	memset(&header, 0, sizeof header);
+	header.zMagic = kImageMagic;
+	header.zVersion = kImageVersion;
+	header.zSourceSize = source.zSize;
+	header.zSourceTime = source.zTime;
+	header.zSourceInode = source.zInode;
+
+	size_t poolSize = 1;	// Keep offset 0 for the empty string
+	IniNode *iSection, *iKey;
+	for (iSection = zRootList->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		header.zSectionCount++;
+		poolSize += strlen(iSection->zName) + 1;
+		for (iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+		{
+			header.zKeyCount++;
+			poolSize += strlen(iKey->zName) + strlen(iKey->zStr) + 2;
+		}
+	}
+	if (poolSize > 0xFFFFFFFFUL)
+		return;
+	header.zPoolSize = poolSize;
+
+	size_t size = sizeof(ImageHeader)
+		+ (size_t)header.zSectionCount * (sizeof(ImageSection) + sizeof(uint32_t))
+		+ (size_t)header.zKeyCount * sizeof(ImageKey) + poolSize;
+	char *image = (char *)IniMalloc(size);
+	ImageSortEntry *sortEntries = (ImageSortEntry *)IniMalloc(
+		(header.zSectionCount + 1) * sizeof(ImageSortEntry));
+	if (image == NULL || sortEntries == NULL)
+	{
+		IniFree(image);
+		IniFree(sortEntries);
+		throw IniFile::EInsufficientMemory();
+	}
+
+	// Fill in the tables and the string pool
+	memcpy(image, &header, sizeof header);
+	ImageSection *sections = (ImageSection *)(image + sizeof(ImageHeader));
+	ImageKey *keys = (ImageKey *)(sections + header.zSectionCount);
+	uint32_t *sorted = (uint32_t *)(keys + header.zKeyCount);
+	char *pool = (char *)(sorted + header.zSectionCount);
+	uint32_t poolPos = 0;
+	pool[poolPos++] = 0;
+
+	uint32_t sectionIndex = 0, keyIndex = 0;
+	for (iSection = zRootList->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		ImageSection &section = sections[sectionIndex];
+		section.zFileOffset = iSection->zFileOffset;
+		section.zFileLength = iSection->zFileLength;
+		section.zName = poolPos;
+		section.zFirstKey = keyIndex;
+		section.zKeyCount = 0;
+		section.zReserved = 0;
+		strcpy(pool + poolPos, iSection->zName);
+		poolPos += strlen(iSection->zName) + 1;
+
+		for (iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+		{
+			keys[keyIndex].zName = poolPos;
+			strcpy(pool + poolPos, iKey->zName);
+			poolPos += strlen(iKey->zName) + 1;
+			keys[keyIndex].zValue = poolPos;
+			strcpy(pool + poolPos, iKey->zStr);
+			poolPos += strlen(iKey->zStr) + 1;
+			keyIndex++;
+			section.zKeyCount++;
+		}
+
+		sortEntries[sectionIndex].zName = iSection->zName;
+		sortEntries[sectionIndex].zIndex = sectionIndex;
+		sectionIndex++;
+	}
+
+	qsort(sortEntries, header.zSectionCount, sizeof(ImageSortEntry), CompareImageSortEntries);
+	for (uint32_t i = 0; i < header.zSectionCount; i++)
+		sorted[i] = sortEntries[i].zIndex;
+	IniFree(sortEntries);
+
+	// Write it to a temporary file first, so nobody ever maps half an image
+	char *name = ImageName(Filename);
+	char *tempName;
+	try
+	{
+		tempName = TempName(name);
+	}
+	catch (...)
+	{
+		IniFree(name);
+		IniFree(image);
+		throw;
+	}
+
+	FILE *stream = fopen(tempName, "wb");
+	if (stream != NULL)
+	{
+		bool written = fwrite(image, size, 1, stream) == 1;
+		if (fclose(stream) == 0 && written)
+			rename(tempName, name);
+		else
+			unlink(tempName);
+	}
+
+	IniFree(tempName);
+	IniFree(name);
+	IniFree(image);
+}
+
+char inline IniFile::ReadChar(FILE *stream)
+{
+	// Read in a character, returning a newline if no
+	// character is actually read (i.e., eof)
+	char ch;
+	if (fread(&ch, 1, 1, stream) != 1)
+		return '\n';
+	zReadOffset++;
+	return ch;
+}
+
+// Reads the next line into the pointer pointed to by str
+bool IniFile::ReadLine(FILE *stream, char **string)
+{
+
+	char *str = NULL;
+	size_t size = 0;
+	size_t pos = 0;
+	size_t nextSize = 64;	// Seem like a reasonable default length to me
+	char ch;
+	
+	for (ch = ReadChar(stream); ch != '\n' && ch != '\r'; ch = ReadChar(stream))
+	{
+		// If we've reached the end of our string (leaving room for
+		// the terminating NULL), we need to double its size before
+		// moving on. 
+		if (pos + 1 >= size)
+		{
+			str = (char *)IniRealloc(str, nextSize);
+			if (str == NULL)
+				throw IniFile::EInsufficientMemory();
+			size = nextSize;
+			nextSize *= 2;
+		}
+		
+		str[pos] = ch;
+		pos++;
+	}
+	
+	if (size != 0)
+	{
+		str[pos] = 0;
+	}
+	else
+	{
+		str = (char *)IniMalloc(1);
+		if (str == NULL)
+			throw IniFile::EInsufficientMemory();
+		str[0] = 0;
+	}		
+	*string = str;
+	return true;
+	
+		
+}
+
+IniNode* IniFile::FindSection(const char *Section) const
+{
+	IniNode *iSection = NULL;
+	if (zImage != NULL)
+		iSection = FindImageSection(Section);
+	if (iSection == NULL)
+		iSection = zRootList->FindNode(Section);
+
+	// Sections of a lazily loaded file get parsed on first access
+	if (iSection != NULL && iSection->zPending != NULL)
+		((IniFile *)this)->ParseSection(iSection);	// Still logically const
+
+	return iSection;
+}
+
+IniNode *IniFile::FindCreateSection(const char *Section)
+{
+	IniNode *iSection;
+
+	// Find the section, creating it if it doesn't exist
+	if ((iSection = FindSection(Section)) == NULL)
+		iSection = AddSection(Section);
+
+	return iSection;
+}
+
+IniNode* IniFile::FindKey(const char *Section, const char *Key) const
+{
+	return FindKey(FindSection(Section), Key);
+}
+
+IniNode* IniFile::FindKey(const IniNode* iSection, const char *Key) const
+{
+	if (iSection == NULL || iSection->zChildList == NULL)
+		return NULL;
+	else
+		return iSection->zChildList->FindNode(Key);
+}
+
+IniNode *IniFile::FindCreateKey(char *Section, const char *Key)
+{
+	return FindCreateKey(FindSection(Section), Key);
+}
+
+IniNode *IniFile::FindCreateKey(IniNode *iSection, const char *Key)
+{
+	// Check iSection
+	if (iSection == NULL)
+		return NULL;
 
 	IniNode *iKey;
 
-	// Find the key, creating it if it doesn't exist
-	if ((iKey = FindKey(iSection, Key)) == NULL)
-		iKey = AddKey(iSection, Key);
+	// Find the key, creating it if it doesn't exist. All our key names
+	// are pooled, so once Key is, pointers are all we need to compare.
+	Key = InternName(Key);
+	if ((iKey = iSection->zChildList->FindInternedNode(Key)) == NULL)
+		iKey = AddKey(iSection, Key);
+
+	return iKey;
+}
+
+const char *IniFile::InternName(const char *Key)
+{
+	return NamePool()->Intern(Key);
+}
+
+// Returns our name pool, creating it the first time
+IniNamePool *IniFile::NamePool()
+{
+	if (zNames == NULL)
+	{
+		zNames = new IniNamePool();
+		if (zNames == NULL)
+			throw IniFile::EInsufficientMemory();
+	}
+	return zNames;
+}
+
+IniNode *IniFile::AddSection(const char *Section)
+{
+	// Add the a new section node
+	MakeWritable();
+	return zRootList->Add(Section);
+}
+
+IniNode *IniFile::AddKey(IniNode *iSection, const char *Key)
+{
+	// If we're not given a section, bail. Otherwise, add the
+	// new key node
+	if (iSection == NULL || iSection->zChildList == NULL)
+		return NULL;
+
+	IniNode *iKey = new IniNode(NULL, "");
+	if (iKey == NULL)
+		throw IniFile::EInsufficientMemory();
+	iKey->SetInternedName(InternName(Key));
+	iSection->zChildList->Add(iKey);
+	return iKey;
+}
+
+void IniFile::WriteString(const char *Section, const char *Key, const char *Val)
+{
+	IniNode *iSection, *iKey;
+
+	// Find the section, creating it if it doesn't exist
+	iSection = WritableSection(Section);
+
+	// Find the key, creating it if it doesn't exist
+	if ((iKey = FindKey(iSection, Key)) == NULL)
+	{
+		iKey = AddKey(iSection, Key);
+		iKey->SetStr(Val);
+		Touch(iSection, iKey);
+	}
+	else
+		SetValue(iSection, iKey, Val);
+}
+
+// Sets the value of an existing key
+void IniFile::SetValue(IniNode *iSection, IniNode *iKey, const char *Val)
+{
+	if (Val != NULL && iKey->zStr != NULL && strcmp(iKey->zStr, Val) == 0)
+		return;		// Same value, so don't mark anything as modified
+
+	iKey->SetStr(Val);
+	Touch(iSection, iKey);
+}
+
+void IniFile::WriteInt(const char *Section, const char *Key, const int Val)
+{
+	char str[40];
+	sprintf(str, "%d", Val);
+	WriteString(Section, Key, str);
+}
+
+void IniFile::WriteBool(const char *Section, const char *Key, const bool Val)
+{
+	WriteInt(Section, Key, Val);
+}
+
+void IniFile::WriteFloat(const char *Section, const char *Key, const float Val)
+{
+	char str[40];
+	sprintf(str, "%f", Val);
+	WriteString(Section, Key, str);
+}
+
+//-----------------------------------------------------------------------------
+// Versioned binary data encodings
+//-----------------------------------------------------------------------------
+
+// The chars of the legacy 6-bit encoding (see Binary8ToChar6()) and of Z85
+static const char kData64Chars[] =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+static const char kZ85Chars[] =
+	"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.-:+=^!/*?&<>()[]{}@%$#";
+
+// Reverse lookup tables for both; chars that aren't part of an encoding
+// decode as 0, which keeps damaged data from throwing us off
+struct DataDecodeTables {
+	unsigned char z64[256];
+	unsigned char z85[256];
+	DataDecodeTables()
+	{
+		memset(z64, 0, sizeof z64);
+		memset(z85, 0, sizeof z85);
+		for (int i = 0; i < 64; i++)
+			z64[(unsigned char)kData64Chars[i]] = i;
+		for (int i = 0; i < 85; i++)
+			z85[(unsigned char)kZ85Chars[i]] = i;
+	}
+};
+static const DataDecodeTables kDataDecode;
+
+static const char kVersionedDataTag[] = "!1";	// Can't start legacy data
+static const size_t kVersionedDataHeader = 4;	// Tag, encoding, compression
+static const size_t kMaxVarintSize = 10;		// Enough for 64 bits
+
+// Both encodings turn blocks of bytes into blocks of chars: Base64 3 into
+// 4, Z85 4 (taken as a big endian number) into 5
+static size_t BlockBytes(char encoding) { return encoding == 'z' ? 4 : 3; }
+static size_t BlockChars(char encoding) { return encoding == 'z' ? 5 : 4; }
+
+static void EncodeDataBlock(char encoding, const unsigned char *in, char *out)
+{
+	if (encoding == 'z')
+	{
+		uint32_t value = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16)
+			| ((uint32_t)in[2] << 8) | in[3];
+		for (int i = 4; i >= 0; i--)
+		{
+			out[i] = kZ85Chars[value % 85];
+			value /= 85;
+		}
+	}
+	else
+	{
+		out[0] = kData64Chars[in[0] >> 2];
+		out[1] = kData64Chars[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+		out[2] = kData64Chars[((in[1] & 0x0F) << 2) | (in[2] >> 6)];
+		out[3] = kData64Chars[in[2] & 0x3F];
+	}
+}
+
+static void DecodeDataBlock(char encoding, const char *in, unsigned char *out)
+{
+	if (encoding == 'z')
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < 5; i++)
+			value = value * 85 + kDataDecode.z85[(unsigned char)in[i]];
+		out[0] = value >> 24;
+		out[1] = value >> 16;
+		out[2] = value >> 8;
+		out[3] = value;
+	}
+	else
+	{
+		const unsigned char *values = kDataDecode.z64;
+		unsigned char a = values[(unsigned char)in[0]], b = values[(unsigned char)in[1]],
+			c = values[(unsigned char)in[2]], d = values[(unsigned char)in[3]];
+		out[0] = (a << 2) | (b >> 4);
+		out[1] = (b << 4) | (c >> 2);
+		out[2] = (c << 6) | d;
+	}
+}
+
+// Encodes Prefix followed by Data, padding the last block with zeros.
+// Returns the number of chars written to Out.
+static size_t EncodeDataText(char encoding, const unsigned char *Prefix, size_t PrefixSize,
+	const unsigned char *Data, size_t Size, char *Out)
+{
+	const size_t blockBytes = BlockBytes(encoding), blockChars = BlockChars(encoding);
+	char *out = Out;
 
-	return iKey;
+	// The prefix and the first few bytes of data, up to a block boundary
+	unsigned char head[kMaxVarintSize + 4];
+	size_t headSize = PrefixSize;
+	memcpy(head, Prefix, PrefixSize);
+	while (headSize % blockBytes != 0 && Size > 0)
+	{
+		head[headSize++] = *Data++;
+		Size--;
+	}
+	while (headSize % blockBytes != 0)
+		head[headSize++] = 0;
+	for (size_t i = 0; i < headSize; i += blockBytes, out += blockChars)
+		EncodeDataBlock(encoding, head + i, out);
+
+	// The rest straight out of Data
+	for (; Size >= blockBytes; Size -= blockBytes, Data += blockBytes, out += blockChars)
+		EncodeDataBlock(encoding, Data, out);
+	if (Size > 0)
+	{
+		unsigned char tail[4] = { 0, 0, 0, 0 };
+		memcpy(tail, Data, Size);
+		EncodeDataBlock(encoding, tail, out);
+		out += blockChars;
+	}
+	return out - Out;
 }
 
-IniNode *IniFile::AddSection(const char *Section)
+// Decodes Text, skipping the first Skip bytes of the result and storing
+// (at most) the following DestSize ones. Returns how many were stored.
+static size_t DecodeDataText(char encoding, const char *Text, size_t TextSize,
+	size_t Skip, unsigned char *Dest, size_t DestSize)
 {
-	// Add the a new section node
-	return zRootList.Add(Section);
+	const size_t blockBytes = BlockBytes(encoding), blockChars = BlockChars(encoding);
+	size_t blocks = TextSize / blockChars;	// A partial block at the end is ignored
+	size_t first = Skip / blockBytes;
+	size_t stored = 0;
+	for (size_t i = first; i < blocks && stored < DestSize; i++)
+	{
+		size_t start = i * blockBytes;		// Position of this block in the result
+		size_t offset = start < Skip ? Skip - start : 0;
+		size_t count = blockBytes - offset;
+		if (count > DestSize - stored)
+			count = DestSize - stored;
+
+		if (count == blockBytes)
+			DecodeDataBlock(encoding, Text + i * blockChars, Dest + stored);
+		else
+		{
+			// Only part of this block is wanted
+			unsigned char block[4];
+			DecodeDataBlock(encoding, Text + i * blockChars, block);
+			memcpy(Dest + stored, block + offset, count);
+		}
+		stored += count;
+	}
+	return stored;
 }
 
-IniNode *IniFile::AddKey(IniNode *iSection, const char *Key)
+static size_t EncodeVarint(uint64_t Value, unsigned char *Out)
 {
-	// If we're not given a section, bail. Otherwise, add the
-	// new key node
-	if (iSection == NULL || iSection->zChildList == NULL)
-		return NULL;
+	size_t size = 0;
+	do
+	{
+		Out[size] = Value & 0x7F;
+		Value >>= 7;
+		if (Value != 0)
+			Out[size] |= 0x80;
+		size++;
+	} while (Value != 0);
+	return size;
+}
+
+// Returns the number of bytes the varint took up, 0 if it's broken
+static size_t DecodeVarint(const unsigned char *In, size_t Size, uint64_t *Value)
+{
+	*Value = 0;
+	for (size_t i = 0; i < Size && i < kMaxVarintSize; i++)
+	{
+		*Value |= (uint64_t)(In[i] & 0x7F) << (7 * i);
+		if ((In[i] & 0x80) == 0)
+			return i + 1;
+	}
+	return 0;
+}
+
+static bool IsVersionedData(const char *Text, size_t Size)
+{
+	return Size >= kVersionedDataHeader && Text[0] == kVersionedDataTag[0]
+		&& Text[1] == kVersionedDataTag[1] && (Text[2] == 'b' || Text[2] == 'z')
+		&& (Text[3] == '-' || Text[3] == 'd');
+}
+
+// Reads the size stored in versioned data. Returns the number of bytes
+// the size itself takes up, 0 if the data is broken.
+static size_t DecodeVersionedSize(const char *Text, size_t Size, uint64_t *Value)
+{
+	unsigned char header[kMaxVarintSize];
+	size_t got = DecodeDataText(Text[2], Text + kVersionedDataHeader,
+		Size - kVersionedDataHeader, 0, header, sizeof header);
+	return DecodeVarint(header, got, Value);
+}
+
+void IniFile::SetDataEncoding(DataEncoding Encoding, bool Compress)
+{
+	zDataEncoding = Encoding;
+	zCompressData = Compress;
+}
+
+// Stores Data in iKey in one of the versioned encodings
+void IniFile::WriteVersionedData(IniNode *iKey, const void *Data, const size_t Size)
+{
+	char encoding = zDataEncoding == Z85Data ? 'z' : 'b';
+	char compression = '-';
+	const unsigned char *body = (const unsigned char *)Data;
+	size_t bodySize = Size;
+	unsigned char *packed = NULL;
+
+#ifdef INIFILE_ZLIB
+	if (zCompressData && Size > 0)
+	{
+		uLongf packedSize = compressBound(Size);
+		packed = (unsigned char *)IniMalloc(packedSize);
+		if (packed == NULL)
+			throw IniFile::EInsufficientMemory();
+		if (compress2(packed, &packedSize, body, Size, Z_DEFAULT_COMPRESSION) == Z_OK
+			&& packedSize < Size)
+		{
+			body = packed;
+			bodySize = packedSize;
+			compression = 'd';
+		}
+	}
+#endif
+
+	unsigned char header[kMaxVarintSize];
+	size_t headerSize = EncodeVarint(Size, header);
+	size_t blocks = (headerSize + bodySize + BlockBytes(encoding) - 1) / BlockBytes(encoding);
+
+	char *str;
+	try
+	{
+		str = iKey->AllocStr(kVersionedDataHeader + blocks * BlockChars(encoding) + 1);
+	}
+	catch (...)
+	{
+		IniFree(packed);
+		throw;
+	}
+	str[0] = kVersionedDataTag[0];
+	str[1] = kVersionedDataTag[1];
+	str[2] = encoding;
+	str[3] = compression;
+	size_t length = EncodeDataText(encoding, header, headerSize, body, bodySize,
+		str + kVersionedDataHeader);
+	str[kVersionedDataHeader + length] = 0;
+	IniFree(packed);
+
+	iKey->DeleteStr(iKey->zStr);
+	iKey->zStr = str;
+}
+
+//-----------------------------------------------------------------------------
+// IniDataWriter
+//-----------------------------------------------------------------------------
+
+// zlib counts in 32 bits, so anything bigger gets fed to it in chunks
+static const size_t kZlibChunk = 1 << 30;
+
+// Bytes decoded at a time for inflating
+static const size_t kInflateInput = 4096;
+
+static char *CopyName(const char *Name)
+{
+	char *copy = (char *)IniMalloc(strlen(Name) + 1);
+	if (copy == NULL)
+		throw IniFile::EInsufficientMemory();
+	strcpy(copy, Name);
+	return copy;
+}
+
+IniDataWriter::IniDataWriter(IniFile &Ini, const char *Section, const char *Key, const size_t Size)
+	: zIni(Ini), zSectionName(NULL), zKeyName(NULL), zSize(Size), zWritten(0),
+	  zEncoding(Ini.zDataEncoding == IniFile::Z85Data ? 'z' : 'b'), zText(NULL),
+	  zTextLength(0), zTextSize(0), zBlockFill(0), zStream(NULL)
+{
+	try
+	{
+		zSectionName = CopyName(Section);
+		zKeyName = CopyName(Key);
+
+		bool legacy = Ini.zDataEncoding == IniFile::LegacyData && Size <= 0xFFFFFFFFul;
+		bool compress = false;
+#ifdef INIFILE_ZLIB
+		compress = !legacy && Ini.zCompressData && Size > 0;
+#endif
+
+		// Uncompressed, we know exactly how much text we'll end up with
+		unsigned char header[kMaxVarintSize];
+		size_t headerSize;
+		if (legacy)
+		{
+			for (int i = 0; i < 6; i++)
+				header[i] = i < 4 ? (Size >> (i * 8)) & 0xFF : 0;
+			headerSize = 6;
+		}
+		else
+			headerSize = EncodeVarint(Size, header);
+		size_t blocks = (headerSize + (compress ? Size / 4 : Size) + BlockBytes(zEncoding) - 1)
+			/ BlockBytes(zEncoding);
+		Reserve(kVersionedDataHeader + blocks * BlockChars(zEncoding));
+
+		if (!legacy)
+		{
+			zText[0] = kVersionedDataTag[0];
+			zText[1] = kVersionedDataTag[1];
+			zText[2] = zEncoding;
+			zText[3] = compress ? 'd' : '-';
+			zTextLength = kVersionedDataHeader;
+		}
+		Append(header, headerSize);
+
+#ifdef INIFILE_ZLIB
+		if (compress)
+		{
+			z_stream *stream = (z_stream *)IniCalloc(1, sizeof(z_stream));
+			if (stream == NULL)
+				throw IniFile::EInsufficientMemory();
+			stream->zalloc = IniZAlloc;
+			stream->zfree = IniZFree;
+			if (deflateInit(stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+			{
+				IniFree(stream);
+				throw IniFile::EInsufficientMemory();
+			}
+			zStream = stream;
+		}
+#endif
+	}
+	catch (...)
+	{
+		IniFree(zSectionName);
+		IniFree(zKeyName);
+		IniFree(zText);
+		throw;
+	}
+}
+
+IniDataWriter::~IniDataWriter()
+{
+#ifdef INIFILE_ZLIB
+	if (zStream != NULL)
+		deflateEnd((z_stream *)zStream);
+#endif
+	IniFree(zStream);
+	IniFree(zText);
+	IniFree(zSectionName);
+	IniFree(zKeyName);
+}
+
+size_t IniDataWriter::Write(const void *Data, const size_t Length)
+{
+	size_t length = Length < zSize - zWritten ? Length : zSize - zWritten;
+	if (zStream != NULL)
+		Deflate((const unsigned char *)Data, length, false);
 	else
-		return iSection->zChildList->Add(Key);
+		Append((const unsigned char *)Data, length);
+	zWritten += length;
+	return length;
 }
 
-void IniFile::WriteString(const char *Section, const char *Key, const char *Val)
+bool IniDataWriter::Finish()
 {
-	IniNode *iSection, *iKey;
+	if (zText == NULL || zWritten != zSize)
+		return false;
+
+	if (zStream != NULL)
+		Deflate(NULL, 0, true);
+
+	// Pad the last block with zeros
+	if (zBlockFill > 0)
+	{
+		unsigned char padding[4] = { 0, 0, 0, 0 };
+		Append(padding, BlockBytes(zEncoding) - zBlockFill);
+	}
+	zText[zTextLength] = 0;
+
+	IniNode *iSection = zIni.WritableSection(zSectionName);
+	IniNode *iKey = zIni.FindCreateKey(iSection, zKeyName);
+	iKey->DeleteStr(iKey->zStr);
+	iKey->zStr = zText;
+	zText = NULL;
+	zIni.Touch(iSection, iKey);
+	return true;
+}
+
+// Makes room for Length more chars (and a terminating NULL)
+void IniDataWriter::Reserve(size_t Length)
+{
+	if (zTextLength + Length + 1 <= zTextSize)
+		return;
+
+	size_t size = zTextSize * 2;
+	if (size < zTextLength + Length + 1)
+		size = zTextLength + Length + 1;
+	char *text = (char *)IniRealloc(zText, size);
+	if (text == NULL)
+		throw IniFile::EInsufficientMemory();
+	zText = text;
+	zTextSize = size;
+}
+
+// Encodes Data, keeping whatever doesn't fill a whole block for later
+void IniDataWriter::Append(const unsigned char *Data, size_t Length)
+{
+	const size_t blockBytes = BlockBytes(zEncoding), blockChars = BlockChars(zEncoding);
+
+	if (zBlockFill > 0)
+	{
+		while (zBlockFill < blockBytes && Length > 0)
+		{
+			zBlock[zBlockFill++] = *Data++;
+			Length--;
+		}
+		if (zBlockFill < blockBytes)
+			return;
+		Reserve(blockChars);
+		EncodeDataBlock(zEncoding, zBlock, zText + zTextLength);
+		zTextLength += blockChars;
+		zBlockFill = 0;
+	}
+
+	size_t blocks = Length / blockBytes;
+	Reserve(blocks * blockChars);
+	for (size_t i = 0; i < blocks; i++, Data += blockBytes, zTextLength += blockChars)
+		EncodeDataBlock(zEncoding, Data, zText + zTextLength);
+
+	for (Length -= blocks * blockBytes; Length > 0; Length--)
+		zBlock[zBlockFill++] = *Data++;
+}
+
+// Runs Data through deflate, encoding whatever comes out of it
+void IniDataWriter::Deflate(const unsigned char *Data, size_t Length, bool Finish)
+{
+#ifdef INIFILE_ZLIB
+	z_stream *stream = (z_stream *)zStream;
+	unsigned char out[4096];
+	do
+	{
+		size_t chunk = Length < kZlibChunk ? Length : kZlibChunk;
+		stream->next_in = (Bytef *)Data;
+		stream->avail_in = chunk;
+		Data += chunk;
+		Length -= chunk;
+
+		bool last = Finish && Length == 0;
+		int status;
+		do
+		{
+			stream->next_out = out;
+			stream->avail_out = sizeof out;
+			status = deflate(stream, last ? Z_FINISH : Z_NO_FLUSH);
+			if (status == Z_STREAM_ERROR)
+				throw IniFile::EInsufficientMemory();
+			Append(out, sizeof out - stream->avail_out);
+		} while (last ? status != Z_STREAM_END : stream->avail_out == 0);
+	} while (Length > 0);
+#else
+	(void)Data;
+	(void)Length;
+	(void)Finish;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// IniDataReader
+//-----------------------------------------------------------------------------
+
+IniDataReader::IniDataReader(const IniFile &Ini, const char *Section, const char *Key)
+	: zText(NULL), zTextLength(0), zEncoding('b'), zSize(0), zRead(0),
+	  zPosition(0), zStream(NULL), zInput(NULL)
+{
+	IniNode *iKey = Ini.FindKey(Section, Key);
+	if (iKey != NULL && iKey->zStr != NULL)
+		SetTo(iKey->zStr, strlen(iKey->zStr));
+}
+
+IniDataReader::IniDataReader(const char *Text, const size_t Length)
+	: zText(NULL), zTextLength(0), zEncoding('b'), zSize(0), zRead(0),
+	  zPosition(0), zStream(NULL), zInput(NULL)
+{
+	SetTo(Text, Length);
+}
+
+IniDataReader::~IniDataReader()
+{
+#ifdef INIFILE_ZLIB
+	if (zStream != NULL)
+		inflateEnd((z_stream *)zStream);
+#endif
+	IniFree(zStream);
+	IniFree(zInput);
+}
+
+void IniDataReader::SetTo(const char *Text, const size_t Length)
+{
+	if (IsVersionedData(Text, Length))
+	{
+		uint64_t size;
+		size_t headerSize = DecodeVersionedSize(Text, Length, &size);
+		if (headerSize == 0 || size > (uint64_t)(size_t)-1)
+			return;
+
+		if (Text[3] == 'd')
+		{
+#ifdef INIFILE_ZLIB
+			z_stream *stream = (z_stream *)IniCalloc(1, sizeof(z_stream));
+			zInput = (unsigned char *)IniMalloc(kInflateInput);
+			if (stream != NULL)
+			{
+				stream->zalloc = IniZAlloc;
+				stream->zfree = IniZFree;
+			}
+			if (stream == NULL || zInput == NULL || inflateInit(stream) != Z_OK)
+			{
+				IniFree(stream);
+				IniFree(zInput);
+				zInput = NULL;
+				throw IniFile::EInsufficientMemory();
+			}
+			zStream = stream;
+#else
+			return;		// We can't inflate anything
+#endif
+		}
+
+		zEncoding = Text[2];
+		zText = Text + kVersionedDataHeader;
+		zTextLength = Length - kVersionedDataHeader;
+		zSize = size;
+		zPosition = headerSize;
+	}
+	else
+	{
+		// Legacy data starts with a 32-bit little endian size, padded
+		// to two blocks
+		unsigned char header[6];
+		if (DecodeDataText('b', Text, Length, 0, header, sizeof header) < sizeof header)
+			return;
+
+		zEncoding = 'b';
+		zText = Text;
+		zTextLength = Length;
+		zSize = 0;
+		for (int i = 3; i >= 0; i--)
+			zSize = (zSize << 8) | header[i];
+		zPosition = sizeof header;
+	}
+}
+
+size_t IniDataReader::Read(void *Buffer, const size_t Length)
+{
+	if (zText == NULL)
+		return 0;
+
+	size_t length = Length < zSize - zRead ? Length : zSize - zRead;
+	size_t count;
+	if (zStream != NULL)
+		count = Inflate((unsigned char *)Buffer, length);
+	else
+	{
+		count = DecodeDataText(zEncoding, zText, zTextLength, zPosition,
+			(unsigned char *)Buffer, length);
+		zPosition += count;
+	}
+	zRead += count;
+	return count;
+}
+
+size_t IniDataReader::Inflate(unsigned char *Buffer, size_t Length)
+{
+#ifdef INIFILE_ZLIB
+	z_stream *stream = (z_stream *)zStream;
+	size_t count = 0;
+	while (count < Length)
+	{
+		if (stream->avail_in == 0)
+		{
+			size_t got = DecodeDataText(zEncoding, zText, zTextLength, zPosition,
+				zInput, kInflateInput);
+			if (got == 0)
+				break;		// Data was cut short
+			zPosition += got;
+			stream->next_in = zInput;
+			stream->avail_in = got;
+		}
+
+		size_t chunk = Length - count < kZlibChunk ? Length - count : kZlibChunk;
+		stream->next_out = Buffer + count;
+		stream->avail_out = chunk;
+		int status = inflate(stream, Z_NO_FLUSH);
+		count += chunk - stream->avail_out;
+		if (status == Z_MEM_ERROR)
+			throw IniFile::EInsufficientMemory();	// The window is allocated on first use
+		if (status != Z_OK)
+			break;		// Done, or damaged
+	}
+	return count;
+#else
+	(void)Buffer;
+	(void)Length;
+	return 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// IniBatch
+//-----------------------------------------------------------------------------
+
+IniBatch::IniBatch(IniFile &Ini, const char *Section)
+	: zIni(Ini), zSection(NULL), zEntries(NULL), zCount(0), zSize(0),
+	  zTable(NULL), zTableSize(0)
+{
+	zSection = CopyName(Section);
+}
+
+IniBatch::~IniBatch()
+{
+	Discard();
+	IniFree(zEntries);
+	IniFree(zTable);
+	IniFree(zSection);
+}
+
+void IniBatch::Discard()
+{
+	for (int i = 0; i < zCount; i++)
+	{
+		IniFree(zEntries[i].zValue);
+		if (zEntries[i].zNew)
+			delete zEntries[i].zNode;
+	}
+	zCount = 0;
+	for (int i = 0; i < zTableSize; i++)
+		zTable[i] = -1;
+}
+
+// Returns the slot of zTable that holds Key, or the free one where it
+// belongs
+int IniBatch::FindEntry(const char *Key) const
+{
+	int mask = zTableSize - 1;
+	for (int slot = HashName(Key) & mask; ; slot = (slot + 1) & mask)
+	{
+		int index = zTable[slot];
+		if (index < 0 || zEntries[index].zKey == Key || strcmp(zEntries[index].zKey, Key) == 0)
+			return slot;
+	}
+}
+
+// Keeps the table at most half full
+void IniBatch::GrowTable()
+{
+	if (zCount < zTableSize / 2)
+		return;
+
+	int size = zTableSize > 0 ? zTableSize * 2 : 16;
+	int *table = (int *)IniMalloc(size * sizeof(int));
+	if (table == NULL)
+		throw IniFile::EInsufficientMemory();
+	IniFree(zTable);
+	zTable = table;
+	zTableSize = size;
+	for (int i = 0; i < zTableSize; i++)
+		zTable[i] = -1;
+	for (int i = 0; i < zCount; i++)
+		zTable[FindEntry(zEntries[i].zKey)] = i;
+}
+
+void IniBatch::WriteString(const char *Key, const char *Val)
+{
+	char *value = CopyName(Val != NULL ? Val : "");
+	try
+	{
+		GrowTable();
+		if (zCount == zSize)
+		{
+			int size = zSize > 0 ? zSize * 2 : 16;
+			Entry *entries = (Entry *)IniRealloc(zEntries, size * sizeof(Entry));
+			if (entries == NULL)
+				throw IniFile::EInsufficientMemory();
+			zEntries = entries;
+			zSize = size;
+		}
+		Key = zIni.InternName(Key);
+	}
+	catch (...)
+	{
+		IniFree(value);
+		throw;
+	}
+
+	int slot = FindEntry(Key);
+	if (zTable[slot] >= 0)
+	{
+		Entry &entry = zEntries[zTable[slot]];
+		IniFree(entry.zValue);
+		entry.zValue = value;
+		return;
+	}
+
+	Entry &entry = zEntries[zCount];
+	entry.zKey = Key;
+	entry.zValue = value;
+	entry.zNode = NULL;
+	entry.zNew = false;
+	zTable[slot] = zCount++;
+}
+
+void IniBatch::WriteInt(const char *Key, const int Val)
+{
+	char str[40];
+	sprintf(str, "%d", Val);
+	WriteString(Key, str);
+}
+
+void IniBatch::WriteBool(const char *Key, const bool Val)
+{
+	WriteInt(Key, Val);
+}
+
+void IniBatch::WriteFloat(const char *Key, const float Val)
+{
+	char str[40];
+	sprintf(str, "%f", Val);
+	WriteString(Key, str);
+}
+
+bool IniBatch::Commit(const char *Filename, const bool ThrowExceptionOnFileError)
+{
+	// First get hold of everything we need. This may run out of memory,
+	// but only makes private copies of shared lists and builds nodes that
+	// aren't linked in yet, so our IniFile looks the same either way.
+	IniNode *iSection = NULL, *iNewSection = NULL;
+	if (zCount > 0)
+	{
+		try
+		{
+			zIni.MakeWritable();
+			iSection = zIni.FindSection(zSection);
+			if (iSection != NULL)
+				zIni.MakeSectionWritable(iSection);
+			else
+				iSection = iNewSection = new IniNode(zSection, "");
+
+			for (IniNode *iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+			{
+				int index = zTable[FindEntry(iKey->zName)];
+				if (index >= 0 && zEntries[index].zNode == NULL)
+					zEntries[index].zNode = iKey;
+			}
+			for (int i = 0; i < zCount; i++)
+			{
+				if (zEntries[i].zNode != NULL)
+					continue;
+				zEntries[i].zNode = new IniNode(NULL, NULL);
+				zEntries[i].zNew = true;
+				zEntries[i].zNode->SetInternedName(zEntries[i].zKey);
+			}
+		}
+		catch (...)
+		{
+			delete iNewSection;
+			for (int i = 0; i < zCount; i++)
+			{
+				if (zEntries[i].zNew)
+					delete zEntries[i].zNode;
+				zEntries[i].zNode = NULL;
+				zEntries[i].zNew = false;
+			}
+			throw;
+		}
+	}
 
-	// Find the section, creating it if it doesn't exist
-	iSection = FindCreateSection(Section);
+	// Then put it all in place, which can't fail
+	bool touched = false;
+	for (int i = 0; i < zCount; i++)
+	{
+		Entry &entry = zEntries[i];
+		IniNode *iKey = entry.zNode;
+		if (entry.zNew)
+			iSection->zChildList->Add(iKey);
+		else if (iKey->zStr != NULL && strcmp(iKey->zStr, entry.zValue) == 0)
+		{
+			IniFree(entry.zValue);		// Same value, so don't mark anything as modified
+			continue;
+		}
 
-	// Find the key, creating it if it doesn't exist
-	if ((iKey = FindKey(iSection, Key)) == NULL)
-		iKey = AddKey(iSection, Key);
+		if (!touched)
+		{
+			zIni.Touch(iSection);
+			touched = true;
+		}
+		iKey->DeleteStr(iKey->zStr);
+		iKey->zStr = entry.zValue;
+		iKey->zGeneration = zIni.zGeneration;
+	}
+	if (iNewSection != NULL)
+		zIni.zRootList->Add(iNewSection);
 
-	iKey->SetStr(Val);
-}
+	zCount = 0;
+	for (int i = 0; i < zTableSize; i++)
+		zTable[i] = -1;
 
-void IniFile::WriteInt(const char *Section, const char *Key, const int Val)
-{
-	char str[40];
-	sprintf(str, "%d", Val);
-	WriteString(Section, Key, str);
+	return Filename != NULL ? zIni.Store(Filename, ThrowExceptionOnFileError) : true;
 }
 
-void IniFile::WriteBool(const char *Section, const char *Key, const bool Val)
+// Goes through IniBatch, so every section is looked up once and its keys
+// are matched up in one pass, however big it is
+void IniFile::Merge(const IniFile &Over)
 {
-	WriteInt(Section, Key, Val);
-}
+	const NodeList *over = Over.ParsedRootList();
+	if (over == ParsedRootList())
+		return;
 
-void IniFile::WriteFloat(const char *Section, const char *Key, const float Val)
-{
-	char str[40];
-	sprintf(str, "%f", Val);
-	WriteString(Section, Key, str);
+	for (IniNode *iSection = over->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		IniBatch batch(*this, iSection->zName);
+		for (IniNode *iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+			batch.WriteString(iKey->zName, iKey->zStr);
+		if (batch.Count() == 0)
+			FindCreateSection(iSection->zName);
+		else
+			batch.Commit();
+	}
 }
 
 void IniFile::WriteData(const char *Section, const char *Key, const void *Data, const size_t Size)
@@ -820,19 +3571,30 @@ void IniFile::WriteData(const char *Section, const char *Key, const void *Data,
 	IniNode *iSection, *iKey;
 	
 	// Find the section, creating it if it doesn't exist
-	iSection = FindCreateSection(Section);
+	iSection = WritableSection(Section);
 	
 	// Find the key creating it if it doesn't exist
 	iKey = FindKey(iSection, Key);
 	if (iKey == NULL)
 		iKey = AddKey(iSection, Key);
+
+	// The legacy format can't hold more than 4 GB
+	if (zDataEncoding != LegacyData || Size > 0xFFFFFFFFul)
+	{
+		WriteVersionedData(iKey, Data, Size);
+		Touch(iSection, iKey);
+		return;
+	}
 		
-	int blocks = Size / kBytesPerBlock + 2;	// Add two blocks for the sizeof(data) value
-	int leftovers = Size % kBytesPerBlock;
-	int charBlocks = (leftovers == 0) ? blocks : blocks + 1;
-	int totalChars = charBlocks * kCharsPerBlock + 1;
+	// Sizes up to 4 GB don't fit in an int once encoded
+	size_t blocks = Size / kBytesPerBlock + 2;	// Add two blocks for the sizeof(data) value
+	size_t leftovers = Size % kBytesPerBlock;
+	size_t charBlocks = (leftovers == 0) ? blocks : blocks + 1;
+	size_t totalChars = charBlocks * kCharsPerBlock + 1;
 	if (IniFile::DEBUG)
-		printf("Size == %d, blocks == %d, leftoevers == %d, charBlocks == %d, totalChars == %d\n", Size, blocks, leftovers, charBlocks, totalChars);
+		printf("Size == %lu, blocks == %lu, leftoevers == %lu, charBlocks == %lu, totalChars == %lu\n",
+			(unsigned long)Size, (unsigned long)blocks, (unsigned long)leftovers,
+			(unsigned long)charBlocks, (unsigned long)totalChars);
 
 	// We're going to manhandle this node a little bit
 	// and manipulate its data members directly for the
@@ -854,7 +3616,8 @@ void IniFile::WriteData(const char *Section, const char *Key, const void *Data,
 	// LITTLE ENDIAN ONLY!!!  Actually, I'm not totally sure about that. LITTLE ENDIAN ONLY MAYBE!!!
 	// ---------------------
 	unsigned char sizeBlock[ kBytesPerBlock * 2 ] = { 0, 0, 0, 0, 0, 0 };
-	memcpy(sizeBlock, &Size, 4);	// ASSUMPTION: int == 4 bytes
+	for (int i = 0; i < 4; i++)
+		sizeBlock[i] = (Size >> (i * 8)) & 0xFF;	// Always little endian
 	EncodeBlockToString(sizeBlock, stringData);	
 	stringData += kCharsPerBlock;	
 	EncodeBlockToString(&(sizeBlock[3]), stringData);
@@ -864,7 +3627,7 @@ void IniFile::WriteData(const char *Section, const char *Key, const void *Data,
 	// Now we convert one full block of 8-bit data in Data to
 	// one full block of 6-bit data (represented by 8-bit ASCII
 	// characters) in str
-	for (int i = 0; i < blocks; i++)
+	for (size_t i = 0; i < blocks; i++)
 	{
 		EncodeBlockToString(blockData, stringData);
 		
@@ -877,7 +3640,7 @@ void IniFile::WriteData(const char *Section, const char *Key, const void *Data,
 	if (leftovers > 0)
 	{
 		unsigned char finalBlock[kBytesPerBlock];
-		for (int i = 0; i < kBytesPerBlock; i++)
+		for (size_t i = 0; i < (size_t)kBytesPerBlock; i++)
 			finalBlock[i] = (i < leftovers) ? blockData[i] : 0;
 			
 		EncodeBlockToString(finalBlock, stringData);
@@ -889,10 +3652,10 @@ void IniFile::WriteData(const char *Section, const char *Key, const void *Data,
 	
 	// Pass the string on to the node
 	iKey->zStr = str;		
-	
+	Touch(iSection, iKey);
 }
 
-char* IniFile::ReadString(const char *Section, const char *Key, const char *Default = NULL)  const 
+char* IniFile::ReadString(const char *Section, const char *Key, const char *Default) const
 {
 	IniNode *Item;	
 	Item = FindKey(Section, Key);
@@ -926,7 +3689,7 @@ char* IniFile::ReadString(const char *Section, const char *Key, const char *Defa
 }
 
 
-char* IniFile::ReadString(const char *Section, const char *Key, char *Result, size_t Size, const char *Default = NULL) const
+char* IniFile::ReadString(const char *Section, const char *Key, char *Result, size_t Size, const char *Default) const
 {
 
 	IniNode *Item;
@@ -942,49 +3705,440 @@ char* IniFile::ReadString(const char *Section, const char *Key, char *Result, si
 	return Result;
 }
 
-int IniFile::ReadInt(const char *Section, const char *Key, const int Default) const
+// Parses an optionally signed decimal number the way sscanf() does, but
+// fails if it doesn't fit into 64 bits. *Negative is set to whether
+// there was a minus sign.
+static bool ParseDecimal(const char *str, uint64_t *magnitude, bool *negative)
 {
-	int val;
-	char *str;
-	char defaultStr[256];	// 255 digits ought to be enough for an int, right?
-	sprintf(defaultStr, "%d", Default);
+	while (*str == ' ' || *str == '\t' || *str == '\n' || *str == '\r'
+		|| *str == '\f' || *str == '\v')
+		str++;
 
-	// Read in the string for the given key
-	str = ReadString(Section, Key, defaultStr);
+	*negative = *str == '-';
+	if (*str == '-' || *str == '+')
+		str++;
 
-	// Attempt to convert the string to an int
-	if (sscanf(str, "%d", &val) != 1)
-		val = Default;
-	
-	// Free the string
-	free(str);
+	if (*str < '0' || *str > '9')
+		return false;
+
+	uint64_t value = 0;
+	for (; *str >= '0' && *str <= '9'; str++)
+	{
+		unsigned digit = *str - '0';
+		if (value > (UINT64_MAX - digit) / 10)
+			return false;	// Overflow
+		value = value * 10 + digit;
+	}
+
+	*magnitude = value;
+	return true;
+}
+
+static bool ParseSigned(const char *str, int64_t min, int64_t max, int64_t *result)
+{
+	uint64_t magnitude;
+	bool negative;
+	if (!ParseDecimal(str, &magnitude, &negative))
+		return false;
+
+	if (negative)
+	{
+		if (magnitude > (uint64_t)-(min + 1) + 1)
+			return false;
+		*result = magnitude == 0 ? 0 : -(int64_t)(magnitude - 1) - 1;
+	}
+	else
+	{
+		if (magnitude > (uint64_t)max)
+			return false;
+		*result = magnitude;
+	}
+	return true;
+}
+
+static bool ParseInt(const char *str, int *result)
+{
+	int64_t val;
+	if (!ParseSigned(str, INT_MIN, INT_MAX, &val))
+		return false;
+	*result = (int)val;
+	return true;
+}
+
+static bool ParseInt64(const char *str, int64_t *result)
+{
+	return ParseSigned(str, INT64_MIN, INT64_MAX, result);
+}
+
+static bool ParseUInt(const char *str, unsigned int *result)
+{
+	uint64_t val;
+	bool negative;
+	if (!ParseDecimal(str, &val, &negative) || negative || val > UINT_MAX)
+		return false;
+	*result = (unsigned int)val;
+	return true;
+}
+
+static bool ParseDouble(const char *str, double *result)
+{
+	char *end;
+	double val = strtod(str, &end);
+	if (end == str)
+		return false;
+	*result = val;
+	return true;
+}
+
+static bool ParseBool(const char *str, bool *result)
+{
+	int64_t val;
+	if (ParseSigned(str, INT64_MIN, INT64_MAX, &val))
+		*result = val != 0;
+	else if (strcasecmp(str, "true") == 0)
+		*result = true;
+	else if (strcasecmp(str, "false") == 0)
+		*result = false;
+	else
+		return false;
+	return true;
+}
+
+static bool FoundString(const IniNode *Item, const char **Result, size_t *Length)
+{
+	if (Item == NULL || Item->zStr == NULL)
+		return false;
+
+	*Result = Item->zStr;
+	if (Length != NULL)
+		*Length = strlen(Item->zStr);
+	return true;
+}
+
+bool IniFile::FindString(const char *Section, const char *Key, const char **Result, size_t *Length) const
+{
+	return FoundString(FindKey(Section, Key), Result, Length);
+}
+
+bool IniFile::FindInt(const char *Section, const char *Key, int *Result) const
+{
+	const char *str;
+	return FindString(Section, Key, &str) && ParseInt(str, Result);
+}
+
+bool IniFile::FindInt64(const char *Section, const char *Key, int64_t *Result) const
+{
+	const char *str;
+	return FindString(Section, Key, &str) && ParseInt64(str, Result);
+}
+
+bool IniFile::FindUInt(const char *Section, const char *Key, unsigned int *Result) const
+{
+	const char *str;
+	return FindString(Section, Key, &str) && ParseUInt(str, Result);
+}
+
+bool IniFile::FindDouble(const char *Section, const char *Key, double *Result) const
+{
+	const char *str;
+	return FindString(Section, Key, &str) && ParseDouble(str, Result);
+}
+
+bool IniFile::FindBool(const char *Section, const char *Key, bool *Result) const
+{
+	const char *str;
+	return FindString(Section, Key, &str) && ParseBool(str, Result);
+}
+
+bool IniFile::ForEachKey(const char *Section, KeyVisitor Visitor, void *Cookie) const
+{
+	IniNode *iSection = FindSection(Section);
+	if (iSection == NULL)
+		return false;
+
+	for (IniNode *iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+	{
+		if (!Visitor(iKey->zName, iKey->zStr, Cookie))
+			break;
+	}
+	return true;
+}
+
+// Finds Name in List for Diff(). Versions of a file usually keep their
+// sections and keys in the same order, so Name is first looked for at
+// *Next, where the previous match left off, and only searched for if it
+// isn't there. That keeps comparing two similar lists linear.
+static IniNode *FindNextNode(const NodeList *List, IniNode **Next, const char *Name)
+{
+	IniNode *iNode = *Next;
+	if (iNode == NULL || strcmp(iNode->zName, Name) != 0)
+		iNode = List->FindNode(Name);
+	if (iNode != NULL)
+		*Next = iNode->zNext;
+	return iNode;
+}
+
+// Reports the keys that changed between two versions of the key list of
+// the same section, either of which may be missing
+static int DiffSection(const char *Section, const NodeList *Older, const NodeList *Newer,
+	IniFile::ChangeVisitor Visitor, void *Cookie)
+{
+	static const NodeList empty;
+	if (Older == NULL)
+		Older = &empty;
+	if (Newer == NULL)
+		Newer = &empty;
+	if (Older == Newer)
+		return 0;
+
+	int changes = 0;
+	IniNode *iNext = Older->zStart;
+	for (IniNode *iKey = Newer->zStart; iKey != NULL; iKey = iKey->zNext)
+	{
+		const char *newValue = iKey->zStr ? iKey->zStr : "";
+		IniNode *iOld = FindNextNode(Older, &iNext, iKey->zName);
+		if (iOld == NULL)
+		{
+			Visitor(Section, iKey->zName, NULL, newValue, Cookie);
+			changes++;
+		}
+		else if (strcmp(iOld->zStr ? iOld->zStr : "", newValue) != 0)
+		{
+			Visitor(Section, iKey->zName, iOld->zStr ? iOld->zStr : "", newValue, Cookie);
+			changes++;
+		}
+	}
+
+	iNext = Newer->zStart;
+	for (IniNode *iKey = Older->zStart; iKey != NULL; iKey = iKey->zNext)
+	{
+		if (FindNextNode(Newer, &iNext, iKey->zName) == NULL)
+		{
+			Visitor(Section, iKey->zName, iKey->zStr ? iKey->zStr : "", NULL, Cookie);
+			changes++;
+		}
+	}
+	return changes;
+}
+
+int IniFile::Diff(const IniFile &Newer, ChangeVisitor Visitor, void *Cookie) const
+{
+	const NodeList *older = ParsedRootList(), *newer = Newer.ParsedRootList();
+	if (older == newer)
+		return 0;
+
+	int changes = 0;
+	IniNode *iNext = older->zStart;
+	for (IniNode *iSection = newer->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		IniNode *iOld = FindNextNode(older, &iNext, iSection->zName);
+		changes += DiffSection(iSection->zName, iOld ? iOld->zChildList : NULL,
+			iSection->zChildList, Visitor, Cookie);
+	}
+
+	iNext = newer->zStart;
+	for (IniNode *iSection = older->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		if (FindNextNode(newer, &iNext, iSection->zName) == NULL)
+			changes += DiffSection(iSection->zName, iSection->zChildList, NULL, Visitor, Cookie);
+	}
+	return changes;
+}
 
-	return val;
+int IniFile::ReadInt(const char *Section, const char *Key, const int Default) const
+{
+	int val;
+	return FindInt(Section, Key, &val) ? val : Default;
 }
 
 bool IniFile::ReadBool(const char *Section, const char *Key, const bool Default) const
 {
-	return ReadInt(Section, Key, Default) != 0;
+	bool val;
+	return FindBool(Section, Key, &val) ? val : Default;
 }
 
 float IniFile::ReadFloat(const char *Section, const char *Key, const float Default) const
 {
-	float val;
-	char *str;
-	char defaultStr[256];	// 255 digits ought to be enough for a float, right?
-	sprintf(defaultStr, "%f", Default);
+	double val;
+	return FindDouble(Section, Key, &val) ? (float)val : Default;
+}
 
-	// Read in the string for the given key
-	str = ReadString(Section, Key, defaultStr);
+//-----------------------------------------------------------------------------
+// IniFile key handles
+//-----------------------------------------------------------------------------
 
-	// Attempt to convert the string to a float
-	if (sscanf(str, "%f", &val) != 1)
-		val = Default;
-	
-	// Free the string
-	free(str);
+// Slot in an IniFile's handle table
+struct IniHandleSlot {
+	IniNode *zSection;
+	IniNode *zKey;
+};
+
+int IniKeyHandle::sCount = 0;
+
+IniKeyHandle::IniKeyHandle(const char *Section, const char *Key)
+	: zSection(Section), zKey(Key),
+	  zIndex(__atomic_fetch_add(&sCount, 1, __ATOMIC_RELAXED))
+{
+}
+
+// Makes sure our handle table has room for Count handles
+void IniFile::GrowHandleTable(int Count)
+{
+	if (Count <= zHandleCount)
+		return;
+
+	IniHandleSlot *slots = (IniHandleSlot *)IniRealloc(zHandleSlots, Count * sizeof(IniHandleSlot));
+	if (slots == NULL)
+		throw IniFile::EInsufficientMemory();
+	memset(slots + zHandleCount, 0, (Count - zHandleCount) * sizeof(IniHandleSlot));
+	zHandleSlots = slots;
+	zHandleCount = Count;
+}
+
+// Forgets all resolved handles; needed whenever nodes go away
+void IniFile::ResetHandles()
+{
+	IniFree(zHandleSlots);
+	zHandleSlots = NULL;
+	zHandleCount = 0;
+	zHandlesFrozen = false;
+}
+
+void IniFile::FreezeHandles()
+{
+	ParseAllSections();
+	GrowHandleTable(__atomic_load_n(&IniKeyHandle::sCount, __ATOMIC_RELAXED));
+	zHandlesFrozen = true;
+}
+
+// Returns the key node for Handle (NULL if the key doesn't exist),
+// looking it up by name only if it hasn't been resolved yet
+IniNode *IniFile::HandleNode(const IniKeyHandle &Handle) const
+{
+	IniHandleSlot *slot = NULL;
+	if (Handle.zIndex < zHandleCount)
+	{
+		slot = &zHandleSlots[Handle.zIndex];
+		IniNode *iKey = __atomic_load_n(&slot->zKey, __ATOMIC_ACQUIRE);
+		if (iKey != NULL)
+			return iKey;
+	}
+
+	IniNode *iSection = FindSection(Handle.zSection);
+	IniNode *iKey = FindKey(iSection, Handle.zKey);
+	if (iKey == NULL)
+		return NULL;
+
+	// Remember where the key is. Once frozen, the table may be read by
+	// several threads at once, so it can't be reallocated anymore, and
+	// slots are filled in atomically (racing threads store the same thing).
+	if (slot == NULL && !zHandlesFrozen)
+	{
+		IniFile *self = (IniFile *)this;	// Still logically const
+		self->GrowHandleTable(Handle.zIndex + 1);
+		slot = &zHandleSlots[Handle.zIndex];
+	}
+	if (slot != NULL)
+	{
+		__atomic_store_n(&slot->zSection, iSection, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->zKey, iKey, __ATOMIC_RELEASE);
+	}
+	return iKey;
+}
+
+bool IniFile::FindString(const IniKeyHandle &Handle, const char **Result, size_t *Length) const
+{
+	return FoundString(HandleNode(Handle), Result, Length);
+}
+
+bool IniFile::FindInt(const IniKeyHandle &Handle, int *Result) const
+{
+	const char *str;
+	return FindString(Handle, &str) && ParseInt(str, Result);
+}
+
+bool IniFile::FindInt64(const IniKeyHandle &Handle, int64_t *Result) const
+{
+	const char *str;
+	return FindString(Handle, &str) && ParseInt64(str, Result);
+}
+
+bool IniFile::FindUInt(const IniKeyHandle &Handle, unsigned int *Result) const
+{
+	const char *str;
+	return FindString(Handle, &str) && ParseUInt(str, Result);
+}
+
+bool IniFile::FindDouble(const IniKeyHandle &Handle, double *Result) const
+{
+	const char *str;
+	return FindString(Handle, &str) && ParseDouble(str, Result);
+}
+
+bool IniFile::FindBool(const IniKeyHandle &Handle, bool *Result) const
+{
+	const char *str;
+	return FindString(Handle, &str) && ParseBool(str, Result);
+}
 
-	return val;
+int IniFile::ReadInt(const IniKeyHandle &Handle, const int Default) const
+{
+	int val;
+	return FindInt(Handle, &val) ? val : Default;
+}
+
+bool IniFile::ReadBool(const IniKeyHandle &Handle, const bool Default) const
+{
+	bool val;
+	return FindBool(Handle, &val) ? val : Default;
+}
+
+float IniFile::ReadFloat(const IniKeyHandle &Handle, const float Default) const
+{
+	double val;
+	return FindDouble(Handle, &val) ? (float)val : Default;
+}
+
+void IniFile::WriteString(const IniKeyHandle &Handle, const char *Val)
+{
+	MakeWritable();
+	IniNode *iKey = HandleNode(Handle);
+	if (iKey == NULL || Handle.zIndex >= zHandleCount
+		|| zHandleSlots[Handle.zIndex].zSection->zChildList->IsShared())
+	{
+		// Go by name, and make sure the handle finds the key from now on,
+		// unless the table is frozen and has no slot for it (see
+		// HandleNode())
+		WriteString(Handle.zSection, Handle.zKey, Val);
+		if (Handle.zIndex >= zHandleCount && zHandlesFrozen)
+			return;
+		IniNode *iSection = FindSection(Handle.zSection);
+		GrowHandleTable(Handle.zIndex + 1);
+		zHandleSlots[Handle.zIndex].zSection = iSection;
+		zHandleSlots[Handle.zIndex].zKey = FindKey(iSection, Handle.zKey);
+		return;
+	}
+
+	SetValue(zHandleSlots[Handle.zIndex].zSection, iKey, Val);
+}
+
+void IniFile::WriteInt(const IniKeyHandle &Handle, const int Val)
+{
+	char str[40];
+	sprintf(str, "%d", Val);
+	WriteString(Handle, str);
+}
+
+void IniFile::WriteBool(const IniKeyHandle &Handle, const bool Val)
+{
+	WriteInt(Handle, Val);
+}
+
+void IniFile::WriteFloat(const IniKeyHandle &Handle, const float Val)
+{
+	char str[40];
+	sprintf(str, "%f", Val);
+	WriteString(Handle, str);
 }
 
 size_t IniFile::ReadData(const char *Section, const char *Key, void *Result, size_t Size) const
@@ -1006,9 +4160,9 @@ size_t IniFile::ReadData(const char *Section, const char *Key, void **Result) co
 	if ( Item != NULL)
 	{
 		// Figure out how much of a buffer we need to allocate
-		int stringLen = strlen(Item->zStr);
-		int bytesNeeded = (stringLen / kCharsPerBlock) * kBytesPerBlock;
-		*Result = malloc(bytesNeeded);
+		size_t stringLen = strlen(Item->zStr);
+		size_t bytesNeeded = DecodedSize(Item->zStr, stringLen);
+		*Result = malloc(bytesNeeded > 0 ? bytesNeeded : 1);
 		if (*Result == NULL)
 			throw IniFile::EInsufficientMemory();
 		try
@@ -1029,88 +4183,36 @@ size_t IniFile::ReadData(const char *Section, const char *Key, void **Result) co
 	}
 }
 
-int IniFile::DecodeData(const char *sourceData, const size_t sourceSize, unsigned char *destData, const size_t destSize) const
+// Returns how big a buffer DecodeData() needs for all of sourceData
+size_t IniFile::DecodedSize(const char *sourceData, const size_t sourceSize) const
 {
-	size_t blocks = sourceSize / kCharsPerBlock;
-		// For reading data, we just chop off any partial block at the end
-		// because our write functions always write out complete blocks :-)
-		// We will always read this many or fewer blocks from sourceData,
-		// no more.
+	if (!IsVersionedData(sourceData, sourceSize))
+		return (sourceSize / kCharsPerBlock) * kBytesPerBlock;
 
-	// We have to at least have two blocks for the sizeof data
-	if (blocks < 2)
+	uint64_t size;
+	if (DecodeVersionedSize(sourceData, sourceSize, &size) == 0)
 		return 0;
-		
-	// We'll use these pointers to keep track of where we are
-	char* sourceDataBlock = (char *)sourceData;		// Get the compiler to shut up about const :-)
-	unsigned char* destDataBlock = destData;
-
-	// Read in the stored data length value
-	size_t storedSize = 0;
-	unsigned char sizeBlock[ kBytesPerBlock * 2 ];
-	DecodeBlockToBuffer(sourceDataBlock, sizeBlock);		// LITTLE ENDIAN ONLY!?!?!
-	sourceDataBlock += kCharsPerBlock;
-	DecodeBlockToBuffer(sourceDataBlock, &sizeBlock[3]);
-	sourceDataBlock += kCharsPerBlock;
-	memcpy(&storedSize, sizeBlock, sizeof storedSize);
-	blocks -= 2;
-	
+
+	// Don't let a damaged size have us allocate much more than the data
+	// could possibly hold (deflate never gets better than about 1:1032)
+	uint64_t limit = (uint64_t)(sourceSize / BlockChars(sourceData[2])) * BlockBytes(sourceData[2]);
+	if (sourceData[3] == 'd')
+		limit *= 1032;
+	if (size > limit || size > (uint64_t)(size_t)-1)
+		return 0;
+	return size;
+}
+
+size_t IniFile::DecodeData(const char *sourceData, const size_t sourceSize, unsigned char *destData, const size_t destSize) const
+{
 	// We have to be prepared to read LESS data than was claimed
 	// to have been stored, but not try to read MORE data than
 	// was claimed to have been stored.
-	size_t bytesAvailable = blocks * kBytesPerBlock;	// Data avaiable
-	if (storedSize < bytesAvailable)
-		bytesAvailable = storedSize;
-		
-/*
-	if (DEBUG)
-	{
-		printf("\n");
-		printf("sourceData == %s\n", sourceData);
-		printf("sourceSize == %d\n", sourceSize);
-		printf("destSize == %d\n", destSize);
-		printf("blocks == %d\n", blocks);
-		printf("bytesAvailable == %d\n", bytesAvailable);
-		printf("\n");
-	}
-*/
-
-	// We have to be prepared to read LESS data than is actually
-	// available, but not try to read MORE data than is available
-	size_t byteBlocks;
-	size_t extras;
-	if (destSize < bytesAvailable)
-	{
-		byteBlocks = destSize / kBytesPerBlock;
-		extras = destSize % kBytesPerBlock;	
-	}
-	else
-	{
-		byteBlocks = bytesAvailable / kBytesPerBlock;
-		extras = bytesAvailable % kBytesPerBlock;
-	}
-	
-	// First we decode all the whole blocks we can
-	for (size_t i = 0; i < byteBlocks; i++)
-	{
-		DecodeBlockToBuffer(sourceDataBlock, destDataBlock);
-		sourceDataBlock += kCharsPerBlock;
-		destDataBlock += kBytesPerBlock;	
-	}
-	
-	// Now we decode any partial blocks
-	if (extras > 0)
-	{
-		// We need an entire block to decode into
-		unsigned char tempBlock[kBytesPerBlock];
-		DecodeBlockToBuffer(sourceDataBlock, tempBlock);
-		for (size_t i = 0; i < extras; i++)
-			destDataBlock[i] = tempBlock[i];
-	}	
-
-	// If we made it this far...
-	return byteBlocks * kBytesPerBlock + extras;
-	
+	IniDataReader reader(sourceData, sourceSize);
+	size_t total = 0, count;
+	while (total < destSize && (count = reader.Read(destData + total, destSize - total)) > 0)
+		total += count;
+	return total;
 }
 
 
@@ -1165,11 +4267,68 @@ bool inline IniFile::IsSectionChar(const char ch)
 }
 
 
+void IniFile::GetStats(IniStats *Stats) const
+{
+	memset(Stats, 0, sizeof(IniStats));
+
+	Stats->zLists = 1;
+	Stats->zOverheadBytes = sizeof(NodeList);
+	for (IniNode *iSection = zRootList->zStart; iSection != NULL; iSection = iSection->zNext)
+	{
+		Stats->zSections++;
+		Stats->zLists++;
+		Stats->zOverheadBytes += sizeof(IniNode) + sizeof(NodeList);
+		Stats->zStringBytes += strlen(iSection->zName) + 1;
+		if (iSection->zStr != NULL)
+			Stats->zStringBytes += strlen(iSection->zStr) + 1;
+		if (iSection->zPending != NULL)
+			Stats->zPendingSections++;
+		for (IniRange *range = iSection->zPending; range != NULL; range = range->zNext)
+			Stats->zOverheadBytes += sizeof(IniRange);
+
+		for (IniNode *iKey = iSection->zChildList->zStart; iKey != NULL; iKey = iKey->zNext)
+		{
+			Stats->zKeys++;
+			Stats->zOverheadBytes += sizeof(IniNode);
+			if (iKey->zChildList != NULL)
+			{
+				Stats->zLists++;
+				Stats->zOverheadBytes += sizeof(NodeList);
+			}
+			if (!iKey->zNameInterned && iKey->zName != NULL)
+				Stats->zStringBytes += strlen(iKey->zName) + 1;
+			if (iKey->zStr != NULL)
+				Stats->zStringBytes += strlen(iKey->zStr) + 1;
+		}
+	}
+	Stats->zNodes = Stats->zSections + Stats->zKeys;
+
+	if (zNames != NULL)
+		zNames->GetStats(&Stats->zStringBytes, &Stats->zOverheadBytes);
+	if (zLazyBuffer != NULL)
+		Stats->zOverheadBytes += zLazySize + 1;
+	if (zImageSections != NULL)
+		Stats->zOverheadBytes += (((const ImageHeader *)zImage)->zSectionCount + 1) * sizeof(IniNode *);
+	Stats->zOverheadBytes += zHandleCount * sizeof(IniHandleSlot);
+	if (zFilename != NULL)
+		Stats->zOverheadBytes += strlen(zFilename) + 1;
+
+#ifdef INIFILE_STATS
+	Stats->zCounting = true;
+	Stats->zAllocations = __atomic_load_n(&sAllocations, __ATOMIC_RELAXED);
+	Stats->zReallocations = __atomic_load_n(&sReallocations, __ATOMIC_RELAXED);
+	Stats->zFrees = __atomic_load_n(&sFrees, __ATOMIC_RELAXED);
+	Stats->zLoadAllocations = zLoadAllocations;
+	Stats->zLoadTime = zLoadTime;
+	Stats->zStoreTime = zStoreTime;
+#endif
+}
+
 // Dumps the contents of this ini file to standard
 // output with a little bit of pretty formatting
 void IniFile::PrintContents() const
 {
-	IniNode *node = zRootList.zStart;
+	IniNode *node = ParsedRootList()->zStart;
 	while (node != NULL)
 	{
 		node->PrintContents("");
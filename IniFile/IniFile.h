@@ -8,6 +8,7 @@
 #define _INI_FILE_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
 
@@ -15,6 +16,56 @@
 
 class NodeList;	// Forward declaration
 
+struct IniRange {	// A byte range of a lazily loaded file that's still waiting to be parsed
+	off_t zStart, zEnd;
+	IniRange *zNext;
+};
+
+// Where IniFile gets its memory from (see IniFile::SetAllocator())
+struct IniAllocator {
+	void *(*zAlloc)(size_t Size, void *Cookie);
+	void *(*zRealloc)(void *Ptr, size_t Size, void *Cookie);
+	void (*zFree)(void *Ptr, void *Cookie);
+	void *zCookie;
+};
+
+// What IniFile::GetStats() reports. Memory is counted as requested from
+// the allocator; lists and names shared with copies are counted in full.
+struct IniStats {
+	size_t zSections;
+	size_t zKeys;
+	size_t zNodes;			// IniNodes, i.e. sections plus keys
+	size_t zLists;			// NodeLists
+	size_t zPendingSections;	// Not parsed yet (see LoadLazy()), so
+								// their keys aren't counted
+	size_t zStringBytes;		// Names and values, including the name pool
+	size_t zOverheadBytes;		// Nodes, lists, tables and buffers
+
+	// Only counted when IniFile is built with INIFILE_STATS defined,
+	// zero otherwise. Allocation counts are process wide.
+	bool zCounting;
+	unsigned long zAllocations, zReallocations, zFrees;
+	unsigned long zLoadAllocations;	// Made by the last load
+	double zLoadTime;		// Seconds taken by the last load
+	double zStoreTime;		// Seconds taken by the last store
+};
+
+// Tells versions of a file on disk apart by its size, inode and its
+// modification and status change times, to the nanosecond where the
+// system keeps them that precisely
+struct IniFileStamp {
+	off_t zSize;
+	ino_t zInode;
+	int64_t zTime;			// Nanoseconds
+	int64_t zChangeTime;
+
+	IniFileStamp() : zSize(-1), zInode(0), zTime(0), zChangeTime(0) {}
+	bool Set(const char *Filename);
+		// Returns false, leaving the stamp unset, if there's no such file
+	bool IsSet() const { return zSize >= 0; }
+	bool operator==(const IniFileStamp &Other) const;
+};
+
 class IniNode {	// Used for sections and keys
 	public:
 		char *zName;
@@ -22,18 +73,39 @@ class IniNode {	// Used for sections and keys
 		NodeList *zChildList;
 		IniNode *zNext;
 
+		unsigned long zGeneration;
+			// IniFile generation at which this node was last modified
+		off_t zFileOffset, zFileLength;
+			// Byte range this section occupies in the file it was last
+			// loaded from or stored to (-1 if unknown, e.g. new sections)
+		IniRange *zPending;
+			// For sections of a lazily loaded file, the ranges holding
+			// keys that haven't been parsed yet (NULL once parsed)
+		bool zNameInterned;
+			// zName belongs to the IniFile's name pool (see InternName())
+
 		IniNode();
 		IniNode(const char *Name, const char *Str);
 		IniNode(const IniNode &ref);
+			// The copy shares ref's child list (see NodeList::IsShared())
+#if __cplusplus >= 201103L
+		IniNode(IniNode &&ref);
+#endif
 		~IniNode();
 
 		void SetName(const char *Name);
+		void SetInternedName(const char *Name);
+			// Uses Name, which must outlive us, without copying it
 		void SetStr(const char *Str);
 		
 		void PrintContents(const char *indentStr) const;
 
 		void DeleteStr(char *str);
 		char* AllocStr(const size_t size);
+
+		// Nodes come from the IniAllocator too
+		static void *operator new(size_t Size);
+		static void operator delete(void *Ptr);
 	protected:
 		void CopyStr(char **str, const char *val);
 	private:
@@ -44,6 +116,7 @@ class IniNode {	// Used for sections and keys
 class NodeList {	// Keeps a list of IniNodes
 	private:
 		int zCount;
+		int zRefs;		// Number of owners sharing this list
 	protected:
 		void Clone(const NodeList &ref);
 			// Clears the list and makes it a copy of ref
@@ -52,9 +125,25 @@ class NodeList {	// Keeps a list of IniNodes
 
 		NodeList();
 		NodeList(const NodeList &ref);
+#if __cplusplus >= 201103L
+		NodeList(NodeList &&ref);
+#endif
 		~NodeList();
 
 		NodeList& operator=(const NodeList &ref);
+#if __cplusplus >= 201103L
+		NodeList& operator=(NodeList &&ref);
+#endif
+
+		// Lists are reference counted so that copies of an IniFile can share
+		// them until one of the copies modifies them. A new list has a single
+		// reference; whoever drops the last one deletes the list.
+		void AcquireReference();
+		bool ReleaseReference();
+			// Returns true if that was the last reference
+		bool IsShared() const;
+			// Returns true if the list has more than one owner, in which
+			// case it must be copied before being modified
 		
 		void Add(IniNode *Item);
 			// Adds the given item to the list (does nothing if Item is NULL)			
@@ -68,25 +157,114 @@ class NodeList {	// Keeps a list of IniNodes
 			// Returns the # of items in the list
 		IniNode *FindNode(const char *Name) const;
 			// Returns the node with the given Name
+		IniNode *FindInternedNode(const char *Name) const;
+			// Same, but only compares pointers, so all names must come
+			// from the same name pool as Name
+
+		static void *operator new(size_t Size);
+		static void operator delete(void *Ptr);
+};
+
+struct IniHandleSlot;
+struct IniShard;
+class IniNamePool;
+
+// Names a key in a way that IniFile can look up faster than by name.
+// Handles are meant to be long-lived (typically static) objects: the
+// first access through a handle resolves it against the IniFile it is
+// used with, later accesses go straight to the key. Every IniFile keeps
+// its own table of resolved handles, which is reset whenever keys could
+// have gone away (Clear(), assignment, ...), so a handle works with any
+// number of IniFile objects. Section and Key are not copied and must
+// outlive the handle.
+class IniKeyHandle {
+	public:
+		IniKeyHandle(const char *Section, const char *Key);
+
+		const char *Section() const { return zSection; }
+		const char *Key() const { return zKey; }
+	private:
+		friend class IniFile;
+
+		const char *zSection;
+		const char *zKey;
+		int zIndex;			// Slot in each IniFile's handle table
+
+		static int sCount;	// Number of handles ever created
 };
 
 class IniFile {
 	public:
 		// Constructors/Destructor
-		IniFile() {};
+		IniFile();
 		IniFile(const IniFile &ref);
 		IniFile(const char *Filename);
-		virtual ~IniFile() {};
+		virtual ~IniFile();
+			// Copies share the tree of the original and only copy the
+			// parts they modify, so copying an IniFile is cheap
 
 		// Assignment
 		IniFile &operator=(const IniFile &Ini);
 
+#if __cplusplus >= 201103L
+		// Moving, which leaves the source empty
+		IniFile(IniFile &&ref);
+		IniFile &operator=(IniFile &&Ini);
+#endif
+
 		// Load and storing entire Ini files from disk
 		bool Load(const char *Filename, const bool ThrowExceptionOnFileError = false);
 		bool Store(const char *Filename, const bool ThrowExceptionOnFileError = false);
+
+		// Lazy loading. LoadLazy() only scans the file for section headers;
+		// the keys of each section are parsed the first time the section
+		// is accessed. The file is kept in memory until every section has
+		// been parsed (or the IniFile is cleared). The result is exactly
+		// what Load() would have produced.
+		bool LoadLazy(const char *Filename, const bool ThrowExceptionOnFileError = false);
+		void ParseAllSections();
+			// Forces all pending sections to be parsed
+
+		// Parallel loading, for very big files. The file is mapped and cut
+		// into shards at section lines, which are parsed by up to Threads
+		// threads at once (0 means one per CPU) and then put together in
+		// file order. The result is exactly what Load() would have
+		// produced; small files are simply handed over to Load().
+		bool LoadParallel(const char *Filename, int Threads = 0, const bool ThrowExceptionOnFileError = false);
+		static const off_t kParallelMinSize;
+			// Files smaller than this aren't worth starting threads for
+
+		// Compiled image cache. When enabled, Load() and LoadLazy() first
+		// look for a binary image of the file next to it (Filename plus
+		// kImageSuffix). If the image was made from the file as it is now
+		// (same size, inode and modification time, to the nanosecond), it
+		// is mapped into memory and used directly; sections are copied out
+		// of it on first access, no parsing involved. Otherwise the text is parsed as usual and a new
+		// image is written. Store() keeps the image up to date as well.
+		void SetImageCache(bool Enabled) { zUseImage = Enabled; }
+		bool ImageCache() const { return zUseImage; }
+		static const char *kImageSuffix;
 		
 		// Clear the ini file
 		void Clear();
+
+		// Modification tracking. Every change to the tree bumps the
+		// generation; Store() is a no-op when nothing changed since the
+		// last Load() or Store() of the same (unchanged) file. Otherwise,
+		// if only sections that were in the file changed, only those are
+		// written out again: the rest is copied over from the file as it
+		// is. Either way a new file is written that then replaces the old
+		// one, so a Store() that fails leaves the old file as it was.
+		bool IsModified() const;
+		unsigned long Generation() const { return zGeneration; }
+		unsigned long StoresSkipped() const { return zStoresSkipped; }
+		unsigned long StoresPerformed() const { return zStoresPerformed; }
+		unsigned long StoresIncremental() const { return zStoresIncremental; }
+			// StoresIncremental() counts the subset of StoresPerformed()
+			// that only patched the dirty sections
+		bool FileUnchanged(const char *Filename) const;
+			// True if Filename is the file last loaded or stored, and it
+			// hasn't changed on disk since
 			
 		// Writing functions
 		void WriteInt(const char *Section, const char *Key, const int Val);
@@ -94,7 +272,93 @@ class IniFile {
 		void WriteFloat(const char *Section, const char *Key, const float Val);
 		void WriteString(const char *Section, const char *Key, const char *Val);
 		void WriteData(const char *Section, const char *Key, const void *Data, const size_t Size);
+
+		// How WriteData() turns binary data into text. ReadData() reads all
+		// of them, whatever the current setting. The versioned encodings
+		// start with "!1", a char for the encoding and one for the
+		// compression, followed by the encoded size (a little endian
+		// base-128 varint, so up to 64 bits) and data.
+		enum DataEncoding {
+			LegacyData,		// What older versions wrote: 6-bit chars, a
+							// 32-bit size, 4/3 the size of the data
+			Base64Data,		// The same chars, versioned (the default)
+			Z85Data			// 85 chars, 5/4 the size of the data
+		};
+		void SetDataEncoding(DataEncoding Encoding, bool Compress = false);
+			// With Compress, data gets deflated first if that makes it
+			// smaller. Needs IniFile to be built with INIFILE_ZLIB defined,
+			// otherwise Compress is ignored and compressed data can't be read.
 		
+		// Allocation free reading functions. Each returns true and sets
+		// *Result if the key exists and its value parses as the requested
+		// type, and returns false leaving *Result alone otherwise. Numbers
+		// are parsed like sscanf() would (leading whitespace is skipped and
+		// trailing junk is ignored), except that out of range values fail.
+		// FindString() hands out a pointer to the value itself, which stays
+		// valid until the key is written to or the IniFile is changed.
+		bool FindString(const char *Section, const char *Key, const char **Result, size_t *Length = NULL) const;
+		bool FindInt(const char *Section, const char *Key, int *Result) const;
+		bool FindInt64(const char *Section, const char *Key, int64_t *Result) const;
+		bool FindUInt(const char *Section, const char *Key, unsigned int *Result) const;
+		bool FindDouble(const char *Section, const char *Key, double *Result) const;
+		bool FindBool(const char *Section, const char *Key, bool *Result) const;
+			// FindBool() takes any integer (non-zero being true) as well
+			// as "true" and "false"
+
+		// Going through all keys of a section at once
+		typedef bool (*KeyVisitor)(const char *Key, const char *Value, void *Cookie);
+		bool ForEachKey(const char *Section, KeyVisitor Visitor, void *Cookie) const;
+			// Calls Visitor for each key of Section, in file order, until
+			// it returns false. Returns false if there's no such section.
+
+		// Comparing two versions of a file
+		typedef void (*ChangeVisitor)(const char *Section, const char *Key,
+			const char *OldValue, const char *NewValue, void *Cookie);
+		int Diff(const IniFile &Newer, ChangeVisitor Visitor, void *Cookie) const;
+			/*	Calls Visitor for every key whose value differs between us
+				and Newer, and returns how many there were. OldValue is NULL
+				for keys that are new in Newer, NewValue is NULL for keys that
+				are gone. Sections Newer still shares with us (see copying)
+				are skipped without looking at their keys.
+			*/
+		void Merge(const IniFile &Over);
+			// Copies every key of Over into us, replacing the values of
+			// keys we both have
+
+		// The same, going through a key handle
+		bool FindString(const IniKeyHandle &Handle, const char **Result, size_t *Length = NULL) const;
+		bool FindInt(const IniKeyHandle &Handle, int *Result) const;
+		bool FindInt64(const IniKeyHandle &Handle, int64_t *Result) const;
+		bool FindUInt(const IniKeyHandle &Handle, unsigned int *Result) const;
+		bool FindDouble(const IniKeyHandle &Handle, double *Result) const;
+		bool FindBool(const IniKeyHandle &Handle, bool *Result) const;
+		int ReadInt(const IniKeyHandle &Handle, const int Default = 0) const;
+		bool ReadBool(const IniKeyHandle &Handle, const bool Default = false) const;
+		float ReadFloat(const IniKeyHandle &Handle, const float Default = 0.0) const;
+		void WriteString(const IniKeyHandle &Handle, const char *Val);
+		void WriteInt(const IniKeyHandle &Handle, const int Val);
+		void WriteBool(const IniKeyHandle &Handle, const bool Val);
+		void WriteFloat(const IniKeyHandle &Handle, const float Val);
+
+		void FreezeHandles();
+			/*	Makes reading through handles safe for several threads at
+				once: the handle table gets room for every handle created so
+				far and is never reallocated afterwards (until the IniFile is
+				cleared or assigned to); slots are filled in atomically on
+				first use. SharedIniFile does this for every version it
+				publishes. Handles created later still work, they are just
+				looked up by name every time.
+			*/
+
+		const char *InternName(const char *Key);
+			/*	Key names are only stored once per IniFile (and its copies),
+				no matter how many sections use them. InternName() returns the
+				stored copy of Key, adding it if needed. Lookups done with that
+				copy find their key by comparing pointers instead of strings.
+				It stays valid for as long as this IniFile or a copy of it
+				exists. Section names aren't pooled.
+			*/
+
 		// Reading functions
 		int ReadInt(const char *Section, const char *Key, const int Default = 0) const;
 		bool ReadBool(const char *Section, const char *Key, const bool Default = false) const;
@@ -137,6 +401,19 @@ class IniFile {
 					Store(...) but only when ThrowExceptionOnFileError == true
 			*/
 		
+		// Memory statistics
+		void GetStats(IniStats *Stats) const;
+			// Walks the whole tree, so it isn't free, but doesn't parse
+			// any pending sections
+		static void SetAllocator(const IniAllocator *Allocator);
+			/*	Makes every IniFile allocate its memory through Allocator
+				(NULL goes back to malloc() and friends), e.g. to keep track
+				of it. Since memory has to be freed by the allocator it came
+				from, this must be done before any IniFile is created. Strings
+				and buffers handed out by ReadString() and ReadData() still
+				come from malloc().
+			*/
+
 		// Handy debugging kinda function
 		void PrintContents() const;
 
@@ -163,13 +440,85 @@ class IniFile {
 		// of data with each of them).
 		char inline Binary8ToChar6(unsigned char binaryValue) const;
 		unsigned char inline Char6ToBinary8(char charValue) const;
-		int DecodeData(const char *sourceData, const size_t sourceSize, unsigned char *destData, const size_t destSize) const;
+		size_t DecodeData(const char *sourceData, const size_t sourceSize, unsigned char *destData, const size_t destSize) const;
+		size_t DecodedSize(const char *sourceData, const size_t sourceSize) const;
 
 	private:
-		// Our list of sections
-		NodeList zRootList;
+		// Our list of sections, possibly shared with copies of us
+		NodeList *zRootList;
+		static NodeList *AcquireEmptyRoot();
+		void MakeWritable();
+		void MakeSectionWritable(IniNode *iSection);
+		IniNode *WritableSection(const char *Section);
+		void Swap(IniFile &Ini);
+
+		// Modification tracking state (see IsModified())
+		unsigned long zGeneration;
+		unsigned long zStoredGeneration;
+		bool zLayoutValid;		// Section byte ranges match zFilename
+		char *zFilename;		// File last loaded from or stored to
+		IniFileStamp zFileStamp;	// and how it was then
+		unsigned long zStoresSkipped;
+		unsigned long zStoresPerformed;
+		unsigned long zStoresIncremental;
+		double zLoadTime, zStoreTime;	// See GetStats()
+		unsigned long zLoadAllocations;
+
+		void Touch(IniNode *iSection, IniNode *iKey = NULL);
+		void SetFilename(const char *Filename);
+		void MarkStored(const char *Filename);
+		bool StoreIncremental(const char *Filename);
+		size_t SectionSize(const IniNode *iSection) const;
+		size_t WriteSection(FILE *stream, const IniNode *iSection) const;
+
+		// Lazy loading state (see LoadLazy())
+		char *zLazyBuffer;
+		off_t zLazySize;
+		void ParseSection(IniNode *iSection);
+		void FreeLazyBuffer();
+		NodeList *ParsedRootList() const;
+
+		// Image cache state (see SetImageCache())
+		bool zUseImage;
+		void *zImage;			// Mapped image, while sections are pending in it
+		size_t zImageSize;
+		IniNode **zImageSections;	// Section nodes in image order
+		bool LoadImage(const char *Filename);
+		void StoreImage(const char *Filename);
+		IniNode *FindImageSection(const char *Section) const;
+		void CopyImageSection(IniNode *iSection);
+		void FreeImage();
+
+		// Binary data encoding (see SetDataEncoding())
+		DataEncoding zDataEncoding;
+		bool zCompressData;
+		void WriteVersionedData(IniNode *iKey, const void *Data, const size_t Size);
+
+		// Pool of key names (see InternName())
+		IniNamePool *zNames;
+		IniNamePool *NamePool();
+
+		// Parallel loading (see LoadParallel())
+		off_t FindShardStart(const char *Data, off_t Size, off_t Pos);
+		void ParseShard(IniShard *Shard);
+		static void *ShardThread(void *Data);
+		void SpliceShard(IniShard *Shard);
+
+		// Key handle state (see IniKeyHandle)
+		IniHandleSlot *zHandleSlots;
+		int zHandleCount;
+		bool zHandlesFrozen;		// Set by FreezeHandles()
+		void GrowHandleTable(int Count);
+		void ResetHandles();
+		IniNode *HandleNode(const IniKeyHandle &Handle) const;
+		void SetValue(IniNode *iSection, IniNode *iKey, const char *Val);
+
+		// Parses a single line
+		enum LineType { SectionLine, DataLine, Nonsense };
+		LineType ParseLine(char *line, char **name, char **value);
 
 		// Handy functions for reading chars and lines from files
+		off_t zReadOffset;		// Bytes consumed by ReadChar() so far
 		char inline ReadChar(FILE *stream);
 		bool ReadLine(FILE *stream, char **str);
 
@@ -204,7 +553,127 @@ class IniFile {
 		void EncodeBlockToString(const unsigned char *blockData, char *stringData);
 		void inline DecodeBlockToBuffer(const char *stringData, unsigned char *blockData) const;		
 		
+		friend class IniDataWriter;
+		friend class IniDataReader;
+		friend class IniBatch;
 };
 
+// Streams binary data into a key, encoding it as it comes in, so it never
+// has to be in memory in one piece. Size has to be known up front. The
+// data is encoded like WriteData() would (see SetDataEncoding()), except
+// that compressed data stays compressed even when it didn't get smaller.
+// Nothing is stored until Finish() is called.
+class IniDataWriter {
+	public:
+		IniDataWriter(IniFile &Ini, const char *Section, const char *Key, const size_t Size);
+		~IniDataWriter();
+
+		size_t Write(const void *Data, const size_t Length);
+			// Returns how much of Data was taken, which is less than Length
+			// only if that would have gone beyond Size
+		bool Finish();
+			// Stores the data; fails if less than Size bytes were written
+	private:
+		IniDataWriter(const IniDataWriter &ref);
+		IniDataWriter &operator=(const IniDataWriter &ref);
+
+		void Append(const unsigned char *Data, size_t Length);
+		void Reserve(size_t Length);
+		void Deflate(const unsigned char *Data, size_t Length, bool Finish);
+
+		IniFile &zIni;
+		char *zSectionName, *zKeyName;
+		size_t zSize;			// Bytes promised
+		size_t zWritten;		// Bytes written so far
+		char zEncoding;
+		char *zText;			// Encoded so far
+		size_t zTextLength, zTextSize;
+		unsigned char zBlock[4];	// Bytes that don't make up a full block yet
+		size_t zBlockFill;
+		void *zStream;			// Deflate state, if compressing
+};
+
+// Streams binary data out of a key, decoding it as it is read. Reads any
+// data WriteData() or IniDataWriter can write. The IniFile must not be
+// modified while the reader is in use.
+class IniDataReader {
+	public:
+		IniDataReader(const IniFile &Ini, const char *Section, const char *Key);
+		IniDataReader(const char *Text, const size_t Length);
+			// Reads data encoded in Text instead
+		~IniDataReader();
+
+		bool IsValid() const { return zText != NULL; }
+			// False if there's no such key or its data is damaged
+		size_t Size() const { return zSize; }
+			// Number of bytes stored (reading may end early if the text
+			// was cut short)
+		size_t Read(void *Buffer, const size_t Length);
+			// Returns the number of bytes read, 0 at the end
+	private:
+		IniDataReader(const IniDataReader &ref);
+		IniDataReader &operator=(const IniDataReader &ref);
+
+		void SetTo(const char *Text, const size_t Length);
+		size_t Inflate(unsigned char *Buffer, size_t Length);
+
+		const char *zText;		// Encoded blocks
+		size_t zTextLength;
+		char zEncoding;
+		size_t zSize;			// Bytes stored
+		size_t zRead;			// Bytes read so far
+		size_t zPosition;		// Position in the decoded blocks
+		void *zStream;			// Inflate state, for compressed data
+		unsigned char *zInput;	// Deflated bytes waiting to be inflated
+};
+
+
+// Stages writes to the keys of one section and applies them all at once.
+// Nothing changes until Commit(), which either applies every staged write
+// or, if it runs out of memory, none of them. However many keys there are,
+// the section is only looked up once and its keys are matched up with the
+// staged ones in a single pass. Writing the same key twice keeps the last
+// value. As with IniFile, every function may throw an
+// IniFile::EInsufficientMemory.
+class IniBatch {
+	public:
+		IniBatch(IniFile &Ini, const char *Section);
+		~IniBatch();
+
+		void WriteString(const char *Key, const char *Val);
+		void WriteInt(const char *Key, const int Val);
+		void WriteBool(const char *Key, const bool Val);
+		void WriteFloat(const char *Key, const float Val);
+		int Count() const { return zCount; }
+			// Number of keys staged
+
+		bool Commit(const char *Filename = NULL, const bool ThrowExceptionOnFileError = false);
+			// Applies the staged writes and starts over with an empty batch.
+			// With Filename, the file is stored afterwards (once, and only
+			// if anything changed since it was last loaded or stored); the
+			// result is that of Store(), or true without Filename.
+		void Discard();
+			// Throws the staged writes away
+	private:
+		IniBatch(const IniBatch &ref);
+		IniBatch &operator=(const IniBatch &ref);
+
+		struct Entry {
+			const char *zKey;		// Interned
+			char *zValue;
+			IniNode *zNode;			// Only while committing
+			bool zNew;
+		};
+
+		IniFile &zIni;
+		char *zSection;
+		Entry *zEntries;
+		int zCount, zSize;
+		int *zTable;			// Open addressing hash of zEntries indices, -1 if free
+		int zTableSize;
+
+		int FindEntry(const char *Key) const;
+		void GrowTable();
+};
 
 #endif
@@ -0,0 +1,191 @@
+//----------------------------------------------------------------------
+//	IniFileWatch.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "IniFileWatch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(INI_FILE_WATCH_POLL)
+#	include <sys/inotify.h>
+#	define INI_FILE_WATCH_INOTIFY
+#endif
+
+
+IniFileWatch::IniFileWatch(const char *Filename, IniFile::ChangeVisitor Visitor, void *Cookie)
+	: zFilename(NULL), zBasename(NULL), zVisitor(Visitor), zCookie(Cookie),
+	  zCurrent(NULL), zStatValid(false), zNotify(-1)
+{
+	zFilename = (char *)malloc(strlen(Filename) + 1);
+	if (zFilename == NULL)
+		throw IniFile::EInsufficientMemory();
+	strcpy(zFilename, Filename);
+	const char *slash = strrchr(zFilename, '/');
+	zBasename = slash != NULL ? slash + 1 : zFilename;
+
+	try
+	{
+		zCurrent = new IniFile();
+		if (zCurrent == NULL)
+			throw IniFile::EInsufficientMemory();
+	}
+	catch (...)
+	{
+		free(zFilename);
+		throw;
+	}
+
+	// Watch first, so that nothing written after loading can slip by
+	StartNotify();
+	Reload();
+}
+
+IniFileWatch::~IniFileWatch()
+{
+	if (zNotify >= 0)
+		close(zNotify);
+	delete zCurrent;
+	free(zFilename);
+}
+
+int IniFileWatch::Poll()
+{
+	bool changed = zNotify >= 0 ? DrainNotify() : StatChanged();
+	if (!changed)
+		return 0;
+
+	IniFile *older = zCurrent;
+	zCurrent = NULL;
+	try
+	{
+		zCurrent = new IniFile();
+		if (zCurrent == NULL)
+			throw IniFile::EInsufficientMemory();
+		if (!Reload())
+		{
+			delete zCurrent;
+			zCurrent = older;
+			return 0;
+		}
+	}
+	catch (...)
+	{
+		delete zCurrent;
+		zCurrent = older;
+		throw;
+	}
+
+	int changes = 0;
+	try
+	{
+		changes = older->Diff(*zCurrent, zVisitor, zCookie);
+	}
+	catch (...)
+	{
+		delete older;
+		throw;
+	}
+	delete older;
+	return changes;
+}
+
+// Loads the file into zCurrent, remembering what it looked like
+bool IniFileWatch::Reload()
+{
+	struct stat st;
+	if (stat(zFilename, &st) != 0 || !zCurrent->Load(zFilename))
+	{
+		zStatValid = false;
+		return false;
+	}
+	zStat = st;
+	zStatValid = true;
+	return true;
+}
+
+// Sets up inotify on the directory the file is in, if we can. Watching
+// the file itself would lose track of it as soon as it got replaced.
+void IniFileWatch::StartNotify()
+{
+#ifdef INI_FILE_WATCH_INOTIFY
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	char *directory;
+	if (zBasename == zFilename)
+		directory = strdup(".");
+	else if (zBasename == zFilename + 1)
+		directory = strdup("/");
+	else
+		directory = strndup(zFilename, zBasename - zFilename - 1);
+	if (directory == NULL)
+	{
+		close(fd);
+		throw IniFile::EInsufficientMemory();
+	}
+
+	int watch = inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO
+		| IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB);
+	free(directory);
+	if (watch < 0)
+	{
+		close(fd);
+		return;
+	}
+	zNotify = fd;
+#endif
+}
+
+// Reads all pending events, returns true if any concerned our file
+bool IniFileWatch::DrainNotify()
+{
+	bool changed = false;
+#ifdef INI_FILE_WATCH_INOTIFY
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;)
+	{
+		ssize_t length = read(zNotify, buffer, sizeof buffer);
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length <= 0)
+			break;
+
+		for (char *pos = buffer; pos < buffer + length; )
+		{
+			const struct inotify_event *event = (const struct inotify_event *)pos;
+			if ((event->mask & IN_Q_OVERFLOW) != 0
+				|| (event->len > 0 && strcmp(event->name, zBasename) == 0))
+				changed = true;
+			pos += sizeof(struct inotify_event) + event->len;
+		}
+	}
+#endif
+	return changed;
+}
+
+// Whole seconds would miss a rewrite of the same size right after the
+// previous one, so we go finer where we can
+static bool SameTime(const struct stat &a, const struct stat &b)
+{
+#if defined(__linux__) || defined(__HAIKU__)
+	return a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec
+		&& a.st_ctim.tv_sec == b.st_ctim.tv_sec && a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
+#else
+	return a.st_mtime == b.st_mtime && a.st_ctime == b.st_ctime;
+#endif
+}
+
+bool IniFileWatch::StatChanged()
+{
+	struct stat st;
+	if (stat(zFilename, &st) != 0)
+		return false;
+	return !zStatValid || st.st_size != zStat.st_size || st.st_ino != zStat.st_ino
+		|| !SameTime(st, zStat);
+}
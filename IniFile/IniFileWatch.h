@@ -0,0 +1,59 @@
+//----------------------------------------------------------------------
+//	IniFileWatch.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _INI_FILE_WATCH_H_
+#define _INI_FILE_WATCH_H_
+
+#include "IniFile.h"
+
+#include <sys/stat.h>
+
+// Keeps an eye on an ini file and tells which keys changed when it does.
+// On Linux, inotify reports writes to the file (and to its directory, so
+// that files replaced by renaming a new one over them are noticed as
+// well); elsewhere, if inotify can't be used, or if built with
+// INI_FILE_WATCH_POLL defined, the file's size and times are checked on
+// every Poll(). Either way nothing happens in between: the caller decides
+// when, and on which thread, changes are delivered.
+//
+// A file that can't be read is taken to be in the middle of being
+// replaced, so the previous contents are kept until it can be read again.
+class IniFileWatch {
+public:
+	IniFileWatch(const char *Filename, IniFile::ChangeVisitor Visitor, void *Cookie);
+	~IniFileWatch();
+
+	int Poll();
+		// Reloads the file if it changed and calls Visitor for every key
+		// that differs from the previous version (see IniFile::Diff()).
+		// Returns the number of changed keys.
+	const IniFile &Contents() const { return *zCurrent; }
+		// The file as of the last Poll() (or construction)
+
+	int FileDescriptor() const { return zNotify; }
+		// Becomes readable when the file may have changed, so it can be
+		// select()ed on; -1 when polling
+	bool IsNotified() const { return zNotify >= 0; }
+private:
+	char *zFilename;
+	const char *zBasename;	// Points into zFilename
+	IniFile::ChangeVisitor zVisitor;
+	void *zCookie;
+	IniFile *zCurrent;
+	struct stat zStat;		// Of the file zCurrent was loaded from
+	bool zStatValid;
+	int zNotify;			// inotify descriptor, -1 if polling
+
+	void StartNotify();
+	bool DrainNotify();
+	bool StatChanged();
+	bool Reload();
+
+	IniFileWatch(const IniFileWatch &ref);
+	IniFileWatch &operator=(const IniFileWatch &ref);
+};
+
+#endif
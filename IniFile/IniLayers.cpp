@@ -0,0 +1,187 @@
+//----------------------------------------------------------------------
+//	IniLayers.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "IniLayers.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+
+IniLayers::IniLayers()
+	: zLayers(NULL), zCount(0), zMerged(NULL), zRebuilds(0)
+{
+}
+
+IniLayers::~IniLayers()
+{
+	for (int i = 0; i < zCount; i++)
+	{
+		delete zLayers[i].zFile;
+		free(zLayers[i].zFilename);
+	}
+	free(zLayers);
+	delete zMerged;
+}
+
+void IniLayers::AddLayer(const char *Filename)
+{
+	Layer *layers = (Layer *)realloc(zLayers, (zCount + 1) * sizeof(Layer));
+	if (layers == NULL)
+		throw IniFile::EInsufficientMemory();
+	zLayers = layers;
+
+	Layer &layer = zLayers[zCount];
+	layer.zFilename = (char *)malloc(strlen(Filename) + 1);
+	if (layer.zFilename == NULL)
+		throw IniFile::EInsufficientMemory();
+	strcpy(layer.zFilename, Filename);
+	layer.zFile = new IniFile();
+	if (layer.zFile == NULL)
+	{
+		free(layer.zFilename);
+		throw IniFile::EInsufficientMemory();
+	}
+	zCount++;
+
+	Load(layer);
+	Invalidate();
+}
+
+// (Re)loads a layer from its file, leaving it empty if it can't be read.
+// Load() adds to what's there, so the old contents go first.
+void IniLayers::Load(Layer &layer)
+{
+	layer.zFile->Clear();
+	layer.zMissing = !layer.zFile->Load(layer.zFilename);
+	if (layer.zMissing)
+		layer.zFile->Clear();
+}
+
+void IniLayers::Invalidate()
+{
+	delete zMerged;
+	zMerged = NULL;
+}
+
+bool IniLayers::Refresh()
+{
+	bool changed = false;
+	for (int i = 0; i < zCount; i++)
+	{
+		Layer &layer = zLayers[i];
+		if (layer.zMissing)
+		{
+			struct stat st;
+			if (stat(layer.zFilename, &st) != 0)
+				continue;
+		}
+		else if (layer.zFile->FileUnchanged(layer.zFilename))
+			continue;
+
+		Load(layer);
+		changed = true;
+	}
+
+	if (changed)
+		Invalidate();
+	return changed;
+}
+
+// Copies of an IniFile share what they don't modify, so the view starts
+// out as a copy of the bottom layer, and only the sections the layers
+// above touch get copies of their own
+IniFile *IniLayers::MergeLayers(int Count) const
+{
+	IniFile *merged = Count > 0 ? new IniFile(*zLayers[0].zFile) : new IniFile();
+	if (merged == NULL)
+		throw IniFile::EInsufficientMemory();
+	try
+	{
+		for (int i = 1; i < Count; i++)
+			merged->Merge(*zLayers[i].zFile);
+	}
+	catch (...)
+	{
+		delete merged;
+		throw;
+	}
+	return merged;
+}
+
+const IniFile &IniLayers::Merged()
+{
+	if (zMerged != NULL)
+		return *zMerged;
+
+	zMerged = MergeLayers(zCount);
+	zRebuilds++;
+	return *zMerged;
+}
+
+IniFile IniLayers::MergedBelow() const
+{
+	IniFile *merged = MergeLayers(zCount > 0 ? zCount - 1 : 0);
+	IniFile below(*merged);
+	delete merged;
+	return below;
+}
+
+IniFile &IniLayers::Top()
+{
+	if (zCount == 0)
+		AddLayer("");
+	Invalidate();
+	return *zLayers[zCount - 1].zFile;
+}
+
+bool IniLayers::Store(const bool ThrowExceptionOnFileError)
+{
+	if (zCount == 0)
+		return false;
+
+	Layer &top = zLayers[zCount - 1];
+	bool stored = top.zFile->Store(top.zFilename, ThrowExceptionOnFileError);
+	if (stored)
+		top.zMissing = false;
+	return stored;
+}
+
+void IniLayers::WriteString(const char *Section, const char *Key, const char *Val)
+{
+	IniFile *merged = zMerged;
+	zMerged = NULL;		// Keep Top() from throwing it away
+	try
+	{
+		Top().WriteString(Section, Key, Val);
+		if (merged != NULL)
+			merged->WriteString(Section, Key, Val);
+	}
+	catch (...)
+	{
+		delete merged;
+		throw;
+	}
+	zMerged = merged;
+}
+
+void IniLayers::WriteInt(const char *Section, const char *Key, const int Val)
+{
+	char str[40];
+	sprintf(str, "%d", Val);
+	WriteString(Section, Key, str);
+}
+
+void IniLayers::WriteBool(const char *Section, const char *Key, const bool Val)
+{
+	WriteInt(Section, Key, Val);
+}
+
+void IniLayers::WriteFloat(const char *Section, const char *Key, const float Val)
+{
+	char str[40];
+	sprintf(str, "%f", Val);
+	WriteString(Section, Key, str);
+}
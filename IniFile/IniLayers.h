@@ -0,0 +1,75 @@
+//----------------------------------------------------------------------
+//	IniLayers.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _INI_LAYERS_H_
+#define _INI_LAYERS_H_
+
+#include "IniFile.h"
+
+// A stack of ini files read as one, e.g. system wide defaults at the
+// bottom, then site settings, then the user's own on top. Every key gets
+// its value from the topmost layer that has it. The merged view is built
+// the first time it's needed and kept until a layer changes, either on
+// disk (see Refresh()) or through Top(). Layer files don't have to exist;
+// a missing one is just empty. As with IniFile, every function may throw
+// an IniFile::EInsufficientMemory.
+class IniLayers {
+public:
+	IniLayers();
+	~IniLayers();
+
+	void AddLayer(const char *Filename);
+		// Loads Filename as the new top layer
+	int CountLayers() const { return zCount; }
+
+	bool Refresh();
+		// Reloads the layers that changed on disk since they were loaded
+		// or stored. Returns true if any did, in which case the merged
+		// view will be rebuilt.
+	const IniFile &Merged();
+		// The merged view, rebuilt if a layer changed since last time
+	IniFile MergedBelow() const;
+		// Every layer but the top one merged, i.e. what the top layer
+		// inherits. Built on every call, and not kept.
+
+	IniFile &Top();
+		// The top layer, which is where changes go. Since it may be
+		// modified through the reference, the merged view is rebuilt the
+		// next time it's needed. Without any layers, an empty one that
+		// has no file is added first.
+	bool Store(const bool ThrowExceptionOnFileError = false);
+		// Stores the top layer to its file
+
+	// Writing to the top layer. Unlike going through Top(), these keep
+	// the merged view, just updating the key in it as well.
+	void WriteString(const char *Section, const char *Key, const char *Val);
+	void WriteInt(const char *Section, const char *Key, const int Val);
+	void WriteBool(const char *Section, const char *Key, const bool Val);
+	void WriteFloat(const char *Section, const char *Key, const float Val);
+
+	unsigned long Rebuilds() const { return zRebuilds; }
+		// Number of times the merged view has been built
+private:
+	struct Layer {
+		char *zFilename;
+		IniFile *zFile;
+		bool zMissing;		// The file couldn't be loaded
+	};
+
+	Layer *zLayers;
+	int zCount;
+	IniFile *zMerged;		// NULL when it has to be rebuilt
+	unsigned long zRebuilds;
+
+	void Load(Layer &layer);
+	void Invalidate();
+	IniFile *MergeLayers(int Count) const;
+
+	IniLayers(const IniLayers &ref);
+	IniLayers &operator=(const IniLayers &ref);
+};
+
+#endif
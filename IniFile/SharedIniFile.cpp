@@ -0,0 +1,178 @@
+//----------------------------------------------------------------------
+//	SharedIniFile.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#include "SharedIniFile.h"
+
+#include <sched.h>
+
+
+// The epoch handshake between readers and writers relies on all of
+// these being sequentially consistent
+static inline long AtomicAdd(volatile long *value, long addValue)
+{
+	return __atomic_fetch_add(value, addValue, __ATOMIC_SEQ_CST);
+}
+
+static inline long AtomicGet(volatile long *value)
+{
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+static inline unsigned long AtomicGet(volatile unsigned long *value)
+{
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+
+SharedIniFile::SharedIniFile()
+	: zCurrent(NULL), zEpoch(0)
+{
+	zReaders[0] = zReaders[1] = 0;
+	zCurrent = new IniFile();
+	if (zCurrent == NULL)
+		throw IniFile::EInsufficientMemory();
+	pthread_mutex_init(&zWriteLock, NULL);
+}
+
+SharedIniFile::~SharedIniFile()
+{
+	delete zCurrent;
+	pthread_mutex_destroy(&zWriteLock);
+}
+
+bool SharedIniFile::Refresh(const char *Filename, const bool UseImageCache)
+{
+	{
+		Reader current(*this);
+		if (current->FileUnchanged(Filename))
+			return false;
+	}
+
+	pthread_mutex_lock(&zWriteLock);
+
+	// Somebody else may have beaten us to it
+	if (zCurrent->FileUnchanged(Filename))
+	{
+		pthread_mutex_unlock(&zWriteLock);
+		return false;
+	}
+
+	IniFile *ini = NULL;
+	try
+	{
+		ini = new IniFile();
+		if (ini == NULL)
+			throw IniFile::EInsufficientMemory();
+		ini->SetImageCache(UseImageCache);
+		if (!ini->Load(Filename))
+		{
+			delete ini;
+			pthread_mutex_unlock(&zWriteLock);
+			return false;
+		}
+		Publish(ini);
+	}
+	catch (...)
+	{
+		delete ini;
+		pthread_mutex_unlock(&zWriteLock);
+		throw;
+	}
+
+	pthread_mutex_unlock(&zWriteLock);
+	return true;
+}
+
+// Makes Ini the current version and deletes the previous one once no
+// reader can see it anymore. The caller must hold zWriteLock.
+void SharedIniFile::Publish(IniFile *Ini)
+{
+	// Readers only ever call const functions, which must not have
+	// anything left to parse lazily or handle tables to grow
+	Ini->ParseAllSections();
+	Ini->FreezeHandles();
+
+	IniFile *old = zCurrent;
+	__atomic_store_n(&zCurrent, Ini, __ATOMIC_SEQ_CST);
+	unsigned long epoch = __atomic_fetch_add(&zEpoch, 1, __ATOMIC_SEQ_CST);
+
+	// Any reader that might still see the old version registered in
+	// the old epoch's counter before we flipped the epoch
+	while (AtomicGet(&zReaders[epoch & 1]) != 0)
+		sched_yield();
+
+	delete old;
+}
+
+
+//-----------------------------------------------------------------------------
+// SharedIniFile::Reader
+//-----------------------------------------------------------------------------
+
+SharedIniFile::Reader::Reader(SharedIniFile &Shared)
+	: zShared(Shared), zSlot(0), zFile(NULL)
+{
+	for (;;)
+	{
+		unsigned long epoch = AtomicGet(&zShared.zEpoch);
+		zSlot = epoch & 1;
+		AtomicAdd(&zShared.zReaders[zSlot], 1);
+
+		// If a writer flipped the epoch in the meantime, it may not have
+		// seen us register, so we have to start over
+		if (AtomicGet(&zShared.zEpoch) == epoch)
+			break;
+		AtomicAdd(&zShared.zReaders[zSlot], -1);
+	}
+
+	zFile = __atomic_load_n(&zShared.zCurrent, __ATOMIC_SEQ_CST);
+}
+
+SharedIniFile::Reader::~Reader()
+{
+	AtomicAdd(&zShared.zReaders[zSlot], -1);
+}
+
+
+//-----------------------------------------------------------------------------
+// SharedIniFile::Writer
+//-----------------------------------------------------------------------------
+
+SharedIniFile::Writer::Writer(SharedIniFile &Shared)
+	: zShared(Shared), zFile(NULL)
+{
+	pthread_mutex_lock(&zShared.zWriteLock);
+	try
+	{
+		zFile = new IniFile(*zShared.zCurrent);
+		if (zFile == NULL)
+			throw IniFile::EInsufficientMemory();
+	}
+	catch (...)
+	{
+		pthread_mutex_unlock(&zShared.zWriteLock);
+		throw;
+	}
+}
+
+SharedIniFile::Writer::~Writer()
+{
+	if (zFile != NULL)
+	{
+		delete zFile;
+		pthread_mutex_unlock(&zShared.zWriteLock);
+	}
+}
+
+void SharedIniFile::Writer::Commit()
+{
+	if (zFile == NULL)
+		return;
+
+	zShared.Publish(zFile);
+	zFile = NULL;
+	pthread_mutex_unlock(&zShared.zWriteLock);
+}
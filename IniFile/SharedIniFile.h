@@ -0,0 +1,83 @@
+//----------------------------------------------------------------------
+//	SharedIniFile.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _SHARED_INI_FILE_H_
+#define _SHARED_INI_FILE_H_
+
+#include "IniFile.h"
+
+#include <pthread.h>
+
+// An IniFile that can be shared between threads. Readers get an immutable
+// snapshot of the current version without taking any locks. Writers work
+// on a private copy and publish it as the new version in one step; the
+// old version is deleted once the last reader looking at it is done
+// (RCU style: readers register in one of two counters, selected by the
+// parity of the current epoch, and a writer waits for the counter of the
+// previous epoch to drain). Writers are serialized among themselves.
+//
+// Readers must not hold on to a snapshot for long, since that stalls
+// the next writer.
+class SharedIniFile {
+public:
+	SharedIniFile();
+	~SharedIniFile();
+
+	// Gives access to the current version for as long as it exists
+	class Reader {
+	public:
+		Reader(SharedIniFile &Shared);
+		~Reader();
+
+		const IniFile *operator->() const { return zFile; }
+		const IniFile &operator*() const { return *zFile; }
+	private:
+		SharedIniFile &zShared;
+		int zSlot;
+		const IniFile *zFile;
+
+		Reader(const Reader &ref);
+		Reader &operator=(const Reader &ref);
+	};
+
+	// Gives access to a private copy of the current version, which
+	// Commit() publishes. Going out of scope without Commit() throws
+	// the changes away.
+	class Writer {
+	public:
+		Writer(SharedIniFile &Shared);
+		~Writer();
+
+		IniFile *operator->() const { return zFile; }
+		IniFile &operator*() const { return *zFile; }
+		void Commit();
+	private:
+		SharedIniFile &zShared;
+		IniFile *zFile;
+
+		Writer(const Writer &ref);
+		Writer &operator=(const Writer &ref);
+	};
+
+	// Reloads Filename and publishes it if it changed on disk since the
+	// current version was loaded or stored. Returns true if it did.
+	bool Refresh(const char *Filename, const bool UseImageCache = false);
+
+	unsigned long Version() const { return __atomic_load_n(&zEpoch, __ATOMIC_RELAXED); }
+
+private:
+	IniFile * volatile zCurrent;
+	volatile unsigned long zEpoch;
+	volatile long zReaders[2];
+	pthread_mutex_t zWriteLock;
+
+	void Publish(IniFile *Ini);
+
+	SharedIniFile(const SharedIniFile &ref);
+	SharedIniFile &operator=(const SharedIniFile &ref);
+};
+
+#endif
@@ -1,22 +1,243 @@
 #include "Settings.h"
+#include "IniFile/SharedIniFile.h"
+#include "IniFile/IniFileWatch.h"
+#include "IniFile/IniLayers.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
-void LoadSettings(BString *proxy_serv, BString *proxy_auth, uint32 *proxy_port, uint32 *poll_rate)
+// Settings come in layers: system wide defaults, then site wide ones, then
+// the user's own file on top, which is where changes are saved. Only the
+// user's file has to exist.
+static const char *kSystemSettingsFile = "/boot/system/settings/SlimSOFT";
+static const char *kSiteSettingsFile   = "/boot/common/settings/SlimSOFT";
+static const char *kSettingsFile       = "/boot/home/config/settings/SlimSOFT";
+static const char *kSettingsSection    = "BeBitsUpdated";
+static IniLayers sLayers;
+static pthread_mutex_t sLayersLock = PTHREAD_MUTEX_INITIALIZER;
+
+// The fetch threads and the UI thread all go through this one copy of the
+// merged layers; it's only replaced when a layer changed on disk
+static SharedIniFile sSettings;
+
+// Where each setting is stored, in schema order
+#define SETTINGS_HANDLE_UINT(id, member, key, def, min, max) IniKeyHandle("BeBitsUpdated", key),
+#define SETTINGS_HANDLE_STRING(id, member, key, def)         IniKeyHandle("BeBitsUpdated", key),
+static const IniKeyHandle kHandles[SETTING_COUNT] = {
+  SETTINGS_SCHEMA(SETTINGS_HANDLE_UINT, SETTINGS_HANDLE_STRING)
+};
+#undef SETTINGS_HANDLE_UINT
+#undef SETTINGS_HANDLE_STRING
+
+// Accepts plain decimal numbers within [min, max] only
+static bool ParseUInt(const char *text, uint32 min, uint32 max, uint32 *result)
+{
+  while( *text == ' ' || *text == '\t' ) text++;
+  if( *text < '0' || *text > '9' )
+    return false;
+
+  char *end;
+  errno = 0;
+  unsigned long value = strtoul(text, &end, 10);
+  while( *end == ' ' || *end == '\t' ) end++;
+  if( *end != 0 || errno != 0 || value < min || value > max )
+    return false;
+
+  *result = value;
+  return true;
+}
+
+Settings::Settings()
+{
+#define SETTINGS_DEFAULT_UINT(id, member, key, def, min, max) member = def;
+#define SETTINGS_DEFAULT_STRING(id, member, key, def)         member = def;
+  SETTINGS_SCHEMA(SETTINGS_DEFAULT_UINT, SETTINGS_DEFAULT_STRING)
+#undef SETTINGS_DEFAULT_UINT
+#undef SETTINGS_DEFAULT_STRING
+}
+
+bool Settings::Set(SettingId id, const char *text)
+{
+  if( text == NULL )
+    return false;
+
+  switch( id )
+  {
+#define SETTINGS_SET_UINT(id, member, key, def, min, max) \
+    case SETTING_##id: return ParseUInt(text, min, max, &member);
+#define SETTINGS_SET_STRING(id, member, key, def) \
+    case SETTING_##id: member.SetTo(text); return true;
+    SETTINGS_SCHEMA(SETTINGS_SET_UINT, SETTINGS_SET_STRING)
+#undef SETTINGS_SET_UINT
+#undef SETTINGS_SET_STRING
+    default: return false;
+  }
+}
+
+void Settings::Get(SettingId id, BString *text) const
+{
+  switch( id )
+  {
+#define SETTINGS_GET_UINT(id, member, key, def, min, max) \
+    case SETTING_##id: text->SetTo(""); *text << member; break;
+#define SETTINGS_GET_STRING(id, member, key, def) \
+    case SETTING_##id: text->SetTo(member); break;
+    SETTINGS_SCHEMA(SETTINGS_GET_UINT, SETTINGS_GET_STRING)
+#undef SETTINGS_GET_UINT
+#undef SETTINGS_GET_STRING
+    default: text->SetTo(""); break;
+  }
+}
+
+// The key set is fixed, so the length weeds out most keys before a
+// single memcmp() settles it
+SettingId Settings::Find(const char *key)
+{
+  size_t length = strlen(key);
+#define SETTINGS_FIND_UINT(id, member, key_, def, min, max) \
+  if( length == sizeof(key_) - 1 && memcmp(key, key_, length) == 0 ) return SETTING_##id;
+#define SETTINGS_FIND_STRING(id, member, key_, def) \
+  if( length == sizeof(key_) - 1 && memcmp(key, key_, length) == 0 ) return SETTING_##id;
+  SETTINGS_SCHEMA(SETTINGS_FIND_UINT, SETTINGS_FIND_STRING)
+#undef SETTINGS_FIND_UINT
+#undef SETTINGS_FIND_STRING
+  return SETTING_COUNT;
+}
+
+const char *Settings::Key(SettingId id)
+{
+  return id < SETTING_COUNT ? kHandles[id].Key() : NULL;
+}
+
+// Hands every key of our section to the setting it belongs to
+static bool LoadSetting(const char *key, const char *value, void *cookie)
+{
+  SettingId id = Settings::Find(key);
+  if( id != SETTING_COUNT )
+    ((Settings *)cookie)->Set(id, value);
+  return true;
+}
+
+// Hands the merged layers to the readers of sSettings
+static void PublishSettings()
+{
+  SharedIniFile::Writer ini(sSettings);
+  *ini = sLayers.Merged();
+  ini.Commit();
+}
+
+// Republishes the settings if a layer changed on disk. The caller must
+// hold sLayersLock.
+static void RefreshSettings()
+{
+  if( sLayers.CountLayers() == 0 )
+  {
+    sLayers.AddLayer(kSystemSettingsFile);
+    sLayers.AddLayer(kSiteSettingsFile);
+    sLayers.AddLayer(kSettingsFile);
+    PublishSettings();
+  }
+  else if( sLayers.Refresh() )
+    PublishSettings();
+}
+
+void LoadSettings(Settings *settings)
 {
-  BIniFile ini;
-  ini.Load("/boot/home/config/settings/SlimSOFT");
-  if(poll_rate  != NULL) *poll_rate  =      ini.ReadInt   ("BeBitsUpdated","PollInterval", 600 )  ;
-  if(proxy_port != NULL) *proxy_port =      ini.ReadInt   ("BeBitsUpdated","ProxyPort"   ,  80 )  ;
-  if(proxy_serv != NULL) proxy_serv->SetTo( ini.ReadString("BeBitsUpdated","ProxyServer" , ""  ) );
-  if(proxy_auth != NULL) proxy_auth->SetTo( ini.ReadString("BeBitsUpdated","ProxyAuth"   , ""  ) );
+  pthread_mutex_lock(&sLayersLock);
+  try
+  {
+    RefreshSettings();
+  }
+  catch( ... )
+  {
+    pthread_mutex_unlock(&sLayersLock);
+    throw;
+  }
+  pthread_mutex_unlock(&sLayersLock);
+
+  SharedIniFile::Reader ini(sSettings);
+  *settings = Settings();
+  ini->ForEachKey(kSettingsSection, LoadSetting, settings);
 }
 
-void SaveSettings(const char *proxy_serv, const char *proxy_auth, uint32 proxy_port, uint32 poll_rate)
+void SaveSettings(const Settings &settings)
 {
-  BIniFile ini;
-  ini.Load("/boot/home/config/settings/SlimSOFT");
-  if(poll_rate > 0 && poll_rate <= 0xFFFF) ini.WriteInt   ("BeBitsUpdated","PollInterval", poll_rate  );
-  if(poll_rate > 0 && poll_rate <= 0xFFFF) ini.WriteInt   ("BeBitsUpdated","ProxyPort"   , proxy_port );
-  ini.WriteString("BeBitsUpdated","ProxyServer" , proxy_serv );
-  ini.WriteString("BeBitsUpdated","ProxyAuth"   , proxy_auth );
-  ini.Store("/boot/home/config/settings/SlimSOFT");
-}
\ No newline at end of file
+  pthread_mutex_lock(&sLayersLock);
+  try
+  {
+    RefreshSettings();
+
+    // Values the layers below (or the defaults) already give aren't copied
+    // into the user's file, so that it keeps following changes to them
+    IniFile below(sLayers.MergedBelow());
+    IniFile &user = sLayers.Top();
+    IniBatch batch(user, kSettingsSection);
+    const Settings defaults;
+    for( int i = 0; i < SETTING_COUNT; i++ )
+    {
+      SettingId id = (SettingId)i;
+      BString text, inherited;
+      Settings check;
+      settings.Get(id, &text);
+      if( !check.Set(id, text.String()) )
+        continue;  // Out of range
+
+      const char *current;
+      if( below.FindString(kHandles[id], &current) )
+        inherited = current;
+      else
+        defaults.Get(id, &inherited);
+      if( !user.FindString(kHandles[id], &current) && text == inherited.String() )
+        continue;
+      batch.WriteString(Settings::Key(id), text.String());
+    }
+
+    // The batch applies all the values or none, and PublishSettings()
+    // then hands them to readers in one step
+    batch.Commit();
+    sLayers.Store();
+    PublishSettings();
+  }
+  catch( ... )
+  {
+    pthread_mutex_unlock(&sLayersLock);
+    throw;
+  }
+  pthread_mutex_unlock(&sLayersLock);
+}
+
+// Notes which of our settings a change in the user's file touched
+static void NoteSetting(const char *section, const char *key,
+                        const char *oldValue, const char *newValue, void *cookie)
+{
+  SettingId id;
+  if( strcmp(section, kSettingsSection) == 0 && (id = Settings::Find(key)) != SETTING_COUNT )
+    *(uint32 *)cookie |= 1 << id;
+}
+
+// The watch tells which settings changed; their values come from the
+// merged layers, since a key gone from the user's file may still be set
+// by a layer below
+uint32 PollSettings(Settings *settings)
+{
+  static uint32 changed;
+  static IniFileWatch watch(kSettingsFile, NoteSetting, &changed);
+
+  changed = 0;
+  watch.Poll();
+  if( changed == 0 )
+    return 0;
+
+  Settings fresh;
+  LoadSettings(&fresh);
+  for( int i = 0; i < SETTING_COUNT; i++ )
+  {
+    if( (changed & (1 << i)) == 0 )
+      continue;
+    BString text;
+    fresh.Get((SettingId)i, &text);
+    settings->Set((SettingId)i, text.String());
+  }
+  return changed;
+}
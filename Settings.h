@@ -6,7 +6,72 @@
 #include "IniFile/BIniFile.h"
 
 
-void LoadSettings(BString *proxy_serv, BString *proxy_auth, uint32 *proxy_port, uint32 *poll_rate);
-void SaveSettings(const char *proxy_serv, const char *proxy_auth, uint32 proxy_port, uint32 poll_rate);
+// Every setting, declared once. The struct, the loader and the saver are all
+// generated from this list:
+//   UINT  (id, member, key, default, min, max)
+//   STRING(id, member, key, default)
+// All settings live in the "BeBitsUpdated" section of the settings file.
+// ProxyServer can list several proxies, "[user:pass@]host[:port], ...";
+// ProxyPort and ProxyAuth apply where an entry has none of its own.
+// The timeouts are in seconds, for each part of a check and for the whole.
+// A check stops reading the feed after StopAfterKnown items in a row it
+// has seen before; 0 reads all of it.
+#define SETTINGS_SCHEMA(UINT, STRING) \
+  UINT  ( POLL_INTERVAL   , poll_rate       , "PollInterval"  , 600, 1, 0xFFFF ) \
+  UINT  ( PROXY_PORT      , proxy_port      , "ProxyPort"     ,  80, 1, 0xFFFF ) \
+  STRING( PROXY_SERVER    , proxy_serv      , "ProxyServer"   , ""             ) \
+  STRING( PROXY_AUTH      , proxy_auth      , "ProxyAuth"     , ""             ) \
+  UINT  ( CONNECT_TIMEOUT , connect_timeout , "ConnectTimeout",  15, 1, 3600   ) \
+  UINT  ( SEND_TIMEOUT    , send_timeout    , "SendTimeout"   ,  15, 1, 3600   ) \
+  UINT  ( RECEIVE_TIMEOUT , receive_timeout , "ReceiveTimeout",  30, 1, 3600   ) \
+  UINT  ( FETCH_TIMEOUT   , fetch_timeout   , "FetchTimeout"  ,  60, 1, 3600   ) \
+  UINT  ( STOP_AFTER_KNOWN, stop_after_known, "StopAfterKnown",   5, 0, 1000   )
 
-#endif
\ No newline at end of file
+#define SETTINGS_ID_UINT(id, member, key, def, min, max) SETTING_##id,
+#define SETTINGS_ID_STRING(id, member, key, def)         SETTING_##id,
+enum SettingId {
+  SETTINGS_SCHEMA(SETTINGS_ID_UINT, SETTINGS_ID_STRING)
+  SETTING_COUNT
+};
+#undef SETTINGS_ID_UINT
+#undef SETTINGS_ID_STRING
+
+struct Settings
+{
+#define SETTINGS_MEMBER_UINT(id, member, key, def, min, max) uint32  member;
+#define SETTINGS_MEMBER_STRING(id, member, key, def)         BString member;
+  SETTINGS_SCHEMA(SETTINGS_MEMBER_UINT, SETTINGS_MEMBER_STRING)
+#undef SETTINGS_MEMBER_UINT
+#undef SETTINGS_MEMBER_STRING
+
+  Settings();
+    // Every setting at its default
+
+  bool Set(SettingId id, const char *text);
+    // Parses text into the setting; values that don't parse or are out of
+    // range are rejected, leaving the setting alone
+  void Get(SettingId id, BString *text) const;
+    // Formats the setting the way it is stored in the file
+
+  static SettingId Find(const char *key);
+    // Returns the setting stored under key, SETTING_COUNT if there's none
+  static const char *Key(SettingId id);
+};
+
+// Keys in the settings file that aren't in the schema are left alone.
+// LoadSettings() doesn't parse the file itself: it walks the section of the
+// already parsed (and merged) settings with ForEachKey(), finding each key
+// with Settings::Find(), a chain of length and memcmp() checks rather than
+// a perfect hash. Tests/settingsbench times it against the four lookups it
+// replaced.
+void LoadSettings(Settings *settings);
+void SaveSettings(const Settings &settings);
+
+// Applies whatever changed in the user's settings file since the last call
+// (or since the first call started watching it) to settings, key by key.
+// Changes to the system or site layers are only picked up by LoadSettings().
+// Returns a mask of the settings that changed, (1 << id) for each.
+// Only meant to be called from one thread.
+uint32 PollSettings(Settings *settings);
+
+#endif
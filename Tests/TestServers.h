@@ -0,0 +1,229 @@
+//----------------------------------------------------------------------
+//	TestServers.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _TEST_SERVERS_H_
+#define _TEST_SERVERS_H_
+
+// Servers on the loopback interface that the feed tests and benchmarks
+// run fetches against, each misbehaving in its own way. They live for as
+// long as the process.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+// Starts listening on Address and *Port (0 has the system pick one, which
+// *Port is then set to) with the given backlog; returns the socket, or -1
+inline int TestListen(const char *Address, int Backlog, unsigned short *Port)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+		return -1;
+	int one = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof address);
+	address.sin_family = AF_INET;
+	inet_pton(AF_INET, Address, &address.sin_addr);
+	address.sin_port = htons(*Port);
+	socklen_t length = sizeof address;
+	if (bind(listener, (struct sockaddr *)&address, sizeof address) != 0
+		|| listen(listener, Backlog) != 0
+		|| getsockname(listener, (struct sockaddr *)&address, &length) != 0)
+	{
+		close(listener);
+		return -1;
+	}
+	*Port = ntohs(address.sin_port);
+	return listener;
+}
+
+// A port nothing listens on, so connecting is refused at once
+inline unsigned short TestClosedPort()
+{
+	unsigned short port = 0;
+	int listener = TestListen("127.0.0.1", 1, &port);
+	close(listener);
+	return port;
+}
+
+// A port that drops SYNs, like a firewalled host would: its listener is
+// never accepted from and its backlog is filled up, after which the
+// kernel ignores new connection attempts. Address may be any 127.x.y.z.
+inline unsigned short TestSynDropPort(const char *Address = "127.0.0.1")
+{
+	unsigned short port = 0;
+	int listener = TestListen(Address, 0, &port);
+	if (listener < 0)
+		return 0;
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof address);
+	address.sin_family = AF_INET;
+	inet_pton(AF_INET, Address, &address.sin_addr);
+	address.sin_port = htons(port);
+	for (int i = 0; i < 4; i++)
+	{
+		int filler = socket(AF_INET, SOCK_STREAM, 0);
+		fcntl(filler, F_SETFL, O_NONBLOCK);
+		connect(filler, (struct sockaddr *)&address, sizeof address);
+	}
+	usleep(100000);
+	return port;
+}
+
+// A server that accepts connections and then never says a word
+inline void *TestSilentThread(void *Data)
+{
+	int listener = (int)(long)Data;
+	for (;;)
+	{
+		int connection = accept(listener, NULL, NULL);
+		(void)connection;		// Kept open, and quiet, for good
+	}
+	return NULL;
+}
+
+inline unsigned short TestSilentServer()
+{
+	unsigned short port = 0;
+	int listener = TestListen("127.0.0.1", 64, &port);
+	if (listener < 0)
+		return 0;
+	pthread_t thread;
+	pthread_create(&thread, NULL, TestSilentThread, (void *)(long)listener);
+	pthread_detach(thread);
+	return port;
+}
+
+// An HTTP server (or proxy, it doesn't care which) that answers every
+// request with zBody after zLatency seconds, or with a 502 while
+// zFailing. With zContentLength, the reply tells its length. Every request
+// is served on a thread of its own.
+struct TestHttpServer {
+	unsigned short zPort;
+	std::string zBody;
+	volatile double zLatency;
+	volatile bool zFailing;
+	bool zContentLength;
+	volatile int zRequests;
+	volatile int zAuthorized;	// Requests that had zAuthorization in them
+	std::string zAuthorization;
+
+	TestHttpServer(const std::string &Body, double Latency = 0)
+		: zPort(0), zBody(Body), zLatency(Latency), zFailing(false), zContentLength(false), zRequests(0),
+		  zAuthorized(0), zListener(-1) {}
+
+	bool Start(const char *Address = "127.0.0.1", unsigned short Port = 0)
+	{
+		zPort = Port;
+		zListener = TestListen(Address, 128, &zPort);
+		if (zListener < 0)
+			return false;
+		pthread_t thread;
+		pthread_create(&thread, NULL, AcceptThread, this);
+		pthread_detach(thread);
+		return true;
+	}
+
+	// What a 200 reply starts with
+	std::string Header() const
+	{
+		char length[64] = "";
+		if (zContentLength)
+			sprintf(length, "Content-Length: %lu\r\n", (unsigned long)zBody.size());
+		return std::string("HTTP/1.0 200 OK\r\n") + length + "\r\n";
+	}
+
+private:
+	int zListener;
+
+	struct Connection {
+		TestHttpServer *zServer;
+		int zSocket;
+	};
+
+	static void *AcceptThread(void *Data)
+	{
+		TestHttpServer *server = (TestHttpServer *)Data;
+		for (;;)
+		{
+			int connection = accept(server->zListener, NULL, NULL);
+			if (connection < 0)
+				continue;
+			Connection *serve = new Connection;
+			serve->zServer = server;
+			serve->zSocket = connection;
+			pthread_t thread;
+			pthread_create(&thread, NULL, ServeThread, serve);
+			pthread_detach(thread);
+		}
+		return NULL;
+	}
+
+	static void *ServeThread(void *Data)
+	{
+		Connection *connection = (Connection *)Data;
+		TestHttpServer *server = connection->zServer;
+		std::string request;
+		char buffer[4096];
+		while (request.find("\r\n\r\n") == std::string::npos)
+		{
+			ssize_t length = recv(connection->zSocket, buffer, sizeof buffer, 0);
+			if (length <= 0)
+				break;
+			request.append(buffer, length);
+		}
+
+		if (!request.empty())
+		{
+			__sync_fetch_and_add(&server->zRequests, 1);
+			if (!server->zAuthorization.empty()
+				&& request.find(server->zAuthorization) != std::string::npos)
+				__sync_fetch_and_add(&server->zAuthorized, 1);
+			usleep((useconds_t)(server->zLatency * 1e6));
+			std::string reply = server->zFailing ? std::string("HTTP/1.0 502 Bad Gateway\r\n\r\n")
+				: server->Header() + server->zBody;
+			send(connection->zSocket, reply.data(), reply.size(), MSG_NOSIGNAL);
+		}
+		close(connection->zSocket);
+		delete connection;
+		return NULL;
+	}
+};
+
+// A feed of the given items, named "Item <n>", in that order
+inline std::string TestFeedOf(const std::vector<int> &Items)
+{
+	std::string feed;
+	char item[128];
+	for (size_t i = 0; i < Items.size(); i++)
+	{
+		sprintf(item, "%%%%\nItem %d\n1.%d\nhttp://example.com/item/%d\n", Items[i], Items[i],
+			Items[i]);
+		feed += item;
+	}
+	return feed + "%%\n";
+}
+
+// A feed of Count items, First to First + Count - 1
+inline std::string TestFeed(int Count, int First = 0)
+{
+	std::vector<int> items;
+	for (int i = First; i < First + Count; i++)
+		items.push_back(i);
+	return TestFeedOf(items);
+}
+
+#endif
@@ -0,0 +1,168 @@
+//----------------------------------------------------------------------
+//	Tests.h
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+#ifndef _TESTS_H_
+#define _TESTS_H_
+
+// What the tests and benchmarks in this directory have in common. They are
+// plain Linux programs, built by the Makefile next to this file: tests
+// exit with 0 once every check passed, benchmarks print each result as a
+// JSON object on a line of its own, so runs on different commits can be
+// compared with nothing but a script.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Tests
+//-----------------------------------------------------------------------------
+
+// Checks keep going after a failure, so that one run shows all of them
+#define CHECK(Condition) \
+	do { if (!(Condition)) TestFailed(__FILE__, __LINE__, #Condition); } while (0)
+
+inline int &TestFailures()
+{
+	static int sFailures = 0;
+	return sFailures;
+}
+
+inline void TestFailed(const char *File, int Line, const char *Condition)
+{
+	printf("FAILED %s:%d: %s\n", File, Line, Condition);
+	TestFailures()++;
+}
+
+// Prints how the test named Name went and returns its exit status
+inline int TestResult(const char *Name)
+{
+	if (TestFailures() == 0)
+		printf("%s: all passed\n", Name);
+	else
+		printf("%s: %d failed\n", Name, TestFailures());
+	return TestFailures() == 0 ? 0 : 1;
+}
+
+//-----------------------------------------------------------------------------
+// Benchmarks
+//-----------------------------------------------------------------------------
+
+// Seconds on a clock that only moves forward
+inline double BenchTime()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Prints a result: {"bench":Bench,"case":Case,"commit":...,<Format>}. The
+// commit comes from $BENCH_COMMIT, which the Makefile sets.
+inline void BenchPrint(const char *Bench, const char *Case, const char *Format, ...)
+{
+	const char *commit = getenv("BENCH_COMMIT");
+	printf("{\"bench\":\"%s\",\"case\":\"%s\",\"commit\":\"%s\"", Bench, Case,
+		commit != NULL ? commit : "");
+	if (Format != NULL && *Format != 0)
+	{
+		va_list args;
+		va_start(args, Format);
+		putchar(',');
+		vprintf(Format, args);
+		va_end(args);
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+// Takes "123", "64K", "16M" or "1G"; returns -1 for anything else
+inline off_t BenchParseSize(const char *Text)
+{
+	char *end;
+	double size = strtod(Text, &end);
+	switch (*end)
+	{
+		case 'k': case 'K': size *= 1024; end++; break;
+		case 'm': case 'M': size *= 1024 * 1024; end++; break;
+		case 'g': case 'G': size *= 1024 * 1024 * 1024; end++; break;
+	}
+	return *end == 0 && size >= 0 ? (off_t)size : -1;
+}
+
+// Where a benchmark or test keeps its files: $TEST_DIR, or /tmp
+inline std::string TestPath(const char *Name)
+{
+	const char *dir = getenv("TEST_DIR");
+	char pid[32];
+	sprintf(pid, "%d-", (int)getpid());
+	return std::string(dir != NULL && *dir != 0 ? dir : "/tmp") + "/" + pid + Name;
+}
+
+// A cheap, repeatable stream of pseudo random numbers
+class BenchRandom {
+public:
+	BenchRandom(unsigned long Seed = 1) : zState(Seed * 2654435761UL + 1) {}
+	unsigned long Next()
+	{
+		zState = zState * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (unsigned long)(zState >> 33);
+	}
+	unsigned long Below(unsigned long Limit) { return Limit > 0 ? Next() % Limit : 0; }
+private:
+	unsigned long long zState;
+};
+
+// How BenchWriteIni() lays out a file. Key names are the same in every
+// section ("Key0", "Key1", ...), like settings of several apps sharing
+// a file; values are ValueLength random letters and digits.
+struct BenchIniShape {
+	int zKeys;				// Per section
+	int zValueLength;
+	const char *zSectionPrefix;
+
+	BenchIniShape(int Keys = 20, int ValueLength = 24, const char *SectionPrefix = "Section")
+		: zKeys(Keys), zValueLength(ValueLength), zSectionPrefix(SectionPrefix) {}
+};
+
+// Writes sections until the file is at least Size bytes (or holds Sections
+// sections, if that's given), and returns the number of sections written,
+// -1 if the file couldn't be written
+inline long BenchWriteIni(const char *Filename, off_t Size, const BenchIniShape &Shape,
+	long Sections = -1)
+{
+	static const char kChars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	FILE *file = fopen(Filename, "w");
+	if (file == NULL)
+		return -1;
+
+	BenchRandom random(Size + Shape.zKeys);
+	char *value = new char[Shape.zValueLength + 1];
+	off_t written = 0;
+	long count = 0;
+	while (Sections >= 0 ? count < Sections : written < Size)
+	{
+		written += fprintf(file, "[%s%ld]\n", Shape.zSectionPrefix, count);
+		for (int key = 0; key < Shape.zKeys; key++)
+		{
+			for (int i = 0; i < Shape.zValueLength; i++)
+				value[i] = kChars[random.Below(sizeof kChars - 1)];
+			value[Shape.zValueLength] = 0;
+			written += fprintf(file, "Key%d=%s\n", key, value);
+		}
+		written += fprintf(file, "\n");
+		count++;
+	}
+	delete[] value;
+	return fclose(file) == 0 ? count : -1;
+}
+
+#endif
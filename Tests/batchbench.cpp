@@ -0,0 +1,152 @@
+//----------------------------------------------------------------------
+//	batchbench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// -w writes into one section, one WriteString() at a time ("per_call")
+// and staged in an IniBatch ("batch"):
+//
+//	new_keys	Keys the section doesn't have yet
+//	overwrite	Keys the section already has, every one of them changed
+//	small_saves	-s keys at a time, each lot saved to a file of -k keys,
+//			as a settings panel would
+//
+// Each prints the time per write for both paths, and the speedup.
+//
+//	batchbench [-w writes] [-s keys per save] [-k keys] [-r repeats]
+//
+// defaults to 10K writes, 10 keys per save, a 10K key file, and the best
+// of 5 repeats per case.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+static long sWrites, sPerSave, sFileKeys;
+static int sRepeats;
+static std::string sFilename;
+
+static const char *Key(long Index)
+{
+	static char key[32];
+	sprintf(key, "Key%ld", Index);
+	return key;
+}
+
+// Times Case with or without a batch; values differ from Round to Round
+static double Time(int Case, bool Batched, int Round)
+{
+	IniFile ini;
+	ini.WriteString("Other", "Key", "value");
+	if (Case == 1 || Case == 2)
+	{
+		IniBatch fill(ini, "Section");
+		for (long i = 0; i < (Case == 2 ? sFileKeys : sWrites); i++)
+			fill.WriteString(Key(i), "old");
+		fill.Commit();
+	}
+	if (Case == 2)
+		ini.Store(sFilename.c_str());
+
+	char value[32];
+	sprintf(value, "new%d", Round);
+	double start = BenchTime();
+	if (Case < 2)
+	{
+		if (Batched)
+		{
+			IniBatch batch(ini, "Section");
+			for (long i = 0; i < sWrites; i++)
+				batch.WriteString(Key(i), value);
+			batch.Commit();
+		}
+		else
+		{
+			for (long i = 0; i < sWrites; i++)
+				ini.WriteString("Section", Key(i), value);
+		}
+	}
+	else
+	{
+		// Each save changes a different lot of keys
+		for (long saved = 0; saved < sWrites; saved += sPerSave)
+		{
+			if (Batched)
+			{
+				IniBatch batch(ini, "Section");
+				for (long i = saved; i < saved + sPerSave; i++)
+					batch.WriteString(Key(i % sFileKeys), value);
+				batch.Commit(sFilename.c_str());
+			}
+			else
+			{
+				for (long i = saved; i < saved + sPerSave; i++)
+					ini.WriteString("Section", Key(i % sFileKeys), value);
+				ini.Store(sFilename.c_str());
+			}
+		}
+	}
+	double took = BenchTime() - start;
+
+	// Both ways have to end up with the same
+	char read[32];
+	if (strcmp(ini.ReadString("Section", Key(sWrites - 1), read, sizeof read), value) != 0)
+	{
+		fprintf(stderr, "batchbench: case %d went wrong\n", Case);
+		exit(1);
+	}
+	return took;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-w writes] [-s keys per save] [-k keys] [-r repeats]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	sWrites = 10000;
+	sPerSave = 10;
+	sFileKeys = 10000;
+	sRepeats = 5;
+
+	int option;
+	while ((option = getopt(argc, argv, "w:s:k:r:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'w': sWrites = atol(optarg); break;
+			case 's': sPerSave = atol(optarg); break;
+			case 'k': sFileKeys = atol(optarg); break;
+			case 'r': sRepeats = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (sWrites <= 0 || sPerSave <= 0 || sFileKeys < sWrites || sRepeats <= 0)
+		Usage(argv[0]);
+	sFilename = TestPath("batchbench.ini");
+
+	const char *cases[] = { "new_keys", "overwrite", "small_saves" };
+	for (int c = 0; c < 3; c++)
+	{
+		double perCall = 1e9, batched = 1e9;
+		for (int r = 0; r < sRepeats; r++)
+		{
+			double took = Time(c, false, r);
+			if (took < perCall)
+				perCall = took;
+			took = Time(c, true, r);
+			if (took < batched)
+				batched = took;
+		}
+		BenchPrint("batchbench", cases[c], "\"writes\":%ld,\"per_save\":%ld,\"file_keys\":%ld,"
+			"\"per_call_us\":%.3f,\"batch_us\":%.3f,\"speedup\":%.2f", sWrites,
+			c == 2 ? sPerSave : 0, c == 2 ? sFileKeys : 0, perCall * 1e6 / sWrites,
+			batched * 1e6 / sWrites, perCall / batched);
+	}
+	unlink(sFilename.c_str());
+	unlink((sFilename + "~").c_str());
+	return 0;
+}
@@ -0,0 +1,129 @@
+//----------------------------------------------------------------------
+//	copybench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// What copies of an IniFile cost now that they share the tree, on a file
+// with -k keys:
+//
+//	copy		Copy construction
+//	assign		Assignment to an IniFile that has a tree of its own
+//	move		Move construction (C++11)
+//	copy_write_one	A copy, then one key written, which copies one section
+//	copy_write_all	A copy, then a key written in every section, which
+//			ends up copying everything, like every copy used to
+//
+//	copybench [-k keys] [-r repeats]
+//
+// defaults to 100K keys, 20 to a section, and 20 repeats per case.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+#include <utility>
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-k keys] [-r repeats]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long keys = 100000;
+	int repeats = 20;
+
+	int option;
+	while ((option = getopt(argc, argv, "k:r:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'k': keys = atol(optarg); break;
+			case 'r': repeats = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (keys <= 0 || repeats <= 0)
+		Usage(argv[0]);
+
+	BenchIniShape shape;
+	long sections = (keys + shape.zKeys - 1) / shape.zKeys;
+	std::string filename = TestPath("copybench.ini");
+	if (BenchWriteIni(filename.c_str(), 0, shape, sections) < 0)
+	{
+		fprintf(stderr, "%s: can't write %s\n", argv[0], filename.c_str());
+		return 1;
+	}
+	IniFile original;
+	original.Load(filename.c_str());
+	unlink(filename.c_str());
+
+	const char *cases[] = { "copy", "assign", "move", "copy_write_one", "copy_write_all", NULL };
+	for (int c = 0; cases[c] != NULL; c++)
+	{
+#if __cplusplus < 201103L
+		if (c == 2)
+			continue;
+#endif
+		double total = 0;
+		bool same = true;
+		for (int i = 0; i < repeats; i++)
+		{
+			IniFile target;
+			target.WriteString("Other", "Key", "value");
+			IniFile source(original);
+			char section[32];
+
+			double start = BenchTime();
+			switch (c)
+			{
+				case 0:
+				{
+					IniFile copy(original);
+					same &= copy.ReadInt("Section0", "Key0", -1) == original.ReadInt("Section0", "Key0", -1);
+					break;
+				}
+				case 1:
+					target = original;
+					break;
+				case 2:
+				{
+#if __cplusplus >= 201103L
+					IniFile moved(std::move(source));
+					same &= moved.ReadInt("Section0", "Key0", -1) == original.ReadInt("Section0", "Key0", -1);
+#endif
+					break;
+				}
+				case 3:
+				{
+					IniFile copy(original);
+					sprintf(section, "%s%ld", shape.zSectionPrefix, sections / 2);
+					copy.WriteString(section, "Key0", "changed");
+					break;
+				}
+				case 4:
+				{
+					IniFile copy(original);
+					for (long s = 0; s < sections; s++)
+					{
+						sprintf(section, "%s%ld", shape.zSectionPrefix, s);
+						copy.WriteString(section, "Key0", "changed");
+					}
+					break;
+				}
+			}
+			total += BenchTime() - start;
+		}
+
+		// Copies must never have written through to the original
+		const char *value = "";
+		original.FindString("Section0", "Key0", &value);
+		same &= strcmp(value, "changed") != 0;
+		BenchPrint("copybench", cases[c], "\"keys\":%ld,\"sections\":%ld,\"repeats\":%d,"
+			"\"ok\":%s,\"us_per_op\":%.2f", sections * shape.zKeys, sections, repeats,
+			same ? "true" : "false", total * 1e6 / repeats);
+	}
+	return 0;
+}
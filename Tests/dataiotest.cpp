@@ -0,0 +1,273 @@
+//----------------------------------------------------------------------
+//	dataiotest.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Tests of the BDataIO adapters in BIniDataIO.h, built against the
+// stand-in BDataIO, with a fake flattenable type in place of BMessage
+//----------------------------------------------------------------------
+#include "BIniDataIO.h"
+#include "Tests.h"
+
+#include <malloc.h>
+
+#include <vector>
+
+// Fails every allocation while sFailing is set, and keeps track of how
+// much memory IniFile holds at most
+static bool sFailing = false;
+static size_t sLive = 0, sPeak = 0;
+
+static void *Counted(void *Ptr)
+{
+	if (Ptr != NULL)
+	{
+		sLive += malloc_usable_size(Ptr);
+		if (sLive > sPeak)
+			sPeak = sLive;
+	}
+	return Ptr;
+}
+
+static void *FailingAlloc(size_t Size, void *)
+{
+	return sFailing ? NULL : Counted(malloc(Size));
+}
+
+static void *FailingRealloc(void *Ptr, size_t Size, void *)
+{
+	if (sFailing)
+		return NULL;
+	size_t old = malloc_usable_size(Ptr);
+	void *ptr = realloc(Ptr, Size);
+	if (ptr != NULL)
+		sLive -= old;
+	return Counted(ptr);
+}
+
+static void FailingFree(void *Ptr, void *)
+{
+	sLive -= malloc_usable_size(Ptr);
+	free(Ptr);
+}
+
+static const IniAllocator kFailingAllocator = { FailingAlloc, FailingRealloc, FailingFree, NULL };
+
+// Flattens itself the way BMessage does: straight to a BDataIO, in pieces,
+// handing back the first error it got
+class FakeFlattenable {
+public:
+	FakeFlattenable(size_t Size = 0, unsigned long Seed = 1, bool Random = true)
+	{
+		BenchRandom random(Seed);
+		for (size_t i = 0; i < Size; i++)
+			zData.push_back(Random ? (unsigned char)random.Next() : (unsigned char)(i % 7));
+	}
+
+	size_t FlattenedSize() const { return sizeof(uint32_t) + zData.size(); }
+
+	status_t Flatten(BDataIO *Stream) const
+	{
+		uint32_t size = zData.size();
+		ssize_t written = Stream->Write(&size, sizeof size);
+		if (written < 0)
+			return written;
+		for (size_t pos = 0; pos < zData.size(); pos += kPiece)
+		{
+			size_t length = zData.size() - pos < kPiece ? zData.size() - pos : kPiece;
+			written = Stream->Write(&zData[pos], length);
+			if (written < 0)
+				return written;
+			if ((size_t)written != length)
+				return B_ERROR;
+		}
+		return B_OK;
+	}
+
+	status_t Unflatten(BDataIO *Stream)
+	{
+		uint32_t size;
+		ssize_t read = Stream->Read(&size, sizeof size);
+		if (read < 0)
+			return read;
+		if (read != sizeof size)
+			return B_ERROR;
+		zData.resize(size);
+		for (size_t pos = 0; pos < size; )
+		{
+			read = Stream->Read(&zData[pos], size - pos < kPiece ? size - pos : kPiece);
+			if (read < 0)
+				return read;
+			if (read == 0)
+				return B_ERROR;
+			pos += read;
+		}
+		return B_OK;
+	}
+
+	bool operator==(const FakeFlattenable &Other) const { return zData == Other.zData; }
+
+private:
+	static const size_t kPiece = 1000;		// Not a multiple of any block size
+	std::vector<unsigned char> zData;
+};
+
+static bool Store(IniFile &Ini, const char *Key, const FakeFlattenable &Object)
+{
+	BIniDataWriter io(Ini, "Data", Key, Object.FlattenedSize());
+	return Object.Flatten(&io) == B_OK && io.Finish();
+}
+
+static bool Restore(const IniFile &Ini, const char *Key, FakeFlattenable *Object)
+{
+	BIniDataReader io(Ini, "Data", Key);
+	status_t error = Object->Unflatten(&io);
+	io.Check();
+	return error == B_OK;
+}
+
+// Objects of all sizes come back as they went in, with every encoding,
+// compressed or not, and after a trip through a file
+static void TestRoundTrip()
+{
+	const IniFile::DataEncoding encodings[] = { IniFile::LegacyData, IniFile::Base64Data, IniFile::Z85Data };
+	const size_t sizes[] = { 0, 1, 3, 1000, 4097, 300000 };
+	std::string filename = TestPath("dataiotest.ini");
+	for (int encoding = 0; encoding < 3; encoding++)
+	{
+		for (int compress = 0; compress < 2; compress++)
+		{
+			IniFile ini;
+			ini.SetDataEncoding(encodings[encoding], compress != 0);
+			char key[32];
+			for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+			{
+				sprintf(key, "Random%d", (int)i);
+				CHECK(Store(ini, key, FakeFlattenable(sizes[i], i + 1)));
+				sprintf(key, "Repeating%d", (int)i);
+				CHECK(Store(ini, key, FakeFlattenable(sizes[i], i + 1, false)));
+			}
+			CHECK(ini.Store(filename.c_str()));
+
+			IniFile loaded;
+			CHECK(loaded.Load(filename.c_str()));
+			for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+			{
+				FakeFlattenable random, repeating;
+				sprintf(key, "Random%d", (int)i);
+				CHECK(Restore(loaded, key, &random) && random == FakeFlattenable(sizes[i], i + 1));
+				sprintf(key, "Repeating%d", (int)i);
+				CHECK(Restore(loaded, key, &repeating)
+					&& repeating == FakeFlattenable(sizes[i], i + 1, false));
+			}
+		}
+	}
+	unlink(filename.c_str());
+
+	// The adapters only go one way, and a missing key is nothing to read
+	IniFile ini;
+	BIniDataWriter writer(ini, "Data", "Key", 1);
+	char byte;
+	CHECK(writer.Read(&byte, 1) == B_NOT_ALLOWED);
+	BIniDataReader reader(ini, "Data", "Key");
+	CHECK(reader.Write(&byte, 1) == B_NOT_ALLOWED);
+	FakeFlattenable object;
+	CHECK(!Restore(ini, "Missing", &object));
+
+	// Nor does an object that flattens to less than it promised get stored
+	BIniDataWriter shortWriter(ini, "Data", "Short", 100);
+	CHECK(shortWriter.Write("abc", 3) == 3);
+	CHECK(!shortWriter.Finish());
+	const char *value;
+	CHECK(!ini.FindString("Data", "Short", &value));
+}
+
+// Streaming never holds a flat copy of the object: at most the encoded
+// text, which is 4/3 of its size
+static void TestPeakMemory()
+{
+	const size_t size = 4 << 20;
+	FakeFlattenable object(size, 3);
+	IniFile ini;
+	ini.WriteString("Data", "Other", "value");
+	size_t before = sLive;
+	sPeak = sLive;
+	CHECK(Store(ini, "Key", object));
+	size_t peak = sPeak - before;
+	CHECK(peak < size * 4 / 3 + 64 * 1024);
+	if (peak >= size * 4 / 3 + 64 * 1024)
+		printf("  peak %lu bytes for a %lu byte object\n", (unsigned long)peak, (unsigned long)size);
+
+	sPeak = sLive;
+	FakeFlattenable restored;
+	CHECK(Restore(ini, "Key", &restored) && restored == object);
+	CHECK(sPeak - sLive < 64 * 1024);
+}
+
+// Running out of memory halfway shows up as B_NO_MEMORY to the flattenable,
+// which gives up, and as an exception from Finish() or Check() once it has
+static void TestOutOfMemory()
+{
+	IniFile ini;
+	ini.SetDataEncoding(IniFile::Base64Data, true);
+	FakeFlattenable object(100000, 7);
+
+	// Random data doesn't compress, so the writer's buffer has to grow
+	{
+		BIniDataWriter io(ini, "Data", "Key", object.FlattenedSize());
+		sFailing = true;
+		status_t error = object.Flatten(&io);
+		CHECK(io.Write("x", 1) == B_NO_MEMORY);
+		sFailing = false;
+		CHECK(error == B_NO_MEMORY);
+		bool threw = false;
+		try
+		{
+			io.Finish();
+		}
+		catch (IniFile::EInsufficientMemory &)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+	const char *value;
+	CHECK(!ini.FindString("Data", "Key", &value));
+
+	// The reader's inflate window is allocated on the first read
+	CHECK(Store(ini, "Key", object));
+	{
+		BIniDataReader io(ini, "Data", "Key");
+		FakeFlattenable restored;
+		sFailing = true;
+		status_t error = restored.Unflatten(&io);
+		char byte;
+		CHECK(io.Read(&byte, 1) == B_NO_MEMORY);
+		sFailing = false;
+		CHECK(error == B_NO_MEMORY);
+		bool threw = false;
+		try
+		{
+			io.Check();
+		}
+		catch (IniFile::EInsufficientMemory &)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// With memory back, all is well again
+	FakeFlattenable restored;
+	CHECK(Restore(ini, "Key", &restored) && restored == object);
+}
+
+int main()
+{
+	IniFile::SetAllocator(&kFailingAllocator);
+	TestRoundTrip();
+	TestPeakMemory();
+	TestOutOfMemory();
+	return TestResult("dataiotest");
+}
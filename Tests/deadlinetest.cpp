@@ -0,0 +1,321 @@
+//----------------------------------------------------------------------
+//	deadlinetest.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Tests of fetch deadlines and cancelling, against a server that accepts
+// connections but never answers and a port that drops SYNs, and of
+// FeedChecker being used by several checks at once, by checks that leave
+// remembering items to their caller, or that stop reading after a run of
+// known items.
+//----------------------------------------------------------------------
+#include "FeedSocket.h"
+#include "Tests.h"
+#include "TestServers.h"
+
+static unsigned short sSilentPort;
+static unsigned short sSynDropPort;
+
+// Cancels after a while, from a thread of its own
+struct CancelLater {
+	FeedCancel *zCancel;
+	double zAfter;
+};
+
+static void *CancelThread(void *Data)
+{
+	CancelLater *later = (CancelLater *)Data;
+	usleep((useconds_t)(later->zAfter * 1e6));
+	later->zCancel->Cancel();
+	later->zCancel->Release();
+	delete later;
+	return NULL;
+}
+
+// Fetches from Port, cancelling after CancelAfter seconds unless that's
+// 0, and checks that it failed with Error after Low to High seconds
+static void CheckFailure(unsigned short Port, const FeedDeadlines &Deadlines,
+	double CancelAfter, const char *Error, double Low, double High)
+{
+	char url[64];
+	sprintf(url, "http://127.0.0.1:%u/backend/recent", Port);
+	FeedSource source;
+	source.SetUrl(url);
+	source.zDeadlines = Deadlines;
+
+	FeedCancel *cancel = new FeedCancel();
+	FeedSocketTransport transport(30, NULL, cancel);
+	if (CancelAfter > 0)
+	{
+		CancelLater *later = new CancelLater;
+		later->zCancel = cancel;
+		later->zAfter = CancelAfter;
+		cancel->Acquire();
+		pthread_t thread;
+		pthread_create(&thread, NULL, CancelThread, later);
+		pthread_detach(thread);
+	}
+	cancel->Release();		// The transport holds on to it
+
+	std::string reply;
+	FeedTiming timing;
+	double start = FeedTime();
+	bool ok = FeedFetch(transport, source, &reply, &timing);
+	double took = FeedTime() - start;
+	CHECK(!ok);
+	CHECK(timing.zError != NULL && strcmp(timing.zError, Error) == 0);
+	CHECK(took >= Low && took <= High);
+	if (took < Low || took > High)
+		printf("  port %u, %s after %.3fs, expected %s after %.2f-%.2fs\n", Port,
+			timing.zError != NULL ? timing.zError : "(no error)", took, Error, Low, High);
+}
+
+static void TestDeadlines()
+{
+	FeedDeadlines deadlines;
+	deadlines.zConnect = 0.3;
+	deadlines.zSend = 1;
+	deadlines.zReceive = 0.5;
+	deadlines.zTotal = 10;
+	CheckFailure(sSilentPort, deadlines, 0, "timeout", 0.49, 0.65);
+	CheckFailure(sSynDropPort, deadlines, 0, "timeout", 0.29, 0.45);
+
+	// The total deadline cuts the receive deadline short
+	deadlines.zReceive = 5;
+	deadlines.zTotal = 0.4;
+	CheckFailure(sSilentPort, deadlines, 0, "timeout", 0.39, 0.55);
+}
+
+static void TestCancel()
+{
+	FeedDeadlines deadlines;
+	deadlines.zConnect = 30;
+	deadlines.zReceive = 30;
+	deadlines.zTotal = 60;
+	CheckFailure(sSilentPort, deadlines, 0.2, "cancelled", 0.19, 0.35);
+	CheckFailure(sSynDropPort, deadlines, 0.2, "cancelled", 0.19, 0.35);
+
+	// Cancelled before it even started
+	FeedCancel *cancel = new FeedCancel();
+	cancel->Cancel();
+	FeedSocketTransport transport(30, NULL, cancel);
+	cancel->Release();
+	FeedSource source;
+	char url[64];
+	sprintf(url, "http://127.0.0.1:%u/backend/recent", sSilentPort);
+	source.SetUrl(url);
+	std::string reply;
+	FeedTiming timing;
+	double start = FeedTime();
+	CHECK(!FeedFetch(transport, source, &reply, &timing));
+	CHECK(timing.zError != NULL && strcmp(timing.zError, "cancelled") == 0);
+	CHECK(FeedTime() - start < 0.05);
+}
+
+// A check stuck on a server that doesn't answer must not hold up other
+// checks, nor Forget()
+struct Check {
+	FeedChecker *zChecker;
+	unsigned short zPort;
+	bool zOk;
+	size_t zNew;
+	double zTook;
+};
+
+static void *CheckThread(void *Data)
+{
+	Check *check = (Check *)Data;
+	char url[64];
+	sprintf(url, "http://127.0.0.1:%u/backend/recent", check->zPort);
+	FeedSource source;
+	source.SetUrl(url);
+	source.zDeadlines.zReceive = 1;
+	FeedSocketTransport transport(5);
+	std::vector<FeedItem> items;
+	FeedTiming timing;
+	double start = FeedTime();
+	check->zOk = check->zChecker->Check(transport, source, &items, &timing);
+	check->zTook = FeedTime() - start;
+	check->zNew = items.size();
+	return NULL;
+}
+
+static void TestConcurrentChecks()
+{
+	TestHttpServer server(TestFeed(5));
+	CHECK(server.Start());
+
+	FeedChecker checker;
+	Check stuck = { &checker, sSilentPort, true, 0, 0 };
+	Check quick = { &checker, server.zPort, false, 0, 0 };
+	pthread_t stuckThread, quickThread;
+	pthread_create(&stuckThread, NULL, CheckThread, &stuck);
+	usleep(100000);
+	double start = FeedTime();
+	pthread_create(&quickThread, NULL, CheckThread, &quick);
+	pthread_join(quickThread, NULL);
+	CHECK(quick.zOk && quick.zNew == 5 && quick.zTook < 0.3);
+	checker.Forget();
+	CHECK(FeedTime() - start < 0.4);
+
+	pthread_join(stuckThread, NULL);
+	CHECK(!stuck.zOk && stuck.zTook >= 0.99);
+
+	// Forget() did forget
+	pthread_create(&quickThread, NULL, CheckThread, &quick);
+	pthread_join(quickThread, NULL);
+	CHECK(quick.zOk && quick.zNew == 5);
+	pthread_create(&quickThread, NULL, CheckThread, &quick);
+	pthread_join(quickThread, NULL);
+	CHECK(quick.zOk && quick.zNew == 0);
+}
+
+// Checks that leave remembering to the caller hand out the same items
+// until the caller has taken them, and get back what it gave up on
+static void TestRememberLater()
+{
+	TestHttpServer server(TestFeed(4));
+	CHECK(server.Start());
+	char url[64];
+	sprintf(url, "http://127.0.0.1:%u/backend/recent", server.zPort);
+	FeedSource source;
+	source.SetUrl(url);
+	FeedSocketTransport transport(5);
+	FeedChecker checker;
+
+	std::vector<FeedItem> items;
+	FeedTiming timing;
+	CHECK(checker.Check(transport, source, &items, &timing, NULL, false));
+	CHECK(items.size() == 4);
+
+	// Delivery was cut short after two, and the second didn't make it
+	CHECK(checker.IsNew(items[0]) && checker.IsNew(items[1]));
+	checker.Forget(items[1]);
+
+	std::vector<FeedItem> again;
+	CHECK(checker.Check(transport, source, &again, &timing, NULL, false));
+	CHECK(again.size() == 3);
+	for (size_t i = 0; i < again.size(); i++)
+		CHECK(again[i].zName != items[0].zName);
+
+	// The usual way remembers right away
+	again.clear();
+	CHECK(checker.Check(transport, source, &again, &timing));
+	CHECK(again.size() == 3);
+	again.clear();
+	CHECK(checker.Check(transport, source, &again, &timing));
+	CHECK(again.empty());
+}
+
+// Checks the feed served on Port, appending what's new to Items
+static bool CheckPort(FeedChecker &Checker, unsigned short Port, std::vector<FeedItem> *Items,
+	FeedTiming *Timing)
+{
+	char url[64];
+	sprintf(url, "http://127.0.0.1:%u/backend/recent", Port);
+	FeedSource source;
+	source.SetUrl(url);
+	FeedSocketTransport transport(5);
+	Timing->Reset();
+	return Checker.Check(transport, source, Items, Timing);
+}
+
+// Items First to Last - 1, newest (highest) first
+static std::vector<int> NewestFirst(int First, int Last)
+{
+	std::vector<int> items;
+	for (int i = Last; i-- > First; )
+		items.push_back(i);
+	return items;
+}
+
+// With SetStopAfterKnown(), a poll stops reading once it's past what's
+// new, but a known item in between new ones doesn't stop it
+static void TestStopAfterKnown()
+{
+	const int kItems = 2000;		// Many times what one read brings in
+	std::vector<int> old = NewestFirst(0, kItems);
+	std::vector<int> newer = NewestFirst(kItems, kItems + 3);
+	newer.insert(newer.end(), old.begin(), old.end());
+	std::vector<int> mixed;
+	mixed.push_back(kItems + 12);
+	mixed.push_back(newer[0]);
+	mixed.push_back(kItems + 11);
+	mixed.push_back(newer[1]);
+	mixed.push_back(newer[2]);
+	mixed.push_back(kItems + 10);
+	mixed.insert(mixed.end(), old.begin(), old.end());
+
+	TestHttpServer first(TestFeedOf(old)), second(TestFeedOf(newer)), third(TestFeedOf(mixed));
+	second.zContentLength = true;
+	CHECK(first.Start() && second.Start() && third.Start());
+
+	FeedChecker checker;
+	checker.SetStopAfterKnown(3);
+	std::vector<FeedItem> items;
+	FeedTiming timing;
+
+	// Nothing is known yet, so the whole feed is read
+	CHECK(CheckPort(checker, first.zPort, &items, &timing));
+	CHECK(!timing.zCutShort && timing.zItems == kItems && items.size() == (size_t)kItems);
+	CHECK(timing.zBytes == first.Header().size() + first.zBody.size());
+
+	// The new items on top still come through, oldest first
+	items.clear();
+	CHECK(CheckPort(checker, second.zPort, &items, &timing));
+	CHECK(timing.zCutShort && timing.zItems < kItems / 2);
+	CHECK(items.size() == 3 && items[0].zName == "Item 2000 - 1.2000"
+		&& items[2].zName == "Item 2002 - 1.2002");
+	size_t length = second.Header().size() + second.zBody.size();
+	CHECK(timing.zBytes < length / 2 && timing.zBytesSkipped > 0);
+	CHECK(timing.zBytes + timing.zBytesSkipped == length);
+
+	// Known items between new ones don't stop the read, only a run does
+	items.clear();
+	CHECK(CheckPort(checker, third.zPort, &items, &timing));
+	CHECK(timing.zCutShort && timing.zBytesSkipped == 0);
+	CHECK(items.size() == 3 && items[0].zName == "Item 2010 - 1.2010"
+		&& items[1].zName == "Item 2011 - 1.2011" && items[2].zName == "Item 2012 - 1.2012");
+
+	// Without it, every reply is read to the end
+	FeedChecker reader;
+	items.clear();
+	CHECK(CheckPort(reader, first.zPort, &items, &timing));
+	CHECK(CheckPort(reader, second.zPort, &items, &timing));
+	CHECK(!timing.zCutShort && timing.zBytes == length && timing.zItems == kItems + 3);
+	CHECK(items.size() == (size_t)kItems + 3);
+}
+
+// FeedTime() is what deadlines are measured on, so it has to keep up with
+// the clock, and never go back
+static void TestClock()
+{
+	double start = FeedTime(), last = start;
+	bool forward = true;
+	for (int i = 0; i < 100000; i++)
+	{
+		double now = FeedTime();
+		forward &= now >= last;
+		last = now;
+	}
+	CHECK(forward);
+	usleep(100000);
+	double took = FeedTime() - start;
+	CHECK(took >= 0.1 && took < 0.3);
+}
+
+int main()
+{
+	sSilentPort = TestSilentServer();
+	sSynDropPort = TestSynDropPort();
+	CHECK(sSilentPort != 0 && sSynDropPort != 0);
+
+	TestClock();
+	TestDeadlines();
+	TestCancel();
+	TestConcurrentChecks();
+	TestRememberLater();
+	TestStopAfterKnown();
+	return TestResult("deadlinetest");
+}
@@ -0,0 +1,129 @@
+//----------------------------------------------------------------------
+//	findbench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Nanoseconds per typed read: the allocation free Find accessors against
+// the Read ones they replace, on a settings section like the app's own.
+//
+//	findbench [-n calls]
+//
+// makes 5M calls per case by default.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+static const char *kSection = "BeBitsUpdated";
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-n calls]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long calls = 5000000;
+
+	int option;
+	while ((option = getopt(argc, argv, "n:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'n': calls = atol(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (calls <= 0)
+		Usage(argv[0]);
+
+	IniFile ini;
+	ini.WriteInt(kSection, "PollInterval", 3600);
+	ini.WriteString(kSection, "Size", "8589934592");
+	ini.WriteString(kSection, "ProxyPort", "8080");
+	ini.WriteFloat(kSection, "Scale", 1.5f);
+	ini.WriteBool(kSection, "UseProxy", true);
+	ini.WriteString(kSection, "ProxyHost", "proxy.example.com");
+	for (int i = 0; i < 14; i++)
+	{
+		char key[16];
+		sprintf(key, "Other%d", i);
+		ini.WriteString(kSection, key, "something");
+	}
+
+	// Keeps the compiler from dropping the reads
+	volatile double sink = 0;
+	const char *cases[] = { "read_int", "find_int", "find_int64", "find_uint", "read_float",
+		"find_double", "read_bool", "find_bool", "read_string", "find_string", NULL };
+	for (int c = 0; cases[c] != NULL; c++)
+	{
+		char buffer[256];
+		double start = BenchTime();
+		for (long i = 0; i < calls; i++)
+		{
+			switch (c)
+			{
+				case 0:
+					sink += ini.ReadInt(kSection, "PollInterval", 0);
+					break;
+				case 1:
+				{
+					int value;
+					if (ini.FindInt(kSection, "PollInterval", &value))
+						sink += value;
+					break;
+				}
+				case 2:
+				{
+					int64_t value;
+					if (ini.FindInt64(kSection, "Size", &value))
+						sink += value;
+					break;
+				}
+				case 3:
+				{
+					unsigned int value;
+					if (ini.FindUInt(kSection, "ProxyPort", &value))
+						sink += value;
+					break;
+				}
+				case 4:
+					sink += ini.ReadFloat(kSection, "Scale", 0);
+					break;
+				case 5:
+				{
+					double value;
+					if (ini.FindDouble(kSection, "Scale", &value))
+						sink += value;
+					break;
+				}
+				case 6:
+					sink += ini.ReadBool(kSection, "UseProxy", false);
+					break;
+				case 7:
+				{
+					bool value;
+					if (ini.FindBool(kSection, "UseProxy", &value))
+						sink += value;
+					break;
+				}
+				case 8:
+					sink += ini.ReadString(kSection, "ProxyHost", buffer, sizeof buffer)[0];
+					break;
+				case 9:
+				{
+					const char *value;
+					if (ini.FindString(kSection, "ProxyHost", &value))
+						sink += value[0];
+					break;
+				}
+			}
+		}
+		double seconds = BenchTime() - start;
+		BenchPrint("findbench", cases[c], "\"calls\":%ld,\"ns_per_call\":%.1f",
+			calls, seconds * 1e9 / calls);
+	}
+	return 0;
+}
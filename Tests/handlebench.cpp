@@ -0,0 +1,96 @@
+//----------------------------------------------------------------------
+//	handlebench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Key handles against names: 10M reads (and writes) of the app's settings
+// keys, looked up by name every time or through handles, in a file that
+// has the app's section among -n others.
+//
+//	handlebench [-n sections] [-c calls]
+//
+// defaults to 100 sections and 10M calls per case.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+static const char *kSection = "BeBitsUpdated";
+static const char *kKeys[] = { "PollInterval", "ProxyPort", "UseProxy", "MaxItems",
+	"Notify", "StopAfterKnown", "Timeout", "Retries" };
+static const int kKeyCount = 8;
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-n sections] [-c calls]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long sections = 100;
+	long calls = 10000000;
+
+	int option;
+	while ((option = getopt(argc, argv, "n:c:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'n': sections = atol(optarg); break;
+			case 'c': calls = atol(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (sections < 0 || calls <= 0)
+		Usage(argv[0]);
+
+	// The app's section comes last, as it would in a file shared by many
+	BenchIniShape shape;
+	std::string filename = TestPath("handlebench.ini");
+	if (BenchWriteIni(filename.c_str(), 0, shape, sections) < 0)
+	{
+		fprintf(stderr, "%s: can't write %s\n", argv[0], filename.c_str());
+		return 1;
+	}
+	IniFile ini;
+	ini.Load(filename.c_str());
+	unlink(filename.c_str());
+	for (int k = 0; k < kKeyCount; k++)
+		ini.WriteInt(kSection, kKeys[k], k + 1);
+
+	IniKeyHandle *handles[kKeyCount];
+	for (int k = 0; k < kKeyCount; k++)
+		handles[k] = new IniKeyHandle(kSection, kKeys[k]);
+
+	// Keeps the compiler from dropping the reads
+	volatile long sink = 0;
+	const char *cases[] = { "find_int_name", "find_int_handle", "read_int_name",
+		"read_int_handle", "write_int_name", "write_int_handle", NULL };
+	for (int c = 0; cases[c] != NULL; c++)
+	{
+		double start = BenchTime();
+		for (long i = 0; i < calls; i++)
+		{
+			int k = i & (kKeyCount - 1);
+			int value = 0;
+			switch (c)
+			{
+				case 0: ini.FindInt(kSection, kKeys[k], &value); break;
+				case 1: ini.FindInt(*handles[k], &value); break;
+				case 2: value = ini.ReadInt(kSection, kKeys[k], 0); break;
+				case 3: value = ini.ReadInt(*handles[k], 0); break;
+				case 4: ini.WriteInt(kSection, kKeys[k], (int)i); break;
+				case 5: ini.WriteInt(*handles[k], (int)i); break;
+			}
+			sink += value;
+		}
+		double seconds = BenchTime() - start;
+		BenchPrint("handlebench", cases[c], "\"sections\":%ld,\"calls\":%ld,\"ns_per_call\":%.1f",
+			sections + 1, calls, seconds * 1e9 / calls);
+	}
+
+	for (int k = 0; k < kKeyCount; k++)
+		delete handles[k];
+	return 0;
+}
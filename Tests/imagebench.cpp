@@ -0,0 +1,118 @@
+//----------------------------------------------------------------------
+//	imagebench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Load times with and without the compiled image cache:
+//
+//	text		Load() parsing the text, no image cache
+//	compile		Load() with the cache on but no image yet, which parses
+//			the text and writes the image
+//	image		Load() from the image, then one key read
+//	image_all	The same, then every section copied out of the image
+//
+// Each is measured warm (files in the page cache) and cold (the files'
+// pages dropped from it with posix_fadvise() first, as close to a fresh
+// boot as a user can get).
+//
+//	imagebench [-s size] [-r rounds]
+//
+// defaults to a 4M file and the best of 10 rounds.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Drops Filename from the page cache, if it's there at all
+static void DropCache(const std::string &Filename)
+{
+	int fd = open(Filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-s size] [-r rounds]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	off_t size = 4 * 1024 * 1024;
+	int rounds = 10;
+
+	int option;
+	while ((option = getopt(argc, argv, "s:r:h")) != -1)
+	{
+		switch (option)
+		{
+			case 's': size = BenchParseSize(optarg); break;
+			case 'r': rounds = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (size <= 0 || rounds <= 0)
+		Usage(argv[0]);
+
+	BenchIniShape shape;
+	std::string filename = TestPath("imagebench.ini");
+	std::string image = filename + IniFile::kImageSuffix;
+	long sections = BenchWriteIni(filename.c_str(), size, shape);
+	if (sections < 0)
+	{
+		fprintf(stderr, "%s: can't write %s\n", argv[0], filename.c_str());
+		return 1;
+	}
+	char section[32];
+	sprintf(section, "%s%ld", shape.zSectionPrefix, sections / 2);
+
+	const char *cases[] = { "text", "compile", "image", "image_all", NULL };
+	for (int cold = 0; cold < 2; cold++)
+	{
+		for (int c = 0; cases[c] != NULL; c++)
+		{
+			double best = 1e9;
+			bool found = true;
+			for (int round = 0; round < rounds; round++)
+			{
+				if (c == 1)
+					unlink(image.c_str());
+				if (cold)
+				{
+					DropCache(filename);
+					DropCache(image);
+				}
+
+				IniFile ini;
+				ini.SetImageCache(c > 0);
+				double start = BenchTime();
+				ini.Load(filename.c_str());
+				const char *value;
+				found &= ini.FindString(section, "Key0", &value);
+				if (c == 3)
+					ini.ParseAllSections();
+				double seconds = BenchTime() - start;
+				if (seconds < best)
+					best = seconds;
+			}
+
+			struct stat info;
+			off_t imageSize = c > 0 && stat(image.c_str(), &info) == 0 ? info.st_size : 0;
+			BenchPrint("imagebench", cases[c], "\"cache\":\"%s\",\"size\":%lld,\"image_size\":%lld,"
+				"\"sections\":%ld,\"found\":%s,\"seconds\":%.6f", cold ? "cold" : "warm",
+				(long long)size, (long long)imageSize, sections, found ? "true" : "false", best);
+		}
+	}
+
+	unlink(image.c_str());
+	unlink(filename.c_str());
+	return 0;
+}
@@ -0,0 +1,244 @@
+//----------------------------------------------------------------------
+//	inibench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Benchmarks the IniFile core on generated files from 1K up to -m bytes
+// (16M by default, 1G at most): Load(), Store(), the Read and Write
+// families, and the data encodings WriteData() and ReadData() use. Every
+// result is a JSON line (see Tests.h):
+//
+//	{"bench":"inibench","case":"load","commit":"...","size":1048576,...}
+//
+// Load and store report the best of -r rounds; the read and write cases
+// report nanoseconds per call, over keys picked at random.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+static const off_t kSizes[] = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024,
+	256 * 1024 * 1024, (off_t)1024 * 1024 * 1024, -1 };
+static const size_t kDataSizes[] = { 64, 4096, 1024 * 1024, 16 * 1024 * 1024, 0 };
+static const long kCalls = 1000000;
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr,
+		"Usage: %s [-m size] [-r rounds]\n"
+		"  -m size    Biggest file to try, e.g. 256M or 1G (default 16M)\n"
+		"  -r rounds  Rounds per load and store, the best one counts (default 5)\n",
+		Name);
+	exit(2);
+}
+
+static double Rate(off_t Bytes, double Seconds)
+{
+	return Seconds > 0 ? Bytes / Seconds / (1024 * 1024) : 0;
+}
+
+static void BenchLoadStore(const char *Filename, off_t Size, long Sections, int Rounds)
+{
+	// Storing the same tree twice to the same file would be skipped, so
+	// the store alternates between two files
+	std::string out[2] = { TestPath("inibench-out0.ini"), TestPath("inibench-out1.ini") };
+	double load = 1e9, store = 1e9;
+	for (int round = 0; round < Rounds; round++)
+	{
+		IniFile ini;
+		double start = BenchTime();
+		ini.Load(Filename);
+		double loaded = BenchTime();
+		ini.Store(out[round & 1].c_str());
+		double stored = BenchTime();
+		if (loaded - start < load)
+			load = loaded - start;
+		if (stored - loaded < store)
+			store = stored - loaded;
+	}
+	unlink(out[0].c_str());
+	unlink(out[1].c_str());
+
+	BenchPrint("inibench", "load", "\"size\":%lld,\"sections\":%ld,\"seconds\":%.6f,\"mb_per_s\":%.1f",
+		(long long)Size, Sections, load, Rate(Size, load));
+	BenchPrint("inibench", "store", "\"size\":%lld,\"sections\":%ld,\"seconds\":%.6f,\"mb_per_s\":%.1f",
+		(long long)Size, Sections, store, Rate(Size, store));
+}
+
+// Names of the keys the read and write cases go through, picked ahead of
+// time so that making them up isn't measured
+struct KeyNames {
+	char zSection[32];
+	char zKey[16];
+};
+
+static void BenchReadWrite(const char *Filename, off_t Size, long Sections, const BenchIniShape &Shape)
+{
+	IniFile ini;
+	ini.Load(Filename);
+
+	static const int kNames = 4096;
+	KeyNames *names = new KeyNames[kNames];
+	BenchRandom random(Size);
+	for (int i = 0; i < kNames; i++)
+	{
+		sprintf(names[i].zSection, "%s%lu", Shape.zSectionPrefix, random.Below(Sections));
+		sprintf(names[i].zKey, "Key%lu", random.Below(Shape.zKeys));
+	}
+
+	// Keeps the compiler from dropping the reads
+	volatile long sink = 0;
+	char buffer[256];
+	const char *cases[] = { "read_string_buffer", "read_string_alloc", "find_string",
+		"read_int", "find_int", "write_string", "write_int", NULL };
+	for (int c = 0; cases[c] != NULL; c++)
+	{
+		double start = BenchTime();
+		for (long i = 0; i < kCalls; i++)
+		{
+			const KeyNames &name = names[i & (kNames - 1)];
+			switch (c)
+			{
+				case 0:
+					sink += ini.ReadString(name.zSection, name.zKey, buffer, sizeof buffer)[0];
+					break;
+				case 1:
+				{
+					char *value = ini.ReadString(name.zSection, name.zKey);
+					sink += value[0];
+					free(value);
+					break;
+				}
+				case 2:
+				{
+					const char *value;
+					if (ini.FindString(name.zSection, name.zKey, &value))
+						sink += value[0];
+					break;
+				}
+				case 3:
+					sink += ini.ReadInt(name.zSection, name.zKey, 1);
+					break;
+				case 4:
+				{
+					int value;
+					if (ini.FindInt(name.zSection, name.zKey, &value))
+						sink += value;
+					break;
+				}
+				case 5:
+					ini.WriteString(name.zSection, name.zKey, "a new value");
+					break;
+				case 6:
+					ini.WriteInt(name.zSection, name.zKey, (int)i);
+					break;
+			}
+		}
+		double seconds = BenchTime() - start;
+		BenchPrint("inibench", cases[c], "\"size\":%lld,\"sections\":%ld,\"calls\":%ld,\"ns_per_call\":%.1f",
+			(long long)Size, Sections, kCalls, seconds * 1e9 / kCalls);
+	}
+	delete[] names;
+}
+
+static void BenchData(off_t MaxSize)
+{
+	struct Encoding {
+		const char *zName;
+		IniFile::DataEncoding zEncoding;
+		bool zCompress;
+	};
+	static const Encoding kEncodings[] = {
+		{ "legacy", IniFile::LegacyData, false },
+		{ "base64", IniFile::Base64Data, false },
+		{ "z85", IniFile::Z85Data, false },
+		{ "base64_deflate", IniFile::Base64Data, true },
+		{ NULL, IniFile::Base64Data, false }
+	};
+
+	for (int s = 0; kDataSizes[s] != 0 && (off_t)kDataSizes[s] <= MaxSize; s++)
+	{
+		// Half random, half runs, so that deflating has something to do
+		size_t size = kDataSizes[s];
+		unsigned char *data = new unsigned char[size];
+		BenchRandom random(size);
+		for (size_t i = 0; i < size; i++)
+			data[i] = (i / 64) & 1 ? (unsigned char)(i / 128) : (unsigned char)random.Next();
+		int repeats = (int)(64 * 1024 * 1024 / size);
+		if (repeats > 10000)
+			repeats = 10000;
+
+		for (int e = 0; kEncodings[e].zName != NULL; e++)
+		{
+			IniFile ini;
+			ini.SetDataEncoding(kEncodings[e].zEncoding, kEncodings[e].zCompress);
+			double start = BenchTime();
+			for (int i = 0; i < repeats; i++)
+				ini.WriteData("Data", "Blob", data, size);
+			double encoded = BenchTime();
+			bool same = true;
+			for (int i = 0; i < repeats; i++)
+			{
+				void *result;
+				size_t length = ini.ReadData("Data", "Blob", &result);
+				if (i == 0)
+					same = length == size && memcmp(result, data, size) == 0;
+				free(result);
+			}
+			double decoded = BenchTime();
+
+			const char *text;
+			size_t textLength = 0;
+			ini.FindString("Data", "Blob", &text, &textLength);
+			BenchPrint("inibench", "encode", "\"encoding\":\"%s\",\"size\":%lu,\"text_size\":%lu,"
+				"\"seconds\":%.6f,\"mb_per_s\":%.1f", kEncodings[e].zName, (unsigned long)size,
+				(unsigned long)textLength, (encoded - start) / repeats,
+				Rate((off_t)size * repeats, encoded - start));
+			BenchPrint("inibench", "decode", "\"encoding\":\"%s\",\"size\":%lu,\"ok\":%s,"
+				"\"seconds\":%.6f,\"mb_per_s\":%.1f", kEncodings[e].zName, (unsigned long)size,
+				same ? "true" : "false", (decoded - encoded) / repeats,
+				Rate((off_t)size * repeats, decoded - encoded));
+		}
+		delete[] data;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	off_t maxSize = 16 * 1024 * 1024;
+	int rounds = 5;
+
+	int option;
+	while ((option = getopt(argc, argv, "m:r:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'm': maxSize = BenchParseSize(optarg); break;
+			case 'r': rounds = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (maxSize < 0 || rounds <= 0)
+		Usage(argv[0]);
+
+	BenchIniShape shape;
+	std::string filename = TestPath("inibench.ini");
+	for (int s = 0; kSizes[s] >= 0 && kSizes[s] <= maxSize; s++)
+	{
+		long sections = BenchWriteIni(filename.c_str(), kSizes[s], shape);
+		if (sections < 0)
+		{
+			fprintf(stderr, "%s: can't write %s\n", argv[0], filename.c_str());
+			return 1;
+		}
+		// The big ones take long enough to measure once
+		BenchLoadStore(filename.c_str(), kSizes[s], sections,
+			kSizes[s] > 64 * 1024 * 1024 ? 1 : rounds);
+		BenchReadWrite(filename.c_str(), kSizes[s], sections, shape);
+	}
+	unlink(filename.c_str());
+
+	BenchData(maxSize);
+	return 0;
+}
@@ -0,0 +1,266 @@
+//----------------------------------------------------------------------
+//	inifuzz.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Differential fuzzer for the IniFile parser. Every input is loaded in
+// each way IniFile can load a file: Load(), LoadLazy(), LoadParallel()
+// (built with INIFILE_PARALLEL_MIN_SIZE=0, so even tiny inputs get cut
+// into shards), from a compiled image, and from what Store() wrote of the
+// first load. All of them have to end up with the same tree, which is
+// compared by what Store() makes of it. The input also goes through every
+// data encoding and back, and is handed to ReadData() as text, which must
+// not crash or overrun.
+//
+// Built with INIFUZZ_LIBFUZZER, this is a libFuzzer target (clang++
+// -fsanitize=fuzzer). Otherwise it has its own driver:
+//
+//	inifuzz [-n runs] [-t seconds] [-s seed] [file...]
+//
+// replays the given files, or runs inputs made up of random pieces of INI
+// syntax, and prints a JSON summary line (see Tests.h). Any difference is
+// printed, the input saved as inifuzz-crash-<n>, and the run aborted.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+#include <stdint.h>
+
+// Returns the contents of Filename
+static std::string ReadFile(const char *Filename)
+{
+	std::string contents;
+	FILE *file = fopen(Filename, "rb");
+	if (file == NULL)
+		return contents;
+	char buffer[4096];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof buffer, file)) > 0)
+		contents.append(buffer, length);
+	fclose(file);
+	return contents;
+}
+
+static bool WriteFile(const char *Filename, const void *Data, size_t Size)
+{
+	FILE *file = fopen(Filename, "wb");
+	if (file == NULL)
+		return false;
+	bool written = Size == 0 || fwrite(Data, Size, 1, file) == 1;
+	return fclose(file) == 0 && written;
+}
+
+// What Store() makes of Ini: the tree, in a canonical form
+static std::string Canonical(IniFile &Ini)
+{
+	std::string filename = TestPath("inifuzz-canonical.ini");
+	unlink(filename.c_str());
+	Ini.Store(filename.c_str());
+	std::string text = ReadFile(filename.c_str());
+	unlink(filename.c_str());
+	return text;
+}
+
+static void Fail(const char *What, const uint8_t *Data, size_t Size,
+	const std::string &Expected, const std::string &Got)
+{
+	static int sCrashes = 0;
+	char name[64];
+	sprintf(name, "inifuzz-crash-%d", sCrashes++);
+	WriteFile(name, Data, Size);
+	fprintf(stderr, "inifuzz: %s differs (input saved as %s)\n--- expected\n%s\n--- got\n%s\n",
+		What, name, Expected.c_str(), Got.c_str());
+	abort();
+}
+
+static void CheckLoaders(const uint8_t *Data, size_t Size)
+{
+	std::string input = TestPath("inifuzz.ini");
+	std::string image = input + IniFile::kImageSuffix;
+	std::string stored = TestPath("inifuzz-stored.ini");
+	if (!WriteFile(input.c_str(), Data, Size))
+		abort();
+	unlink(image.c_str());
+
+	IniFile plain;
+	plain.Load(input.c_str());
+	std::string expected = Canonical(plain);
+
+	IniFile lazy;
+	lazy.LoadLazy(input.c_str());
+	std::string got = Canonical(lazy);
+	if (got != expected)
+		Fail("LoadLazy()", Data, Size, expected, got);
+
+	IniFile parallel;
+	parallel.LoadParallel(input.c_str(), 4);
+	got = Canonical(parallel);
+	if (got != expected)
+		Fail("LoadParallel()", Data, Size, expected, got);
+
+	// The first load compiles the image, the second one uses it
+	for (int i = 0; i < 2; i++)
+	{
+		IniFile cached;
+		cached.SetImageCache(true);
+		cached.Load(input.c_str());
+		got = Canonical(cached);
+		if (got != expected)
+			Fail(i == 0 ? "Load() compiling an image" : "Load() from an image",
+				Data, Size, expected, got);
+	}
+	unlink(image.c_str());
+
+	// What was stored has to load back into the same tree
+	WriteFile(stored.c_str(), expected.data(), expected.size());
+	IniFile reloaded;
+	reloaded.Load(stored.c_str());
+	got = Canonical(reloaded);
+	if (got != expected)
+		Fail("reloading what Store() wrote", Data, Size, expected, got);
+
+	unlink(stored.c_str());
+	unlink(input.c_str());
+}
+
+static void CheckEncodings(const uint8_t *Data, size_t Size)
+{
+	static const IniFile::DataEncoding kEncodings[] = { IniFile::LegacyData,
+		IniFile::Base64Data, IniFile::Z85Data };
+	std::string expected((const char *)Data, Size);
+	for (int e = 0; e < 3; e++)
+	{
+		for (int compress = 0; compress < 2; compress++)
+		{
+			IniFile ini;
+			ini.SetDataEncoding(kEncodings[e], compress != 0);
+			ini.WriteData("S", "k", Data, Size);
+
+			void *result;
+			size_t length = ini.ReadData("S", "k", &result);
+			std::string got((const char *)result, result != NULL ? length : 0);
+			free(result);
+			if (got != expected)
+				Fail("ReadData() after WriteData()", Data, Size, expected, got);
+
+			// Streaming, in odd sized pieces
+			IniDataReader reader(ini, "S", "k");
+			got.erase();
+			char buffer[37];
+			while ((length = reader.Read(buffer, sizeof buffer)) > 0)
+				got.append(buffer, length);
+			if (got != expected)
+				Fail("IniDataReader after WriteData()", Data, Size, expected, got);
+		}
+	}
+
+	// Any text may claim to be encoded data
+	std::string text((const char *)Data, Size);
+	IniFile ini;
+	ini.WriteString("S", "k", text.c_str());
+	void *result;
+	ini.ReadData("S", "k", &result);
+	free(result);
+	unsigned char buffer[16];
+	ini.ReadData("S", "k", buffer, Size % sizeof buffer);
+	IniDataReader reader(ini, "S", "k");
+	while (reader.Read(buffer, sizeof buffer) > 0)
+		;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+	CheckLoaders(Data, Size);
+	CheckEncodings(Data, Size);
+	return 0;
+}
+
+#ifndef INIFUZZ_LIBFUZZER
+
+// Pieces random inputs are made of: INI syntax, and what tends to trip
+// parsers up
+static const char *kPieces[] = {
+	"[A]", "[B]", "[Section]", " [ A ] ", "[A", "A]", "[]", "[[A]]", "[A];c", "[A] x",
+	"x=1", "y = 2 ", "x=3;c", "z=a b", "k=", "=v", "==", "k==v", "  q=w", "key name=v",
+	";[B]", "#c", ";", "\r", "\r\n", "\n", "\n\n", "\t", " ", "junk", "\xff\xfe",
+	"!1b-", "!1bd", "!1z-", "!1zd", "%%", "x=!1b-AAAA", NULL
+};
+
+static void MakeInput(BenchRandom &Random, std::string *Input)
+{
+	static int sPieces = 0;
+	if (sPieces == 0)
+		while (kPieces[sPieces] != NULL)
+			sPieces++;
+
+	Input->erase();
+	int count = Random.Below(40);
+	for (int i = 0; i < count; i++)
+	{
+		if (Random.Below(8) == 0)
+			*Input += (char)Random.Below(256);
+		else
+			*Input += kPieces[Random.Below(sPieces)];
+		if (Random.Below(3) == 0)
+			*Input += '\n';
+	}
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr,
+		"Usage: %s [-n runs] [-t seconds] [-s seed] [file...]\n"
+		"Replays the files, or runs random inputs until either limit is hit\n"
+		"(default 20000 runs).\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long runs = 20000;
+	double seconds = 0;
+	unsigned long seed = 1;
+
+	int option;
+	while ((option = getopt(argc, argv, "n:t:s:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'n': runs = atol(optarg); break;
+			case 't': seconds = atof(optarg); break;
+			case 's': seed = strtoul(optarg, NULL, 10); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+
+	double start = BenchTime();
+	long done = 0;
+	if (optind < argc)
+	{
+		for (int i = optind; i < argc; i++, done++)
+		{
+			std::string input = ReadFile(argv[i]);
+			LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+		}
+	}
+	else
+	{
+		BenchRandom random(seed);
+		std::string input;
+		for (; done < runs && (seconds <= 0 || BenchTime() - start < seconds); done++)
+		{
+			MakeInput(random, &input);
+			LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+		}
+	}
+
+	double elapsed = BenchTime() - start;
+	BenchPrint("inifuzz", "differential", "\"seed\":%lu,\"runs\":%ld,\"seconds\":%.3f,"
+		"\"runs_per_s\":%.0f,\"failures\":0", seed, done, elapsed,
+		elapsed > 0 ? done / elapsed : 0.0);
+	return 0;
+}
+
+#endif
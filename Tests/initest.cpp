@@ -0,0 +1,394 @@
+//----------------------------------------------------------------------
+//	initest.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Tests of the IniFile core
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "IniLayers.h"
+#include "Tests.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+// Fails allocations once sFailAfter more have been made, unless it's -1
+static long sFailAfter = -1;
+static long sReallocations = 0;
+
+static void *FailingAlloc(size_t Size, void *)
+{
+	if (sFailAfter == 0)
+		return NULL;
+	if (sFailAfter > 0)
+		sFailAfter--;
+	return malloc(Size);
+}
+
+static void *FailingRealloc(void *Ptr, size_t Size, void *)
+{
+	if (sFailAfter == 0)
+		return NULL;
+	if (sFailAfter > 0)
+		sFailAfter--;
+	sReallocations++;
+	return realloc(Ptr, Size);
+}
+
+static void FailingFree(void *Ptr, void *)
+{
+	free(Ptr);
+}
+
+static const IniAllocator kFailingAllocator = { FailingAlloc, FailingRealloc, FailingFree, NULL };
+
+// Runs Ini.PrintContents() with its output thrown away, for the walk over
+// every node it makes
+static void PrintQuietly(const IniFile &Ini)
+{
+	fflush(stdout);
+	int saved = dup(1);
+	int null = open("/dev/null", O_WRONLY);
+	dup2(null, 1);
+	close(null);
+	Ini.PrintContents();
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved);
+}
+
+// A batch committed to a section that isn't there yet has to create one
+// that can be stored, and loads back with everything in it
+static void TestBatchNewSection()
+{
+	std::string filename = TestPath("initest-batch.ini");
+	unlink(filename.c_str());
+
+	IniFile ini;
+	ini.WriteString("Old", "Key", "value");
+	IniBatch batch(ini, "New");
+	batch.WriteString("Name", "text");
+	batch.WriteInt("Count", 42);
+	batch.WriteBool("On", true);
+	CHECK(batch.Commit(filename.c_str()));
+	PrintQuietly(ini);
+	ini.WriteString("Old", "Key2", "more");
+	CHECK(ini.Store(filename.c_str()));
+
+	IniFile loaded;
+	CHECK(loaded.Load(filename.c_str()));
+	char buffer[32];
+	CHECK(strcmp(loaded.ReadString("New", "Name", buffer, sizeof buffer), "text") == 0);
+	CHECK(loaded.ReadInt("New", "Count", 0) == 42);
+	CHECK(loaded.ReadBool("New", "On", false));
+	CHECK(strcmp(loaded.ReadString("Old", "Key", buffer, sizeof buffer), "value") == 0);
+
+	// Merge() goes through IniBatch too
+	IniFile over;
+	over.WriteString("Merged", "Key", "merged");
+	loaded.Merge(over);
+	PrintQuietly(loaded);
+	CHECK(loaded.Store(filename.c_str()));
+	IniFile merged;
+	CHECK(merged.Load(filename.c_str()));
+	CHECK(strcmp(merged.ReadString("Merged", "Key", buffer, sizeof buffer), "merged") == 0);
+
+	unlink(filename.c_str());
+}
+
+static void IgnoreChange(const char *, const char *, const char *, const char *, void *)
+{
+}
+
+// A Commit() that runs out of memory leaves the tree as it was, and the
+// batch as well, so that it can be committed later
+static void TestBatchFailure()
+{
+	const char *sections[] = { "S", "New" };
+	for (int s = 0; s < 2; s++)
+	{
+		IniFile ini;
+		ini.WriteString("S", "a", "1");
+		ini.WriteString("S", "b", "2");
+		ini.WriteString("Other", "c", "3");
+		IniFile copy(ini);
+		IniBatch batch(ini, sections[s]);
+		batch.WriteString("a", "10");
+		batch.WriteInt("d", 4);
+		batch.WriteBool("e", true);
+		unsigned long generation = ini.Generation();
+
+		int failures = 0;
+		for (long after = 0; ; after++)
+		{
+			IniFile before(ini);
+			sFailAfter = after;
+			bool threw = false;
+			try
+			{
+				batch.Commit();
+			}
+			catch (IniFile::EInsufficientMemory &)
+			{
+				threw = true;
+			}
+			sFailAfter = -1;
+			if (!threw)
+				break;
+			failures++;
+			CHECK(batch.Count() == 3);
+			CHECK(ini.Generation() == generation);
+			CHECK(before.Diff(ini, IgnoreChange, NULL) == 0);
+			CHECK(ini.ReadInt("S", "a", 0) == 1 && ini.ReadInt(sections[s], "d", 0) == 0);
+		}
+		CHECK(failures > 0);
+		CHECK(batch.Count() == 0);
+		CHECK(ini.ReadInt(sections[s], "a", 0) == 10 && ini.ReadInt(sections[s], "d", 0) == 4);
+		CHECK(ini.ReadBool(sections[s], "e", false));
+		CHECK(ini.ReadInt("S", "b", 0) == 2);
+
+		// Copies never see any of it
+		CHECK(copy.ReadInt("S", "a", 0) == 1 && copy.ReadInt(sections[s], "d", 0) == 0);
+	}
+}
+
+// A Store() cut short by a full disk (here, a file size limit) fails,
+// leaves the old file alone, and doesn't keep the next Store() from
+// writing the file
+static void TestStoreFailure()
+{
+	std::string filename = TestPath("initest-store.ini");
+	IniFile old;
+	old.WriteString("S", "Key", "old");
+	CHECK(old.Store(filename.c_str()));
+
+	IniFile ini;
+	CHECK(ini.Load(filename.c_str()));
+	for (int i = 0; i < 1000; i++)
+	{
+		char key[32];
+		sprintf(key, "Key%d", i);
+		ini.WriteString("S", key, "a value long enough to go past the limit");
+	}
+	ini.WriteString("New", "Key", "new");
+
+	signal(SIGXFSZ, SIG_IGN);
+	struct rlimit saved, limit;
+	getrlimit(RLIMIT_FSIZE, &saved);
+	limit = saved;
+	limit.rlim_cur = 4096;
+	setrlimit(RLIMIT_FSIZE, &limit);
+	bool stored = ini.Store(filename.c_str());
+	bool threw = false;
+	try
+	{
+		ini.Store(filename.c_str(), true);
+	}
+	catch (IniFile::EFileError &)
+	{
+		threw = true;
+	}
+	setrlimit(RLIMIT_FSIZE, &saved);
+	CHECK(!stored && threw);
+	CHECK(access((filename + "~").c_str(), F_OK) != 0);
+
+	IniFile check;
+	const char *value;
+	CHECK(check.Load(filename.c_str()));
+	CHECK(check.FindString("S", "Key", &value) && strcmp(value, "old") == 0);
+	CHECK(!check.FindString("New", "Key", &value));
+
+	unsigned long performed = ini.StoresPerformed();
+	CHECK(ini.Store(filename.c_str()));
+	CHECK(ini.StoresPerformed() == performed + 1);
+	CHECK(check.Load(filename.c_str()));
+	CHECK(check.FindString("New", "Key", &value) && strcmp(value, "new") == 0);
+	CHECK(check.FindString("S", "Key999", &value));
+
+	unlink(filename.c_str());
+}
+
+// What the top layer inherits comes from the layers below it only
+static void TestLayersBelow()
+{
+	std::string names[3] = { TestPath("initest-system.ini"), TestPath("initest-site.ini"),
+		TestPath("initest-user.ini") };
+	const char *values[3] = { "system", "site", "user" };
+	for (int i = 0; i < 3; i++)
+	{
+		IniFile layer;
+		layer.WriteString("S", "Shared", values[i]);
+		layer.WriteString("S", values[i], "only here");
+		CHECK(layer.Store(names[i].c_str()));
+	}
+
+	IniLayers layers;
+	for (int i = 0; i < 3; i++)
+		layers.AddLayer(names[i].c_str());
+	const char *value;
+	CHECK(layers.Merged().FindString("S", "Shared", &value) && strcmp(value, "user") == 0);
+
+	IniFile below = layers.MergedBelow();
+	CHECK(below.FindString("S", "Shared", &value) && strcmp(value, "site") == 0);
+	CHECK(below.FindString("S", "system", &value));
+	CHECK(below.FindString("S", "site", &value));
+	CHECK(!below.FindString("S", "user", &value));
+	CHECK(layers.Merged().FindString("S", "user", &value));
+
+	for (int i = 0; i < 3; i++)
+		unlink(names[i].c_str());
+}
+
+// Every key of a, with its value, is in b and the other way round
+static bool SameKeys(const IniFile &a, const IniFile &b)
+{
+	return a.Diff(b, IgnoreChange, NULL) == 0;
+}
+
+// The merged view is only rebuilt when a layer's file changed, and writes
+// through IniLayers keep it up to date without a rebuild
+static void TestLayersRefresh()
+{
+	std::string names[3] = { TestPath("initest-system.ini"), TestPath("initest-site.ini"),
+		TestPath("initest-user.ini") };
+	const char *values[3] = { "system", "site", "user" };
+	for (int i = 0; i < 3; i++)
+	{
+		IniFile layer;
+		layer.WriteString("S", "Shared", values[i]);
+		layer.WriteString("S", values[i], "only here");
+		layer.WriteString(values[i], "Key", values[i]);
+		CHECK(layer.Store(names[i].c_str()));
+	}
+	unlink(TestPath("initest-missing.ini").c_str());
+
+	IniLayers layers;
+	for (int i = 0; i < 3; i++)
+		layers.AddLayer(names[i].c_str());
+	layers.AddLayer(TestPath("initest-missing.ini").c_str());
+	const IniFile *merged = &layers.Merged();
+	CHECK(layers.Rebuilds() == 1);
+
+	// Nothing changed, so nothing is reloaded or rebuilt
+	CHECK(!layers.Refresh());
+	CHECK(&layers.Merged() == merged && layers.Rebuilds() == 1);
+
+	// A layer in the middle changed on disk
+	IniFile site(names[1].c_str());
+	site.WriteString("S", "Shared", "site, changed");
+	site.WriteString("site", "New", "new");
+	CHECK(site.Store(names[1].c_str()));
+	CHECK(layers.Refresh());
+	const char *value;
+	CHECK(layers.Merged().FindString("S", "Shared", &value) && strcmp(value, "user") == 0);
+	CHECK(layers.Merged().FindString("site", "New", &value));
+	CHECK(layers.Rebuilds() == 2);
+	CHECK(!layers.Refresh());
+	layers.Merged();
+	CHECK(layers.Rebuilds() == 2);
+
+	// The top layer's file showing up counts as a change
+	IniFile missing;
+	missing.WriteString("S", "Shared", "top");
+	CHECK(missing.Store(TestPath("initest-missing.ini").c_str()));
+	CHECK(layers.Refresh());
+	CHECK(layers.Merged().FindString("S", "Shared", &value) && strcmp(value, "top") == 0);
+	CHECK(layers.Rebuilds() == 3);
+
+	// Writes go to the top layer and into the view, which stays the same
+	// as one built from scratch
+	layers.WriteString("S", "Shared", "written");
+	layers.WriteInt("system", "Key", 42);
+	layers.WriteString("Brand new", "Key", "new");
+	CHECK(layers.Rebuilds() == 3);
+	CHECK(layers.Merged().FindString("S", "Shared", &value) && strcmp(value, "written") == 0);
+	CHECK(layers.Merged().ReadInt("system", "Key", 0) == 42);
+	CHECK(layers.Merged().FindString("S", "system", &value));
+	CHECK(layers.Merged().FindString("Brand new", "Key", &value));
+	IniFile cached(layers.Merged());
+	CHECK(layers.Store());
+	CHECK(!layers.Refresh());
+	CHECK(layers.Rebuilds() == 3);
+
+	IniLayers fresh;
+	for (int i = 0; i < 3; i++)
+		fresh.AddLayer(names[i].c_str());
+	fresh.AddLayer(TestPath("initest-missing.ini").c_str());
+	CHECK(SameKeys(cached, fresh.Merged()));
+
+	// What the system layer had is still there below
+	IniFile below = layers.MergedBelow();
+	CHECK(below.FindString("system", "Key", &value) && strcmp(value, "system") == 0);
+
+	// Top() may change anything, so the view is rebuilt
+	layers.Top().WriteString("S", "Shared", "through Top()");
+	CHECK(layers.Merged().FindString("S", "Shared", &value) && strcmp(value, "through Top()") == 0);
+	CHECK(layers.Rebuilds() == 4);
+
+	for (int i = 0; i < 3; i++)
+		unlink(names[i].c_str());
+	unlink(TestPath("initest-missing.ini").c_str());
+}
+
+// A frozen handle table never grows, not even when a handle created after
+// freezing it is written through
+static void TestFrozenHandles()
+{
+	IniFile ini;
+	ini.WriteString("S", "Key", "old");
+	IniKeyHandle early("S", "Early");
+	ini.WriteString(early, "early");
+	ini.FreezeHandles();
+
+	IniKeyHandle late("S", "Key");
+	long reallocations = sReallocations;
+	ini.WriteString(late, "new");
+	CHECK(sReallocations == reallocations);
+	const char *value;
+	CHECK(ini.FindString(late, &value) && strcmp(value, "new") == 0);
+	CHECK(ini.FindString("S", "Key", &value) && strcmp(value, "new") == 0);
+
+	// Handles that have a slot are still remembered
+	ini.WriteString(early, "again");
+	CHECK(ini.FindString(early, &value) && strcmp(value, "again") == 0);
+	CHECK(sReallocations == reallocations);
+}
+
+// Assigning copies the settings of how data is written, like copying does
+static void TestAssignSettings()
+{
+	IniFile source;
+	source.SetImageCache(true);
+	source.SetDataEncoding(IniFile::Z85Data, true);
+	source.WriteString("S", "Key", "value");
+
+	IniFile assigned;
+	assigned = source;
+	CHECK(assigned.ImageCache());
+	unsigned char data[256];
+	memset(data, 'x', sizeof data);
+	assigned.WriteData("S", "Data", data, sizeof data);
+	const char *value;
+	CHECK(assigned.FindString("S", "Data", &value) && strlen(value) > 3);
+	CHECK(value[0] == '!' && value[1] == '1' && value[2] == 'z' && value[3] == 'd');
+
+	IniFile copied(source);
+	copied.WriteData("S", "Data", data, sizeof data);
+	const char *copiedValue;
+	CHECK(copied.FindString("S", "Data", &copiedValue) && strcmp(value, copiedValue) == 0);
+}
+
+int main()
+{
+	IniFile::SetAllocator(&kFailingAllocator);
+	TestBatchNewSection();
+	TestBatchFailure();
+	TestStoreFailure();
+	TestLayersBelow();
+	TestLayersRefresh();
+	TestFrozenHandles();
+	TestAssignSettings();
+	return TestResult("initest");
+}
@@ -0,0 +1,104 @@
+//----------------------------------------------------------------------
+//	internbench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Memory the key name pool saves, on a file of -n sections that all have
+// the same -k keys. The heap used by the loaded file is measured with
+// mallinfo2(); what the names would take without the pool is measured by
+// making a separate copy of every key name, which is what each key node
+// used to hold.
+//
+//	internbench [-n sections] [-k keys]
+//
+// defaults to 10K sections of 50 keys.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+#include <malloc.h>
+
+#include <vector>
+
+static size_t HeapUsed()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+// What a separate copy of each of Count names costs the heap
+static size_t CopiesCost(const std::vector<std::string> &Names, long Count)
+{
+	std::vector<char *> copies;
+	copies.reserve(Count);
+	size_t before = HeapUsed();
+	for (long i = 0; i < Count; i++)
+		copies.push_back(strdup(Names[i % Names.size()].c_str()));
+	size_t cost = HeapUsed() - before;
+	for (size_t i = 0; i < copies.size(); i++)
+		free(copies[i]);
+	return cost;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-n sections] [-k keys]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long sections = 10000;
+	int keys = 50;
+
+	int option;
+	while ((option = getopt(argc, argv, "n:k:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'n': sections = atol(optarg); break;
+			case 'k': keys = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (sections <= 0 || keys <= 0)
+		Usage(argv[0]);
+
+	// Short values, so that names are a fair share of the file
+	BenchIniShape shape(keys, 8);
+	std::string filename = TestPath("internbench.ini");
+	if (BenchWriteIni(filename.c_str(), 0, shape, sections) < 0)
+	{
+		fprintf(stderr, "%s: can't write %s\n", argv[0], filename.c_str());
+		return 1;
+	}
+
+	std::vector<std::string> names;
+	for (int k = 0; k < keys; k++)
+	{
+		char name[16];
+		sprintf(name, "Key%d", k);
+		names.push_back(name);
+	}
+
+	size_t before = HeapUsed();
+	IniFile *ini = new IniFile;
+	ini->Load(filename.c_str());
+	size_t heap = HeapUsed() - before;
+	unlink(filename.c_str());
+
+	IniStats stats;
+	ini->GetStats(&stats);
+	size_t unpooled = CopiesCost(names, stats.zKeys);
+	size_t pooled = CopiesCost(names, keys);
+	size_t saved = unpooled > pooled ? unpooled - pooled : 0;
+	BenchPrint("internbench", "memory", "\"sections\":%ld,\"keys\":%lu,\"distinct_names\":%d,"
+		"\"heap_bytes\":%lu,\"heap_bytes_unpooled\":%lu,\"saved_bytes\":%lu,\"saved_percent\":%.1f",
+		sections, (unsigned long)stats.zKeys, keys, (unsigned long)heap,
+		(unsigned long)(heap + saved), (unsigned long)saved, 100.0 * saved / (heap + saved));
+
+	delete ini;
+	return 0;
+}
@@ -0,0 +1,126 @@
+//----------------------------------------------------------------------
+//	knownbench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// What FeedChecker::SetStopAfterKnown() saves per poll, against a stand-in
+// server on the loopback interface (see TestServers.h) serving a feed of
+// -i items, -k of them new since the previous poll:
+//
+//	full			Every reply read to the end
+//	stop			Reading stops after 3 known items in a row
+//	stop_length		The same, with the server telling the reply's length,
+//					so that what was left unread is known
+//
+// Each prints bytes read and skipped, items parsed and new items per poll,
+// and the median time a poll took. Exits with 1 if a poll missed a new item.
+//
+//	knownbench [-n polls] [-i items] [-k new]
+//
+// defaults to 50 polls of 500 items, 5 of them new.
+//----------------------------------------------------------------------
+#include "FeedSocket.h"
+#include "Tests.h"
+#include "TestServers.h"
+
+#include <algorithm>
+
+static int sPolls, sItems, sNew;
+
+// The feed as of Poll: the newest sItems items, newest first
+static std::string FeedAt(int Poll)
+{
+	std::vector<int> items;
+	for (int i = sItems + Poll * sNew; i-- > Poll * sNew; )
+		items.push_back(i);
+	return TestFeedOf(items);
+}
+
+// Returns false if a poll didn't bring exactly the new items
+static bool Run(const char *Case, int StopAfter, bool ContentLength)
+{
+	TestHttpServer server(FeedAt(0));
+	server.zContentLength = ContentLength;
+	if (!server.Start())
+	{
+		fprintf(stderr, "knownbench: can't start the stand-in server\n");
+		return false;
+	}
+	char url[64];
+	sprintf(url, "http://127.0.0.1:%u/backend/recent", server.zPort);
+	FeedSource source;
+	source.SetUrl(url);
+	FeedSocketTransport transport(5);
+	FeedChecker checker;
+	checker.SetStopAfterKnown(StopAfter);
+
+	// The first poll sees everything for the first time
+	std::vector<FeedItem> items;
+	FeedTiming timing;
+	bool ok = checker.Check(transport, source, &items, &timing);
+
+	unsigned long bytes = 0, skipped = 0, parsed = 0, found = 0;
+	int cutShort = 0;
+	std::vector<double> times;
+	for (int poll = 1; ok && poll <= sPolls; poll++)
+	{
+		server.zBody = FeedAt(poll);	// No request is being served
+		items.clear();
+		timing.Reset();
+		double start = BenchTime();
+		ok = checker.Check(transport, source, &items, &timing) && items.size() == (size_t)sNew;
+		times.push_back(BenchTime() - start);
+		bytes += timing.zBytes;
+		skipped += timing.zBytesSkipped;
+		parsed += timing.zItems;
+		found += items.size();
+		cutShort += timing.zCutShort;
+	}
+	if (!ok)
+	{
+		fprintf(stderr, "knownbench: %s: a poll failed or missed new items\n", Case);
+		return false;
+	}
+
+	std::sort(times.begin(), times.end());
+	BenchPrint("knownbench", Case, "\"polls\":%d,\"items\":%d,\"stop_after\":%d,"
+		"\"bytes_per_poll\":%lu,\"skipped_per_poll\":%lu,\"parsed_per_poll\":%lu,"
+		"\"new_per_poll\":%lu,\"cut_short\":%d,\"p50_ms\":%.3f", sPolls, sItems, StopAfter,
+		bytes / sPolls, skipped / sPolls, parsed / sPolls, found / sPolls, cutShort,
+		times[times.size() / 2] * 1000);
+	return true;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-n polls] [-i items] [-k new]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	sPolls = 50;
+	sItems = 500;
+	sNew = 5;
+
+	int option;
+	while ((option = getopt(argc, argv, "n:i:k:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'n': sPolls = atoi(optarg); break;
+			case 'i': sItems = atoi(optarg); break;
+			case 'k': sNew = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (sPolls < 1 || sItems < 1 || sNew < 0 || sNew > sItems)
+		Usage(argv[0]);
+
+	bool ok = Run("full", 0, false);
+	ok = Run("stop", 3, false) && ok;
+	ok = Run("stop_length", 3, true) && ok;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+//----------------------------------------------------------------------
+//	layersbench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Reading through IniLayers, with three layers: a system file of -s
+// sections of 20 keys, a site file overriding 10% of its keys and a user
+// file overriding 1%:
+//
+//	per_layer_load		Every lookup loads the layers and looks from the
+//				top down, as reading several files used to
+//	merged			Lookups in the merged view
+//	build			Building the merged view
+//	refresh_unchanged	Refresh() with no layer changed on disk, then a
+//				lookup, which mustn't rebuild anything
+//	refresh_changed		Refresh() after the user's file changed, then a
+//				lookup, which rebuilds the view
+//
+//	layersbench [-s sections] [-l lookups]
+//
+// defaults to 200 sections and 100K lookups (100 for per_layer_load).
+//----------------------------------------------------------------------
+#include "IniLayers.h"
+#include "Tests.h"
+
+static const int kKeys = 20;
+
+// Writes a layer that has every Every'th key of the system layer
+static bool WriteLayer(const std::string &Filename, long Sections, int Every, const char *Value)
+{
+	IniFile layer;
+	char section[32], key[32];
+	for (long i = 0; i < Sections * kKeys; i += Every)
+	{
+		sprintf(section, "Section%ld", i / kKeys);
+		sprintf(key, "Key%ld", i % kKeys);
+		layer.WriteString(section, key, Value);
+	}
+	return layer.Store(Filename.c_str());
+}
+
+// Looks up random keys; returns how many came from the user's layer
+static long Lookups(IniLayers &Layers, long Sections, long Count)
+{
+	BenchRandom random;
+	char section[32], key[32];
+	long user = 0;
+	for (long i = 0; i < Count; i++)
+	{
+		sprintf(section, "Section%lu", random.Below(Sections));
+		sprintf(key, "Key%lu", random.Below(kKeys));
+		const char *value;
+		if (Layers.Merged().FindString(section, key, &value) && strcmp(value, "user") == 0)
+			user++;
+	}
+	return user;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-s sections] [-l lookups]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long sections = 200, lookups = 100000;
+
+	int option;
+	while ((option = getopt(argc, argv, "s:l:h")) != -1)
+	{
+		switch (option)
+		{
+			case 's': sections = atol(optarg); break;
+			case 'l': lookups = atol(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (sections <= 0 || lookups < 100)
+		Usage(argv[0]);
+
+	std::string names[3] = { TestPath("layersbench-system.ini"), TestPath("layersbench-site.ini"),
+		TestPath("layersbench-user.ini") };
+	if (!WriteLayer(names[0], sections, 1, "system") || !WriteLayer(names[1], sections, 10, "site")
+		|| !WriteLayer(names[2], sections, 100, "user"))
+	{
+		fprintf(stderr, "%s: can't write the layers\n", argv[0]);
+		return 1;
+	}
+	char shape[96];
+	sprintf(shape, "\"layers\":3,\"sections\":%ld,\"keys\":%ld", sections, sections * kKeys);
+
+	// The way it was: every file, every time
+	long slow = lookups / 1000 > 100 ? lookups / 1000 : 100;
+	BenchRandom random;
+	double start = BenchTime();
+	for (long i = 0; i < slow; i++)
+	{
+		char section[32], key[32];
+		sprintf(section, "Section%lu", random.Below(sections));
+		sprintf(key, "Key%lu", random.Below(kKeys));
+		for (int layer = 2; layer >= 0; layer--)
+		{
+			IniFile file(names[layer].c_str());
+			const char *value;
+			if (file.FindString(section, key, &value))
+				break;
+		}
+	}
+	BenchPrint("layersbench", "per_layer_load", "%s,\"lookups\":%ld,\"us_per_lookup\":%.3f",
+		shape, slow, (BenchTime() - start) * 1e6 / slow);
+
+	IniLayers layers;
+	for (int i = 0; i < 3; i++)
+		layers.AddLayer(names[i].c_str());
+	start = BenchTime();
+	layers.Merged();
+	BenchPrint("layersbench", "build", "%s,\"ms\":%.3f", shape, (BenchTime() - start) * 1000);
+
+	start = BenchTime();
+	long user = Lookups(layers, sections, lookups);
+	BenchPrint("layersbench", "merged", "%s,\"lookups\":%ld,\"us_per_lookup\":%.3f,\"from_user\":%ld",
+		shape, lookups, (BenchTime() - start) * 1e6 / lookups, user);
+
+	const long kRefreshes = 1000;
+	unsigned long rebuilds = layers.Rebuilds();
+	start = BenchTime();
+	for (long i = 0; i < kRefreshes; i++)
+	{
+		layers.Refresh();
+		Lookups(layers, sections, 1);
+	}
+	BenchPrint("layersbench", "refresh_unchanged", "%s,\"refreshes\":%ld,\"us_per_refresh\":%.3f,"
+		"\"rebuilds\":%lu", shape, kRefreshes, (BenchTime() - start) * 1e6 / kRefreshes,
+		layers.Rebuilds() - rebuilds);
+	bool ok = layers.Rebuilds() == rebuilds;
+
+	const long kChanges = 20;
+	IniFile top(names[2].c_str());
+	double took = 0;
+	for (long i = 0; i < kChanges; i++)
+	{
+		top.WriteInt("Section0", "Changes", i);
+		top.Store(names[2].c_str());
+		start = BenchTime();
+		layers.Refresh();
+		Lookups(layers, sections, 1);
+		took += BenchTime() - start;
+	}
+	BenchPrint("layersbench", "refresh_changed", "%s,\"refreshes\":%ld,\"ms_per_refresh\":%.3f,"
+		"\"rebuilds\":%lu", shape, kChanges, took * 1000 / kChanges,
+		layers.Rebuilds() - rebuilds);
+	ok = ok && layers.Rebuilds() == rebuilds + kChanges;
+
+	for (int i = 0; i < 3; i++)
+		unlink(names[i].c_str());
+	if (!ok)
+	{
+		fprintf(stderr, "%s: the merged view was rebuilt when it shouldn't have been, or wasn't\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
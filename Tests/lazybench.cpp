@@ -0,0 +1,86 @@
+//----------------------------------------------------------------------
+//	lazybench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Startup latency of LoadLazy() against Load(), the way an app sharing a
+// settings file with others starts up: load the file, then read one key
+// of its own section. Also reports what it costs to end up with every
+// section parsed anyway.
+//
+//	lazybench [-s size] [-n sections] [-r rounds]
+//
+// defaults to a 4M file with 400 sections, the best of 10 rounds.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-s size] [-n sections] [-r rounds]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	off_t size = 4 * 1024 * 1024;
+	long sections = 400;
+	int rounds = 10;
+
+	int option;
+	while ((option = getopt(argc, argv, "s:n:r:h")) != -1)
+	{
+		switch (option)
+		{
+			case 's': size = BenchParseSize(optarg); break;
+			case 'n': sections = atol(optarg); break;
+			case 'r': rounds = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (size <= 0 || sections <= 0 || rounds <= 0)
+		Usage(argv[0]);
+
+	// Keys of about 36 bytes a line, enough of them per section to come
+	// out at the requested size
+	BenchIniShape shape((int)(size / sections / 36) + 1);
+	std::string filename = TestPath("lazybench.ini");
+	if (BenchWriteIni(filename.c_str(), size, shape, sections) < 0)
+	{
+		fprintf(stderr, "%s: can't write %s\n", argv[0], filename.c_str());
+		return 1;
+	}
+	char section[32];
+	sprintf(section, "%s%ld", shape.zSectionPrefix, sections / 2);
+
+	const char *cases[] = { "load", "load_lazy", "load_all", "load_lazy_all", NULL };
+	for (int c = 0; cases[c] != NULL; c++)
+	{
+		double best = 1e9;
+		bool found = true;
+		for (int round = 0; round < rounds; round++)
+		{
+			IniFile ini;
+			double start = BenchTime();
+			if (c & 1)
+				ini.LoadLazy(filename.c_str());
+			else
+				ini.Load(filename.c_str());
+			const char *value;
+			found &= ini.FindString(section, "Key0", &value);
+			if (c >= 2)
+				ini.ParseAllSections();
+			double seconds = BenchTime() - start;
+			if (seconds < best)
+				best = seconds;
+		}
+		BenchPrint("lazybench", cases[c], "\"size\":%lld,\"sections\":%ld,\"keys_per_section\":%d,"
+			"\"found\":%s,\"seconds\":%.6f", (long long)size, sections, shape.zKeys,
+			found ? "true" : "false", best);
+	}
+
+	unlink(filename.c_str());
+	return 0;
+}
@@ -0,0 +1,129 @@
+//----------------------------------------------------------------------
+//	parallelbench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Speedup of LoadParallel() over Load() with 1, 2, 4, 8 and 16 threads,
+// on a file shaped like what WriteData() leaves behind: few keys with
+// long values. Every parallel load is checked against the sequential one.
+// With one thread LoadParallel() simply calls Load(); from two on, the
+// shards are parsed from the mapped file, which is faster than Load()
+// even on one CPU. So besides the speedup over Load(), each result has
+// the scaling over two threads, which is what the threads themselves
+// bring. Threads beyond the number of CPUs can't speed anything up; the
+// CPU count is part of each result.
+//
+//	parallelbench [-s size] [-t max threads] [-r rounds]
+//
+// defaults to a 64M file, up to 16 threads, the best of 3 rounds.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+// Compares the parts of two trees that a shard boundary could get wrong
+static bool SameTree(IniFile &Ini, IniFile &Other, long Sections, const BenchIniShape &Shape)
+{
+	IniStats stats, otherStats;
+	Ini.GetStats(&stats);
+	Other.GetStats(&otherStats);
+	if (stats.zSections != otherStats.zSections || stats.zKeys != otherStats.zKeys)
+		return false;
+
+	char section[32];
+	for (long s = 0; s < Sections; s += Sections / 97 + 1)
+	{
+		sprintf(section, "%s%ld", Shape.zSectionPrefix, s);
+		const char *value, *otherValue;
+		if (!Ini.FindString(section, "Key0", &value) || !Other.FindString(section, "Key0", &otherValue)
+			|| strcmp(value, otherValue) != 0)
+			return false;
+	}
+	return true;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-s size] [-t max threads] [-r rounds]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	off_t size = 64 * 1024 * 1024;
+	int maxThreads = 16;
+	int rounds = 3;
+
+	int option;
+	while ((option = getopt(argc, argv, "s:t:r:h")) != -1)
+	{
+		switch (option)
+		{
+			case 's': size = BenchParseSize(optarg); break;
+			case 't': maxThreads = atoi(optarg); break;
+			case 'r': rounds = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (size <= 0 || maxThreads <= 0 || rounds <= 0)
+		Usage(argv[0]);
+
+	BenchIniShape shape(8, 1024, "Blob");
+	std::string filename = TestPath("parallelbench.ini");
+	long sections = BenchWriteIni(filename.c_str(), size, shape);
+	if (sections < 0)
+	{
+		fprintf(stderr, "%s: can't write %s\n", argv[0], filename.c_str());
+		return 1;
+	}
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	IniFile sequential;
+	double load = 1e9;
+	for (int round = 0; round < rounds; round++)
+	{
+		sequential.Clear();
+		double start = BenchTime();
+		sequential.Load(filename.c_str());
+		double seconds = BenchTime() - start;
+		if (seconds < load)
+			load = seconds;
+	}
+	BenchPrint("parallelbench", "load", "\"size\":%lld,\"sections\":%ld,\"cpus\":%ld,"
+		"\"threads\":1,\"seconds\":%.4f,\"speedup\":1.00", (long long)size, sections, cpus, load);
+
+	bool allSame = true;
+	double two = 0;
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		double best = 1e9;
+		bool same = true;
+		for (int round = 0; round < rounds; round++)
+		{
+			IniFile parallel;
+			double start = BenchTime();
+			parallel.LoadParallel(filename.c_str(), threads);
+			double seconds = BenchTime() - start;
+			if (seconds < best)
+				best = seconds;
+			if (round == 0)
+				same = SameTree(sequential, parallel, sections, shape);
+		}
+		allSame &= same;
+		if (threads == 2)
+			two = best;
+		BenchPrint("parallelbench", "load_parallel", "\"size\":%lld,\"sections\":%ld,\"cpus\":%ld,"
+			"\"threads\":%d,\"same\":%s,\"seconds\":%.4f,\"speedup\":%.2f,\"scaling\":%.2f",
+			(long long)size, sections, cpus, threads, same ? "true" : "false", best, load / best,
+			two > 0 ? two / best : 1.0);
+	}
+
+	unlink(filename.c_str());
+	if (!allSame)
+	{
+		fprintf(stderr, "%s: LoadParallel() didn't match Load()\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,156 @@
+//----------------------------------------------------------------------
+//	proxybench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Fetch latency through FeedProxyPool, against stand-in proxies on the
+// loopback interface that answer after a set latency (see TestServers.h):
+//
+//	single_slow	One proxy, 200ms, as before the pool
+//	single_dead	One proxy that refuses connections
+//	pool		Dead, slow (200ms), fast (20ms) and medium (50ms)
+//	pool_failover	The same pool, with the fast proxy answering 502 for
+//			a quarter of the polls and then coming back
+//
+// Each prints p50, p95 and failures over -n polls, and the pool cases the
+// health each proxy ended up with. Exits with 1 if the pool failed a
+// fetch, or the fast proxy didn't get its share back after failing.
+//
+//	proxybench [-n polls]
+//
+// defaults to 100 polls per case.
+//----------------------------------------------------------------------
+#include "FeedProxy.h"
+#include "FeedSocket.h"
+#include "Tests.h"
+#include "TestServers.h"
+
+#include <algorithm>
+
+static TestHttpServer *sFast;
+static int sPolls;
+
+struct Latencies {
+	double zP50, zP95;
+	int zFailures;
+};
+
+// Sets sFast failing for the third quarter of the polls
+static void FailFast(int Poll)
+{
+	sFast->zFailing = Poll >= sPolls / 2 && Poll < sPolls * 3 / 4;
+}
+
+static Latencies Run(FeedProxyPool &Pool, void (*BeforePoll)(int) = NULL)
+{
+	FeedSocketTransport transport(5);
+	FeedSource source;
+	source.SetUrl("http://feed.example/backend/recent");
+	source.zDeadlines.zConnect = 1;
+
+	std::vector<double> times;
+	int failures = 0;
+	for (int i = 0; i < sPolls; i++)
+	{
+		if (BeforePoll != NULL)
+			BeforePoll(i);
+		std::string reply;
+		FeedTiming timing;
+		double start = FeedTime();
+		if (!Pool.Fetch(transport, source, &reply, &timing))
+			failures++;
+		times.push_back(FeedTime() - start);
+	}
+	std::sort(times.begin(), times.end());
+	Latencies result = { times[times.size() / 2], times[times.size() * 95 / 100], failures };
+	return result;
+}
+
+static void Print(const char *Case, int Proxies, const Latencies &Result)
+{
+	BenchPrint("proxybench", Case, "\"proxies\":%d,\"polls\":%d,\"p50_ms\":%.1f,"
+		"\"p95_ms\":%.1f,\"failures\":%d", Proxies, sPolls, Result.zP50 * 1000,
+		Result.zP95 * 1000, Result.zFailures);
+}
+
+static void PrintHealth(const char *Case, FeedProxyPool &Pool, const char **Names)
+{
+	FeedProxy proxy;
+	for (int i = 0; Pool.Proxy(i, &proxy); i++)
+		BenchPrint("proxybench", Case, "\"proxy\":\"%s\",\"latency_ms\":%.1f,\"error_rate\":%.2f,"
+			"\"samples\":%d,\"failures\":%d", Names[i], proxy.zLatency * 1000, proxy.zErrorRate,
+			proxy.zSamples, proxy.zFailures);
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-n polls]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	sPolls = 100;
+
+	int option;
+	while ((option = getopt(argc, argv, "n:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'n': sPolls = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (sPolls < 4)
+		Usage(argv[0]);
+
+	std::string feed = TestFeed(20);
+	TestHttpServer slow(feed, 0.2), fast(feed, 0.02), medium(feed, 0.05);
+	if (!slow.Start() || !fast.Start() || !medium.Start())
+	{
+		fprintf(stderr, "%s: can't start the stand-in proxies\n", argv[0]);
+		return 1;
+	}
+	sFast = &fast;
+	unsigned short dead = TestClosedPort();
+	char list[256];
+
+	FeedProxyPool single;
+	sprintf(list, "127.0.0.1:%u", slow.zPort);
+	single.Configure(list, 80, "");
+	Print("single_slow", 1, Run(single));
+
+	FeedProxyPool singleDead;
+	sprintf(list, "127.0.0.1:%u", dead);
+	singleDead.Configure(list, 80, "");
+	Print("single_dead", 1, Run(singleDead));
+
+	// Short retry times, so that the fast proxy gets probed again within
+	// the run
+	const char *names[] = { "dead", "slow", "fast", "medium" };
+	FeedProxyPool pool(0.3, 0.5, 5);
+	sprintf(list, "127.0.0.1:%u, 127.0.0.1:%u, 127.0.0.1:%u, 127.0.0.1:%u",
+		dead, slow.zPort, fast.zPort, medium.zPort);
+	pool.Configure(list, 80, "");
+	Latencies steady = Run(pool);
+	Print("pool", 4, steady);
+	PrintHealth("pool_health", pool, names);
+
+	int before = fast.zRequests;
+	Latencies failover = Run(pool, FailFast);
+	Print("pool_failover", 4, failover);
+	PrintHealth("pool_failover_health", pool, names);
+
+	// The fast proxy came back for the last quarter of the polls
+	FeedProxy proxy;
+	pool.Proxy(2, &proxy);
+	bool recovered = proxy.zFailures == 0 && fast.zRequests - before > sPolls * 3 / 4 - 5;
+	if (steady.zFailures != 0 || failover.zFailures != 0 || !recovered)
+	{
+		fprintf(stderr, "%s: the pool failed fetches, or didn't go back to the fast proxy\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+//----------------------------------------------------------------------
+//	resolvetest.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Tests of FeedDnsCache, in front of a FeedFakeResolver, and of how
+// FeedSocketTransport connects to hosts with several addresses. Takes a
+// few seconds, as the cache is tested against the clock.
+//----------------------------------------------------------------------
+#include "FeedSocket.h"
+#include "Tests.h"
+#include "TestServers.h"
+
+// A second lookup is answered from the cache
+static void TestHit()
+{
+	FeedFakeResolver fake;
+	FeedDnsCache cache(fake);
+	fake.Add("a.test", "127.0.0.1", 60);
+
+	std::vector<FeedAddress> addresses;
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_RESOLVED);
+	CHECK(addresses.size() == 1 && addresses[0].ToString() == "127.0.0.1");
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_CACHED);
+	CHECK(addresses.size() == 1);
+	CHECK(fake.Lookups() == 1);
+	CHECK(cache.Lookup("unknown.test", &addresses) == FEED_DNS_FAILED);
+}
+
+// An answer in the last part of its TTL is handed out while it's being
+// refreshed; once its TTL is over and the resolver fails, it's handed out
+// stale, but only for so long
+static void TestRefreshAndStale()
+{
+	FeedFakeResolver fake;
+	FeedDnsCache cache(fake, 0.5, 0.5);
+	fake.Add("a.test", "127.0.0.1", 1);
+
+	std::vector<FeedAddress> addresses;
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_RESOLVED);
+	usleep(700000);
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_CACHED);
+	cache.WaitForRefreshes();
+	CHECK(fake.Lookups() == 2);
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_CACHED);
+	CHECK(fake.Lookups() == 2);
+
+	// The refresh restarted the TTL
+	fake.SetFailing(true);
+	usleep(1100000);
+	addresses.clear();
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_STALE);
+	CHECK(addresses.size() == 1 && addresses[0].ToString() == "127.0.0.1");
+	usleep(500000);
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_FAILED);
+
+	fake.SetFailing(false);
+	CHECK(cache.Lookup("a.test", &addresses) == FEED_DNS_RESOLVED);
+}
+
+// With several addresses, one that swallows SYNs holds the connect up for
+// kFeedAttemptDelay, one that refuses doesn't hold it up at all
+static void TestHappyEyeballs()
+{
+	FeedFakeResolver fake;
+	FeedDnsCache cache(fake);
+	FeedSocketTransport transport(2, &cache);
+
+	unsigned short port = TestSynDropPort("127.0.0.1");
+	TestHttpServer server(TestFeed(1));
+	CHECK(port != 0 && server.Start("127.0.0.2", port));
+	fake.Add("drop.test", "127.0.0.1", 60);
+	fake.Add("drop.test", "127.0.0.2", 60);
+	double start = FeedTime();
+	bool connected = transport.Connect("drop.test", port);
+	double took = FeedTime() - start;
+	CHECK(connected && transport.PeerAddress() == "127.0.0.2");
+	CHECK(took >= kFeedAttemptDelay - 0.01 && took < kFeedAttemptDelay + 0.2);
+	transport.Close();
+
+	fake.Add("refuse.test", "127.0.0.3", 60);
+	fake.Add("refuse.test", "127.0.0.2", 60);
+	start = FeedTime();
+	connected = transport.Connect("refuse.test", port);
+	took = FeedTime() - start;
+	CHECK(connected && transport.PeerAddress() == "127.0.0.2");
+	CHECK(took < kFeedAttemptDelay / 2);
+	transport.Close();
+
+	// With nothing but a black hole, the transport's timeout ends it
+	fake.Add("hole.test", "127.0.0.1", 60);
+	start = FeedTime();
+	connected = transport.Connect("hole.test", port);
+	took = FeedTime() - start;
+	CHECK(!connected && took >= 1.9 && took < 2.5);
+}
+
+// A fetch by name resolves once, then goes by the cache
+static void TestFetch()
+{
+	FeedFakeResolver fake;
+	FeedDnsCache cache(fake);
+	FeedSocketTransport transport(5, &cache);
+	TestHttpServer server(TestFeed(3));
+	CHECK(server.Start());
+	fake.SetDelay(0.1);
+	fake.Add("feed.test", "127.0.0.1", 60);
+
+	char url[64];
+	sprintf(url, "http://feed.test:%u/backend/recent", server.zPort);
+	FeedSource source;
+	source.SetUrl(url);
+	for (int i = 0; i < 2; i++)
+	{
+		std::string reply;
+		FeedTiming timing;
+		CHECK(FeedFetch(transport, source, &reply, &timing));
+		std::vector<FeedItem> items;
+		CHECK(timing.zStatus == 200 && FeedParse(reply.data(), reply.size(), &items) == 3);
+		if (i == 0)
+			CHECK(transport.LastDnsSource() == FEED_DNS_RESOLVED && timing.zResolveTime >= 0.09);
+		else
+			CHECK(transport.LastDnsSource() == FEED_DNS_CACHED && timing.zResolveTime < 0.01);
+	}
+	CHECK(fake.Lookups() == 1);
+}
+
+int main()
+{
+	TestHit();
+	TestRefreshAndStale();
+	TestHappyEyeballs();
+	TestFetch();
+	return TestResult("resolvetest");
+}
@@ -0,0 +1,224 @@
+//----------------------------------------------------------------------
+//	settingsbench.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Loading the app's settings out of an already loaded settings file, whose
+// "BeBitsUpdated" section holds every setting and -u keys the app doesn't
+// know of, next to -s sections of other apps:
+//
+//	four_lookups	What LoadSettings() used to do: ReadInt() for
+//			PollInterval and ProxyPort, ReadString() for
+//			ProxyServer and ProxyAuth
+//	schema		What it does now: ForEachKey() over the section,
+//			each key found and parsed into the struct, all
+//			nine settings
+//
+// Settings.cpp needs the Be API, so Settings is stood in for by a struct
+// generated the same way, from a copy of SETTINGS_SCHEMA with std::string
+// for BString; its Find() and Set() are those of Settings.cpp.
+//
+//	settingsbench [-s sections] [-u unknown keys] [-l loads]
+//
+// defaults to 20 sections, 4 unknown keys and 100K loads.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+#include <errno.h>
+#include <stdint.h>
+
+// Has to follow SETTINGS_SCHEMA in Settings.h
+#define BENCH_SETTINGS_SCHEMA(UINT, STRING) \
+	UINT  ( POLL_INTERVAL   , poll_rate       , "PollInterval"  , 600, 1, 0xFFFF ) \
+	UINT  ( PROXY_PORT      , proxy_port      , "ProxyPort"     ,  80, 1, 0xFFFF ) \
+	STRING( PROXY_SERVER    , proxy_serv      , "ProxyServer"   , ""             ) \
+	STRING( PROXY_AUTH      , proxy_auth      , "ProxyAuth"     , ""             ) \
+	UINT  ( CONNECT_TIMEOUT , connect_timeout , "ConnectTimeout",  15, 1, 3600   ) \
+	UINT  ( SEND_TIMEOUT    , send_timeout    , "SendTimeout"   ,  15, 1, 3600   ) \
+	UINT  ( RECEIVE_TIMEOUT , receive_timeout , "ReceiveTimeout",  30, 1, 3600   ) \
+	UINT  ( FETCH_TIMEOUT   , fetch_timeout   , "FetchTimeout"  ,  60, 1, 3600   ) \
+	UINT  ( STOP_AFTER_KNOWN, stop_after_known, "StopAfterKnown",   5, 0, 1000   )
+
+#define BENCH_ID_UINT(id, member, key, def, min, max) SETTING_##id,
+#define BENCH_ID_STRING(id, member, key, def)         SETTING_##id,
+enum SettingId {
+	BENCH_SETTINGS_SCHEMA(BENCH_ID_UINT, BENCH_ID_STRING)
+	SETTING_COUNT
+};
+#undef BENCH_ID_UINT
+#undef BENCH_ID_STRING
+
+static const char *kSection = "BeBitsUpdated";
+
+static bool ParseUInt(const char *Text, uint32_t Min, uint32_t Max, uint32_t *Result)
+{
+	while (*Text == ' ' || *Text == '\t') Text++;
+	if (*Text < '0' || *Text > '9')
+		return false;
+
+	char *end;
+	errno = 0;
+	unsigned long value = strtoul(Text, &end, 10);
+	while (*end == ' ' || *end == '\t') end++;
+	if (*end != 0 || errno != 0 || value < Min || value > Max)
+		return false;
+
+	*Result = value;
+	return true;
+}
+
+struct Settings {
+#define BENCH_MEMBER_UINT(id, member, key, def, min, max) uint32_t member;
+#define BENCH_MEMBER_STRING(id, member, key, def)         std::string member;
+	BENCH_SETTINGS_SCHEMA(BENCH_MEMBER_UINT, BENCH_MEMBER_STRING)
+#undef BENCH_MEMBER_UINT
+#undef BENCH_MEMBER_STRING
+
+	Settings()
+	{
+#define BENCH_DEFAULT_UINT(id, member, key, def, min, max) member = def;
+#define BENCH_DEFAULT_STRING(id, member, key, def)         member = def;
+		BENCH_SETTINGS_SCHEMA(BENCH_DEFAULT_UINT, BENCH_DEFAULT_STRING)
+#undef BENCH_DEFAULT_UINT
+#undef BENCH_DEFAULT_STRING
+	}
+
+	bool Set(SettingId Id, const char *Text)
+	{
+		switch (Id)
+		{
+#define BENCH_SET_UINT(id, member, key, def, min, max) \
+			case SETTING_##id: return ParseUInt(Text, min, max, &member);
+#define BENCH_SET_STRING(id, member, key, def) \
+			case SETTING_##id: member = Text; return true;
+			BENCH_SETTINGS_SCHEMA(BENCH_SET_UINT, BENCH_SET_STRING)
+#undef BENCH_SET_UINT
+#undef BENCH_SET_STRING
+			default: return false;
+		}
+	}
+
+	static SettingId Find(const char *Key)
+	{
+		size_t length = strlen(Key);
+#define BENCH_FIND_UINT(id, member, key_, def, min, max) \
+		if (length == sizeof(key_) - 1 && memcmp(Key, key_, length) == 0) return SETTING_##id;
+#define BENCH_FIND_STRING(id, member, key_, def) \
+		if (length == sizeof(key_) - 1 && memcmp(Key, key_, length) == 0) return SETTING_##id;
+		BENCH_SETTINGS_SCHEMA(BENCH_FIND_UINT, BENCH_FIND_STRING)
+#undef BENCH_FIND_UINT
+#undef BENCH_FIND_STRING
+		return SETTING_COUNT;
+	}
+};
+
+// LoadSetting() of Settings.cpp
+static bool LoadSetting(const char *Key, const char *Value, void *Cookie)
+{
+	SettingId id = Settings::Find(Key);
+	if (id != SETTING_COUNT)
+		((Settings *)Cookie)->Set(id, Value);
+	return true;
+}
+
+// The four settings there were, read the way they used to be
+static void LoadFour(const IniFile &Ini, Settings *Result)
+{
+	char text[256];
+	Result->poll_rate = Ini.ReadInt(kSection, "PollInterval", 600);
+	Result->proxy_port = Ini.ReadInt(kSection, "ProxyPort", 80);
+	Result->proxy_serv = Ini.ReadString(kSection, "ProxyServer", text, sizeof text, "");
+	Result->proxy_auth = Ini.ReadString(kSection, "ProxyAuth", text, sizeof text, "");
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-s sections] [-u unknown keys] [-l loads]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long sections = 20, unknown = 4, loads = 100000;
+
+	int option;
+	while ((option = getopt(argc, argv, "s:u:l:h")) != -1)
+	{
+		switch (option)
+		{
+			case 's': sections = atol(optarg); break;
+			case 'u': unknown = atol(optarg); break;
+			case 'l': loads = atol(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (sections < 0 || unknown < 0 || loads <= 0)
+		Usage(argv[0]);
+
+	// Other apps' sections come first, so that ours isn't the first one
+	// looked at
+	IniFile ini;
+	char section[32], key[32];
+	for (long i = 0; i < sections; i++)
+	{
+		sprintf(section, "Section%ld", i);
+		for (int k = 0; k < 20; k++)
+		{
+			sprintf(key, "Key%d", k);
+			ini.WriteInt(section, key, k);
+		}
+	}
+	ini.WriteInt(kSection, "PollInterval", 300);
+	ini.WriteInt(kSection, "ProxyPort", 8080);
+	ini.WriteString(kSection, "ProxyServer", "proxy.example.com, user:pass@other.example.com:3128");
+	ini.WriteString(kSection, "ProxyAuth", "user:secret");
+	ini.WriteInt(kSection, "ConnectTimeout", 10);
+	ini.WriteInt(kSection, "SendTimeout", 10);
+	ini.WriteInt(kSection, "ReceiveTimeout", 20);
+	ini.WriteInt(kSection, "FetchTimeout", 45);
+	ini.WriteInt(kSection, "StopAfterKnown", 3);
+	for (long i = 0; i < unknown; i++)
+	{
+		sprintf(key, "Unknown%ld", i);
+		ini.WriteString(kSection, key, "left alone");
+	}
+	char shape[96];
+	sprintf(shape, "\"sections\":%ld,\"section_keys\":%ld", sections + 1, SETTING_COUNT + unknown);
+
+	Settings four;
+	double start = BenchTime();
+	for (long i = 0; i < loads; i++)
+	{
+		four = Settings();
+		LoadFour(ini, &four);
+	}
+	double fourTook = BenchTime() - start;
+	BenchPrint("settingsbench", "four_lookups", "%s,\"loads\":%ld,\"settings\":4,\"us_per_load\":%.3f",
+		shape, loads, fourTook * 1e6 / loads);
+
+	Settings schema;
+	start = BenchTime();
+	for (long i = 0; i < loads; i++)
+	{
+		schema = Settings();
+		ini.ForEachKey(kSection, LoadSetting, &schema);
+	}
+	double schemaTook = BenchTime() - start;
+	BenchPrint("settingsbench", "schema", "%s,\"loads\":%ld,\"settings\":%d,\"us_per_load\":%.3f,"
+		"\"vs_four_lookups\":%.2f", shape, loads, (int)SETTING_COUNT, schemaTook * 1e6 / loads,
+		schemaTook / fourTook);
+
+	// Both have to read the four settings they have in common alike, and
+	// the schema the rest as well
+	if (four.poll_rate != schema.poll_rate || four.proxy_port != schema.proxy_port
+		|| four.proxy_serv != schema.proxy_serv || four.proxy_auth != schema.proxy_auth
+		|| schema.poll_rate != 300 || schema.fetch_timeout != 45 || schema.stop_after_known != 3)
+	{
+		fprintf(stderr, "%s: the two ways read different settings\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,178 @@
+//----------------------------------------------------------------------
+//	sharedstress.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Stress test and benchmark of SharedIniFile: 1, 2, 4, ... reader threads
+// read as fast as they can while one writer keeps publishing new
+// versions. The writer always sets two keys to the same value in one
+// commit, so a reader seeing them differ has seen a torn version, which
+// fails the run. Reports reads per second for each number of readers.
+//
+//	sharedstress [-t max readers] [-d seconds per step] [-w writes/s]
+//
+// defaults to up to 16 readers, 1 second per step, 1000 writes a second.
+//----------------------------------------------------------------------
+#include "SharedIniFile.h"
+#include "Tests.h"
+
+#include <pthread.h>
+
+struct StressState {
+	SharedIniFile zShared;
+	volatile bool zStop;
+	int zWritesPerSecond;
+	long zSections;
+};
+
+struct ReaderState {
+	StressState *zState;
+	unsigned long zSeed;
+	long zReads;
+	long zTorn;
+	unsigned long zVersions;	// Distinct versions seen
+};
+
+static void *ReaderThread(void *Data)
+{
+	ReaderState *reader = (ReaderState *)Data;
+	StressState *state = reader->zState;
+	BenchRandom random(reader->zSeed);
+	unsigned long lastVersion = 0;
+	char section[32];
+	while (!__atomic_load_n(&state->zStop, __ATOMIC_RELAXED))
+	{
+		sprintf(section, "Section%lu", random.Below(state->zSections));
+		SharedIniFile::Reader ini(state->zShared);
+		int first = 0, second = -1;
+		ini->FindInt("Counter", "First", &first);
+		ini->FindInt("Counter", "Second", &second);
+		if (first != second)
+			reader->zTorn++;
+		const char *value;
+		ini->FindString(section, "Key0", &value);
+		if (first != (int)lastVersion)
+		{
+			lastVersion = first;
+			reader->zVersions++;
+		}
+		reader->zReads++;
+	}
+	return NULL;
+}
+
+static void *WriterThread(void *Data)
+{
+	StressState *state = (StressState *)Data;
+	int counter = 0;
+	BenchRandom random(99);
+	char section[32];
+	struct timespec pause = { 0, 1000000000L / state->zWritesPerSecond };
+	while (!__atomic_load_n(&state->zStop, __ATOMIC_RELAXED))
+	{
+		counter++;
+		sprintf(section, "Section%lu", random.Below(state->zSections));
+		SharedIniFile::Writer ini(state->zShared);
+		ini->WriteInt("Counter", "First", counter);
+		ini->WriteString(section, "Key1", "changed");
+		ini->WriteInt("Counter", "Second", counter);
+		ini.Commit();
+		nanosleep(&pause, NULL);
+	}
+	return (void *)(long)counter;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "Usage: %s [-t max readers] [-d seconds per step] [-w writes/s]\n", Name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int maxReaders = 16;
+	double duration = 1;
+	int writesPerSecond = 1000;
+
+	int option;
+	while ((option = getopt(argc, argv, "t:d:w:h")) != -1)
+	{
+		switch (option)
+		{
+			case 't': maxReaders = atoi(optarg); break;
+			case 'd': duration = atof(optarg); break;
+			case 'w': writesPerSecond = atoi(optarg); break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+	if (maxReaders <= 0 || duration <= 0 || writesPerSecond <= 0)
+		Usage(argv[0]);
+
+	// Start out with a file of a realistic size
+	BenchIniShape shape;
+	std::string filename = TestPath("sharedstress.ini");
+	StressState state;
+	state.zSections = BenchWriteIni(filename.c_str(), 256 * 1024, shape);
+	state.zWritesPerSecond = writesPerSecond;
+	{
+		SharedIniFile::Writer ini(state.zShared);
+		ini->Load(filename.c_str());
+		ini->WriteInt("Counter", "First", 0);
+		ini->WriteInt("Counter", "Second", 0);
+		ini.Commit();
+	}
+	unlink(filename.c_str());
+
+	long totalTorn = 0;
+	for (int readers = 1; readers <= maxReaders; readers *= 2)
+	{
+		state.zStop = false;
+		ReaderState *reader = new ReaderState[readers];
+		pthread_t *threads = new pthread_t[readers];
+		pthread_t writer;
+		unsigned long before = state.zShared.Version();
+		double start = BenchTime();
+		pthread_create(&writer, NULL, WriterThread, &state);
+		for (int i = 0; i < readers; i++)
+		{
+			reader[i].zState = &state;
+			reader[i].zSeed = i + 1;
+			reader[i].zReads = reader[i].zTorn = 0;
+			reader[i].zVersions = 0;
+			pthread_create(&threads[i], NULL, ReaderThread, &reader[i]);
+		}
+
+		struct timespec pause = { (time_t)duration, (long)((duration - (time_t)duration) * 1e9) };
+		nanosleep(&pause, NULL);
+		__atomic_store_n(&state.zStop, true, __ATOMIC_RELAXED);
+
+		long reads = 0, torn = 0;
+		unsigned long versions = 0;
+		for (int i = 0; i < readers; i++)
+		{
+			pthread_join(threads[i], NULL);
+			reads += reader[i].zReads;
+			torn += reader[i].zTorn;
+			versions += reader[i].zVersions;
+		}
+		pthread_join(writer, NULL);
+		double seconds = BenchTime() - start;
+		totalTorn += torn;
+
+		BenchPrint("sharedstress", "read", "\"readers\":%d,\"seconds\":%.3f,\"reads\":%ld,"
+			"\"reads_per_s\":%.0f,\"reads_per_s_per_reader\":%.0f,\"writes\":%lu,"
+			"\"versions_seen\":%lu,\"torn\":%ld", readers, seconds, reads, reads / seconds,
+			reads / seconds / readers, state.zShared.Version() - before, versions, torn);
+		delete[] reader;
+		delete[] threads;
+	}
+
+	if (totalTorn != 0)
+	{
+		fprintf(stderr, "%s: readers saw %ld torn versions\n", argv[0], totalTorn);
+		return 1;
+	}
+	return 0;
+}
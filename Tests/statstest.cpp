@@ -0,0 +1,168 @@
+//----------------------------------------------------------------------
+//	statstest.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Tests of IniFile::SetAllocator() and GetStats(), with an allocator that
+// counts what it's asked for. Built twice by the Makefile: as statstest,
+// and as statstest-stats, against a build of IniFile with INIFILE_STATS
+// defined, where the allocation counts GetStats() reports have to match
+// the allocator's own.
+//----------------------------------------------------------------------
+#include "IniFile.h"
+#include "Tests.h"
+
+// Every block is preceded by its size
+struct Counts {
+	unsigned long zAllocations, zReallocations, zFrees;
+	size_t zLive;			// Bytes requested and not freed yet
+};
+
+static Counts sCounts;
+static const size_t kHeader = 16;
+
+static void *CountingAlloc(size_t Size, void *Cookie)
+{
+	Counts *counts = (Counts *)Cookie;
+	char *block = (char *)malloc(Size + kHeader);
+	if (block == NULL)
+		return NULL;
+	*(size_t *)block = Size;
+	counts->zAllocations++;
+	counts->zLive += Size;
+	return block + kHeader;
+}
+
+static void *CountingRealloc(void *Ptr, size_t Size, void *Cookie)
+{
+	Counts *counts = (Counts *)Cookie;
+	if (Ptr == NULL)
+		return CountingAlloc(Size, Cookie);
+	char *block = (char *)Ptr - kHeader;
+	size_t old = *(size_t *)block;
+	block = (char *)realloc(block, Size + kHeader);
+	if (block == NULL)
+		return NULL;
+	*(size_t *)block = Size;
+	counts->zReallocations++;
+	counts->zLive += Size - old;
+	return block + kHeader;
+}
+
+static void CountingFree(void *Ptr, void *Cookie)
+{
+	Counts *counts = (Counts *)Cookie;
+	char *block = (char *)Ptr - kHeader;
+	counts->zFrees++;
+	counts->zLive -= *(size_t *)block;
+	free(block);
+}
+
+static const IniAllocator kCountingAllocator = { CountingAlloc, CountingRealloc, CountingFree, &sCounts };
+
+// The allocator and GetStats() agree on how many calls were made, when
+// IniFile counts them at all
+static void CheckCounts(const IniFile &Ini)
+{
+	IniStats stats;
+	Ini.GetStats(&stats);
+#ifdef INIFILE_STATS
+	CHECK(stats.zCounting);
+	CHECK(stats.zAllocations == sCounts.zAllocations);
+	CHECK(stats.zReallocations == sCounts.zReallocations);
+	CHECK(stats.zFrees == sCounts.zFrees);
+#else
+	CHECK(!stats.zCounting);
+	CHECK(stats.zAllocations == 0 && stats.zReallocations == 0 && stats.zFrees == 0);
+#endif
+}
+
+// Everything a loaded file holds comes from the allocator and is counted
+// by GetStats(), and all of it is given back
+static void TestLoad(const std::string &Filename, long Sections, const BenchIniShape &Shape)
+{
+	// The first IniFile allocates the empty tree all of them start out
+	// sharing, which stays
+	IniFile probe;
+	CheckCounts(probe);
+	Counts before = sCounts;
+	{
+		IniFile ini;
+		Counts loading = sCounts;
+		CHECK(ini.Load(Filename.c_str()));
+		CheckCounts(ini);
+		CHECK(sCounts.zAllocations > loading.zAllocations);
+
+		IniStats stats;
+		ini.GetStats(&stats);
+		CHECK(stats.zSections == (size_t)Sections);
+		CHECK(stats.zKeys == (size_t)Sections * Shape.zKeys);
+		CHECK(stats.zNodes == stats.zSections + stats.zKeys);
+		CHECK(stats.zPendingSections == 0);
+#ifdef INIFILE_STATS
+		CHECK(stats.zLoadAllocations == sCounts.zAllocations - loading.zAllocations);
+		CHECK(stats.zLoadTime > 0);
+#endif
+
+		// What GetStats() accounts for is what the allocator handed out,
+		// give or take what it doesn't know of (the nodes' own padding,
+		// and the free space in tables)
+		size_t counted = stats.zStringBytes + stats.zOverheadBytes;
+		size_t live = sCounts.zLive - before.zLive;
+		CHECK(counted <= live + live / 10 && counted >= live - live / 4);
+		if (counted > live + live / 10 || counted < live - live / 4)
+			printf("  GetStats() counted %lu bytes, the allocator has %lu out\n",
+				(unsigned long)counted, (unsigned long)live);
+
+		// Copies share the tree, and only allocate for what they change:
+		// the section list and one section, not every key
+		unsigned long loadAllocations = sCounts.zAllocations - loading.zAllocations;
+		Counts copying = sCounts;
+		IniFile copy(ini);
+		copy.WriteString("Section0", "Key0", "changed");
+		CheckCounts(copy);
+		CHECK(sCounts.zAllocations - copying.zAllocations < loadAllocations / 10);
+
+		// Lazily loaded sections are counted as pending
+		IniFile lazy;
+		CHECK(lazy.LoadLazy(Filename.c_str()));
+		lazy.ReadInt("Section1", "Key1", 0);
+		lazy.GetStats(&stats);
+		CHECK(stats.zSections == (size_t)Sections);
+		CHECK(stats.zPendingSections == (size_t)Sections - 1);
+		CHECK(stats.zKeys == (size_t)Shape.zKeys);
+		CheckCounts(lazy);
+
+		std::string stored = Filename + ".stored";
+		CHECK(copy.Store(stored.c_str()));
+		CheckCounts(copy);
+		unlink(stored.c_str());
+	}
+
+	// Gone with the IniFiles
+	CheckCounts(probe);
+	CHECK(sCounts.zLive == before.zLive);
+	CHECK(sCounts.zAllocations - before.zAllocations == sCounts.zFrees - before.zFrees);
+}
+
+int main()
+{
+	// Before any IniFile exists
+	IniFile::SetAllocator(&kCountingAllocator);
+
+	BenchIniShape shape;
+	std::string filename = TestPath("statstest.ini");
+	long sections = BenchWriteIni(filename.c_str(), 256 * 1024, shape);
+	CHECK(sections > 0);
+	TestLoad(filename, sections, shape);
+	unlink(filename.c_str());
+
+	// Nothing was left behind but the shared empty tree
+	CHECK(sCounts.zLive < 64 && sCounts.zAllocations == sCounts.zFrees + 1);
+#ifdef INIFILE_STATS
+	return TestResult("statstest-stats");
+#else
+	return TestResult("statstest");
+#endif
+}
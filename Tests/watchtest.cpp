@@ -0,0 +1,270 @@
+//----------------------------------------------------------------------
+//	watchtest.cpp
+//	This software is release under the MIT License
+//	See the accompanying License file, or wander
+//	over to: http://www.opensource.org/licenses/mit-license.html
+//----------------------------------------------------------------------
+// Tests of IniFileWatch and IniFile::Diff(). Built twice by the Makefile:
+// as watchtest, with inotify, and as watchtest-poll, with the watch built
+// with INI_FILE_WATCH_POLL defined. Prints the change-to-callback latency
+// as a benchmark result.
+//----------------------------------------------------------------------
+#include "IniFileWatch.h"
+#include "Tests.h"
+
+#include <errno.h>
+#include <sys/select.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef INI_FILE_WATCH_POLL
+static const char *kMode = "poll";
+#else
+static const char *kMode = "inotify";
+#endif
+
+// How often Poll() is called when there's nothing to wait on
+static const int kPollInterval = 10000;	// Microseconds
+
+// Sleeps until the next multiple of kPollInterval, so that polls run on a
+// fixed schedule, as they would off a timer, whenever the file is written
+static void SleepToNextPoll()
+{
+	long long now = (long long)(BenchTime() * 1e6);
+	usleep(kPollInterval - now % kPollInterval);
+}
+
+struct Change {
+	std::string zSection, zKey, zOld, zNew;	// "-" for none
+	double zTime;
+};
+
+static std::vector<Change> sChanges;
+
+static void NoteChange(const char *Section, const char *Key, const char *OldValue,
+	const char *NewValue, void *Cookie)
+{
+	std::vector<Change> *changes = (std::vector<Change> *)Cookie;
+	Change change = { Section, Key, OldValue != NULL ? OldValue : "-",
+		NewValue != NULL ? NewValue : "-", BenchTime() };
+	changes->push_back(change);
+}
+
+// True if Section/Key went from Old to New ("-" for none)
+static bool Changed(const char *Section, const char *Key, const char *Old, const char *New)
+{
+	for (size_t i = 0; i < sChanges.size(); i++)
+	{
+		if (sChanges[i].zSection == Section && sChanges[i].zKey == Key)
+			return sChanges[i].zOld == Old && sChanges[i].zNew == New;
+	}
+	return false;
+}
+
+// Polls until the watch reports changes, or Timeout seconds are up;
+// returns what Poll() returned
+static int WaitForChanges(IniFileWatch &Watch, double Timeout = 1)
+{
+	double end = BenchTime() + Timeout;
+	for (;;)
+	{
+		if (!Watch.IsNotified())
+			SleepToNextPoll();
+		int changes = Watch.Poll();
+		double left = end - BenchTime();
+		if (changes != 0 || left <= 0)
+			return changes;
+		if (Watch.IsNotified())
+		{
+			fd_set read;
+			FD_ZERO(&read);
+			FD_SET(Watch.FileDescriptor(), &read);
+			struct timeval timeout = { (time_t)left, (suseconds_t)((left - (time_t)left) * 1e6) };
+			select(Watch.FileDescriptor() + 1, &read, NULL, NULL, &timeout);
+		}
+	}
+}
+
+// Writes Text to Filename in place
+static void WriteFile(const std::string &Filename, const char *Text)
+{
+	FILE *file = fopen(Filename.c_str(), "w");
+	fputs(Text, file);
+	fclose(file);
+}
+
+// Writes Text to a file of its own and renames it over Filename, the way
+// editors and IniFile::Store() replace files
+static void ReplaceFile(const std::string &Filename, const char *Text)
+{
+	std::string temp = Filename + ".new";
+	WriteFile(temp, Text);
+	rename(temp.c_str(), Filename.c_str());
+}
+
+// Per-key changes, of a file written in place, then replaced
+static void TestChanges(const std::string &Filename)
+{
+	WriteFile(Filename, "[A]\nx=1\ny=2\n\n[B]\nz=3\n");
+	IniFileWatch watch(Filename.c_str(), NoteChange, &sChanges);
+#ifdef INI_FILE_WATCH_POLL
+	CHECK(!watch.IsNotified());
+#else
+	CHECK(watch.IsNotified());
+#endif
+	CHECK(watch.Contents().ReadInt("B", "z", 0) == 3);
+	CHECK(watch.Poll() == 0);
+
+	sChanges.clear();
+	WriteFile(Filename, "[A]\nx=10\nw=4\n\n[C]\nv=5\n");
+	CHECK(WaitForChanges(watch) == 5);
+	CHECK(sChanges.size() == 5);
+	CHECK(Changed("A", "x", "1", "10"));
+	CHECK(Changed("A", "y", "2", "-"));
+	CHECK(Changed("A", "w", "-", "4"));
+	CHECK(Changed("B", "z", "3", "-"));
+	CHECK(Changed("C", "v", "-", "5"));
+	CHECK(watch.Poll() == 0);
+
+	// Replaced by renaming another file over it
+	sChanges.clear();
+	ReplaceFile(Filename, "[A]\nx=11\nw=4\n\n[C]\nv=5\n");
+	CHECK(WaitForChanges(watch) == 1);
+	CHECK(sChanges.size() == 1 && Changed("A", "x", "10", "11"));
+	CHECK(watch.Contents().ReadInt("A", "x", 0) == 11);
+
+	// As IniFile::Store() does
+	sChanges.clear();
+	IniFile ini(Filename.c_str());
+	ini.WriteInt("C", "v", 6);
+	CHECK(ini.Store(Filename.c_str()));
+	CHECK(WaitForChanges(watch) == 1);
+	CHECK(sChanges.size() == 1 && Changed("C", "v", "5", "6"));
+
+	// Rewritten without any change to its keys
+	sChanges.clear();
+	WriteFile(Filename, "; A comment\n[A]\nx=11\nw=4\n\n[C]\nv=6\n");
+	CHECK(WaitForChanges(watch, 0.2) == 0);
+	CHECK(sChanges.empty());
+}
+
+// A file that can't be read keeps its old contents, without callbacks,
+// until it can be read again
+static void TestUnreadable(const std::string &Filename)
+{
+	WriteFile(Filename, "[A]\nx=1\n");
+	IniFileWatch watch(Filename.c_str(), NoteChange, &sChanges);
+	sChanges.clear();
+
+	unlink(Filename.c_str());
+	CHECK(WaitForChanges(watch, 0.2) == 0);
+	CHECK(sChanges.empty());
+	CHECK(watch.Contents().ReadInt("A", "x", 0) == 1);
+
+	WriteFile(Filename, "[A]\nx=2\n");
+	CHECK(WaitForChanges(watch) == 1);
+	CHECK(Changed("A", "x", "1", "2"));
+
+	// Permissions don't stop root
+	if (geteuid() != 0)
+	{
+		sChanges.clear();
+		WriteFile(Filename, "[A]\nx=3\n");
+		chmod(Filename.c_str(), 0);
+		CHECK(WaitForChanges(watch, 0.2) == 0);
+		CHECK(sChanges.empty());
+		CHECK(watch.Contents().ReadInt("A", "x", 0) == 2);
+		chmod(Filename.c_str(), 0644);
+		CHECK(WaitForChanges(watch) == 1);
+		CHECK(Changed("A", "x", "2", "3"));
+	}
+
+	// Nothing else in the directory concerns the watch
+	sChanges.clear();
+	WriteFile(Filename + ".other", "[A]\nx=4\n");
+	CHECK(WaitForChanges(watch, 0.2) == 0);
+	unlink((Filename + ".other").c_str());
+}
+
+// Diff() on its own, sections shared with a copy included
+static void TestDiff()
+{
+	IniFile base;
+	base.WriteString("Shared", "Key", "same");
+	IniFile older(base), newer(base);
+	older.WriteString("S", "Gone", "old");
+	older.WriteString("S", "Same", "same");
+	older.WriteString("S", "Changed", "old");
+	newer.WriteString("S", "Same", "same");
+	newer.WriteString("S", "Changed", "new");
+	newer.WriteString("S", "Added", "new");
+	newer.WriteString("New", "Key", "new");
+
+	sChanges.clear();
+	CHECK(older.Diff(newer, NoteChange, &sChanges) == 4);
+	CHECK(sChanges.size() == 4);
+	CHECK(Changed("S", "Gone", "old", "-"));
+	CHECK(Changed("S", "Changed", "old", "new"));
+	CHECK(Changed("S", "Added", "-", "new"));
+	CHECK(Changed("New", "Key", "-", "new"));
+
+	sChanges.clear();
+	CHECK(newer.Diff(older, NoteChange, &sChanges) == 4);
+	CHECK(Changed("New", "Key", "new", "-"));
+	CHECK(newer.Diff(newer, NoteChange, &sChanges) == 0);
+}
+
+// Time from a write being done to its callback
+static void MeasureLatency(const std::string &Filename)
+{
+	const int kWrites = 50;
+	WriteFile(Filename, "[A]\nx=0\n");
+	IniFileWatch watch(Filename.c_str(), NoteChange, &sChanges);
+	std::vector<double> latencies;
+	int missed = 0;
+	BenchRandom random;
+	for (int i = 1; i <= kWrites; i++)
+	{
+		char text[64];
+		sprintf(text, "[A]\nx=%d\n", i);
+		sChanges.clear();
+		usleep(random.Below(kPollInterval));	// Anywhere between two polls
+		WriteFile(Filename, text);
+		double written = BenchTime();
+		if (WaitForChanges(watch) != 1 || sChanges.size() != 1)
+			missed++;
+		else
+			latencies.push_back(sChanges[0].zTime - written);
+	}
+	CHECK(missed == 0);
+	if (latencies.empty())
+		return;
+	std::sort(latencies.begin(), latencies.end());
+	BenchPrint("watchtest", kMode, "\"writes\":%d,\"missed\":%d,\"poll_interval_us\":%d,"
+		"\"p50_us\":%.1f,\"p95_us\":%.1f,\"max_us\":%.1f", kWrites, missed,
+		watch.IsNotified() ? 0 : kPollInterval, latencies[latencies.size() / 2] * 1e6,
+		latencies[latencies.size() * 95 / 100] * 1e6, latencies.back() * 1e6);
+}
+
+int main()
+{
+	// A directory of our own, so nobody else's files set off the watch
+	std::string directory = TestPath("watchtest");
+	if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+	{
+		printf("watchtest: can't create %s\n", directory.c_str());
+		return 1;
+	}
+	std::string filename = directory + "/watched.ini";
+
+	TestDiff();
+	TestChanges(filename);
+	TestUnreadable(filename);
+	MeasureLatency(filename);
+
+	unlink(filename.c_str());
+	unlink((filename + ".image").c_str());
+	rmdir(directory.c_str());
+	return TestResult(kMode[0] == 'p' ? "watchtest-poll" : "watchtest");
+}